@@ -0,0 +1,208 @@
+// Runs a matrix of scenarios over the examples, each in a hidden window without vsync,
+// and gathers their frame times into one JSON document, e.g.
+//
+//   trif_bench --bin-dir build/bin -o bench.json
+//   trif_bench --bin-dir build/bin --filter 'msaa|tess' -n 1000
+//
+// Every scenario runs its example with --bench-json, see FrameTimer for what is
+// measured, and its result describes the renderer and the CPU. Scenarios whose example
+// exits with 77, i.e. found no display, are recorded as skipped, and any other failure
+// makes trif_bench fail once the matrix is done.
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "CLI11.hpp"
+#include "json.hpp"
+
+struct Scenario {
+    std::string name;
+    /// Example run, found in --bin-dir
+    std::string app;
+    std::vector<std::string> args;
+};
+
+/// The matrix, add new scenarios here
+static std::vector<Scenario> scenarios()
+{
+    std::vector<Scenario> s;
+
+    s.push_back({"gears/strips", "glxgears", {}});
+    s.push_back({"gears/fat", "glxgears", {"--fat-draw"}});
+    s.push_back({"gears/fbo", "glxgears", {"--use-fbo"}});
+
+    // one indirect draw per square
+    for (int n : {8, 32, 128}) {
+        const std::string size = std::to_string(n) + "x" + std::to_string(n);
+        s.push_back({"checkerboard/" + size, "checkerboard", {"-s", size}});
+    }
+
+    for (int level : {1, 8, 32, 64})
+        s.push_back({"tess/" + std::to_string(level), "tess",
+                     {"-o", std::to_string(level), "-i", std::to_string(level)}});
+
+    for (int samples : {0, 2, 4, 8})
+        s.push_back({"msaa/" + std::to_string(samples) + "x", "msaa", {"--samples", std::to_string(samples)}});
+
+    // one instance per brick, 1875 to 30000 of them at 800x600
+    for (int size : {16, 8, 4})
+        s.push_back({"brickwall/" + std::to_string(size) + "px", "brickwall", {"-b", std::to_string(size)}});
+
+    return s;
+}
+
+/// Exit code of the command with its standard output discarded, or 1 if it could not
+/// run or was killed
+static int run(const std::vector<std::string>& command)
+{
+    std::vector<char *> argv;
+    for (auto& arg : command)
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0)
+            dup2(null, STDOUT_FILENO);
+        execvp(argv[0], argv.data());
+        perror(argv[0]);
+        _exit(127);
+    }
+
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0)
+        return 1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+static std::string read_file(const std::string& path)
+{
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+int main(int argc, const char **argv)
+{
+    CLI::App app("trif_bench");
+
+    std::string bin_dir = ".";
+    std::string output = "-";
+    std::string filter;
+    int frames = 300;
+    int warmup = 30;
+    std::string geometry = "800x600";
+    bool list = false;
+
+    app.add_option("--bin-dir", bin_dir, "Directory of the example executables (default .)");
+    app.add_option("-o,--output", output, "JSON file written, - for the standard output (default -)");
+    app.add_option("--filter", filter, "Run the scenarios whose name matches the given regular expression only");
+    app.add_option("-n,--frames", frames, "Frames drawn by every scenario (default 300)");
+    app.add_option("--warmup", warmup, "Frames left out of the times of every scenario (default 30)");
+    app.add_option("-g,--geometry", geometry, "Window size of the scenarios like NNNxMMM (default 800x600)");
+    app.add_flag("--list", list, "List the scenarios and exit");
+
+    CLI11_PARSE(app, argc, argv);
+
+    std::vector<Scenario> matrix;
+    const std::regex re(filter);
+    for (auto& s : scenarios())
+        if (filter.empty() || std::regex_search(s.name, re))
+            matrix.push_back(s);
+
+    if (list) {
+        for (auto& s : matrix) {
+            std::cout << s.name << ":  " << s.app;
+            for (auto& arg : s.args)
+                std::cout << " " << arg;
+            std::cout << "\n";
+        }
+        return 0;
+    }
+
+    std::stringstream doc;
+    trif::JsonWriter json(doc);
+
+    char date[32];
+    const time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    struct utsname uts;
+    uname(&uts);
+
+    json.begin_object()
+        .key("date").value(date)
+        .key("frames").value(frames)
+        .key("warmup").value(warmup)
+        .key("geometry").value(geometry)
+        .key("host").begin_object()
+            .key("threads").value(std::thread::hardware_concurrency())
+            .key("kernel").value(std::string(uts.sysname) + " " + uts.release + " " + uts.machine)
+            .key("compiler").value(__VERSION__)
+        .end_object()
+        .key("scenarios").begin_array();
+
+    int failed = 0;
+    const std::string result = "/tmp/trif_bench." + std::to_string(getpid()) + ".json";
+
+    for (auto& s : matrix) {
+        std::vector<std::string> command = {
+            bin_dir + "/" + s.app, "--headless", "--fixed-step", "0.016", "-n", std::to_string(frames),
+            "--warmup", std::to_string(warmup), "-g", geometry, "--bench-json", result
+        };
+        command.insert(command.end(), s.args.begin(), s.args.end());
+
+        std::cerr << s.name << "... " << std::flush;
+        std::remove(result.c_str());
+        const int status = run(command);
+        const std::string measured = status == 0 ? read_file(result) : "";
+
+        std::string verdict = "ok";
+        if (status == 77)
+            verdict = "skipped";
+        else if (status != 0 || measured.empty())
+            verdict = "failed";
+        std::cerr << verdict << std::endl;
+
+        json.begin_object()
+            .key("scenario").value(s.name)
+            .key("status").value(verdict)
+            .key("exit_code").value(status);
+        if (!measured.empty())
+            json.key("result").raw(measured.substr(0, measured.find_last_not_of("\n") + 1));
+        json.end_object();
+
+        failed += verdict == "failed";
+    }
+    std::remove(result.c_str());
+
+    json.end_array().end_object();
+
+    if (output == "-") {
+        std::cout << doc.str();
+    } else {
+        std::ofstream os(output);
+        os << doc.str();
+        if (!os) {
+            std::cerr << "Failed to write " << output << std::endl;
+            return 1;
+        }
+        std::cerr << "Wrote " << matrix.size() << " scenarios to " << output << std::endl;
+    }
+
+    if (failed)
+        std::cerr << failed << " of " << matrix.size() << " scenarios failed" << std::endl;
+    return failed ? 1 : 0;
+}
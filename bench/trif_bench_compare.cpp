@@ -0,0 +1,289 @@
+// Compares two trif_bench results, a baseline and a candidate, e.g. before and after
+// an upgrade of Mesa, the compiler flags or trif itself
+//
+//   trif_bench_compare base.json new.json
+//   trif_bench_compare base.json new.json --metric gpu_ms --threshold 3
+//
+// For every scenario the samples of the metric are compared: the change of the median,
+// a bootstrap confidence interval of it and the p-value of a Mann-Whitney U test, which
+// assumes no particular distribution of frame times. A scenario regresses when its
+// median rises by more than --threshold percent and both the test and the interval say
+// the change is significant. Exits with 1 if any scenario regresses or stopped working.
+//
+// The output of one example run with --bench-json is taken as a single scenario too, and
+// that of trif_microbench --json is compared the same way with --metric ns_op.
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CLI11.hpp"
+#include "json.hpp"
+
+struct Comparison {
+    std::string scenario;
+    std::string verdict;
+    double base{0.0};
+    double candidate{0.0};
+    /// Relative change of the median and its confidence interval
+    double delta{0.0};
+    double low{0.0};
+    double high{0.0};
+    double p_value{1.0};
+};
+
+static double median(std::vector<double> v)
+{
+    if (v.empty())
+        return 0.0;
+    const size_t mid = v.size() / 2;
+    std::nth_element(v.begin(), v.begin() + mid, v.end());
+    if (v.size() % 2)
+        return v[mid];
+    return (v[mid] + *std::max_element(v.begin(), v.begin() + mid)) / 2.0;
+}
+
+/// Percentile bootstrap interval of median(b) / median(a) - 1 at `confidence`
+static void bootstrap(const std::vector<double>& a, const std::vector<double>& b, int resamples, double confidence,
+                      double& low, double& high)
+{
+    // a fixed seed, comparing the same files twice gives the same interval
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<size_t> pick_a(0, a.size() - 1), pick_b(0, b.size() - 1);
+    std::vector<double> ra(a.size()), rb(b.size()), deltas;
+    deltas.reserve(resamples);
+
+    for (int r = 0; r < resamples; r++) {
+        for (auto& x : ra)
+            x = a[pick_a(rng)];
+        for (auto& x : rb)
+            x = b[pick_b(rng)];
+        const double ma = median(ra);
+        if (ma > 0.0)
+            deltas.push_back(median(rb) / ma - 1.0);
+    }
+
+    if (deltas.empty()) {
+        low = high = 0.0;
+        return;
+    }
+    std::sort(deltas.begin(), deltas.end());
+    const double tail = (1.0 - confidence) / 2.0;
+    low = deltas[static_cast<size_t>(tail * (deltas.size() - 1))];
+    high = deltas[static_cast<size_t>((1.0 - tail) * (deltas.size() - 1))];
+}
+
+/// Two-sided p-value of the Mann-Whitney U test, from the normal approximation with
+/// the tie correction, which holds for the hundreds of frames a scenario draws
+static double mann_whitney(const std::vector<double>& a, const std::vector<double>& b)
+{
+    const double n1 = a.size(), n2 = b.size(), n = n1 + n2;
+    if (n1 < 2 || n2 < 2)
+        return 1.0;
+
+    std::vector<std::pair<double, int>> all;
+    for (double x : a)
+        all.push_back({x, 0});
+    for (double x : b)
+        all.push_back({x, 1});
+    std::sort(all.begin(), all.end());
+
+    // tied values share the mean of their ranks
+    double rank_sum = 0.0, ties = 0.0;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first)
+            j++;
+        const double t = j - i;
+        const double rank = (i + 1 + j) / 2.0;
+        for (size_t k = i; k < j; k++)
+            if (all[k].second == 0)
+                rank_sum += rank;
+        ties += t * t * t - t;
+        i = j;
+    }
+
+    const double u = rank_sum - n1 * (n1 + 1) / 2.0;
+    const double mean = n1 * n2 / 2.0;
+    const double sigma = std::sqrt(n1 * n2 / 12.0 * ((n + 1) - ties / (n * (n - 1))));
+    if (sigma == 0.0)
+        return 1.0;
+
+    // continuity correction
+    const double z = std::max(0.0, std::fabs(u - mean) - 0.5) / sigma;
+    return std::erfc(z / std::sqrt(2.0));
+}
+
+static bool load(const std::string& path, trif::JsonValue& doc)
+{
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+
+    std::string error;
+    if (!in || !trif::JsonValue::parse(ss.str(), doc, &error)) {
+        std::cerr << "Failed to read " << path << (error.empty() ? "" : ": " + error) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/// Scenario name, status and result of every scenario of a document
+static std::vector<const trif::JsonValue *> scenarios(const trif::JsonValue& doc)
+{
+    std::vector<const trif::JsonValue *> v;
+    for (const auto& s : doc["scenarios"].items())
+        v.push_back(&s);
+    if (v.empty() && doc.is_object())
+        v.push_back(&doc);
+    return v;
+}
+
+static std::string name_of(const trif::JsonValue& s)
+{
+    return s.contains("scenario") ? s["scenario"].as_string() : s["name"].as_string();
+}
+
+static const trif::JsonValue& result_of(const trif::JsonValue& s)
+{
+    return s.contains("scenario") ? s["result"] : s;
+}
+
+static std::string status_of(const trif::JsonValue& s)
+{
+    return s.contains("status") ? s["status"].as_string() : "ok";
+}
+
+int main(int argc, const char **argv)
+{
+    CLI::App app("trif_bench_compare");
+
+    std::string base_path, candidate_path;
+    std::string metric = "frame_ms";
+    double threshold = 5.0;
+    double alpha = 0.01;
+    double confidence = 0.95;
+    int resamples = 2000;
+
+    app.add_option("baseline", base_path, "Results taken as the reference")->required();
+    app.add_option("candidate", candidate_path, "Results compared with them")->required();
+    app.add_option("--metric", metric, "frame_ms, cpu_ms or gpu_ms of trif_bench, ns_op or cycles_op of "
+                                       "trif_microbench (default frame_ms)")
+            ->check(CLI::IsMember({"frame_ms", "cpu_ms", "gpu_ms", "ns_op", "cycles_op"}));
+    app.add_option("--threshold", threshold, "Rise of the median in percent a regression must exceed (default 5)");
+    app.add_option("--alpha", alpha, "Significance level of the Mann-Whitney test (default 0.01)");
+    app.add_option("--confidence", confidence, "Confidence level of the bootstrap interval (default 0.95)");
+    app.add_option("--resamples", resamples, "Bootstrap resamples (default 2000)");
+
+    CLI11_PARSE(app, argc, argv);
+
+    trif::JsonValue base, candidate;
+    if (!load(base_path, base) || !load(candidate_path, candidate))
+        return 2;
+
+    auto renderer = [](const trif::JsonValue& doc) {
+        auto all = scenarios(doc);
+        for (auto *s : all)
+            if (!result_of(*s)["renderer"].as_string().empty())
+                return result_of(*s)["renderer"].as_string();
+        return std::string("unknown");
+    };
+    std::cout << "baseline:  " << base_path << " (" << renderer(base) << ")\n"
+              << "candidate: " << candidate_path << " (" << renderer(candidate) << ")\n"
+              << "metric " << metric << ", regression above +" << threshold << "% at p < " << alpha << "\n\n";
+
+    std::vector<Comparison> comparisons;
+    auto candidates = scenarios(candidate);
+
+    for (auto *b : scenarios(base)) {
+        Comparison c;
+        c.scenario = name_of(*b);
+
+        const trif::JsonValue *match = nullptr;
+        for (auto *s : candidates)
+            if (name_of(*s) == c.scenario)
+                match = s;
+
+        const auto a_samples = result_of(*b)[metric]["samples"].numbers();
+        const auto b_samples = match ? result_of(*match)[metric]["samples"].numbers() : std::vector<double>();
+
+        if (status_of(*b) != "ok") {
+            c.verdict = "no baseline";
+        } else if (!match) {
+            c.verdict = "missing";
+        } else if (status_of(*match) == "skipped") {
+            c.verdict = "skipped";
+        } else if (status_of(*match) != "ok") {
+            c.verdict = "failed";
+        } else if (a_samples.empty() || b_samples.empty()) {
+            c.verdict = "no samples";
+        } else {
+            c.base = median(a_samples);
+            c.candidate = median(b_samples);
+            c.delta = c.base > 0.0 ? c.candidate / c.base - 1.0 : 0.0;
+            bootstrap(a_samples, b_samples, resamples, confidence, c.low, c.high);
+            c.p_value = mann_whitney(a_samples, b_samples);
+
+            const bool significant = c.p_value < alpha && (c.low > 0.0 || c.high < 0.0);
+            if (significant && c.delta > threshold / 100.0)
+                c.verdict = "REGRESSION";
+            else if (significant && c.delta < -threshold / 100.0)
+                c.verdict = "improvement";
+            else
+                c.verdict = "same";
+        }
+        comparisons.push_back(c);
+    }
+
+    for (auto *s : candidates) {
+        bool known = false;
+        for (auto& c : comparisons)
+            known = known || c.scenario == name_of(*s);
+        if (!known) {
+            Comparison c;
+            c.scenario = name_of(*s);
+            c.verdict = "new";
+            comparisons.push_back(c);
+        }
+    }
+
+    size_t width = 8;
+    for (auto& c : comparisons)
+        width = std::max(width, c.scenario.size() + 2);
+
+    std::cout << std::left << std::setw(width) << "scenario" << std::right
+              << std::setw(11) << "base" << std::setw(11) << "candidate" << std::setw(10) << "change"
+              << std::setw(22) << "interval" << std::setw(10) << "p" << "  verdict\n"
+              << std::fixed;
+
+    int regressions = 0, broken = 0;
+    for (auto& c : comparisons) {
+        std::cout << std::left << std::setw(width) << c.scenario << std::right;
+        if (c.base > 0.0) {
+            std::ostringstream interval;
+            interval << std::fixed << std::setprecision(1) << "[" << std::showpos << 100.0 * c.low << "%, "
+                     << 100.0 * c.high << "%]";
+            std::cout << std::setprecision(3) << std::setw(11) << c.base << std::setw(11) << c.candidate
+                      << std::setprecision(1) << std::setw(9) << std::showpos << 100.0 * c.delta << "%"
+                      << std::noshowpos << std::setw(22) << interval.str()
+                      << std::setw(10) << std::setprecision(4) << c.p_value;
+        } else {
+            std::cout << std::setw(11 + 11 + 10 + 22 + 10) << "";
+        }
+        std::cout << "  " << c.verdict << "\n";
+
+        regressions += c.verdict == "REGRESSION";
+        broken += c.verdict == "missing" || c.verdict == "failed";
+    }
+
+    if (regressions || broken) {
+        std::cout << "\n" << regressions << " regressions, " << broken << " scenarios missing or failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
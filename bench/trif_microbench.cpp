@@ -0,0 +1,314 @@
+// Micro-benchmarks of the host code of trif, what the CPU spends before anything
+// reaches the GPU, e.g.
+//
+//   trif_microbench
+//   trif_microbench --filter template --min-time 200 --json micro.json
+//   trif_microbench --gl
+//
+// See MicroBench for how they are measured. --gl adds the benchmarks which need a
+// context, in a hidden window, and skips them if there is no display. The JSON output
+// is compared like that of trif_bench:
+//
+//   trif_bench_compare base.json micro.json --metric ns_op
+#include <cassert>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "CLI11.hpp"
+#include "json.hpp"
+#include "microbench.hpp"
+#include "parser.hpp"
+#include "shader.hpp"
+#include "gear.h"
+
+// the control shader of the tess example
+static const std::string tcs = R"(
+#version 400 core
+
+layout (vertices = ${OUTPUT_PATCH_VERTICES}) out;
+
+uniform float outer_level;
+uniform float inner_level;
+
+void main() {
+    gl_out[gl_InvocationID].gl_Position = gl_in[gl_InvocationID].gl_Position;
+
+    if (gl_InvocationID == 0) {
+        gl_TessLevelOuter[0] = outer_level;
+        gl_TessLevelOuter[1] = outer_level;
+        gl_TessLevelOuter[2] = outer_level;
+        gl_TessLevelOuter[3] = outer_level;
+
+        gl_TessLevelInner[0] = inner_level;
+        gl_TessLevelInner[1] = inner_level;
+    }
+}
+)";
+
+static const std::string vertex_source = R"(
+#version 330 core
+
+layout(location = 0) in vec3 position;
+
+uniform mat4 ModelViewProjectionMatrix;
+uniform vec4 MaterialColor;
+
+out vec4 color;
+
+void main() {
+    gl_Position = ModelViewProjectionMatrix * vec4(position, 1.0);
+    color = MaterialColor;
+}
+)";
+
+static const std::string fragment_source = R"(
+#version 330 core
+
+in vec4 color;
+out vec4 fg_FragColor;
+
+void main() {
+    fg_FragColor = color;
+}
+)";
+
+/// A template of `params` parameters, each used twice among lines of plain source
+static std::string many_parameters_template(int params)
+{
+    std::ostringstream ss;
+    ss << "#version 330 core\n";
+    for (int i = 0; i < params; i++)
+        ss << "const float K" << i << " = ${K" << i << "};\n"
+           << "// ${K" << i << "} is substituted in comments as well\n";
+    ss << "void main() {}\n";
+    return ss.str();
+}
+
+static void add_cpu_benchmarks(trif::MicroBench& bench, const std::string& tmp_file)
+{
+    bench.add("template/specialize_tess", [](size_t n) {
+        trif::ShaderSourceTemplate tmpl(tcs);
+        trif::ShaderSourceTemplate::ParamsType params = {{"OUTPUT_PATCH_VERTICES", "4"}};
+        for (size_t i = 0; i < n; i++)
+            trif::do_not_optimize(tmpl.specialize(params));
+    });
+
+    bench.add("template/specialize_64_params", [](size_t n) {
+        trif::ShaderSourceTemplate tmpl(many_parameters_template(64));
+        trif::ShaderSourceTemplate::ParamsType params;
+        for (int i = 0; i < 64; i++)
+            params["K" + std::to_string(i)] = std::to_string(i) + ".5";
+        for (size_t i = 0; i < n; i++)
+            trif::do_not_optimize(tmpl.specialize(params));
+    });
+
+    // every source string is first tried as a file name
+    bench.add("shader_source/string", [](size_t n) {
+        for (size_t i = 0; i < n; i++)
+            trif::do_not_optimize(trif::shader_source_from_string_or_file(vertex_source));
+    });
+
+    bench.add("shader_source/file", [tmp_file](size_t n) {
+        for (size_t i = 0; i < n; i++)
+            trif::do_not_optimize(trif::shader_source_from_string_or_file(tmp_file));
+    });
+
+    bench.add("parser/parse", [](size_t n) {
+        const std::vector<std::string> args = {"trif", "-g", "1920x1080", "--scale", "1.5", "--frames", "300",
+                                               "--headless"};
+        for (size_t i = 0; i < n; i++) {
+            trif::Option geometry("-g,--geometry", "Window size", trif::OptionType::Pair);
+            trif::Option scale("--scale", "Scale");
+            trif::Option frames("-n,--frames", "Frames");
+            trif::Option headless("--headless", "Hidden window", trif::OptionType::FlagOnly);
+            trif::Option title("--title", "Window title");
+
+            trif::CLI11Parser parser("trif", "trif", args);
+            parser.parse({&geometry, &scale, &frames, &headless, &title});
+            trif::do_not_optimize(parser);
+        }
+    });
+
+    bench.add("parser/as", [](size_t n) {
+        const std::vector<std::string> args = {"trif", "-g", "1920x1080", "--scale", "1.5", "--frames", "300"};
+        trif::Option geometry("-g,--geometry", "Window size", trif::OptionType::Pair);
+        trif::Option scale("--scale", "Scale");
+        trif::Option frames("-n,--frames", "Frames");
+
+        trif::CLI11Parser parser("trif", "trif", args);
+        parser.parse({&geometry, &scale, &frames});
+        for (size_t i = 0; i < n; i++) {
+            trif::do_not_optimize(parser.as<std::pair<uint32_t, uint32_t>>(&geometry));
+            trif::do_not_optimize(parser.as<float>(&scale));
+            trif::do_not_optimize(parser.as<int>(&frames));
+        }
+    });
+
+    // the largest of the glxgears gears, without its upload
+    bench.add("gears/build_gear", [](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            struct gear *g = build_gear(1.0, 4.0, 1.0, 20, 0.7);
+            trif::do_not_optimize(g->nvertices);
+            destroy_gear(g);
+        }
+    });
+}
+
+using ProgramType = trif::Program<trif::Shaders<GL_VERTEX_SHADER>, trif::Shaders<GL_FRAGMENT_SHADER>>;
+
+static void add_gl_benchmarks(trif::MicroBench& bench, ProgramType& program)
+{
+    const glm::mat4 mvp = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+
+    bench.add("program/uniform_location", [&program](size_t n) {
+        for (size_t i = 0; i < n; i++)
+            trif::do_not_optimize(program.uniform("ModelViewProjectionMatrix"));
+    });
+
+    bench.add("program/uniform_mat4", [&program, mvp](size_t n) {
+        for (size_t i = 0; i < n; i++)
+            program.uniform("ModelViewProjectionMatrix", mvp);
+        glFinish();
+    });
+
+    // the baseline of the above, with the location looked up once
+    bench.add("program/uniform_mat4_cached", [&program, mvp](size_t n) {
+        const GLint location = program.uniform("ModelViewProjectionMatrix");
+        for (size_t i = 0; i < n; i++)
+            glUniformMatrix4fv(location, 1, GL_FALSE, &mvp[0][0]);
+        glFinish();
+    });
+
+    bench.add("program/uniform_vec4", [&program](size_t n) {
+        const glm::vec4 color(0.8f, 0.1f, 0.0f, 1.0f);
+        for (size_t i = 0; i < n; i++)
+            program.uniform("MaterialColor", color);
+        glFinish();
+    });
+
+    // links the program again every time
+    bench.add("program/use", [&program](size_t n) {
+        for (size_t i = 0; i < n; i++)
+            program.use();
+        glFinish();
+    });
+
+    bench.add("program/bind", [&program](size_t n) {
+        for (size_t i = 0; i < n; i++)
+            program.bind();
+        glFinish();
+    });
+}
+
+int main(int argc, const char **argv)
+{
+    CLI::App app("trif_microbench");
+
+    std::string filter;
+    double min_time = 50.0;
+    int repetitions = 10;
+    std::string output;
+    bool gl = false;
+    bool list = false;
+
+    app.add_option("--filter", filter, "Run the benchmarks whose name matches the given regular expression only");
+    app.add_option("--min-time", min_time, "Milliseconds one repetition lasts at least (default 50)");
+    app.add_option("-r,--repetitions", repetitions, "Repetitions of every benchmark (default 10)");
+    app.add_option("--json", output, "Write the results to the given JSON file, - for the standard output");
+    app.add_flag("--gl", gl, "Also run the benchmarks which need a GL context, in a hidden window");
+    app.add_flag("--list", list, "List the benchmarks and exit");
+
+    CLI11_PARSE(app, argc, argv);
+
+    const std::string tmp_file = "/tmp/trif_microbench." + std::to_string(getpid()) + ".vert";
+    {
+        std::ofstream os(tmp_file);
+        os << vertex_source;
+    }
+
+    trif::MicroBench bench(min_time, repetitions);
+    add_cpu_benchmarks(bench, tmp_file);
+
+    GLFWwindow *window = nullptr;
+    std::unique_ptr<ProgramType> program;
+    if (gl) {
+        if (glfwInit()) {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            window = glfwCreateWindow(64, 64, "trif_microbench", NULL, NULL);
+        }
+
+        if (window) {
+            glfwMakeContextCurrent(window);
+            glewExperimental = GL_TRUE;
+            glewInit();
+
+            program.reset(new ProgramType(vertex_source, fragment_source));
+            program->use();
+            add_gl_benchmarks(bench, *program);
+        } else {
+            std::cerr << "No display, skipping the GL benchmarks" << std::endl;
+        }
+    }
+
+    if (list) {
+        for (auto& name : bench.names())
+            std::cout << name << "\n";
+    } else {
+        // the table goes to the standard error if the JSON goes to the standard output
+        bench.run(filter, output == "-" ? std::cerr : std::cout);
+    }
+    std::remove(tmp_file.c_str());
+
+    int status = 0;
+    if (!list && !output.empty()) {
+        std::stringstream doc;
+        trif::JsonWriter json(doc);
+
+        char date[32];
+        const time_t now = time(nullptr);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+        json.begin_object()
+            .key("date").value(date)
+            .key("host").begin_object()
+                .key("threads").value(std::thread::hardware_concurrency())
+                .key("compiler").value(__VERSION__)
+            .end_object();
+        if (window)
+            json.key("renderer").value(reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+        bench.write_json(json);
+        json.end_object();
+
+        if (output == "-") {
+            std::cout << doc.str();
+        } else {
+            std::ofstream os(output);
+            os << doc.str();
+            if (!os) {
+                std::cerr << "Failed to write " << output << std::endl;
+                status = 1;
+            }
+        }
+    }
+
+    program.reset();
+    if (gl)
+        glfwTerminate();
+    return status;
+}
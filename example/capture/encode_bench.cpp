@@ -0,0 +1,110 @@
+// Times the ImageWriter formats against stbi_write_png on one image, e.g.
+//
+//   encode_bench --image frame.png --threads 8 --repeat 5
+//
+// Throughput counts the bytes of the RGBA pixels, so that it compares with the rate a
+// capture produces them, e.g. 800x600 at 60 frames/s is 115 MB/s. Every output is
+// decoded back and checked against the pixels.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CLI11.hpp"
+#include "image_writer.hpp"
+
+/// Best time of `repeat` runs of `run`
+static double best_ms(int repeat, const std::function<void()>& run)
+{
+    double best = 1e30;
+    for (int i = 0; i < repeat; i++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, const char **argv)
+{
+    CLI::App app("encode_bench");
+
+    std::string image = ASSETS_DIR "wall.jpg";
+    size_t threads = trif::ThreadPool::default_workers();
+    int repeat = 5;
+
+    app.add_option("--image", image, "Image encoded (default wall.jpg)");
+    app.add_option("--threads", threads, "Workers of the parallel PNG encoder besides the calling thread");
+    app.add_option("--repeat", repeat, "Runs of each encoder, the best one is kept (default 5)");
+
+    CLI11_PARSE(app, argc, argv);
+
+    int width, height, channels;
+    std::unique_ptr<stbi_uc, void (*)(void *)> pixels(stbi_load(image.c_str(), &width, &height, &channels, 4),
+                                                      stbi_image_free);
+    if (!pixels) {
+        std::cerr << "Failed to load " << image << std::endl;
+        return 1;
+    }
+
+    const size_t size = static_cast<size_t>(width) * height * 4;
+    std::cout << "Encoding " << image << ", " << width << "x" << height << " RGBA, best of " << repeat << ":\n";
+
+    auto report = [&](const std::string& name, const std::function<std::vector<unsigned char>()>& encode,
+                      int decoded_channels) {
+        std::vector<unsigned char> encoded;
+        double ms = best_ms(repeat, [&] { encoded = encode(); });
+
+        // the formats without alpha are compared on RGB only
+        bool ok = false;
+        int w, h, c;
+        std::vector<unsigned char> decoded;
+        if (name == "qoi") {
+            ok = trif::ImageWriter::decode_qoi(encoded.data(), encoded.size(), decoded, w, h, c);
+        } else if (stbi_uc *d = stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()), &w, &h, &c,
+                                                      decoded_channels)) {
+            decoded.assign(d, d + static_cast<size_t>(w) * h * decoded_channels);
+            stbi_image_free(d);
+            ok = true;
+        }
+        for (size_t i = 0; ok && i < static_cast<size_t>(width) * height; i++)
+            for (int k = 0; k < decoded_channels; k++)
+                ok = ok && decoded[i * decoded_channels + k] == pixels.get()[i * 4 + k];
+
+        std::cout << "  " << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(9) << ms << " ms" << std::setw(9) << size / ms / 1.0e3 << " MB/s"
+                  << std::setw(10) << encoded.size() / 1024 << " KiB" << std::setw(7)
+                  << 100.0 * encoded.size() / size << "%" << (ok ? "" : "  MISMATCH") << "\n";
+    };
+
+    report("stb png", [&] {
+        int len;
+        unsigned char *png = stbi_write_png_to_mem(pixels.get(), width * 4, width, height, 4, &len);
+        std::vector<unsigned char> encoded(png, png + len);
+        STBIW_FREE(png);
+        return encoded;
+    }, 4);
+
+    trif::ThreadPool pool(threads);
+    for (int level : {1, 6}) {
+        for (trif::ThreadPool *p : {static_cast<trif::ThreadPool *>(nullptr), &pool}) {
+            trif::ImageWriter writer(p, level);
+            std::string name = "png " + std::to_string(level) + (p ? " x" + std::to_string(threads + 1) : "");
+            report(name, [&] { return writer.encode_png(pixels.get(), width, height, 4); }, 4);
+        }
+    }
+
+    report("qoi", [&] { return trif::ImageWriter::encode_qoi(pixels.get(), width, height, 4); }, 4);
+    report("bmp", [&] { return trif::ImageWriter::encode_bmp(pixels.get(), width, height, 4); }, 3);
+    report("ppm", [&] { return trif::ImageWriter::encode_ppm(pixels.get(), width, height, 4); }, 3);
+
+    return 0;
+}
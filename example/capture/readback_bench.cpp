@@ -0,0 +1,332 @@
+// Compares the ways of reading a rendered frame back to client memory, e.g.
+//
+//   readback_bench -g 1920x1080
+//   readback_bench -g 3840x2160 --formats rgba8,depth --paths sync,pbo_latency --latency 4
+//
+// Every frame draws --layers full screen triangles into a target of the window size,
+// then reads its color or depth back by one of the paths:
+//
+//   sync           glReadPixels into client memory
+//   pbo_map        glReadPixels into a pixel-pack buffer, mapped right away
+//   pbo_latency    the same into a ring of --latency buffers, each fenced and mapped
+//                  that many frames later, as ReadbackRing does
+//   get_tex_image  glGetTexImage of the attachment into client memory
+//
+// and every combination of format and path takes its turn for --case-frames frames.
+// The mapped buffers are copied to client memory, so every path delivers the same.
+//
+// read ms is the CPU time spent in the readback per frame, stall ms the part of it
+// waiting for the GPU: in the read itself for the synchronous paths, in the map or the
+// fence for the others, though a driver copying in the read itself, as llvmpipe does,
+// shows it in read ms only. MB/s is the rate the frames are delivered at, i.e. the
+// bytes of a frame per frame time, so it includes drawing.
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <map>
+
+#include "application.hpp"
+
+const std::string vs = R"(
+    #version 330 core
+    uniform float depth;
+
+    void main()
+    {
+        // full screen triangle
+        vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        gl_Position = vec4(pos * 2.0 - 1.0, depth, 1.0);
+    }
+)";
+
+const std::string fs = R"(
+    #version 330 core
+    uniform vec4 color;
+    out vec4 FragColor;
+
+    void main()
+    {
+        FragColor = color * vec4(fract(gl_FragCoord.xy / 256.0), 1.0, 1.0);
+    }
+)";
+
+enum class Path { Sync, PboMap, PboLatency, GetTexImage };
+
+/// How a format is stored and read back
+struct Format {
+    GLenum internal_format;
+    GLenum format;
+    GLenum type;
+    size_t bytes_per_pixel;
+};
+
+struct Case {
+    std::string name;
+    Format format;
+    Path path;
+
+    size_t frames{0};
+    double frame_ms{0.0};
+    double read_ms{0.0};
+    double stall_ms{0.0};
+};
+
+/// Frames drawn before every case is timed
+const size_t WARMUP_FRAMES = 3;
+
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, const char **argv)
+{
+    trif::Application app("readback_bench");
+
+    int layers = 4;
+    size_t latency = 3;
+    size_t case_frames = 30;
+    std::vector<std::string> formats = {"rgba8", "bgra8", "rgba16f", "depth"};
+    std::vector<std::string> paths = {"sync", "pbo_map", "pbo_latency", "get_tex_image"};
+
+    const std::map<std::string, Format> format_names = {
+        {"rgba8", {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4}},
+        {"bgra8", {GL_RGBA8, GL_BGRA, GL_UNSIGNED_BYTE, 4}},
+        {"rgba16f", {GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8}},
+        {"depth", {GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, 4}},
+    };
+    const std::map<std::string, Path> path_names = {
+        {"sync", Path::Sync}, {"pbo_map", Path::PboMap}, {"pbo_latency", Path::PboLatency},
+        {"get_tex_image", Path::GetTexImage}
+    };
+
+    app.add_option("--layers", layers, "Full screen triangles drawn per frame (default 4)");
+    app.add_option("--latency", latency, "Frames between a pbo_latency read and its map (default 3)");
+    app.add_option("--case-frames", case_frames, "Frames timed per case (default 30)");
+    app.add_option("--formats", formats, "Formats among rgba8, bgra8, rgba16f and depth (default all)")
+            ->delimiter(',')
+            ->check(CLI::IsMember({"rgba8", "bgra8", "rgba16f", "depth"}));
+    app.add_option("--paths", paths, "Paths among sync, pbo_map, pbo_latency and get_tex_image (default all)")
+            ->delimiter(',')
+            ->check(CLI::IsMember({"sync", "pbo_map", "pbo_latency", "get_tex_image"}));
+
+    app.init(argc, argv);
+
+    // frames must not wait for the display
+    glfwSwapInterval(0);
+
+    latency = std::max<size_t>(latency, 1);
+
+    std::vector<Case> cases;
+    for (auto& format : formats)
+        for (auto& path : paths)
+            cases.push_back({format + "/" + path, format_names.at(format), path_names.at(path)});
+
+    trif::Program<
+        trif::Shaders<GL_VERTEX_SHADER>,
+        trif::Shaders<GL_FRAGMENT_SHADER>
+    > program(vs, fs);
+
+    program.use();
+    const GLint depth_location = program.uniform("depth");
+    const GLint color_location = program.uniform("color");
+
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+
+    const int width = app.getWindowWidth();
+    const int height = app.getWindowHeight();
+
+    // textures rather than renderbuffers so that glGetTexImage reads them too
+    GLuint fbo, color_tex[2], depth_tex;
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(2, color_tex);
+    glGenTextures(1, &depth_tex);
+
+    const GLenum color_formats[2] = {GL_RGBA8, GL_RGBA16F};
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, color_tex[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, color_formats[i], width, height);
+    }
+    glBindTexture(GL_TEXTURE_2D, depth_tex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_tex, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // client memory every path delivers the frame to, and the buffers of the PBO paths
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 8);
+    std::vector<GLuint> pbos(latency);
+    std::vector<GLsync> fences(latency, 0);
+    glGenBuffers(pbos.size(), pbos.data());
+    for (auto pbo : pbos) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, pixels.size(), NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    std::cout << "Reading back " << width << "x" << height << " in " << cases.size() << " cases, "
+              << case_frames << " frames each" << std::endl;
+
+    size_t current = 0, frame = 0;
+    Clock::time_point frame_start;
+
+    auto color_of = [&](const Case& c) { return color_tex[c.format.internal_format == GL_RGBA16F ? 1 : 0]; };
+
+    // attaches the color texture of the next case
+    auto setup = [&]() {
+        if (current == cases.size())
+            return;
+        const Case& c = cases[current];
+        const GLuint tex = color_of(c);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << c.name << ": incomplete target" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    };
+    setup();
+
+    // maps the buffer of `slot` once its read is done and copies it to client memory,
+    // returns the time waited
+    auto collect = [&](size_t slot, size_t size) {
+        auto start = Clock::now();
+        glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+        glDeleteSync(fences[slot]);
+        fences[slot] = 0;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+        const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        const double stall = ms_since(start);
+        if (mapped)
+            memcpy(pixels.data(), mapped, size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return stall;
+    };
+
+    app.main_loop([&]() {
+        if (current == cases.size()) {
+            glfwSetWindowShouldClose(app.getWindow(), true);
+            return;
+        }
+
+        Case& c = cases[current];
+        const bool timed = frame >= WARMUP_FRAMES && frame < WARMUP_FRAMES + case_frames;
+        const bool depth = c.format.format == GL_DEPTH_COMPONENT;
+        const size_t size = static_cast<size_t>(width) * height * c.format.bytes_per_pixel;
+
+        // the time of a frame runs from its start to the start of the next, which is one
+        // frame more to draw
+        if (frame > WARMUP_FRAMES)
+            c.frame_ms += ms_since(frame_start);
+        frame_start = Clock::now();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClearDepth(1.0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        glEnable(GL_DEPTH_TEST);
+        program.bind();
+        glBindVertexArray(vao);
+        for (int i = 0; i < layers; i++) {
+            // back to front, the depth read back changes every frame
+            const float t = static_cast<float>(i + frame % 8) / (layers + 8);
+            glUniform1f(depth_location, 0.9f - 0.8f * t);
+            glUniform4f(color_location, t, 1.0f - t, 0.5f, 1.0f);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glDisable(GL_DEPTH_TEST);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+        auto start = Clock::now();
+        double stall = 0.0;
+        switch (c.path) {
+            case Path::Sync:
+                glReadPixels(0, 0, width, height, c.format.format, c.format.type, pixels.data());
+                stall = ms_since(start);
+                break;
+            case Path::PboMap:
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[0]);
+                glReadPixels(0, 0, width, height, c.format.format, c.format.type, (void *)0);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                fences[0] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                stall = collect(0, size);
+                break;
+            case Path::PboLatency: {
+                const size_t slot = frame % latency;
+                if (fences[slot])
+                    stall = collect(slot, size);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+                glReadPixels(0, 0, width, height, c.format.format, c.format.type, (void *)0);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                break;
+            }
+            case Path::GetTexImage:
+                glBindTexture(GL_TEXTURE_2D, depth ? depth_tex : color_of(c));
+                glGetTexImage(GL_TEXTURE_2D, 0, c.format.format, c.format.type, pixels.data());
+                glBindTexture(GL_TEXTURE_2D, 0);
+                stall = ms_since(start);
+                break;
+        }
+        if (timed) {
+            c.read_ms += ms_since(start);
+            c.stall_ms += stall;
+        }
+
+        // show the color, depth is drawn the same
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if (++frame == WARMUP_FRAMES + case_frames + 1) {
+            // the reads still in flight are not timed
+            for (size_t slot = 0; slot < latency; slot++)
+                if (fences[slot])
+                    collect(slot, size);
+            c.frames = case_frames;
+
+            frame = 0;
+            current++;
+            setup();
+        }
+    });
+
+    std::cout << std::left << std::setw(24) << "case" << std::right << std::setw(10) << "frame ms"
+              << std::setw(10) << "read ms" << std::setw(10) << "stall ms" << std::setw(10) << "MB/s" << '\n'
+              << std::fixed << std::setprecision(3);
+
+    for (auto& c : cases) {
+        std::cout << std::left << std::setw(24) << c.name << std::right;
+        if (!c.frames) {
+            std::cout << std::setw(10) << "not run" << '\n';
+            continue;
+        }
+
+        const double frame_ms = c.frame_ms / c.frames;
+        const double bytes = static_cast<double>(width) * height * c.format.bytes_per_pixel;
+        std::cout << std::setw(10) << frame_ms << std::setw(10) << c.read_ms / c.frames
+                  << std::setw(10) << c.stall_ms / c.frames << std::setw(10) << std::setprecision(1)
+                  << (frame_ms > 0.0 ? bytes / (frame_ms * 1e3) : 0.0) << std::setprecision(3) << '\n';
+    }
+    std::cout << std::defaultfloat;
+
+    glDeleteBuffers(pbos.size(), pbos.data());
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(2, color_tex);
+    glDeleteTextures(1, &depth_tex);
+    glDeleteVertexArrays(1, &vao);
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+// Reads the frames an application publishes with --shm, e.g.
+//
+//   glxgears --shm trif & shm_consumer --name trif
+//
+// and reports the latency from readback to the consumer, where the frame was copied to
+// the shared memory and where the consumer had gone through its pixels, as well as the
+// throughput and how many frames were missed or overwritten while being read.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CLI11.hpp"
+#include "shared_frames.hpp"
+
+/// Percentile `p` of sorted `v`
+static double percentile(const std::vector<double>& v, double p)
+{
+    return v.empty() ? 0.0 : v[std::min(v.size() - 1, static_cast<size_t>(p * v.size()))];
+}
+
+static void print_latency(const std::string& name, std::vector<double> v)
+{
+    std::sort(v.begin(), v.end());
+    double sum = 0.0;
+    for (double x : v)
+        sum += x;
+
+    std::cout << "  " << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(3)
+              << " mean " << std::setw(8) << (v.empty() ? 0.0 : sum / v.size())
+              << " p50 " << std::setw(8) << percentile(v, 0.5)
+              << " p99 " << std::setw(8) << percentile(v, 0.99)
+              << " max " << std::setw(8) << (v.empty() ? 0.0 : v.back()) << " ms\n";
+}
+
+int main(int argc, const char **argv)
+{
+    CLI::App app("shm_consumer");
+
+    std::string name = "trif";
+    int frames = -1;
+    int timeout = 5000;
+
+    app.add_option("--name", name, "Shared memory object the application publishes to (default trif)");
+    app.add_option("-n,--frames", frames, "Read the given number of frames then exit");
+    app.add_option("--timeout", timeout, "Milliseconds to wait for the application or a frame (default 5000)");
+
+    CLI11_PARSE(app, argc, argv);
+
+    trif::SharedFrameSource source(name);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    while (!source.open()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            std::cerr << "No frames published to " << trif::shm::object_name(name) << std::endl;
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    std::vector<double> published, received, processed;
+    uint64_t count = 0, torn = 0, bytes = 0, checksum = 0;
+    uint32_t width = 0, height = 0;
+    std::chrono::steady_clock::time_point start, end;
+
+    trif::SharedFrameSource::Frame frame;
+    while ((frames < 0 || count + torn < static_cast<uint64_t>(frames)) && source.wait(frame, timeout)) {
+        const uint64_t received_ns = trif::shm::monotonic_ns();
+        if (count + torn == 0)
+            start = std::chrono::steady_clock::now();
+
+        // stands for an encoder or a compositor going through the pixels in place
+        const size_t size = static_cast<size_t>(frame.stride) * frame.height;
+        uint64_t sum = 0;
+        for (size_t i = 0; i < size; i += 64)
+            sum += frame.pixels[i];
+
+        if (!source.valid(frame)) {
+            torn++;
+            continue;
+        }
+
+        const uint64_t processed_ns = trif::shm::monotonic_ns();
+        published.push_back((frame.publish_ns - frame.capture_ns) / 1.0e6);
+        received.push_back((received_ns - frame.capture_ns) / 1.0e6);
+        processed.push_back((processed_ns - frame.capture_ns) / 1.0e6);
+        checksum += sum;
+        bytes += size;
+        width = frame.width;
+        height = frame.height;
+        count++;
+        end = std::chrono::steady_clock::now();
+    }
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << "Read " << count << " frames of " << width << "x" << height << " from "
+              << trif::shm::object_name(name) << ", " << source.missed() << " missed, " << torn
+              << " overwritten while read" << (source.closed() ? ", producer exited" : "") << "\n"
+              << std::fixed << std::setprecision(2)
+              << "  " << (seconds > 0.0 ? bytes / seconds / 1.0e6 : 0.0) << " MB/s, "
+              << (seconds > 0.0 ? (count - 1) / seconds : 0.0) << " frames/s, checksum " << checksum
+              << "\nLatency from readback to\n";
+    print_latency("published", published);
+    print_latency("received", received);
+    print_latency("processed", processed);
+
+    return count ? 0 : 1;
+}
@@ -0,0 +1,356 @@
+// Measures how many draws per second the driver sustains for every way of submitting
+// N small objects and of giving each its constants, e.g.
+//
+//   draw_overhead --counts 100,1000,10000 --case-frames 100
+//   draw_overhead --filter 'mdi|instanced'
+//
+// The cases are named style/constants:
+//
+//   arrays       one glDrawArrays per object
+//   base_vertex  one glDrawElementsBaseVertex per object, sharing 6 indices
+//   instanced    one glDrawElementsInstanced for all of them
+//   multi_draw   one glMultiDrawElements for all of them
+//   mdi          one glMultiDrawElementsIndirect from a static command buffer
+//
+//   uniform      a glUniform4fv before every draw
+//   ubo          a glBindBufferRange of the object's slice of a UBO before every draw
+//   ssbo         an SSBO of all the objects, indexed in the vertex shader
+//
+// Every case draws the same grid of quads for --case-frames frames without vsync, after
+// a few left out. Draws/s count the objects drawn per second of wall clock, swaps
+// included, and CPU µs/draw the time spent issuing the draw calls of a frame per object.
+// The ssbo and mdi cases need GL 4.3 and are skipped without it.
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <regex>
+
+#include "application.hpp"
+
+const std::string vs = R"(
+    #version ${VERSION}
+    layout(location = 0) in vec2 corner;
+    layout(location = 1) in float index;
+    out vec3 color;
+
+    ${CONSTANTS}
+
+    void main()
+    {
+        // xy: position, z: size, w: hue
+        vec4 object = ${OBJECT};
+        gl_Position = vec4(object.xy + corner * object.z, 0.0, 1.0);
+        color = 0.5 + 0.5 * cos(6.2832 * (object.w + vec3(0.0, 0.33, 0.67)));
+    }
+)";
+
+const std::string fs = R"(
+    #version 330 core
+    in vec3 color;
+    out vec4 FragColor;
+
+    void main()
+    {
+        FragColor = vec4(color, 1.0);
+    }
+)";
+
+enum class Style { Arrays, BaseVertex, Instanced, MultiDraw, Indirect };
+enum class Constants { Uniform, Ubo, Ssbo };
+
+struct Case {
+    std::string name;
+    Style style;
+    Constants constants;
+    int count;
+
+    size_t frames{0};
+    double wall_ms{0.0};
+    double cpu_ms{0.0};
+};
+
+using ProgramType = trif::Program<trif::Shaders<GL_VERTEX_SHADER>, trif::Shaders<GL_FRAGMENT_SHADER>>;
+
+/// Frames drawn before every case is timed
+const size_t WARMUP_FRAMES = 5;
+
+/// Per draw command of glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+int main(int argc, const char **argv)
+{
+    trif::Application app("draw_overhead");
+
+    std::vector<int> counts = {100, 1000, 10000};
+    size_t case_frames = 50;
+    std::string filter;
+
+    app.add_option("--counts", counts, "Objects drawn, swept in turn (default 100,1000,10000)")->delimiter(',');
+    app.add_option("--case-frames", case_frames, "Frames timed per case (default 50)");
+    app.add_option("--filter", filter, "Run the cases whose name matches the given regular expression only");
+
+    app.init(argc, argv);
+
+    // draws must not wait for the display
+    glfwSwapInterval(0);
+
+    const bool has_ssbo = GLEW_VERSION_4_3 || GLEW_ARB_shader_storage_buffer_object;
+    const bool has_indirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+
+    std::vector<Case> cases;
+    const std::regex re(filter);
+    for (int count : counts) {
+        auto add = [&](const std::string& name, Style style, Constants constants) {
+            if (filter.empty() || std::regex_search(name, re))
+                cases.push_back({name, style, constants, count});
+        };
+
+        for (auto style : {Style::Arrays, Style::BaseVertex}) {
+            const std::string prefix = style == Style::Arrays ? "arrays/" : "base_vertex/";
+            add(prefix + "uniform", style, Constants::Uniform);
+            add(prefix + "ubo", style, Constants::Ubo);
+            if (has_ssbo)
+                add(prefix + "ssbo", style, Constants::Ssbo);
+        }
+        if (has_ssbo) {
+            add("instanced/ssbo", Style::Instanced, Constants::Ssbo);
+            add("multi_draw/ssbo", Style::MultiDraw, Constants::Ssbo);
+        }
+        if (has_ssbo && has_indirect)
+            add("mdi/ssbo", Style::Indirect, Constants::Ssbo);
+    }
+    if (cases.empty()) {
+        std::cerr << "No case to run" << std::endl;
+        return 1;
+    }
+    if (!has_ssbo || !has_indirect)
+        std::cout << "GL 4.3 unsupported, skipping the ssbo and mdi cases" << std::endl;
+
+    const int max_count = *std::max_element(counts.begin(), counts.end());
+
+    // the same quad for every object, followed by its index, so that objects drawn
+    // from their own vertices find their constants
+    std::vector<GLfloat> vertices;
+    for (int i = 0; i < max_count; i++) {
+        for (auto& c : {std::make_pair(0.0f, 0.0f), std::make_pair(1.0f, 0.0f),
+                        std::make_pair(0.0f, 1.0f), std::make_pair(1.0f, 1.0f)}) {
+            vertices.push_back(c.first);
+            vertices.push_back(c.second);
+            vertices.push_back(static_cast<GLfloat>(i));
+        }
+    }
+
+    // 6 indices of the first quad, for the base vertex draws, then those of every quad
+    std::vector<GLuint> indices = {0, 1, 2, 2, 1, 3};
+    for (int i = 0; i < max_count; i++)
+        for (GLuint j : {0, 1, 2, 2, 1, 3})
+            indices.push_back(4 * i + j);
+
+    std::vector<GLsizei> multi_counts(max_count, 6);
+    std::vector<const void *> multi_offsets;
+    std::vector<DrawElementsIndirectCommand> commands;
+    for (int i = 0; i < max_count; i++) {
+        const GLuint first = 6 + 6 * i;
+        multi_offsets.push_back(reinterpret_cast<const void *>(first * sizeof(GLuint)));
+        commands.push_back({6, 1, first, 0, 0});
+    }
+
+    GLuint vao, vbo, ebo;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void *)(2 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(1);
+    glGenBuffers(1, &ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+    GLuint indirect = 0;
+    if (has_indirect) {
+        glGenBuffers(1, &indirect);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand),
+                     commands.data(), GL_STATIC_DRAW);
+    }
+
+    // every object of the UBO starts at a multiple of the offset alignment
+    GLint ubo_alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ubo_alignment);
+    const size_t ubo_stride = (sizeof(glm::vec4) + ubo_alignment - 1) / ubo_alignment * ubo_alignment;
+
+    GLuint ubo, ssbo = 0;
+    glGenBuffers(1, &ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, max_count * ubo_stride, nullptr, GL_STATIC_DRAW);
+    if (has_ssbo) {
+        glGenBuffers(1, &ssbo);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, max_count * sizeof(glm::vec4), nullptr, GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
+    }
+
+    trif::ShaderSourceTemplate vs_template(vs);
+
+    ProgramType uniform_program(vs_template.specialize({
+        {"VERSION", "330 core"},
+        {"CONSTANTS", "uniform vec4 object_constants;"},
+        {"OBJECT", "object_constants"}
+    }), fs);
+    ProgramType ubo_program(vs_template.specialize({
+        {"VERSION", "330 core"},
+        {"CONSTANTS", "layout(std140) uniform Object { vec4 object_constants; };"},
+        {"OBJECT", "object_constants"}
+    }), fs);
+    std::unique_ptr<ProgramType> ssbo_program;
+    if (has_ssbo)
+        ssbo_program.reset(new ProgramType(vs_template.specialize({
+            {"VERSION", "430 core"},
+            {"CONSTANTS", "layout(std430, binding = 0) readonly buffer Objects { vec4 objects[]; };"},
+            // the instances of one quad take the next objects
+            {"OBJECT", "objects[int(index) + gl_InstanceID]"}
+        }), fs));
+
+    uniform_program.use();
+    const GLint object_location = uniform_program.uniform("object_constants");
+    ubo_program.use();
+    glUniformBlockBinding(ubo_program.id(), glGetUniformBlockIndex(ubo_program.id(), "Object"), 0);
+    // linked once here, the timed frames only bind them
+    if (ssbo_program)
+        ssbo_program->use();
+
+    // lays out `count` objects on a grid and uploads them
+    std::vector<glm::vec4> objects;
+    auto layout = [&](int count) {
+        const int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count))));
+        const float cell = 2.0f / columns;
+        objects.clear();
+        for (int i = 0; i < count; i++)
+            objects.push_back(glm::vec4(-1.0f + (i % columns) * cell, -1.0f + (i / columns) * cell, 0.8f * cell,
+                                        static_cast<float>(i) / count));
+
+        std::vector<uint8_t> ubo_data(count * ubo_stride);
+        for (int i = 0; i < count; i++)
+            memcpy(&ubo_data[i * ubo_stride], &objects[i], sizeof(glm::vec4));
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, ubo_data.size(), ubo_data.data());
+        if (ssbo) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(glm::vec4), objects.data());
+        }
+    };
+
+    auto draw = [&](const Case& c) {
+        const int n = c.count;
+        switch (c.style) {
+            case Style::Arrays:
+            case Style::BaseVertex:
+                for (int i = 0; i < n; i++) {
+                    if (c.constants == Constants::Uniform)
+                        glUniform4fv(object_location, 1, &objects[i][0]);
+                    else if (c.constants == Constants::Ubo)
+                        glBindBufferRange(GL_UNIFORM_BUFFER, 0, ubo, i * ubo_stride, sizeof(glm::vec4));
+
+                    if (c.style == Style::Arrays)
+                        glDrawArrays(GL_TRIANGLE_STRIP, 4 * i, 4);
+                    else
+                        glDrawElementsBaseVertex(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void *)0, 4 * i);
+                }
+                break;
+            case Style::Instanced:
+                glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void *)0, n);
+                break;
+            case Style::MultiDraw:
+                glMultiDrawElements(GL_TRIANGLES, multi_counts.data(), GL_UNSIGNED_INT, multi_offsets.data(), n);
+                break;
+            case Style::Indirect:
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void *)0, n, 0);
+                break;
+        }
+    };
+
+    std::cout << "Drawing " << counts.size() << " counts of objects in " << cases.size() / counts.size()
+              << " ways, " << case_frames << " frames each" << std::endl;
+
+    size_t current = 0, frame = 0;
+    int laid_out = 0;
+    std::chrono::steady_clock::time_point start;
+
+    app.main_loop([&]() {
+        if (current == cases.size())
+            return;
+
+        Case *c = &cases[current];
+        if (frame == WARMUP_FRAMES + case_frames) {
+            c->frames = case_frames;
+            c->wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            frame = 0;
+            if (++current == cases.size()) {
+                glfwSetWindowShouldClose(app.getWindow(), true);
+                return;
+            }
+            c = &cases[current];
+        }
+        if (frame == WARMUP_FRAMES)
+            start = std::chrono::steady_clock::now();
+        if (laid_out != c->count) {
+            layout(c->count);
+            laid_out = c->count;
+        }
+
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        ProgramType& program = c->constants == Constants::Uniform ? uniform_program
+                             : c->constants == Constants::Ubo ? ubo_program : *ssbo_program;
+        program.bind();
+        glBindVertexArray(vao);
+
+        auto submit = std::chrono::steady_clock::now();
+        draw(*c);
+        if (frame >= WARMUP_FRAMES)
+            c->cpu_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submit).count();
+
+        frame++;
+    });
+
+    std::cout << std::left << std::setw(22) << "case" << std::right << std::setw(8) << "objects"
+              << std::setw(12) << "ms/frame" << std::setw(14) << "draws/s" << std::setw(14) << "CPU us/draw"
+              << '\n' << std::fixed;
+
+    for (auto& c : cases) {
+        if (!c.frames) {
+            std::cout << std::left << std::setw(22) << c.name << std::right << std::setw(8) << c.count
+                      << "  not run\n";
+            continue;
+        }
+
+        const double draws = static_cast<double>(c.count) * c.frames;
+        std::cout << std::left << std::setw(22) << c.name << std::right << std::setw(8) << c.count
+                  << std::setw(12) << std::setprecision(3) << c.wall_ms / c.frames
+                  << std::setw(14) << std::setprecision(0) << draws / (c.wall_ms / 1e3)
+                  << std::setw(14) << std::setprecision(3) << c.cpu_ms * 1e3 / draws << '\n';
+    }
+    std::cout << std::defaultfloat;
+
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ebo);
+    glDeleteBuffers(1, &ubo);
+    if (ssbo)
+        glDeleteBuffers(1, &ssbo);
+    if (indirect)
+        glDeleteBuffers(1, &indirect);
+    glDeleteVertexArrays(1, &vao);
+
+    return 0;
+}
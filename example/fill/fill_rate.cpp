@@ -0,0 +1,263 @@
+// Measures raster and ROP throughput: every frame draws --layers full screen quads into
+// a render target of the window size, e.g.
+//
+//   fill_rate -g 1920x1080 --layers 32
+//   fill_rate -g 3840x2160 --formats rgba8,rgba16f --blend on --depth off,write --msaa 0,4
+//
+// and every combination of target format, blending, depth and MSAA takes its turn for
+// --case-frames frames. The depth modes are off, test, which tests every layer against
+// the cleared depth, and write, which also writes it; the layers are drawn back to front
+// so that none of them is rejected.
+//
+// Gpixels/s counts the fragments shaded per second of GPU time. GB/s estimates the
+// framebuffer traffic from it: every sample writes its color, reads it too if blending,
+// and reads and writes its depth as configured, ignoring any framebuffer compression.
+#include <iomanip>
+#include <map>
+#include <memory>
+
+#include "application.hpp"
+#include "render_target.hpp"
+
+const std::string vs = R"(
+    #version 330 core
+    uniform float depth;
+
+    void main()
+    {
+        // full screen triangle
+        vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        gl_Position = vec4(pos * 2.0 - 1.0, depth, 1.0);
+    }
+)";
+
+const std::string fs = R"(
+    #version 330 core
+    uniform vec4 color;
+    out vec4 FragColor;
+
+    void main()
+    {
+        FragColor = color;
+    }
+)";
+
+enum class Depth { Off, Test, Write };
+
+struct Case {
+    std::string name;
+    GLenum format;
+    bool blend;
+    Depth depth;
+    int samples;
+
+    bool supported{true};
+    size_t frames{0};
+    double gpu_ms{0.0};
+};
+
+/// Frames drawn before every case is timed
+const size_t WARMUP_FRAMES = 3;
+
+int main(int argc, const char **argv)
+{
+    trif::Application app("fill_rate");
+
+    int layers = 16;
+    size_t case_frames = 30;
+    std::vector<std::string> formats = {"rgba8", "rgba16f", "r11g11b10f", "rgb565"};
+    std::vector<std::string> blends = {"off", "on"};
+    std::vector<std::string> depths = {"off", "write"};
+    std::vector<int> msaa = {0, 4};
+
+    const std::map<std::string, GLenum> format_names = {
+        {"rgba8", GL_RGBA8}, {"rgba16f", GL_RGBA16F}, {"r11g11b10f", GL_R11F_G11F_B10F}, {"rgb565", GL_RGB565}
+    };
+    const std::map<std::string, Depth> depth_names = {
+        {"off", Depth::Off}, {"test", Depth::Test}, {"write", Depth::Write}
+    };
+
+    app.add_option("--layers", layers, "Full screen quads drawn per frame (default 16)");
+    app.add_option("--case-frames", case_frames, "Frames timed per case (default 30)");
+    app.add_option("--formats", formats, "Target formats among rgba8, rgba16f, r11g11b10f and rgb565 (default all)")
+            ->delimiter(',')
+            ->check(CLI::IsMember({"rgba8", "rgba16f", "r11g11b10f", "rgb565"}));
+    app.add_option("--blend", blends, "Blending off, on or both with off,on (default off,on)")
+            ->delimiter(',')
+            ->check(CLI::IsMember({"off", "on"}));
+    app.add_option("--depth", depths, "Depth modes among off, test and write (default off,write)")
+            ->delimiter(',')
+            ->check(CLI::IsMember({"off", "test", "write"}));
+    app.add_option("--msaa", msaa, "Samples per pixel of the target, 0 for none (default 0,4)")->delimiter(',');
+
+    app.init(argc, argv);
+
+    // frames must not wait for the display
+    glfwSwapInterval(0);
+
+    GLint max_samples = 0;
+    glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+
+    std::vector<Case> cases;
+    for (auto& format : formats)
+        for (auto& blend : blends)
+            for (auto& depth : depths)
+                for (int samples : msaa) {
+                    Case c{format + "/" + (blend == "on" ? "blend" : "opaque") + "/depth_" + depth + "/" +
+                           std::to_string(samples) + "x",
+                           format_names.at(format), blend == "on", depth_names.at(depth), samples};
+                    c.supported = samples <= max_samples;
+                    cases.push_back(c);
+                }
+
+    trif::Program<
+        trif::Shaders<GL_VERTEX_SHADER>,
+        trif::Shaders<GL_FRAGMENT_SHADER>
+    > program(vs, fs);
+
+    program.use();
+    const GLint depth_location = program.uniform("depth");
+    const GLint color_location = program.uniform("color");
+
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+
+    // one query per timed frame of a case, read once the case is done
+    std::vector<GLuint> queries(case_frames);
+    glGenQueries(queries.size(), queries.data());
+
+    const int width = app.getWindowWidth();
+    const int height = app.getWindowHeight();
+
+    std::cout << "Filling " << width << "x" << height << " with " << layers << " layers in "
+              << cases.size() << " cases, " << case_frames << " frames each" << std::endl;
+
+    std::unique_ptr<trif::RenderTarget> target;
+    size_t current = 0, frame = 0;
+
+    // skips the cases whose target cannot be created and makes one of the next
+    auto next_target = [&]() {
+        target.reset();
+        for (; current < cases.size(); current++) {
+            Case& c = cases[current];
+            if (!c.supported)
+                continue;
+
+            trif::RenderTargetDesc desc;
+            desc.width = width;
+            desc.height = height;
+            desc.color_format = c.format;
+            desc.depth_format = c.depth == Depth::Off ? GL_NONE : GL_DEPTH24_STENCIL8;
+            desc.samples = c.samples;
+            target.reset(new trif::RenderTarget(desc, width, height));
+
+            glBindFramebuffer(GL_FRAMEBUFFER, target->fbo());
+            c.supported = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            if (c.supported)
+                return;
+            target.reset();
+        }
+    };
+    next_target();
+
+    app.main_loop([&]() {
+        if (current == cases.size()) {
+            glfwSetWindowShouldClose(app.getWindow(), true);
+            return;
+        }
+
+        Case& c = cases[current];
+        target->bind();
+
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClearDepth(1.0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        if (c.depth == Depth::Off) {
+            glDisable(GL_DEPTH_TEST);
+        } else {
+            glEnable(GL_DEPTH_TEST);
+            glDepthFunc(GL_LESS);
+            glDepthMask(c.depth == Depth::Write ? GL_TRUE : GL_FALSE);
+        }
+        if (c.blend) {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        } else {
+            glDisable(GL_BLEND);
+        }
+
+        program.use();
+        glBindVertexArray(vao);
+
+        const bool timed = frame >= WARMUP_FRAMES;
+        if (timed)
+            glBeginQuery(GL_TIME_ELAPSED, queries[frame - WARMUP_FRAMES]);
+        for (int i = 0; i < layers; i++) {
+            // back to front, every layer passes the depth test
+            const float t = static_cast<float>(i) / layers;
+            glUniform1f(depth_location, 0.9f - 0.8f * t);
+            glUniform4f(color_location, t, 1.0f - t, 0.5f, 0.25f);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        if (timed)
+            glEndQuery(GL_TIME_ELAPSED);
+
+        glDisable(GL_BLEND);
+        glDisable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+
+        // show the single sampled targets, multisampled ones would need a resolve of
+        // the same format first
+        if (c.samples <= 1) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, target->fbo());
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if (++frame == WARMUP_FRAMES + case_frames) {
+            for (auto query : queries) {
+                GLuint64 ns = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+                c.gpu_ms += ns / 1e6;
+            }
+            c.frames = case_frames;
+
+            frame = 0;
+            current++;
+            next_target();
+        }
+    });
+
+    const double pixels = static_cast<double>(width) * height * layers;
+
+    std::cout << std::left << std::setw(36) << "case" << std::right << std::setw(10) << "ms/frame"
+              << std::setw(12) << "Gpixels/s" << std::setw(12) << "GB/s" << '\n' << std::fixed;
+
+    for (auto& c : cases) {
+        std::cout << std::left << std::setw(36) << c.name << std::right;
+        if (!c.supported || !c.frames) {
+            std::cout << std::setw(10) << (c.supported ? "not run" : "unsupported") << '\n';
+            continue;
+        }
+
+        // bytes every sample of every layer moves
+        const double bytes = trif::bytes_per_pixel(c.format) * (c.blend ? 2 : 1) +
+                             (c.depth == Depth::Off ? 0 : 4) * (c.depth == Depth::Write ? 2 : 1);
+        const double ms = c.gpu_ms / c.frames;
+        const double gpixels = ms > 0.0 ? pixels / (ms * 1e6) : 0.0;
+
+        std::cout << std::setw(10) << std::setprecision(3) << ms
+                  << std::setw(12) << std::setprecision(2) << gpixels
+                  << std::setw(12) << gpixels * std::max(c.samples, 1) * bytes << '\n';
+    }
+    std::cout << std::defaultfloat;
+
+    target.reset();
+    glDeleteQueries(queries.size(), queries.data());
+    glDeleteVertexArrays(1, &vao);
+
+    return 0;
+}
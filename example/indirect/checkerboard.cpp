@@ -1,24 +1,5 @@
-#include <GLFW/glfw3.h>
 #include "application.hpp"
 
-
-void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void mouse_callback(GLFWwindow* window, double xpos, double ypos);
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void processInput(GLFWwindow *window);
-
-// settings
-const unsigned int SCR_WIDTH = 800;
-const unsigned int SCR_HEIGHT = 600;
-
-float lastX = (float)SCR_WIDTH / 2.0;
-float lastY = (float)SCR_HEIGHT / 2.0;
-bool firstMouse = true;
-
-// timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
-
 static const std::string square_vs_source = R"(
     #version 410 core                                                               
                                                                                     
@@ -65,46 +46,21 @@ struct DrawElementsIndirectCommand {
     GLuint baseInstance;
 };
 
-int main(int argc, char **argv)
+int main(int argc, const char **argv)
 {
-    trif::Option board_size = {
-        "-s,--size", "Specify the width and height of checkerboard as WxH (default: 8x8)",
-        trif::OptionType::Pair
-    };
+    trif::Application app("checkerboard");
 
-    trif::Application app("checkerboard", argc, argv, {&board_size});
-    trif::Config config = app.getConfig();
+    std::pair<uint32_t, uint32_t> board_sz{8, 8};
 
-    const uint32_t win_w = config.window_size.first;
-    const uint32_t win_h = config.window_size.second;
+    app.add_option("-s,--size", board_sz, "Specify the width and height of checkerboard as WxH (default: 8x8)")
+            ->delimiter('x');
 
-    std::pair<uint32_t, uint32_t> board_sz = app.get_option_value<std::pair<uint32_t, uint32_t>>(&board_size, std::make_pair(8, 8));
+    app.init(argc, argv);
 
     const uint32_t BOARD_WIDTH = board_sz.first;
     const uint32_t BOARD_HEIGHT = board_sz.second;
     const uint32_t NUM_DRAWS = BOARD_WIDTH * BOARD_HEIGHT;
 
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(win_w, win_h, "LearnOpenGL", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-
     trif::Program<
         trif::Shaders<GL_VERTEX_SHADER>,
         trif::Shaders<GL_FRAGMENT_SHADER>
@@ -225,9 +181,6 @@ int main(int argc, char **argv)
     glVertexAttribDivisor(1, 1);
     glVertexAttribDivisor(2, 1);
 
-    trif::Config conf = app.getConfig();
-    uint32_t frames = conf.n_frames;
-
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
@@ -239,81 +192,15 @@ int main(int argc, char **argv)
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window) && frames)
-    {
-        // per-frame time logic
-        // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // input
-        // -----
-        processInput(window);
-
+    app.main_loop([&]() {
         // render
         // ------
         for (int i = 0; i < NUM_DRAWS; ++i)
             glDrawElementsIndirect(GL_TRIANGLE_FAN, GL_UNSIGNED_SHORT,
                     (void *)(i * sizeof(DrawElementsIndirectCommand)));
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-
-        if (!conf.forever)
-            frames--;
-    }
+    });
 
     glBindVertexArray(0);
 
-    glfwTerminate();
     return 0;
 }
-
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-// ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow *window)
-{
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
-}
-
-// glfw: whenever the window size changed (by OS or user resize) this callback function executes
-// ---------------------------------------------------------------------------------------------
-void framebuffer_size_callback(GLFWwindow* window, int width, int height)
-{
-    // make sure the viewport matches the new window dimensions; note that width and
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
-}
-
-// glfw: whenever the mouse moves, this callback is called
-// -------------------------------------------------------
-void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
-{
-    float xpos = static_cast<float>(xposIn);
-    float ypos = static_cast<float>(yposIn);
-    if (firstMouse)
-    {
-        lastX = xpos;
-        lastY = ypos;
-        firstMouse = false;
-    }
-
-    float xoffset = xpos - lastX;
-    float yoffset = lastY - ypos; // reversed since y-coordinates go from bottom to top
-
-    lastX = xpos;
-    lastY = ypos;
-
-//    camera.ProcessMouseMovement(xoffset, yoffset);
-}
-
-// glfw: whenever the mouse scroll wheel scrolls, this callback is called
-// ----------------------------------------------------------------------
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
-{
-//    camera.ProcessMouseScroll(static_cast<float>(yoffset));
-}
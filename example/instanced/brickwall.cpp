@@ -1,24 +1,5 @@
-#include <GLFW/glfw3.h>
 #include "application.hpp"
 
-
-void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void mouse_callback(GLFWwindow* window, double xpos, double ypos);
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void processInput(GLFWwindow *window);
-
-// settings
-const unsigned int SCR_WIDTH = 800;
-const unsigned int SCR_HEIGHT = 600;
-
-float lastX = (float)SCR_WIDTH / 2.0;
-float lastY = (float)SCR_HEIGHT / 2.0;
-bool firstMouse = true;
-
-// timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
-
 static const std::string checkerboard_vs_source = R"(
     #version 330 core                                                               
                                                                                     
@@ -51,39 +32,24 @@ static const std::string checkerboard_fs_source = R"(
     }                                                                                
 )";
 
-#define BRICK_SIZE 16
-
-int main(int argc, char **argv)
+int main(int argc, const char **argv)
 {
-    trif::Application app("brickwall", argc, argv);
-    trif::Config config = app.getConfig();
-
-    const uint32_t win_w = config.window_size.first;
-    const uint32_t win_h = config.window_size.second;
-
-    const int cols = win_w / BRICK_SIZE;
-    const int rows = win_h / BRICK_SIZE;
-
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(win_w, win_h, "LearnOpenGL", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+    trif::Application app("brickwall");
+
+    int brick_size = 16;
+
+    app.add_option("-b,--brick-size", brick_size, "Side of the bricks in pixels, one instance each (default 16)")
+        ->check(CLI::PositiveNumber);
+
+    app.init(argc, argv);
+
+    const uint32_t win_w = app.getWindowWidth();
+    const uint32_t win_h = app.getWindowHeight();
+
+    const int cols = win_w / brick_size;
+    const int rows = win_h / brick_size;
+
+    std::cout << "Bricks: " << cols << "x" << rows << " = " << cols * rows << " instances" << std::endl;
 
     trif::Program<
         trif::Shaders<GL_VERTEX_SHADER>,
@@ -162,9 +128,6 @@ int main(int argc, char **argv)
     glVertexAttribDivisor(2, 1);
 
 
-    trif::Config conf = app.getConfig();
-    uint32_t frames = conf.n_frames;
-
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
@@ -174,79 +137,13 @@ int main(int argc, char **argv)
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window) && frames)
-    {
-        // per-frame time logic
-        // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // input
-        // -----
-        processInput(window);
-
+    app.main_loop([&]() {
         // render
         // ------
         glDrawArraysInstanced(GL_TRIANGLES, 0, 6, cols * rows);
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-
-        if (!conf.forever)
-            frames--;
-    }
+    });
 
     glBindVertexArray(0);
 
-    glfwTerminate();
     return 0;
 }
-
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-// ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow *window)
-{
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
-}
-
-// glfw: whenever the window size changed (by OS or user resize) this callback function executes
-// ---------------------------------------------------------------------------------------------
-void framebuffer_size_callback(GLFWwindow* window, int width, int height)
-{
-    // make sure the viewport matches the new window dimensions; note that width and
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
-}
-
-// glfw: whenever the mouse moves, this callback is called
-// -------------------------------------------------------
-void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
-{
-    float xpos = static_cast<float>(xposIn);
-    float ypos = static_cast<float>(yposIn);
-    if (firstMouse)
-    {
-        lastX = xpos;
-        lastY = ypos;
-        firstMouse = false;
-    }
-
-    float xoffset = xpos - lastX;
-    float yoffset = lastY - ypos; // reversed since y-coordinates go from bottom to top
-
-    lastX = xpos;
-    lastY = ypos;
-
-//    camera.ProcessMouseMovement(xoffset, yoffset);
-}
-
-// glfw: whenever the mouse scroll wheel scrolls, this callback is called
-// ----------------------------------------------------------------------
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
-{
-//    camera.ProcessMouseScroll(static_cast<float>(yoffset));
-}
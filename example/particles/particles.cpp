@@ -0,0 +1,254 @@
+// Simulates particles on the GPU: a compute shader integrates them around a few moving
+// attractors and respawns those at the end of their life, then the same storage buffer
+// is drawn as points, e.g.
+//
+//   particles --count 4194304
+//   particles --count 1048576 --attractors 5 --bench-json particles.json
+//
+// Nothing but the attractors goes through the CPU after the start, so the count is
+// bound by the bandwidth of the buffer, 32 bytes per particle read and written by the
+// simulation and read again by the draw. --indirect takes the work groups of the
+// dispatch from a buffer, as a simulation deciding its own work would.
+#include <glm/gtc/matrix_transform.hpp>
+#include <random>
+
+#include "application.hpp"
+#include "compute.hpp"
+
+const std::string simulate_cs = R"(
+    #version 430 core
+    layout (local_size_x = ${GROUP_SIZE}) in;
+
+    struct Particle {
+        vec4 position;  // w, the life left in seconds
+        vec4 velocity;
+    };
+
+    layout (std430, binding = 0) buffer Particles { Particle particles[]; };
+
+    uniform int count;
+    uniform float dt;
+    uniform int seed;
+    uniform vec4 attractors[${ATTRACTORS}];  // w, the strength
+
+    uint hash(uint x)
+    {
+        // PCG
+        uint state = x * 747796405u + 2891336453u;
+        uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    float random(inout uint state)
+    {
+        state = hash(state);
+        return float(state) / 4294967295.0;
+    }
+
+    void main()
+    {
+        uint i = gl_GlobalInvocationID.x;
+        if (i >= uint(count))
+            return;
+
+        Particle p = particles[i];
+
+        p.position.w -= dt;
+        if (p.position.w <= 0.0) {
+            // respawn around an attractor, on a circle across its pull
+            uint state = i ^ hash(uint(seed));
+            vec4 a = attractors[int(random(state) * ${ATTRACTORS}) % ${ATTRACTORS}];
+            vec3 dir = normalize(vec3(random(state), random(state), random(state)) * 2.0 - 1.0 + 1e-4);
+            p.position = vec4(a.xyz + dir * 0.3, 2.0 + 6.0 * random(state));
+            p.velocity = vec4(normalize(cross(dir, vec3(0.0, 1.0, 0.0)) + 1e-4) * sqrt(a.w / 0.3), 0.0);
+        }
+
+        vec3 acceleration = vec3(0.0);
+        for (int k = 0; k < ${ATTRACTORS}; k++) {
+            vec3 d = attractors[k].xyz - p.position.xyz;
+            float r2 = dot(d, d) + 0.01;
+            acceleration += attractors[k].w * d * inversesqrt(r2 * r2 * r2);
+        }
+
+        p.velocity.xyz = (p.velocity.xyz + acceleration * dt) * (1.0 - 0.2 * dt);
+        p.position.xyz += p.velocity.xyz * dt;
+        particles[i] = p;
+    }
+)";
+
+const std::string point_vs = R"(
+    #version 330 core
+    layout (location = 0) in vec4 position;
+    layout (location = 1) in vec4 velocity;
+
+    uniform mat4 mvp;
+    uniform float intensity;
+    out vec4 color;
+
+    void main()
+    {
+        gl_Position = mvp * vec4(position.xyz, 1.0);
+
+        // blue when slow, orange when fast, fading in and out of life
+        float speed = clamp(length(velocity.xyz) * 0.4, 0.0, 1.0);
+        float fade = clamp(position.w, 0.0, 1.0);
+        color = vec4(mix(vec3(0.1, 0.3, 1.0), vec3(1.0, 0.6, 0.2), speed), intensity * fade);
+    }
+)";
+
+const std::string point_fs = R"(
+    #version 330 core
+    in vec4 color;
+    out vec4 FragColor;
+
+    void main()
+    {
+        FragColor = color;
+    }
+)";
+
+/// As the Particle struct of the compute shader lays it out
+struct Particle {
+    glm::vec4 position;
+    glm::vec4 velocity;
+};
+
+/// Invocations of a work group of the simulation
+const GLuint GROUP_SIZE = 256;
+
+int main(int argc, const char **argv)
+{
+    trif::Application app("particles");
+
+    size_t count = 1 << 20;
+    int attractors = 3;
+    bool indirect = false;
+
+    app.add_option("--count", count, "Particles simulated (default 1048576)");
+    app.add_option("--attractors", attractors, "Attractors pulling the particles (default 3)");
+    app.add_flag("--indirect", indirect, "Dispatch the simulation from a buffer of work groups");
+
+    app.init(argc, argv);
+
+    if (!GLEW_VERSION_4_3 && !GLEW_ARB_compute_shader) {
+        std::cerr << "Compute shaders unsupported" << std::endl;
+        return trif::Application::EXIT_SKIP;
+    }
+    attractors = std::max(attractors, 1);
+
+    // spread over a ball with random lives, so that they do not all respawn at once
+    std::vector<Particle> initial(count);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    for (auto& p : initial) {
+        glm::vec3 pos;
+        do {
+            pos = glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+        } while (glm::dot(pos, pos) > 1.0f);
+        p.position = glm::vec4(pos * 2.0f, 4.0f + 4.0f * uniform(rng));
+        p.velocity = glm::vec4(0.0f);
+    }
+
+    trif::StorageBuffer<Particle> particles(initial);
+    initial.clear();
+    initial.shrink_to_fit();
+
+    const GLuint groups = trif::groups_for(count, GROUP_SIZE);
+    trif::StorageBuffer<trif::DispatchIndirectCommand> dispatch_command(1);
+    if (indirect) {
+        trif::DispatchIndirectCommand command = {groups, 1, 1};
+        dispatch_command.upload(&command, 1);
+    }
+
+    trif::ShaderSourceTemplate simulate_template(simulate_cs);
+    trif::ComputeProgram simulate(simulate_template.specialize({
+        {"GROUP_SIZE", std::to_string(GROUP_SIZE)}, {"ATTRACTORS", std::to_string(attractors)}
+    }));
+
+    trif::Program<
+        trif::Shaders<GL_VERTEX_SHADER>,
+        trif::Shaders<GL_FRAGMENT_SHADER>
+    > draw(point_vs, point_fs);
+    // linked once, the frames only bind them
+    simulate.use();
+    draw.use();
+
+    // the storage buffer is the vertex buffer of the points
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, particles.id());
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), (void *)offsetof(Particle, position));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), (void *)offsetof(Particle, velocity));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    const float aspect = static_cast<float>(app.getWindowWidth()) / app.getWindowHeight();
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 100.0f);
+
+    // the fewer the particles, the brighter each of them
+    const float intensity = std::min(1.0f, 65536.0f / count) * 0.5f;
+
+    std::cout << "Simulating " << count << " particles in " << groups << " work groups of "
+              << GROUP_SIZE << std::endl;
+
+    double last = app.time();
+    int frame = 0;
+
+    app.main_loop([&]() {
+        const double now = app.time();
+        const float dt = static_cast<float>(std::min(now - last, 1.0 / 30.0));
+        const float t = static_cast<float>(now);
+        last = now;
+
+        simulate.bind();
+        simulate.uniform("count", static_cast<int>(count));
+        simulate.uniform("dt", dt);
+        simulate.uniform("seed", frame++);
+        for (int k = 0; k < attractors; k++) {
+            // on Lissajous curves of their own
+            const float phase = 6.2831853f * k / attractors;
+            const glm::vec3 pos(1.5f * std::sin(0.7f * t + phase), 0.8f * std::sin(1.1f * t + 2.0f * phase),
+                                1.5f * std::cos(0.5f * t + phase));
+            simulate.uniform("attractors[" + std::to_string(k) + "]", glm::vec4(pos, 1.0f));
+        }
+
+        particles.bind(0);
+        if (indirect) {
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, dispatch_command.id());
+            simulate.dispatch_indirect();
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+        } else {
+            simulate.dispatch(groups);
+        }
+
+        // the points are drawn from what the simulation has just written, and the next
+        // frame's dispatch reads it back through the storage buffer
+        trif::memory_barrier(trif::Barrier::VertexAttribs | trif::Barrier::Storage);
+
+        glClearColor(0.0f, 0.0f, 0.02f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        // additive, the order of the points does not matter
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+        const glm::mat4 view = glm::lookAt(glm::vec3(6.0f * std::sin(0.1f * t), 2.0f, 6.0f * std::cos(0.1f * t)),
+                                           glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        draw.bind();
+        draw.uniform("mvp", projection * view);
+        draw.uniform("intensity", intensity);
+
+        glBindVertexArray(vao);
+        glDrawArrays(GL_POINTS, 0, count);
+        glBindVertexArray(0);
+
+        glDisable(GL_BLEND);
+    });
+
+    glDeleteVertexArrays(1, &vao);
+
+    return 0;
+}
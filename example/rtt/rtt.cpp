@@ -2,6 +2,7 @@
 #include <stb_image.h>
 
 #include "application.hpp"
+#include "frame_graph.hpp"
 
 const char* vertex_shader_source = R"(
 #version 330 core
@@ -67,59 +68,51 @@ int main(int argc, const char *argv[]) {
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
-    // Create a framebuffer object (FBO)
-    GLuint FBO;
-    glGenFramebuffers(1, &FBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-
-    // Create a texture to render to
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 800, 600, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
-
-    // Create a renderbuffer object for depth and stencil attachment (optional)
-    GLuint RBO;
-    glGenRenderbuffers(1, &RBO);
-    glBindRenderbuffer(GL_RENDERBUFFER, RBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, 800, 600);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, RBO);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        std::cerr << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
-        return -1;
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    app.main_loop([&]() {
-
-        // First pass: render to texture
-        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-        glClearColor(0.0f, 1.0f, 0.0f, 1.0f); // Green background
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
+    // Offscreen target following the window size, handed out by the pool every frame
+    trif::RenderTargetPool pool(app);
+    trif::RenderTargetDesc offscreen;
+    offscreen.color_format = GL_RGB8;
+    offscreen.depth_format = GL_DEPTH24_STENCIL8;
+
+    trif::FrameGraph graph(pool);
+    trif::FrameGraph::Resource backbuffer = graph.import_backbuffer();
+    trif::FrameGraph::Resource scene;
+
+    // First pass: render to texture
+    graph.add_pass("scene", [&](trif::FrameGraph::Builder& builder) {
+        scene = builder.create("scene", offscreen);
+        builder.clear(scene, {GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, {0.0f, 1.0f, 0.0f, 1.0f}}); // Green background
+    }, [&](trif::FrameGraph::Context&) {
         // Render your scene here
+        glBindTexture(GL_TEXTURE_2D, 0);
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    });
 
-        // Second pass: render to screen
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // Black background
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        glBindTexture(GL_TEXTURE_2D, texture);
+    // Second pass: render to screen
+    graph.add_pass("present", [&](trif::FrameGraph::Builder& builder) {
+        builder.read(scene);
+        builder.clear(backbuffer, {GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, {0.0f, 0.0f, 0.0f, 1.0f}}); // Black background
+    }, [&](trif::FrameGraph::Context& ctx) {
+        glBindTexture(GL_TEXTURE_2D, ctx.texture(scene));
+        glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
     });
 
+    graph.compile();
+    graph.print_schedule();
+
+    app.main_loop([&]() {
+        graph.execute();
+        pool.end_frame();
+    });
+
+    graph.print_timings();
+    pool.print_stats();
+
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
-    glDeleteFramebuffers(1, &FBO);
-    glDeleteRenderbuffers(1, &RBO);
-    glDeleteTextures(1, &texture);
 
     return 0;
 }
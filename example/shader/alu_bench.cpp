@@ -0,0 +1,421 @@
+// Measures shader ALU throughput with generated fragment and compute shaders, e.g.
+//
+//   alu_bench
+//   alu_bench --ops 64,256,1024,4096 --stages compute --case-frames 30
+//
+// The shaders come from one ShaderSourceTemplate with four parameters, each swept in
+// turn while the others stay at their defaults:
+//
+//   ops        vec4 operations per invocation (default 256)
+//   mix        fraction of them which are transcendental, sin() instead of an FMA
+//              (default 0)
+//   unroll     operations of every register per loop iteration, the rest of the
+//              count being a loop whose trip count is a uniform (default 4)
+//   registers  independent vec4 chains kept live, i.e. the parallelism available to
+//              the scheduler against the register pressure (default 4)
+//
+// The fragment shaders cover the window once per frame, the compute shaders run one
+// invocation per pixel without writing anything. Every frame is timed by a query and,
+// finished on both sides, by the wall clock, because some drivers' queries do not cover
+// dispatches. Gops/s counts the scalar operations, 4 per vec4 one, per second of GPU
+// time for the fragment shaders and of wall time for the compute ones, which is why
+// the cheapest compute cases look slow.
+//
+// Two references are drawn the same way: the lighting of glxgears' fragment shader and
+// a shader writing a constant, which costs the bandwidth of the window alone. The
+// lighting is then placed on the fragment ops curve by GPU time.
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+
+#include "application.hpp"
+
+const std::string fullscreen_vs = R"(
+    #version 420 core
+    layout (location = 0) out vec3 outNormal;
+    layout (location = 1) out vec3 outEyePos;
+
+    void main()
+    {
+        // full screen triangle
+        vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+
+        // a hemisphere in front of the eye for the glxgears lighting
+        vec2 p = pos * 2.0 - 1.0;
+        outNormal = normalize(vec3(p, 1.0));
+        outEyePos = vec3(p * 5.0, -20.0);
+    }
+)";
+
+const std::string alu_fs = R"(
+    #version 330 core
+    uniform vec4 a;
+    uniform vec4 b;
+    uniform int iterations;
+    out vec4 FragColor;
+
+    void main()
+    {
+        vec4 seed = vec4(gl_FragCoord.xy * 0.001, 0.5, 1.0);
+${DECLARE}
+        for (int i = 0; i < iterations; i++) {
+${BODY}
+        }
+        FragColor = ${RESULT};
+    }
+)";
+
+const std::string alu_cs = R"(
+    #version 430 core
+    layout (local_size_x = 8, local_size_y = 8) in;
+    layout (std430, binding = 0) writeonly buffer Result { vec4 result[]; };
+    uniform vec4 a;
+    uniform vec4 b;
+    uniform int iterations;
+
+    void main()
+    {
+        vec4 seed = vec4(vec2(gl_GlobalInvocationID.xy) * 0.001, 0.5, 1.0);
+${DECLARE}
+        for (int i = 0; i < iterations; i++) {
+${BODY}
+        }
+        vec4 sum = ${RESULT};
+
+        // never true, keeps the chains alive without writing anything
+        if (sum.x == -1234.5)
+            result[gl_GlobalInvocationID.y * gl_NumWorkGroups.x * 8u + gl_GlobalInvocationID.x] = sum;
+    }
+)";
+
+// as in glxgears
+const std::string gears_fs = R"(
+    #version 420 core
+
+    precision mediump float;
+
+    layout (location = 0) out vec4 fg_FragColor;
+
+    layout (location = 0) in vec3 inNormal;
+    layout (location = 1) in vec3 inEyePos;
+
+    uniform vec4 LightSourcePosition;
+    uniform vec4 MaterialColor;
+
+    void main(void)
+    {
+        // Lambertian reflection
+        vec3 Eye = normalize(-inEyePos);
+        vec3 LightVec = normalize(LightSourcePosition.xyz - inEyePos);
+        vec3 Reflected = normalize(reflect(-LightVec, inNormal));
+
+        vec4 IAmbient = vec4(0.2, 0.2, 0.2, 1.0);
+        vec4 IDiffuse = vec4(0.5, 0.5, 0.5, 0.5) * max(dot(inNormal, LightVec), 0.0);
+
+        float specular = 0.25;
+        vec4 ISpecular = vec4(0.5, 0.5, 0.5, 1.0) * pow(max(dot(Reflected, Eye), 0.0), 0.8) * specular;
+
+        fg_FragColor = vec4((IAmbient + IDiffuse) * MaterialColor + ISpecular);
+    }
+)";
+
+const std::string constant_fs = R"(
+    #version 330 core
+    out vec4 FragColor;
+
+    void main()
+    {
+        FragColor = vec4(0.8, 0.1, 0.0, 1.0);
+    }
+)";
+
+enum class Kind { Fragment, Compute, Gears, Constant };
+
+struct Case {
+    std::string name;
+    Kind kind;
+    int ops;
+    double mix;
+    int unroll;
+    int registers;
+
+    /// vec4 operations per invocation, a multiple of unroll * registers
+    int actual_ops{0};
+    size_t frames{0};
+    double gpu_ms{0.0};
+    double wall_ms{0.0};
+};
+
+/// Frames drawn before every case is timed
+const size_t WARMUP_FRAMES = 3;
+
+/// The parameters of the template for a case, and the loop trip count
+static trif::ShaderSourceTemplate::ParamsType alu_params(const Case& c, int& iterations)
+{
+    const int per_iteration = c.unroll * c.registers;
+    iterations = std::max(1, c.ops / per_iteration);
+
+    std::ostringstream declare, body, result;
+    for (int r = 0; r < c.registers; r++) {
+        declare << "        vec4 r" << r << " = seed + vec4(" << r << ".0);\n";
+        result << (r ? " + " : "") << "r" << r;
+    }
+
+    // the transcendental operations are spread evenly among the others
+    int statement = 0;
+    for (int u = 0; u < c.unroll; u++) {
+        for (int r = 0; r < c.registers; r++, statement++) {
+            const bool transcendental = static_cast<int>((statement + 1) * c.mix) > static_cast<int>(statement * c.mix);
+            body << "            r" << r << " = " << (transcendental ? "sin(r" + std::to_string(r) + ")"
+                                                                     : "r" + std::to_string(r) + " * a + b")
+                 << ";\n";
+        }
+    }
+
+    return {{"DECLARE", declare.str()}, {"BODY", body.str()}, {"RESULT", result.str()}};
+}
+
+int main(int argc, const char **argv)
+{
+    trif::Application app("alu_bench");
+
+    std::vector<int> ops = {16, 64, 256, 1024};
+    std::vector<double> mixes = {0.0, 0.125, 0.25, 0.5};
+    std::vector<int> unrolls = {1, 2, 4, 8};
+    std::vector<int> registers = {1, 2, 4, 8, 16, 32};
+    std::vector<std::string> stages = {"fragment", "compute"};
+    size_t case_frames = 10;
+
+    app.add_option("--ops", ops, "vec4 operations per invocation swept (default 16,64,256,1024)")->delimiter(',');
+    app.add_option("--mix", mixes, "Transcendental fractions swept (default 0,0.125,0.25,0.5)")->delimiter(',');
+    app.add_option("--unroll", unrolls, "Unroll factors swept (default 1,2,4,8)")->delimiter(',');
+    app.add_option("--registers", registers, "Live vec4 registers swept (default 1,2,4,8,16,32)")->delimiter(',');
+    app.add_option("--stages", stages, "fragment, compute or both (default fragment,compute)")
+            ->delimiter(',')
+            ->check(CLI::IsMember({"fragment", "compute"}));
+    app.add_option("--case-frames", case_frames, "Frames timed per case (default 10)");
+
+    app.init(argc, argv);
+
+    // frames must not wait for the display
+    glfwSwapInterval(0);
+
+    const bool has_compute = GLEW_VERSION_4_3 || GLEW_ARB_compute_shader;
+    if (!has_compute && std::count(stages.begin(), stages.end(), "compute"))
+        std::cout << "Compute shaders unsupported, skipping the compute cases" << std::endl;
+
+    std::vector<Case> cases;
+    cases.push_back({"reference/constant", Kind::Constant, 0, 0.0, 1, 1});
+    cases.push_back({"reference/glxgears_lighting", Kind::Gears, 0, 0.0, 1, 1});
+    for (auto& stage : stages) {
+        if (stage == "compute" && !has_compute)
+            continue;
+
+        const Kind kind = stage == "compute" ? Kind::Compute : Kind::Fragment;
+        const Case base{"", kind, 256, 0.0, 4, 4};
+        auto add = [&](const std::string& sweep, const std::string& value, Case c) {
+            c.name = stage + "/" + sweep + "/" + value;
+            cases.push_back(c);
+        };
+
+        for (int n : ops) {
+            Case c = base;
+            c.ops = n;
+            add("ops", std::to_string(n), c);
+        }
+        for (double m : mixes) {
+            Case c = base;
+            c.mix = m;
+            std::ostringstream value;
+            value << m;
+            add("mix", value.str(), c);
+        }
+        for (int u : unrolls) {
+            Case c = base;
+            c.unroll = u;
+            add("unroll", std::to_string(u), c);
+        }
+        for (int r : registers) {
+            Case c = base;
+            c.registers = r;
+            add("registers", std::to_string(r), c);
+        }
+    }
+
+    using GraphicsProgram = trif::Program<trif::Shaders<GL_VERTEX_SHADER>, trif::Shaders<GL_FRAGMENT_SHADER>>;
+    trif::ShaderSourceTemplate fs_template(alu_fs), cs_template(alu_cs);
+
+    const int width = app.getWindowWidth();
+    const int height = app.getWindowHeight();
+    const GLuint groups_x = (width + 7) / 8, groups_y = (height + 7) / 8;
+
+    GLuint vao, ssbo = 0;
+    glGenVertexArrays(1, &vao);
+    if (has_compute) {
+        glGenBuffers(1, &ssbo);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<size_t>(groups_x * 8) * groups_y * 8 * 16, nullptr,
+                     GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
+    }
+
+    // one query per timed frame of a case, read once the case is done
+    std::vector<GLuint> queries(case_frames);
+    glGenQueries(queries.size(), queries.data());
+
+    std::cout << "Shading " << width << "x" << height << " in " << cases.size() << " cases, "
+              << case_frames << " frames each" << std::endl;
+
+    size_t current = 0, frame = 0;
+    std::unique_ptr<GraphicsProgram> graphics;
+    std::unique_ptr<trif::ComputeProgram> compute;
+    int iterations = 1;
+
+    // compiles and links the program of a case and sets its uniforms, so that the timed
+    // frames only bind() it: Program::use() relinks every time
+    auto setup = [&](Case& c) {
+        graphics.reset();
+        compute.reset();
+        switch (c.kind) {
+            case Kind::Constant:
+                graphics.reset(new GraphicsProgram(fullscreen_vs, constant_fs));
+                break;
+            case Kind::Gears:
+                graphics.reset(new GraphicsProgram(fullscreen_vs, gears_fs));
+                break;
+            case Kind::Fragment:
+                graphics.reset(new GraphicsProgram(fullscreen_vs, fs_template.specialize(alu_params(c, iterations))));
+                break;
+            case Kind::Compute:
+                compute.reset(new trif::ComputeProgram(cs_template.specialize(alu_params(c, iterations))));
+                break;
+        }
+        c.actual_ops = c.kind == Kind::Fragment || c.kind == Kind::Compute ? iterations * c.unroll * c.registers : 0;
+
+        if (compute) {
+            compute->use();
+            compute->uniform("a", glm::vec4(0.999f));
+            compute->uniform("b", glm::vec4(0.001f));
+            compute->uniform("iterations", iterations);
+        } else {
+            graphics->use();
+            if (c.kind == Kind::Gears) {
+                graphics->uniform("LightSourcePosition", glm::vec4(5.0f, 5.0f, 10.0f, 1.0f));
+                graphics->uniform("MaterialColor", glm::vec4(0.8f, 0.1f, 0.0f, 1.0f));
+            } else if (c.kind == Kind::Fragment) {
+                graphics->uniform("a", glm::vec4(0.999f));
+                graphics->uniform("b", glm::vec4(0.001f));
+                graphics->uniform("iterations", iterations);
+            }
+        }
+    };
+    setup(cases[0]);
+
+    app.main_loop([&]() {
+        if (current == cases.size()) {
+            glfwSetWindowShouldClose(app.getWindow(), true);
+            return;
+        }
+
+        Case& c = cases[current];
+        const bool timed = frame >= WARMUP_FRAMES;
+
+        glFinish();
+        const auto start = std::chrono::steady_clock::now();
+
+        if (compute) {
+            compute->bind();
+
+            if (timed)
+                glBeginQuery(GL_TIME_ELAPSED, queries[frame - WARMUP_FRAMES]);
+            compute->dispatch(groups_x, groups_y);
+            if (timed)
+                glEndQuery(GL_TIME_ELAPSED);
+        } else {
+            graphics->bind();
+            glBindVertexArray(vao);
+
+            if (timed)
+                glBeginQuery(GL_TIME_ELAPSED, queries[frame - WARMUP_FRAMES]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            if (timed)
+                glEndQuery(GL_TIME_ELAPSED);
+        }
+
+        glFinish();
+        if (timed)
+            c.wall_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        if (++frame == WARMUP_FRAMES + case_frames) {
+            for (auto query : queries) {
+                GLuint64 ns = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+                c.gpu_ms += ns / 1e6;
+            }
+            c.frames = case_frames;
+
+            frame = 0;
+            if (++current < cases.size())
+                setup(cases[current]);
+        }
+    });
+
+    std::cout << std::left << std::setw(30) << "case" << std::right << std::setw(8) << "ops"
+              << std::setw(10) << "gpu ms" << std::setw(10) << "wall ms" << std::setw(10) << "Gops/s" << '\n'
+              << std::fixed;
+
+    for (auto& c : cases) {
+        std::cout << std::left << std::setw(30) << c.name << std::right;
+        if (!c.frames) {
+            std::cout << "  not run\n";
+            continue;
+        }
+
+        const double gpu_ms = c.gpu_ms / c.frames, wall_ms = c.wall_ms / c.frames;
+        const double invocations = c.kind == Kind::Compute ? 64.0 * groups_x * groups_y
+                                                           : static_cast<double>(width) * height;
+        // only the dispatches may be missed by the queries
+        const double ms = c.kind == Kind::Compute ? wall_ms : gpu_ms;
+        std::cout << std::setw(8) << c.actual_ops << std::setprecision(3) << std::setw(10) << gpu_ms
+                  << std::setw(10) << wall_ms << std::setw(10) << std::setprecision(2)
+                  << (ms > 0.0 ? invocations * c.actual_ops * 4 / (ms * 1e6) : 0.0) << '\n';
+    }
+
+    // where the glxgears lighting falls on the fragment ops curve
+    const Case& constant = cases[0];
+    const Case& gears = cases[1];
+    if (constant.frames && gears.frames) {
+        const double constant_ms = constant.gpu_ms / constant.frames, gears_ms = gears.gpu_ms / gears.frames;
+        std::cout << "glxgears lighting: " << std::setprecision(2) << gears_ms / constant_ms
+                  << "x the time of writing a constant";
+
+        // writing a constant is the curve at no operations
+        const Case *below = &constant, *above = nullptr;
+        for (auto& c : cases) {
+            if (c.kind != Kind::Fragment || c.name.find("/ops/") == std::string::npos || !c.frames)
+                continue;
+            const double ms = c.gpu_ms / c.frames;
+            if (ms <= gears_ms && c.actual_ops > below->actual_ops)
+                below = &c;
+            if (ms >= gears_ms && (!above || c.actual_ops < above->actual_ops))
+                above = &c;
+        }
+        if (above) {
+            const double below_ms = below->gpu_ms / below->frames, above_ms = above->gpu_ms / above->frames;
+            const double t = above_ms > below_ms ? (gears_ms - below_ms) / (above_ms - below_ms) : 0.0;
+            std::cout << ", about " << std::setprecision(0)
+                      << below->actual_ops + t * (above->actual_ops - below->actual_ops) << " vec4 FMAs";
+        }
+        std::cout << '\n';
+    }
+    std::cout << std::defaultfloat;
+
+    if (ssbo)
+        glDeleteBuffers(1, &ssbo);
+    glDeleteQueries(queries.size(), queries.data());
+    glDeleteVertexArrays(1, &vao);
+
+    return 0;
+}
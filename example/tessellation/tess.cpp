@@ -1,27 +1,8 @@
-#include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 //#include <glm/gtc/type_ptr.hpp>
 
 #include "application.hpp"
 
-
-void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void mouse_callback(GLFWwindow* window, double xpos, double ypos);
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void processInput(GLFWwindow *window);
-
-// settings
-const unsigned int SCR_WIDTH = 800;
-const unsigned int SCR_HEIGHT = 600;
-
-float lastX = (float)SCR_WIDTH / 2.0;
-float lastY = (float)SCR_HEIGHT / 2.0;
-bool firstMouse = true;
-
-// timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
-
 const std::string vertex_source = R"(
 #version 400 core
 
@@ -98,43 +79,22 @@ void main()
 )";
 
 
-int main(int argc, char **argv)
+int main(int argc, const char **argv)
 {
-    trif::Option outer_level = {"-o,--outer-level", "Set all outer tessellation levels of the current patch"};
-    trif::Option inner_level = {"-i,--inner-level", "Set all inner tessellation levels of the current patch"};
-    trif::Option output_patch_vertices = { "-v, --patch-vertices", "Set output patch vertices count ([1, 32])"};
-
-    trif::Application app("tess", argc, argv, {&outer_level, &inner_level, &output_patch_vertices});
-    trif::Config config = app.getConfig();
-
-    const uint32_t win_w = config.window_size.first;
-    const uint32_t win_h = config.window_size.second;
-
-    uint32_t frames = config.n_frames;
-    float ol = app.get_option_value<float>(&outer_level, 8.0f);
-    float il = app.get_option_value<float>(&inner_level, 8.0f);
-    std::string patch_vertices = app.get_option_value<std::string>(&output_patch_vertices, "4");
-
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(win_w, win_h, "LearnOpenGL", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+    trif::Application app("tess");
+
+    float ol = 8.0f;
+    float il = 8.0f;
+    std::string patch_vertices = "4";
+
+    app.add_option("-o,--outer-level", ol, "Set all outer tessellation levels of the current patch");
+    app.add_option("-i,--inner-level", il, "Set all inner tessellation levels of the current patch");
+    app.add_option("-v,--patch-vertices", patch_vertices, "Set output patch vertices count ([1, 32])");
+
+    app.init(argc, argv);
+
+    const uint32_t win_w = app.getWindowWidth();
+    const uint32_t win_h = app.getWindowHeight();
 
     // configure global opengl state
     // -----------------------------
@@ -234,18 +194,7 @@ int main(int argc, char **argv)
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window) && frames)
-    {
-        // per-frame time logic
-        // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // input
-        // -----
-        processInput(window);
-
+    app.main_loop([&]() {
         // render
         // ------
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
@@ -270,62 +219,7 @@ int main(int argc, char **argv)
         glBindVertexArray(cubeVAO);
         glDrawArrays(GL_PATCHES, 0, 36);
         glBindVertexArray(0);
+    });
 
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-
-        if (!config.forever)
-            frames--;
-    }
-
-    glfwTerminate();
     return 0;
 }
-
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-// ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow *window)
-{
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
-}
-
-// glfw: whenever the window size changed (by OS or user resize) this callback function executes
-// ---------------------------------------------------------------------------------------------
-void framebuffer_size_callback(GLFWwindow* window, int width, int height)
-{
-    // make sure the viewport matches the new window dimensions; note that width and
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
-}
-
-// glfw: whenever the mouse moves, this callback is called
-// -------------------------------------------------------
-void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
-{
-    float xpos = static_cast<float>(xposIn);
-    float ypos = static_cast<float>(yposIn);
-    if (firstMouse)
-    {
-        lastX = xpos;
-        lastY = ypos;
-        firstMouse = false;
-    }
-
-    float xoffset = xpos - lastX;
-    float yoffset = lastY - ypos; // reversed since y-coordinates go from bottom to top
-
-    lastX = xpos;
-    lastY = ypos;
-
-//    camera.ProcessMouseMovement(xoffset, yoffset);
-}
-
-// glfw: whenever the mouse scroll wheel scrolls, this callback is called
-// ----------------------------------------------------------------------
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
-{
-//    camera.ProcessMouseScroll(static_cast<float>(yoffset));
-}
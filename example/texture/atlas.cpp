@@ -0,0 +1,171 @@
+// Draws many textured quads, each with its own image, in a single instanced call.
+// The images are packed by trif::AtlasBuilder and every instance looks its UV rect
+// and layer up in the region table bound as a buffer texture.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <cmath>
+#include <random>
+
+#include "application.hpp"
+#include "atlas.hpp"
+
+const std::string vs = R"(
+    #version 330 core
+    layout (location = 0) in vec4 aRect;        // x, y, w, h in NDC
+    layout (location = 1) in float aRegion;
+
+    uniform samplerBuffer regions;
+
+    out vec3 TexCoord;
+
+    void main()
+    {
+        vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+        int region = int(aRegion);
+        vec4 uv = texelFetch(regions, 2 * region);
+        float layer = texelFetch(regions, 2 * region + 1).x;
+
+        gl_Position = vec4(aRect.xy + corner * aRect.zw, 0.0, 1.0);
+        // images are stored top row first
+        TexCoord = vec3(mix(uv.xw, uv.zy, corner), layer);
+    }
+)";
+
+const std::string fs = R"(
+    #version 330 core
+    uniform ${SAMPLER} atlas;
+
+    in vec3 TexCoord;
+    out vec4 FragColor;
+
+    void main()
+    {
+        FragColor = texture(atlas, ${COORD});
+    }
+)";
+
+/// Small procedural sprites, so there are more images than the assets directory holds
+static std::vector<unsigned char> make_sprite(int width, int height, std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> channel(64, 255);
+    unsigned char a[3] = {static_cast<unsigned char>(channel(rng)), static_cast<unsigned char>(channel(rng)),
+                          static_cast<unsigned char>(channel(rng))};
+    unsigned char b[3] = {static_cast<unsigned char>(a[1] / 3), static_cast<unsigned char>(a[2] / 3),
+                          static_cast<unsigned char>(a[0] / 3)};
+    int cell = 4 + rng() % 8;
+
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 4);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const unsigned char *c = ((x / cell) + (y / cell)) % 2 ? a : b;
+            unsigned char *p = &pixels[(static_cast<size_t>(y) * width + x) * 4];
+            p[0] = c[0]; p[1] = c[1]; p[2] = c[2]; p[3] = 255;
+        }
+    }
+    return pixels;
+}
+
+int main(int argc, const char **argv)
+{
+    trif::Application app("atlas");
+
+    bool use_array = false;
+    int sprites = 64;
+    int count = 1024;
+    int padding = 4;
+
+    app.add_flag("--array", use_array, "Pack into a GL_TEXTURE_2D_ARRAY instead of a 2D atlas");
+    app.add_option("--sprites", sprites, "Procedural images packed besides the assets (default 64)");
+    app.add_option("--count", count, "Quads drawn, all in one instanced call (default 1024)");
+    app.add_option("--padding", padding, "Texels of edge padding around each image (default 4)");
+
+    app.init(argc, argv);
+
+    trif::AtlasBuilder atlas(use_array ? trif::AtlasBuilder::Mode::Array : trif::AtlasBuilder::Mode::Atlas,
+                             padding);
+
+    atlas.add(ASSETS_DIR"wall.jpg");
+    atlas.add(ASSETS_DIR"rabbit.jpg");
+
+    std::mt19937 rng(42);
+    for (int i = 0; i < sprites; i++) {
+        int w = 16 + rng() % 112, h = 16 + rng() % 112;
+        std::vector<unsigned char> pixels = make_sprite(w, h, rng);
+        atlas.add(pixels.data(), w, h);
+    }
+
+    if (!atlas.build())
+        return 1;
+    atlas.print_stats();
+
+    // region table as an RGBA32F buffer texture
+    std::vector<float> table = atlas.table();
+    GLuint table_buffer, table_texture;
+    glGenBuffers(1, &table_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, table_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, table.size() * sizeof(float), table.data(), GL_STATIC_DRAW);
+    glGenTextures(1, &table_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, table_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, table_buffer);
+
+    // lay the quads out on a grid, every one picking an image in turn
+    const int n_regions = static_cast<int>(atlas.regions().size());
+    const int cols = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count))));
+    const float cell = 2.0f / cols;
+
+    std::vector<float> instances;
+    for (int i = 0; i < count; i++) {
+        float rect[5] = {-1.0f + (i % cols) * cell, 1.0f - (i / cols + 1) * cell,
+                         cell * 0.9f, cell * 0.9f, static_cast<float>(i % n_regions)};
+        instances.insert(instances.end(), rect, rect + 5);
+    }
+
+    GLuint vao, instance_buffer;
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &instance_buffer);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(float), instances.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(4 * sizeof(float)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(0, 1);
+    glVertexAttribDivisor(1, 1);
+
+    trif::ShaderSourceTemplate fs_template(fs);
+    trif::Program<
+        trif::Shaders<GL_VERTEX_SHADER>,
+        trif::Shaders<GL_FRAGMENT_SHADER>
+    > program(vs, fs_template.specialize({
+        {"SAMPLER", use_array ? "sampler2DArray" : "sampler2D"},
+        {"COORD", use_array ? "TexCoord" : "TexCoord.xy"}}));
+
+    app.main_loop([&]() {
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        program.use();
+        program.uniform("atlas", 0);
+        program.uniform("regions", 1);
+
+        // one bind, one draw, whatever the number of images
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(atlas.target(), atlas.texture());
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_BUFFER, table_texture);
+
+        glBindVertexArray(vao);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+
+        glActiveTexture(GL_TEXTURE0);
+    });
+
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &instance_buffer);
+    glDeleteBuffers(1, &table_buffer);
+    glDeleteTextures(1, &table_texture);
+
+    return 0;
+}
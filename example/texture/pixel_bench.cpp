@@ -0,0 +1,115 @@
+// Times the trif::pixel conversions of every instruction set against the converters
+// stb_image applies while loading, e.g.
+//
+//   pixel_bench --size 4096 --repeat 5
+//
+// stb's converters are internal to the translation unit defining its implementation,
+// which is this one. stb has no premultiplication, the scalar kernel stands for it.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "CLI11.hpp"
+#include "pixel.hpp"
+
+/// Best time of `repeat` runs of `run`, each after an untimed `prepare`
+static double best_ms(int repeat, const std::function<void()>& prepare, const std::function<void()>& run)
+{
+    double best = 1e30;
+    for (int i = 0; i < repeat; i++) {
+        prepare();
+        auto start = std::chrono::steady_clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, const char **argv)
+{
+    CLI::App app("pixel_bench");
+
+    int size = 4096;
+    int repeat = 5;
+
+    app.add_option("--size", size, "Side of the square image converted (default 4096)");
+    app.add_option("--repeat", repeat, "Runs of each conversion, the best one is kept (default 5)");
+
+    CLI11_PARSE(app, argc, argv);
+
+    const size_t n = static_cast<size_t>(size) * size;
+    std::vector<trif::pixel::Isa> isas;
+    for (auto isa : {trif::pixel::Isa::Scalar, trif::pixel::Isa::SSE2, trif::pixel::Isa::AVX2}) {
+        if (static_cast<int>(isa) <= static_cast<int>(trif::pixel::detect_isa()))
+            isas.push_back(isa);
+    }
+
+    std::mt19937 rng(42);
+    std::vector<uint8_t> rgb(n * 3), rgba(n * 4), work(n * 4);
+    for (auto& c : rgb)
+        c = static_cast<uint8_t>(rng());
+    for (auto& c : rgba)
+        c = static_cast<uint8_t>(rng());
+    std::vector<float> linear(n * 4);
+    trif::pixel::srgb_to_linear(rgba.data(), linear.data(), n, 4);
+
+    std::cout << "Converting " << size << "x" << size << " images, best of " << repeat
+              << ", widest instruction set " << trif::pixel::isa_name(trif::pixel::detect_isa()) << ":\n";
+
+    // bytes read and written by a conversion, for the throughput
+    auto report = [&](const std::string& name, const char *reference, double reference_ms, size_t bytes,
+                      const std::function<void()>& prepare, const std::function<void()>& run) {
+        std::cout << "  " << std::left << std::setw(16) << name << std::setw(8) << reference << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(9) << reference_ms << " ms\n";
+        for (auto isa : isas) {
+            trif::pixel::set_isa(isa);
+            double ms = best_ms(repeat, prepare, run);
+            std::cout << "  " << std::left << std::setw(16) << "" << std::setw(8) << trif::pixel::isa_name(isa)
+                      << std::right << std::setw(9) << ms << " ms" << std::setw(8) << bytes / ms / 1.0e6 << " GB/s"
+                      << std::setw(8) << reference_ms / ms << "x\n";
+        }
+        trif::pixel::set_isa(trif::pixel::detect_isa());
+    };
+
+    // stb converts buffers it allocated itself and frees them
+    unsigned char *owned = nullptr;
+    auto own_copy = [&](const void *src, size_t bytes) {
+        owned = static_cast<unsigned char *>(malloc(bytes));
+        memcpy(owned, src, bytes);
+    };
+
+    double stb_ms = best_ms(repeat, [&] { own_copy(rgb.data(), rgb.size()); },
+        [&] { stbi_image_free(stbi__convert_format(owned, 3, 4, size, size)); });
+    report("rgb -> rgba", "stb", stb_ms, n * 7, [] {},
+        [&] { trif::pixel::rgb_to_rgba(rgb.data(), work.data(), n); });
+
+    stb_ms = best_ms(repeat, [] {}, [&] { stbi__vertical_flip(rgba.data(), size, size, 4); });
+    report("vertical flip", "stb", stb_ms, n * 8, [] {},
+        [&] { trif::pixel::flip_vertical(rgba.data(), size, size, 4); });
+
+    // stb linearizes with a 2.2 power rather than the sRGB curve, at the same cost
+    stb_ms = best_ms(repeat, [&] { own_copy(rgba.data(), rgba.size()); },
+        [&] { stbi_image_free(stbi__ldr_to_hdr(owned, size, size, 4)); });
+    report("srgb -> linear", "stb", stb_ms, n * 20, [] {},
+        [&] { trif::pixel::srgb_to_linear(rgba.data(), linear.data(), n, 4); });
+
+    stb_ms = best_ms(repeat, [&] { own_copy(linear.data(), linear.size() * sizeof(float)); },
+        [&] { stbi_image_free(stbi__hdr_to_ldr(reinterpret_cast<float *>(owned), size, size, 4)); });
+    report("linear -> srgb", "stb", stb_ms, n * 20, [] {},
+        [&] { trif::pixel::linear_to_srgb(linear.data(), work.data(), n, 4); });
+
+    trif::pixel::set_isa(trif::pixel::Isa::Scalar);
+    double scalar_ms = best_ms(repeat, [&] { work = rgba; }, [&] { trif::pixel::premultiply_alpha(work.data(), n); });
+    report("premultiply", "scalar", scalar_ms, n * 8, [&] { work = rgba; },
+        [&] { trif::pixel::premultiply_alpha(work.data(), n); });
+
+    return 0;
+}
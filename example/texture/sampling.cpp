@@ -0,0 +1,192 @@
+// Compares sampling the stb RGBA8 texture against block compressed ones, e.g.
+//
+//   sampling -n 400 --compressed wall.ktx2 --compressed wall.dds
+//
+// Every frame draws --passes full screen quads with one texture, the textures take
+// turns, and each of them reports GPU time, texel rate, memory and the texel data it
+// asks the sampler for.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize.h>
+
+#include <array>
+#include <iomanip>
+
+#include "application.hpp"
+#include "compressed_texture.hpp"
+#include "mipmap.hpp"
+
+const std::string vs = R"(
+    #version 330 core
+    uniform float scale;
+    out vec2 uv;
+
+    void main()
+    {
+        // full screen triangle
+        vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        uv = pos * scale;
+        gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+    }
+)";
+
+const std::string fs = R"(
+    #version 330 core
+    uniform sampler2D tex;
+    in vec2 uv;
+    out vec4 FragColor;
+
+    void main()
+    {
+        FragColor = texture(tex, uv);
+    }
+)";
+
+struct Sampled {
+    std::string name;
+    GLuint texture;
+    int width;
+    int height;
+    size_t bytes;
+
+    static constexpr size_t QUERIES = 4;
+    std::array<GLuint, QUERIES> queries{};
+    std::array<bool, QUERIES> issued{};
+    size_t results{0};
+    size_t frames{0};
+    double gpu_ms{0.0};
+};
+
+/// Results dropped per texture, the first draws pay for first use of the texture
+const size_t WARMUP_FRAMES = 2;
+
+int main(int argc, const char **argv)
+{
+    trif::Application app("sampling");
+
+    std::vector<std::string> compressed;
+    int passes = 16;
+    float scale = 1.0f;
+
+    app.add_option("--compressed", compressed, "KTX2 or DDS textures to compare with the RGBA8 wall.jpg");
+    app.add_option("--passes", passes, "Full screen quads drawn per frame (default 16)");
+    app.add_option("--scale", scale, "Texture repeats across the window, > 1 minifies (default 1)");
+
+    app.init(argc, argv);
+
+    std::vector<Sampled> textures;
+
+    // the stb path: 8-bit RGBA with driver mipmaps
+    {
+        int width, height, channels;
+        unsigned char *data = stbi_load(ASSETS_DIR"wall.jpg", &width, &height, &channels, 4);
+        if (!data) {
+            std::cerr << "Failed to load wall.jpg" << std::endl;
+            return 1;
+        }
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, trif::mip_levels(width, height), GL_RGBA8, width, height);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        stbi_image_free(data);
+
+        size_t bytes = 0;
+        for (int level = 0; level < trif::mip_levels(width, height); level++)
+            bytes += static_cast<size_t>(std::max(1, width >> level)) * std::max(1, height >> level) * 4;
+
+        textures.push_back({"RGBA8 (stb)", texture, width, height, bytes});
+    }
+
+    for (const auto& path : compressed) {
+        trif::CompressedImage image;
+        if (!trif::load_compressed(path, image))
+            continue;
+
+        GLuint texture = trif::upload_compressed(image);
+        if (!texture)
+            continue;
+
+        textures.push_back({std::string(trif::format_name(image.format)) + " (" + path + ")",
+                            texture, image.width, image.height, image.bytes()});
+    }
+
+    trif::Program<
+        trif::Shaders<GL_VERTEX_SHADER>,
+        trif::Shaders<GL_FRAGMENT_SHADER>
+    > program(vs, fs);
+
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+
+    for (auto& t : textures) {
+        glBindTexture(GL_TEXTURE_2D, t.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glGenQueries(Sampled::QUERIES, t.queries.data());
+    }
+
+    size_t frame = 0;
+
+    app.main_loop([&]() {
+        Sampled& t = textures[frame % textures.size()];
+        size_t slot = (frame / textures.size()) % Sampled::QUERIES;
+
+        // the query of this slot was issued QUERIES turns ago, it is done by now
+        if (t.issued[slot]) {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(t.queries[slot], GL_QUERY_RESULT, &ns);
+            if (t.results++ >= WARMUP_FRAMES) {
+                t.gpu_ms += ns / 1e6;
+                t.frames++;
+            }
+        }
+
+        program.use();
+        glUniform1f(program.uniform("scale"), scale);
+        glBindVertexArray(vao);
+        glBindTexture(GL_TEXTURE_2D, t.texture);
+
+        glBeginQuery(GL_TIME_ELAPSED, t.queries[slot]);
+        for (int i = 0; i < passes; i++)
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        glEndQuery(GL_TIME_ELAPSED);
+        t.issued[slot] = true;
+
+        frame++;
+    });
+
+    // every fragment takes one trilinear sample
+    const double fragments = static_cast<double>(app.getWindowWidth()) * app.getWindowHeight() * passes;
+
+    std::cout << std::left << std::setw(32) << "texture" << std::right
+              << std::setw(12) << "memory KiB" << std::setw(8) << "bpp"
+              << std::setw(10) << "ms/frame" << std::setw(12) << "Gtexels/s"
+              << std::setw(12) << "texel GB/s" << '\n' << std::fixed;
+
+    for (auto& t : textures) {
+        // bits per texel over the whole chain, a full chain adds a third to the base level
+        double bpp = t.bytes * 8.0 / (t.width * t.height * 4.0 / 3.0);
+        double ms = t.frames ? t.gpu_ms / t.frames : 0.0;
+        double gtexels = ms > 0.0 ? fragments / (ms * 1e6) : 0.0;
+
+        std::cout << std::left << std::setw(32) << t.name << std::right
+                  << std::setw(12) << t.bytes / 1024 << std::setw(8) << std::setprecision(1) << bpp
+                  << std::setw(10) << std::setprecision(3) << ms
+                  << std::setw(12) << std::setprecision(2) << gtexels
+                  << std::setw(12) << gtexels * bpp / 8.0 << '\n';
+
+        glDeleteQueries(Sampled::QUERIES, t.queries.data());
+        glDeleteTextures(1, &t.texture);
+    }
+    std::cout << std::defaultfloat;
+
+    glDeleteVertexArrays(1, &vao);
+
+    return 0;
+}
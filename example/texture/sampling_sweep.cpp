@@ -0,0 +1,363 @@
+// Sweeps texture sampling throughput over filters, mip mapping, texture sizes and
+// formats and access patterns, e.g.
+//
+//   sampling_sweep
+//   sampling_sweep --sizes 512,4096 --formats rgba8,bc1 --patterns minified --taps 8
+//
+// The textures are wall.jpg resized to every size, with a box filtered mip chain, and
+// encoded in-process to the block compressed formats the context samples natively. The
+// cases are named size/format/mips/filter/pattern, where the mips are off when only the
+// base level is sampled and the filters are:
+//
+//   nearest    GL_NEAREST, GL_NEAREST_MIPMAP_NEAREST with mips
+//   linear     GL_LINEAR, GL_LINEAR_MIPMAP_NEAREST with mips
+//   trilinear  GL_LINEAR_MIPMAP_LINEAR, with mips only
+//   aniso      trilinear with 16x anisotropy, with mips only and where supported
+//
+// and the access patterns:
+//
+//   coherent   one texel per pixel
+//   random     a random texel for every sample, at the level of one texel per pixel
+//   minified   --minify texels per pixel across and a quarter of that down, the 4:1
+//              footprint of a floor seen at a grazing angle
+//
+// Every fragment takes --taps samples, and Gtexels/s counts these filtered samples per
+// second of GPU time.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize.h>
+
+#include <iomanip>
+#include <map>
+
+#include "application.hpp"
+#include "block_compress.hpp"
+#include "compressed_texture.hpp"
+#include "mipmap.hpp"
+
+const std::string vs = R"(
+    #version 330 core
+    uniform vec2 scale;
+    out vec2 uv;
+
+    void main()
+    {
+        // full screen triangle
+        vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        uv = pos * scale;
+        gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+    }
+)";
+
+const std::string fs = R"(
+    #version 330 core
+    uniform sampler2D tex;
+    uniform int taps;
+    in vec2 uv;
+    out vec4 FragColor;
+
+    // PCG hash
+    uint hash(uint x)
+    {
+        x = x * 747796405u + 2891336453u;
+        x = ((x >> ((x >> 28u) + 4u)) ^ x) * 277803737u;
+        return (x >> 22u) ^ x;
+    }
+
+    void main()
+    {
+        vec2 dx = dFdx(uv), dy = dFdy(uv);
+        uint seed = (uint(gl_FragCoord.y) * 8192u + uint(gl_FragCoord.x)) * uint(taps);
+        vec4 sum = vec4(0.0);
+
+        for (int i = 0; i < taps; i++) {
+            ${SAMPLE}
+        }
+        FragColor = sum / float(taps);
+    }
+)";
+
+const std::map<std::string, std::string> samples = {
+    // taps half a pixel apart
+    {"coherent", "sum += texture(tex, uv + float(i) * 0.5 * dx);"},
+    {"minified", "sum += texture(tex, uv + float(i) * 0.5 * dx);"},
+    {"random", "uint h = hash(seed + uint(i));\n"
+               "            sum += textureGrad(tex, vec2(h, hash(h)) / 4294967296.0, dx, dy);"},
+};
+
+enum class Filter { Nearest, Linear, Trilinear, Aniso };
+
+struct Case {
+    std::string name;
+    int size;
+    std::string format;
+    bool mips;
+    Filter filter;
+    std::string pattern;
+
+    size_t frames{0};
+    double gpu_ms{0.0};
+};
+
+/// A texture of every level of one size in one format
+struct Texture {
+    GLuint id{0};
+    /// bits per texel of the base level
+    double bpp{0.0};
+};
+
+/// Frames drawn before every case is timed
+const size_t WARMUP_FRAMES = 3;
+
+int main(int argc, const char **argv)
+{
+    trif::Application app("sampling_sweep");
+
+    std::vector<int> sizes = {1024};
+    std::vector<std::string> formats = {"rgba8", "rgba16f", "bc1", "bc7", "etc2"};
+    std::vector<std::string> mips = {"off", "on"};
+    std::vector<std::string> filters = {"nearest", "linear", "trilinear", "aniso"};
+    std::vector<std::string> patterns = {"coherent", "random", "minified"};
+    int taps = 4;
+    float minify = 16.0f;
+    size_t case_frames = 10;
+
+    const std::map<std::string, Filter> filter_names = {
+        {"nearest", Filter::Nearest}, {"linear", Filter::Linear},
+        {"trilinear", Filter::Trilinear}, {"aniso", Filter::Aniso}
+    };
+    const std::map<std::string, trif::CompressedFormat> compressed_names = {
+        {"bc1", trif::CompressedFormat::BC1}, {"bc7", trif::CompressedFormat::BC7},
+        {"etc2", trif::CompressedFormat::ETC2_RGB}
+    };
+
+    app.add_option("--sizes", sizes, "Sides of the square textures (default 1024)")->delimiter(',');
+    app.add_option("--formats", formats, "Formats among rgba8, rgba16f, bc1, bc7 and etc2 (default all)")
+            ->delimiter(',')
+            ->check(CLI::IsMember({"rgba8", "rgba16f", "bc1", "bc7", "etc2"}));
+    app.add_option("--mips", mips, "Mip mapping off, on or both with off,on (default off,on)")
+            ->delimiter(',')
+            ->check(CLI::IsMember({"off", "on"}));
+    app.add_option("--filters", filters, "Filters among nearest, linear, trilinear and aniso (default all)")
+            ->delimiter(',')
+            ->check(CLI::IsMember({"nearest", "linear", "trilinear", "aniso"}));
+    app.add_option("--patterns", patterns, "Access patterns among coherent, random and minified (default all)")
+            ->delimiter(',')
+            ->check(CLI::IsMember({"coherent", "random", "minified"}));
+    app.add_option("--taps", taps, "Samples per fragment (default 4)");
+    app.add_option("--minify", minify, "Texels per pixel across of the minified pattern (default 16)");
+    app.add_option("--case-frames", case_frames, "Frames timed per case (default 10)");
+
+    app.init(argc, argv);
+
+    // frames must not wait for the display
+    glfwSwapInterval(0);
+
+    const bool has_aniso = GLEW_EXT_texture_filter_anisotropic || GLEW_ARB_texture_filter_anisotropic;
+    GLfloat max_anisotropy = 1.0f;
+    if (has_aniso)
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropy);
+
+    std::vector<Case> cases;
+    for (int size : sizes) {
+        for (auto& format : formats) {
+            auto compressed = compressed_names.find(format);
+            if (compressed != compressed_names.end() && !trif::format_supported(compressed->second))
+                continue;
+            for (auto& mip : mips) {
+                for (auto& filter : filters) {
+                    // anisotropic filtering is defined over the mip chain
+                    if ((filter == "trilinear" || filter == "aniso") && mip == "off")
+                        continue;
+                    if (filter == "aniso" && !has_aniso)
+                        continue;
+                    for (auto& pattern : patterns)
+                        cases.push_back({std::to_string(size) + "/" + format + "/mips_" + mip + "/" + filter + "/" +
+                                         pattern, size, format, mip == "on", filter_names.at(filter), pattern});
+                }
+            }
+        }
+    }
+    if (!has_aniso)
+        std::cout << "Anisotropic filtering unsupported, skipping the aniso cases" << std::endl;
+    for (auto& c : compressed_names)
+        if (std::count(formats.begin(), formats.end(), c.first) && !trif::format_supported(c.second))
+            std::cout << c.first << " textures unsupported, skipping them" << std::endl;
+    if (cases.empty()) {
+        std::cerr << "No case to run" << std::endl;
+        return 1;
+    }
+
+    int image_width, image_height, channels;
+    unsigned char *image = stbi_load(ASSETS_DIR"wall.jpg", &image_width, &image_height, &channels, 4);
+    if (!image) {
+        std::cerr << "Failed to load wall.jpg" << std::endl;
+        return 1;
+    }
+
+    trif::ThreadPool pool;
+    trif::MipBuilder builder(&pool);
+
+    // makes the texture of a size and format, with all its levels
+    auto make_texture = [&](int size, const std::string& format) {
+        std::vector<unsigned char> resized(static_cast<size_t>(size) * size * 4);
+        stbir_resize_uint8(image, image_width, image_height, 0, resized.data(), size, size, 0, 4);
+        trif::MipChain chain = builder.build(resized.data(), size, size, 4, trif::MipFilter::Box);
+
+        Texture t;
+        auto compressed = compressed_names.find(format);
+        if (compressed != compressed_names.end()) {
+            trif::CompressedImage encoded = trif::compress_chain(chain, compressed->second, false, &pool);
+            t.id = trif::upload_compressed(encoded);
+            t.bpp = trif::block_bytes(compressed->second) * 8 / 16.0;
+        } else {
+            const GLenum internal_format = format == "rgba16f" ? GL_RGBA16F : GL_RGBA8;
+            glGenTextures(1, &t.id);
+            glBindTexture(GL_TEXTURE_2D, t.id);
+            glTexStorage2D(GL_TEXTURE_2D, chain.levels(), internal_format, size, size);
+            trif::MipBuilder::upload(chain);
+            t.bpp = internal_format == GL_RGBA16F ? 64 : 32;
+        }
+        return t;
+    };
+
+    // the sampler of every filter, with and without mips
+    auto make_sampler = [&](Filter filter, bool mipped) {
+        GLuint sampler;
+        glGenSamplers(1, &sampler);
+        GLenum min = GL_LINEAR, mag = GL_LINEAR;
+        switch (filter) {
+            case Filter::Nearest:
+                min = mipped ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST;
+                mag = GL_NEAREST;
+                break;
+            case Filter::Linear:
+                min = mipped ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR;
+                break;
+            case Filter::Trilinear:
+            case Filter::Aniso:
+                min = mipped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+                break;
+        }
+        glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, min);
+        glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, mag);
+        glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        if (filter == Filter::Aniso)
+            glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(16.0f, max_anisotropy));
+        return sampler;
+    };
+
+    std::map<std::pair<int, bool>, GLuint> samplers;
+    for (auto& c : cases) {
+        auto key = std::make_pair(static_cast<int>(c.filter), c.mips);
+        if (!samplers.count(key))
+            samplers[key] = make_sampler(c.filter, c.mips);
+    }
+
+    using ProgramType = trif::Program<trif::Shaders<GL_VERTEX_SHADER>, trif::Shaders<GL_FRAGMENT_SHADER>>;
+    trif::ShaderSourceTemplate fs_template(fs);
+    std::map<std::string, std::unique_ptr<ProgramType>> programs;
+    for (auto& pattern : patterns)
+        if (!programs.count(pattern))
+            programs[pattern].reset(new ProgramType(vs, fs_template.specialize({{"SAMPLE", samples.at(pattern)}})));
+
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+
+    std::vector<GLuint> queries(case_frames);
+    glGenQueries(queries.size(), queries.data());
+
+    const int width = app.getWindowWidth();
+    const int height = app.getWindowHeight();
+
+    std::cout << "Sampling " << width << "x" << height << " with " << taps << " taps in " << cases.size()
+              << " cases, " << case_frames << " frames each" << std::endl;
+
+    size_t current = 0, frame = 0;
+    std::string texture_key;
+    Texture texture;
+    std::map<std::string, double> bpp;
+
+    app.main_loop([&]() {
+        if (current == cases.size()) {
+            glfwSetWindowShouldClose(app.getWindow(), true);
+            return;
+        }
+
+        Case& c = cases[current];
+        const std::string key = std::to_string(c.size) + "/" + c.format;
+        if (key != texture_key) {
+            if (texture.id)
+                glDeleteTextures(1, &texture.id);
+            texture = make_texture(c.size, c.format);
+            texture_key = key;
+            bpp[key] = texture.bpp;
+        }
+
+        ProgramType& program = *programs[c.pattern];
+        program.use();
+
+        // one texel per pixel, or the minified footprint
+        glm::vec2 scale(static_cast<float>(width) / c.size, static_cast<float>(height) / c.size);
+        if (c.pattern == "minified")
+            scale *= glm::vec2(minify, minify / 4.0f);
+        program.uniform("scale", scale);
+        program.uniform("taps", taps);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        glBindSampler(0, samplers[std::make_pair(static_cast<int>(c.filter), c.mips)]);
+        glBindVertexArray(vao);
+
+        const bool timed = frame >= WARMUP_FRAMES;
+        if (timed)
+            glBeginQuery(GL_TIME_ELAPSED, queries[frame - WARMUP_FRAMES]);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        if (timed)
+            glEndQuery(GL_TIME_ELAPSED);
+        glBindSampler(0, 0);
+
+        if (++frame == WARMUP_FRAMES + case_frames) {
+            for (auto query : queries) {
+                GLuint64 ns = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+                c.gpu_ms += ns / 1e6;
+            }
+            c.frames = case_frames;
+
+            frame = 0;
+            current++;
+        }
+    });
+
+    const double texels = static_cast<double>(width) * height * taps;
+
+    std::cout << std::left << std::setw(44) << "case" << std::right << std::setw(8) << "bpp"
+              << std::setw(10) << "ms/frame" << std::setw(12) << "Gtexels/s" << '\n' << std::fixed;
+
+    for (auto& c : cases) {
+        std::cout << std::left << std::setw(44) << c.name << std::right;
+        if (!c.frames) {
+            std::cout << "  not run\n";
+            continue;
+        }
+
+        const double ms = c.gpu_ms / c.frames;
+        std::cout << std::setw(8) << std::setprecision(1) << bpp[std::to_string(c.size) + "/" + c.format]
+                  << std::setw(10) << std::setprecision(3) << ms
+                  << std::setw(12) << std::setprecision(2) << (ms > 0.0 ? texels / (ms * 1e6) : 0.0) << '\n';
+    }
+    std::cout << std::defaultfloat;
+
+    stbi_image_free(image);
+    if (texture.id)
+        glDeleteTextures(1, &texture.id);
+    for (auto& s : samplers)
+        glDeleteSamplers(1, &s.second);
+    glDeleteQueries(queries.size(), queries.data());
+    glDeleteVertexArrays(1, &vao);
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+// Offline encoder turning images into block compressed KTX2/DDS textures, e.g.
+//
+//   texenc -f bc7 -o out/ assets/*.jpg
+//
+// The container is picked from --container, DDS only holds BCn formats.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize.h>
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "CLI11.hpp"
+#include "block_compress.hpp"
+
+int main(int argc, const char **argv)
+{
+    CLI::App app("texenc");
+
+    std::vector<std::string> inputs;
+    std::string output_dir = ".";
+    std::string container = "ktx2";
+    trif::CompressedFormat format = trif::CompressedFormat::BC7;
+    trif::MipFilter filter = trif::MipFilter::Box;
+    bool mipmaps = true;
+    bool srgb = false;
+
+    app.add_option("inputs", inputs, "Images to encode")->required()->check(CLI::ExistingFile);
+    app.add_option("-o,--output", output_dir, "Output directory (default .)");
+    app.add_option("-f,--format", format, "bc1, bc3, bc7, etc2 or etc2a (default bc7)")
+        ->transform(CLI::CheckedTransformer(std::map<std::string, trif::CompressedFormat>{
+            {"bc1", trif::CompressedFormat::BC1},
+            {"bc3", trif::CompressedFormat::BC3},
+            {"bc7", trif::CompressedFormat::BC7},
+            {"etc2", trif::CompressedFormat::ETC2_RGB},
+            {"etc2a", trif::CompressedFormat::ETC2_RGBA}}));
+    app.add_option("-c,--container", container, "ktx2 or dds (default ktx2)")
+        ->check(CLI::IsMember({"ktx2", "dds"}));
+    app.add_option("--mip-filter", filter, "box, kaiser or mitchell (default box)")
+        ->transform(CLI::CheckedTransformer(std::map<std::string, trif::MipFilter>{
+            {"box", trif::MipFilter::Box},
+            {"kaiser", trif::MipFilter::Kaiser},
+            {"mitchell", trif::MipFilter::Mitchell}}));
+    app.add_flag("--mipmap,!--no-mipmap", mipmaps, "Whether to store the mip chain or the base level only");
+    app.add_flag("--srgb", srgb, "Tag the texture as sRGB encoded");
+
+    CLI11_PARSE(app, argc, argv);
+
+    trif::ThreadPool pool;
+    trif::MipBuilder builder(&pool);
+    int failures = 0;
+
+    for (const auto& input : inputs) {
+        int width, height, channels;
+        unsigned char *pixels = stbi_load(input.c_str(), &width, &height, &channels, 4);
+        if (!pixels) {
+            std::cerr << input << ": " << stbi_failure_reason() << std::endl;
+            failures++;
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        trif::MipChain chain;
+        if (mipmaps) {
+            chain = builder.build(pixels, width, height, 4, filter);
+        } else {
+            chain.width = width;
+            chain.height = height;
+            chain.channels = 4;
+            chain.offsets = {0};
+            chain.data.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+        }
+        stbi_image_free(pixels);
+
+        trif::CompressedImage image = trif::compress_chain(chain, format, srgb, &pool);
+        std::vector<unsigned char> bytes = container == "dds" ? trif::write_dds(image) : trif::write_ktx2(image);
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        if (bytes.empty()) {
+            failures++;
+            continue;
+        }
+
+        std::string name = input.substr(input.find_last_of('/') + 1);
+        std::string path = output_dir + "/" + name.substr(0, name.find_last_of('.')) + "." + container;
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+        if (!file) {
+            std::cerr << "Failed to write " << path << std::endl;
+            failures++;
+            continue;
+        }
+
+        std::cout << path << ": " << width << "x" << height << " " << trif::format_name(format)
+                  << ", " << image.levels.size() << " levels, " << image.bytes() / 1024 << " KiB vs "
+                  << chain.data.size() / 1024 << " KiB RGBA8 (" << std::fixed << std::setprecision(1)
+                  << static_cast<double>(chain.data.size()) / image.bytes() << "x), "
+                  << ms << " ms" << std::defaultfloat << std::endl;
+    }
+
+    return failures ? 1 : 0;
+}
@@ -1,12 +1,10 @@
-#include <GLFW/glfw3.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize.h>
 
 #include "application.hpp"
-
-
-void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow *window);
+#include "texture_loader.hpp"
 
 const std::string vs = R"(
     #version 330 core
@@ -41,42 +39,33 @@ const std::string fs = R"(
     }
 )";
 
-int main(int argc, char **argv)
+int main(int argc, const char **argv)
 {
-    trif::Option generate_mipmap = {
-        "--mipmap,!--no-mipmap",
-        "Whether to generate MIPMAP or not",
-        trif::OptionType::FlagOnly
-    };
-
-    trif::Application app("texture_wrap", argc, argv, {&generate_mipmap});
-
-    trif::Config conf = app.getConfig();
-
-    bool has_mipmap = app.get_option_value<bool>(&generate_mipmap, true);
-
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(conf.window_size.first, conf.window_size.second, "LearnOpenGL", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    trif::Application app("texture_wrap");
+
+    bool has_mipmap = true;
+    trif::MipBackend mip_backend = trif::MipBackend::Driver;
+    trif::MipFilter mip_filter = trif::MipFilter::Box;
+    std::string cache;
+    bool mip_bench = false;
+    int upload_budget = 0;
+
+    app.add_flag("--mipmap,!--no-mipmap", has_mipmap, "Whether to generate MIPMAP or not");
+    app.add_option("--mip-backend", mip_backend, "Who builds the mip chain: driver, cpu or compute (default driver)")
+        ->transform(CLI::CheckedTransformer(std::map<std::string, trif::MipBackend>{
+            {"driver", trif::MipBackend::Driver},
+            {"cpu", trif::MipBackend::CPU},
+            {"compute", trif::MipBackend::Compute}}));
+    app.add_option("--mip-filter", mip_filter, "Filter of the cpu backend: box, kaiser or mitchell (default box)")
+        ->transform(CLI::CheckedTransformer(std::map<std::string, trif::MipFilter>{
+            {"box", trif::MipFilter::Box},
+            {"kaiser", trif::MipFilter::Kaiser},
+            {"mitchell", trif::MipFilter::Mitchell}}));
+    app.add_option("--cache,--mip-cache", cache, "Directory caching decoded pixels and the mip chains built by the cpu backend");
+    app.add_flag("--mip-bench", mip_bench, "Time every mip backend against glGenerateMipmap before rendering");
+    app.add_option("--upload-budget", upload_budget, "Spread the upload over frames, at most N KiB per frame (default 0, all at once)");
+
+    app.init(argc, argv);
 
     // build and compile our shader zprogram
     // ------------------------------------
@@ -128,11 +117,40 @@ int main(int argc, char **argv)
     glEnableVertexAttribArray(2);
 
 
-    // load and create a texture 
+    // load and create a texture
     // -------------------------
-    unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture); // all upcoming GL_TEXTURE_2D operations now have effect on this texture object
+    // The image is decoded on worker threads and uploaded through a pixel-unpack buffer,
+    // so the first frames are drawn with texture 0 (black) until it becomes ready.
+    // The scheduler must outlive the loader
+    std::unique_ptr<trif::UploadScheduler> scheduler;
+    trif::TextureLoader loader;
+    if (upload_budget > 0) {
+        scheduler.reset(new trif::UploadScheduler(static_cast<size_t>(upload_budget) * 1024));
+        loader.use_scheduler(scheduler.get());
+    }
+    // The uploading image is 3-channeled, so let's force it to be treated as 4-channeled
+    trif::TextureLoader::Options options;
+    options.channels = 4;
+    options.mipmaps = has_mipmap;
+    options.mip_backend = mip_backend;
+    options.mip_filter = mip_filter;
+    options.cache_dir = cache;
+
+    if (mip_bench) {
+        int width, height, channels;
+        unsigned char *data = stbi_load(ASSETS_DIR"wall.jpg", &width, &height, &channels, 4);
+        if (data) {
+            trif::MipBuilder builder;
+            builder.benchmark(data, width, height);
+        }
+        stbi_image_free(data);
+    }
+
+    trif::TextureHandle texture = loader.load(ASSETS_DIR"wall.jpg", options);
+    // golden and benchmark runs must not depend on how fast the image decodes
+    if (app.get_config().headless || app.get_config().fixed_step > 0.0)
+        loader.finish();
+
     // set the texture wrapping parameters
 //    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
 //    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -147,40 +165,26 @@ int main(int argc, char **argv)
 //    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 //    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    // set texture filtering parameters
-    // Note that unless you want mipmaps, do not set MIN_FILTER to mipmap filters such as
-    // GL_NEAREST_MIPMAP_LINEAR, neither do not leave it alone, or your texture will be
-    // entirely black
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // texture filtering parameters are set by the loader: GL_LINEAR_MIPMAP_LINEAR
+    // with --mipmap, otherwise GL_LINEAR. Note that unless you want mipmaps, do not set
+    // MIN_FILTER to mipmap filters such as GL_NEAREST_MIPMAP_LINEAR, neither do not
+    // leave it alone, or your texture will be entirely black
 
-    // load image, create texture and generate mipmaps
-    int width, height, nrChannels;
-
-    // The uploading image is 3-channeled, so let's force stbi_load() to treat it as 4-channeled
-    unsigned char *data = stbi_load(ASSETS_DIR"wall.jpg", &width, &height, &nrChannels, 4);
-    std::cout << "width height: " << width << "x" << height << ", Channels: " << nrChannels << '\n';
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        if (has_mipmap)
-            glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else
-    {
-        std::cout << "Failed to load texture" << std::endl;
-    }
-    stbi_image_free(data);
-
-    uint32_t frames = conf.n_frames;
+    bool reported = false;
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window) && frames)
-    {
-        // input
-        // -----
-        processInput(window);
+    app.main_loop([&]() {
+        // upload decoded images and publish the finished ones
+        loader.update();
+        if (scheduler)
+            scheduler->update();
+
+        if (texture.ready() && !reported) {
+            std::cout << "width height: " << texture.width() << "x" << texture.height()
+                      << ", Channels: " << texture.channels() << '\n';
+            reported = true;
+        }
 
         // render
         // ------
@@ -188,21 +192,17 @@ int main(int argc, char **argv)
         glClear(GL_COLOR_BUFFER_BIT);
 
         // bind Texture
-        glBindTexture(GL_TEXTURE_2D, texture);
+        glBindTexture(GL_TEXTURE_2D, texture.id());
 
         // render container
         program.use();
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    });
 
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-
-        if (!conf.forever)
-            frames--;
-    }
+    loader.print_stats();
+    if (scheduler)
+        scheduler->print_stats();
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
@@ -210,25 +210,5 @@ int main(int argc, char **argv)
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
 
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    // ------------------------------------------------------------------
-    glfwTerminate();
     return 0;
 }
-
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-// ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow *window)
-{
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
-}
-
-// glfw: whenever the window size changed (by OS or user resize) this callback function executes
-// ---------------------------------------------------------------------------------------------
-void framebuffer_size_callback(GLFWwindow* window, int width, int height)
-{
-    // make sure the viewport matches the new window dimensions; note that width and 
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
-}
@@ -0,0 +1,163 @@
+// Flies over a virtual texture at constant GPU memory, e.g.
+//
+//   virtual_texturing --gigapixel 65536         # generated 4 gigapixel image
+//   virtual_texturing --write-tiles /tmp/wall   # slice wall.jpg into page files
+//   virtual_texturing --tiles /tmp/wall         # stream the page files
+//
+// The camera zooms from the whole image down to a texel per pixel and back, so every
+// level of the page table gets exercised.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <sys/stat.h>
+
+#include "application.hpp"
+#include "virtual_texture.hpp"
+
+const std::string vs = R"(
+    #version 330 core
+    uniform vec4 view;      // center and half extent of the visible uv rect
+    out vec2 uv;
+
+    void main()
+    {
+        vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+        uv = view.xy + vec2(pos.x, -pos.y) * view.zw;
+        gl_Position = vec4(pos, 0.0, 1.0);
+    }
+)";
+
+const std::string fs = R"(
+    #version 330 core
+    ${VT}
+    in vec2 uv;
+    out vec4 FragColor;
+
+    void main()
+    {
+        FragColor = vt_sample(uv);
+    }
+)";
+
+const std::string feedback_fs = R"(
+    #version 330 core
+    ${VT}
+    in vec2 uv;
+    out uvec4 Feedback;
+
+    void main()
+    {
+        Feedback = vt_feedback(uv);
+    }
+)";
+
+int main(int argc, const char **argv)
+{
+    trif::Application app("virtual_texturing");
+
+    std::string image = ASSETS_DIR"wall.jpg";
+    std::string tiles;
+    std::string write_tiles;
+    int gigapixel = 0;
+    int cache_pages = 16;
+    int page_size = 128;
+
+    app.add_option("--image", image, "Image to view (default wall.jpg)");
+    app.add_option("--gigapixel", gigapixel, "View a generated N x N image instead, e.g. 65536");
+    app.add_option("--tiles", tiles, "Stream pages from a directory written by --write-tiles");
+    app.add_option("--write-tiles", write_tiles, "Write the pages of the viewed image to a directory and exit");
+    app.add_option("--cache-pages", cache_pages, "Physical cache of N x N pages, 2 to 256 (default 16)")
+        ->check(CLI::Range(2, 256));
+    app.add_option("--page-size", page_size, "Texels per page side (default 128)")
+        ->check(CLI::PositiveNumber);
+
+    app.init(argc, argv);
+
+    std::shared_ptr<trif::TileSource> source;
+    if (!tiles.empty()) {
+        auto directory = std::make_shared<trif::TileDirectorySource>(tiles);
+        if (!directory->valid())
+            return 1;
+        page_size = directory->page_size();
+        source = directory;
+    } else if (gigapixel > 0) {
+        source = std::make_shared<trif::ProceduralTileSource>(gigapixel, gigapixel);
+    } else {
+        auto decoded = std::make_shared<trif::ImageTileSource>(image);
+        if (!decoded->valid())
+            return 1;
+        source = decoded;
+    }
+
+    if (!write_tiles.empty()) {
+        mkdir(write_tiles.c_str(), 0755);
+        for (int level = 0; level < trif::VirtualTexture::level_count(source->width(), source->height(), page_size); level++)
+            mkdir((write_tiles + "/" + std::to_string(level)).c_str(), 0755);
+
+        bool ok = trif::VirtualTexture::write_tiles(*source, write_tiles, page_size,
+            [](const std::string& path, int size, const unsigned char *texels) {
+                return stbi_write_png(path.c_str(), size, size, 4, texels, size * 4) != 0;
+            });
+        std::cout << (ok ? "Wrote pages to " : "Failed to write pages to ") << write_tiles << std::endl;
+        return ok ? 0 : 1;
+    }
+
+    trif::VirtualTexture vt(source, cache_pages, page_size);
+
+    trif::ShaderSourceTemplate fs_template(fs), feedback_template(feedback_fs);
+    const trif::ShaderSourceTemplate::ParamsType params = {{"VT", trif::VirtualTexture::glsl()}};
+
+    trif::Program<
+        trif::Shaders<GL_VERTEX_SHADER>,
+        trif::Shaders<GL_FRAGMENT_SHADER>
+    > program(vs, fs_template.specialize(params));
+
+    trif::Program<
+        trif::Shaders<GL_VERTEX_SHADER>,
+        trif::Shaders<GL_FRAGMENT_SHADER>
+    > feedback(vs, feedback_template.specialize(params));
+
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    app.main_loop([&]() {
+        const int width = app.getWindowWidth(), height = app.getWindowHeight();
+
+        // zoom exponentially between the whole image and one texel per pixel
+        const float t = static_cast<float>(app.time());
+        const float full = 0.5f;
+        const float texel = 0.5f * width / std::max(source->width(), source->height());
+        const float zoom = 0.5f - 0.5f * std::cos(t * 0.3f);
+        const float half = full * std::pow(std::min(texel / full, 1.0f), zoom);
+        const glm::vec4 view(0.5f + 0.3f * std::sin(t * 0.11f) * (1.0f - 2.0f * half),
+                             0.5f + 0.3f * std::cos(t * 0.07f) * (1.0f - 2.0f * half),
+                             half, half * height / width);
+
+        vt.begin_feedback(width, height);
+        feedback.use();
+        feedback.uniform("view", view);
+        vt.bind(feedback, 0, true);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        vt.end_feedback();
+
+        vt.update();
+
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        program.use();
+        program.uniform("view", view);
+        vt.bind(program);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    });
+
+    vt.print_stats();
+
+    glDeleteVertexArrays(1, &vao);
+
+    return 0;
+}
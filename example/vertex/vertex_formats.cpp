@@ -0,0 +1,385 @@
+// Measures vertex throughput for the ways a mesh can be stored, e.g.
+//
+//   vertex_formats --grid 1024
+//   vertex_formats --filter 'float32|2_10_10_10' --case-frames 50
+//
+// The mesh is a grid of --grid x --grid vertices with a position, a normal and texture
+// coordinates each, and the cases are named format/layout/indices:
+//
+//   float32      32 bytes per vertex, as GearVertex and every example store them
+//   half         20 bytes, half floats
+//   snorm16      20 bytes, normalized shorts
+//   2_10_10_10   12 bytes, GL_INT_2_10_10_10_REV position and normal
+//
+//   interleaved  one buffer of whole vertices
+//   planar       one buffer per attribute
+//
+//   none         a triangle list of 6 vertices per quad without indices
+//   u16, u32     an indexed triangle list, u16 in chunks of at most 65535 vertices
+//   *_restart    a triangle strip per row, separated by the primitive restart index
+//
+// Mverts/s counts the vertices the draws fetch, i.e. the array elements or the
+// indices, and Mtris/s the triangles of the mesh, both per second of GPU time.
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <regex>
+
+#include <glm/gtc/packing.hpp>
+
+#include "application.hpp"
+
+const std::string vs = R"(
+    #version 330 core
+    layout(location = 0) in vec3 position;
+    layout(location = 1) in vec3 normal;
+    layout(location = 2) in vec2 uv;
+    out vec3 color;
+
+    void main()
+    {
+        gl_Position = vec4(position, 1.0);
+        color = (normal * 0.5 + 0.5) * (0.75 + 0.25 * uv.x);
+    }
+)";
+
+const std::string fs = R"(
+    #version 330 core
+    in vec3 color;
+    out vec4 FragColor;
+
+    void main()
+    {
+        FragColor = vec4(color, 1.0);
+    }
+)";
+
+/// One vertex attribute as glVertexAttribPointer takes it
+struct Attribute {
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    size_t bytes;
+};
+
+struct Format {
+    std::string name;
+    /// position, normal and texture coordinates
+    std::array<Attribute, 3> attributes;
+
+    size_t vertex_bytes() const {
+        return attributes[0].bytes + attributes[1].bytes + attributes[2].bytes;
+    }
+};
+
+enum class Indices { None, U16, U32 };
+
+struct Case {
+    std::string name;
+    const Format *format;
+    bool planar;
+    Indices indices;
+    bool restart;
+
+    size_t frames{0};
+    double gpu_ms{0.0};
+};
+
+/// Frames drawn before every case is timed
+const size_t WARMUP_FRAMES = 3;
+
+/// Writes the first a.size components of `v` as `a` stores them
+static void pack(const Attribute& a, const glm::vec4& v, uint8_t *dst)
+{
+    for (int i = 0; i < a.size; i++) {
+        switch (a.type) {
+            case GL_FLOAT: {
+                memcpy(dst + 4 * i, &v[i], 4);
+                break;
+            }
+            case GL_HALF_FLOAT: {
+                const uint16_t h = glm::packHalf1x16(v[i]);
+                memcpy(dst + 2 * i, &h, 2);
+                break;
+            }
+            case GL_SHORT: {
+                const uint16_t s = glm::packSnorm1x16(v[i]);
+                memcpy(dst + 2 * i, &s, 2);
+                break;
+            }
+            case GL_UNSIGNED_SHORT: {
+                const uint16_t s = glm::packUnorm1x16(v[i]);
+                memcpy(dst + 2 * i, &s, 2);
+                break;
+            }
+            case GL_INT_2_10_10_10_REV: {
+                const uint32_t p = glm::packSnorm3x10_1x2(v);
+                memcpy(dst, &p, 4);
+                return;
+            }
+        }
+    }
+}
+
+int main(int argc, const char **argv)
+{
+    trif::Application app("vertex_formats");
+
+    int grid = 512;
+    size_t case_frames = 30;
+    std::string filter;
+
+    // the u16 chunks need 2 rows of the grid at least
+    app.add_option("--grid", grid, "Vertices per side of the mesh, 2 to 32767 (default 512)")
+        ->check(CLI::Range(2, 32767));
+    app.add_option("--case-frames", case_frames, "Frames timed per case (default 30)");
+    app.add_option("--filter", filter, "Run the cases whose name matches the given regular expression only");
+
+    app.init(argc, argv);
+
+    // frames must not wait for the display
+    glfwSwapInterval(0);
+
+    const std::vector<Format> formats = {
+        {"float32", {{{3, GL_FLOAT, GL_FALSE, 12}, {3, GL_FLOAT, GL_FALSE, 12}, {2, GL_FLOAT, GL_FALSE, 8}}}},
+        {"half", {{{4, GL_HALF_FLOAT, GL_FALSE, 8}, {4, GL_HALF_FLOAT, GL_FALSE, 8}, {2, GL_HALF_FLOAT, GL_FALSE, 4}}}},
+        {"snorm16", {{{4, GL_SHORT, GL_TRUE, 8}, {4, GL_SHORT, GL_TRUE, 8}, {2, GL_UNSIGNED_SHORT, GL_TRUE, 4}}}},
+        {"2_10_10_10", {{{4, GL_INT_2_10_10_10_REV, GL_TRUE, 4}, {4, GL_INT_2_10_10_10_REV, GL_TRUE, 4},
+                         {2, GL_UNSIGNED_SHORT, GL_TRUE, 4}}}},
+    };
+
+    std::vector<Case> cases;
+    const std::regex re(filter);
+    for (auto& format : formats) {
+        for (bool planar : {false, true}) {
+            const std::string prefix = format.name + (planar ? "/planar/" : "/interleaved/");
+            auto add = [&](const std::string& name, Indices indices, bool restart) {
+                if (filter.empty() || std::regex_search(prefix + name, re))
+                    cases.push_back({prefix + name, &format, planar, indices, restart});
+            };
+            add("none", Indices::None, false);
+            add("u16", Indices::U16, false);
+            add("u16_restart", Indices::U16, true);
+            add("u32", Indices::U32, false);
+            add("u32_restart", Indices::U32, true);
+        }
+    }
+    if (cases.empty()) {
+        std::cerr << "No case to run" << std::endl;
+        return 1;
+    }
+
+    // the grid covers the window, with a height field for the normals to show
+    const int quads = (grid - 1) * (grid - 1);
+    std::vector<std::array<glm::vec4, 3>> mesh;
+    for (int y = 0; y < grid; y++) {
+        for (int x = 0; x < grid; x++) {
+            const float u = static_cast<float>(x) / (grid - 1), v = static_cast<float>(y) / (grid - 1);
+            const float k = 4.0f * glm::pi<float>();
+            const float z = 0.1f * std::sin(k * u) * std::cos(k * v);
+            const glm::vec3 normal = glm::normalize(glm::vec3(-0.1f * k * std::cos(k * u) * std::cos(k * v) / 2.0f,
+                                                              0.1f * k * std::sin(k * u) * std::sin(k * v) / 2.0f,
+                                                              1.0f));
+            mesh.push_back({glm::vec4(2.0f * u - 1.0f, 2.0f * v - 1.0f, z, 1.0f), glm::vec4(normal, 0.0f),
+                            glm::vec4(u, v, 0.0f, 0.0f)});
+        }
+    }
+
+    // the grid vertices in triangle list order, for the draws without indices
+    std::vector<int> expanded;
+    for (int y = 0; y + 1 < grid; y++) {
+        for (int x = 0; x + 1 < grid; x++) {
+            const int a = y * grid + x, b = a + 1, c = a + grid, d = c + 1;
+            for (int i : {a, b, c, c, b, d})
+                expanded.push_back(i);
+        }
+    }
+
+    trif::Program<
+        trif::Shaders<GL_VERTEX_SHADER>,
+        trif::Shaders<GL_FRAGMENT_SHADER>
+    > program(vs, fs);
+
+    std::vector<GLuint> queries(case_frames);
+    glGenQueries(queries.size(), queries.data());
+
+    std::cout << "Drawing a " << grid << "x" << grid << " grid, " << 2 * quads << " triangles, in "
+              << cases.size() << " cases, " << case_frames << " frames each" << std::endl;
+
+    GLuint vao = 0, ebo = 0;
+    std::array<GLuint, 3> vbos{};
+    /// quad rows and first vertex of every chunk of indices
+    struct Chunk { int rows; GLint base_vertex; };
+    std::vector<Chunk> chunks;
+    GLsizei per_row = 0;
+    GLsizei vertices = 0;
+
+    // makes the buffers and VAO of a case
+    auto setup = [&](const Case& c) {
+        if (vao) {
+            glDeleteVertexArrays(1, &vao);
+            glDeleteBuffers(3, vbos.data());
+            glDeleteBuffers(1, &ebo);
+            vbos = {};
+            ebo = 0;
+        }
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+
+        const Format& f = *c.format;
+        const size_t count = c.indices == Indices::None ? expanded.size() : mesh.size();
+        auto source = [&](size_t i) -> const std::array<glm::vec4, 3>& {
+            return mesh[c.indices == Indices::None ? expanded[i] : i];
+        };
+
+        const size_t buffers = c.planar ? 3 : 1;
+        glGenBuffers(buffers, vbos.data());
+        for (size_t b = 0; b < buffers; b++) {
+            // the attributes stored in this buffer and their stride
+            const size_t first = c.planar ? b : 0, last = c.planar ? b + 1 : 3;
+            size_t stride = 0;
+            for (size_t a = first; a < last; a++)
+                stride += f.attributes[a].bytes;
+
+            std::vector<uint8_t> data(count * stride);
+            for (size_t i = 0; i < count; i++) {
+                size_t offset = 0;
+                for (size_t a = first; a < last; a++) {
+                    pack(f.attributes[a], source(i)[a], &data[i * stride + offset]);
+                    offset += f.attributes[a].bytes;
+                }
+            }
+
+            glBindBuffer(GL_ARRAY_BUFFER, vbos[b]);
+            glBufferData(GL_ARRAY_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+            size_t offset = 0;
+            for (size_t a = first; a < last; a++) {
+                const Attribute& attr = f.attributes[a];
+                glVertexAttribPointer(a, attr.size, attr.type, attr.normalized, stride, (void *)offset);
+                glEnableVertexAttribArray(a);
+                offset += attr.bytes;
+            }
+        }
+
+        chunks.clear();
+        vertices = static_cast<GLsizei>(count);
+        if (c.indices == Indices::None)
+            return;
+
+        // u16 indices address at most 65535 vertices besides the restart index, the
+        // chunks share their last row of vertices with the next
+        const int chunk_rows = c.indices == Indices::U16 ? std::min(grid, 65535 / grid) : grid;
+        for (int row = 0; row + 1 < grid; row += chunk_rows - 1)
+            chunks.push_back({std::min(chunk_rows - 1, grid - 1 - row), row * grid});
+
+        // the indices of the first chunk, the others draw a prefix of them
+        const uint32_t restart_index = c.indices == Indices::U16 ? 0xFFFF : 0xFFFFFFFF;
+        std::vector<uint32_t> indices;
+        for (int y = 0; y + 1 < chunk_rows; y++) {
+            if (c.restart) {
+                for (int x = 0; x < grid; x++) {
+                    indices.push_back((y + 1) * grid + x);
+                    indices.push_back(y * grid + x);
+                }
+                indices.push_back(restart_index);
+            } else {
+                for (int x = 0; x + 1 < grid; x++) {
+                    const uint32_t a = y * grid + x, b = a + 1, d = a + grid, e = d + 1;
+                    for (uint32_t i : {a, b, d, d, b, e})
+                        indices.push_back(i);
+                }
+            }
+        }
+        per_row = c.restart ? 2 * grid + 1 : 6 * (grid - 1);
+
+        glGenBuffers(1, &ebo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        if (c.indices == Indices::U16) {
+            std::vector<uint16_t> short_indices(indices.begin(), indices.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, short_indices.size() * 2, short_indices.data(), GL_STATIC_DRAW);
+        } else {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * 4, indices.data(), GL_STATIC_DRAW);
+        }
+        glPrimitiveRestartIndex(restart_index);
+    };
+
+    size_t current = 0, frame = 0;
+    setup(cases[0]);
+
+    app.main_loop([&]() {
+        if (current == cases.size()) {
+            glfwSetWindowShouldClose(app.getWindow(), true);
+            return;
+        }
+
+        Case& c = cases[current];
+
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        program.use();
+        glBindVertexArray(vao);
+        if (c.restart)
+            glEnable(GL_PRIMITIVE_RESTART);
+
+        const bool timed = frame >= WARMUP_FRAMES;
+        if (timed)
+            glBeginQuery(GL_TIME_ELAPSED, queries[frame - WARMUP_FRAMES]);
+        if (c.indices == Indices::None) {
+            glDrawArrays(GL_TRIANGLES, 0, vertices);
+        } else {
+            const GLenum type = c.indices == Indices::U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+            for (auto& chunk : chunks)
+                glDrawElementsBaseVertex(c.restart ? GL_TRIANGLE_STRIP : GL_TRIANGLES, chunk.rows * per_row, type,
+                                         (void *)0, chunk.base_vertex);
+        }
+        if (timed)
+            glEndQuery(GL_TIME_ELAPSED);
+
+        glDisable(GL_PRIMITIVE_RESTART);
+
+        if (++frame == WARMUP_FRAMES + case_frames) {
+            for (auto query : queries) {
+                GLuint64 ns = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+                c.gpu_ms += ns / 1e6;
+            }
+            c.frames = case_frames;
+
+            frame = 0;
+            if (++current < cases.size())
+                setup(cases[current]);
+        }
+    });
+
+    std::cout << std::left << std::setw(36) << "case" << std::right << std::setw(8) << "B/vert"
+              << std::setw(12) << "vertices" << std::setw(10) << "ms/frame" << std::setw(12) << "Mverts/s"
+              << std::setw(12) << "Mtris/s" << '\n' << std::fixed;
+
+    for (auto& c : cases) {
+        std::cout << std::left << std::setw(36) << c.name << std::right << std::setw(8) << c.format->vertex_bytes();
+        if (!c.frames) {
+            std::cout << "  not run\n";
+            continue;
+        }
+
+        // what the draws fetch, restart indices included
+        size_t fetched = expanded.size();
+        if (c.indices != Indices::None)
+            fetched = static_cast<size_t>(grid - 1) * (c.restart ? 2 * grid + 1 : 6 * (grid - 1));
+
+        const double ms = c.gpu_ms / c.frames;
+        std::cout << std::setw(12) << fetched << std::setw(10) << std::setprecision(3) << ms
+                  << std::setw(12) << std::setprecision(1) << (ms > 0.0 ? fetched / (ms * 1e3) : 0.0)
+                  << std::setw(12) << (ms > 0.0 ? 2.0 * quads / (ms * 1e3) : 0.0) << '\n';
+    }
+    std::cout << std::defaultfloat;
+
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(3, vbos.data());
+    glDeleteBuffers(1, &ebo);
+    glDeleteQueries(queries.size(), queries.data());
+
+    return 0;
+}
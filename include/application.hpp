@@ -4,10 +4,19 @@
 
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "CLI11.hpp"
 
+#include "frame_capture.hpp"
+#include "frame_stream.hpp"
+#include "frame_timer.hpp"
+#include "shared_frames.hpp"
 #include "shader.hpp"
 
 void processInput(GLFWwindow *window)
@@ -29,21 +38,73 @@ struct Config {
     std::string title{"Demo"};
     int frames{-1};
     std::pair<int, int> window_size{800, 600};
+    // Frames are written there if not empty, see FrameCapture
+    std::string capture_dir;
+    int capture_every{1};
+    ImageFormat capture_format{ImageFormat::PNG};
+    int capture_level{1};
+    // Every frame is written there if not empty, "-" for the standard output, see FrameStream
+    std::string stream;
+    FrameStream::Format stream_format{FrameStream::Format::Y4M};
+    // Frames are published to the shared memory object of that name if not empty, see SharedFrameSink
+    std::string shm;
+    int shm_slots{4};
+    // The last of the --frames is written there if not empty
+    std::string screenshot;
+    bool headless{false};
+    // Seconds time() advances by per frame, 0 following the wall clock
+    double fixed_step{0.0};
+    // Samples per pixel of the window, 0 for no multisampling
+    int samples{0};
+    // Frame times are written there as JSON if not empty, see FrameTimer
+    std::string bench_json;
+    int warmup{10};
     // TODO: add other common config as default
 };
 
 class Application : public CLI::App {
 public:
+    // Exit code of --headless runs without a display, which CTest reports as skipped
+    static constexpr int EXIT_SKIP = 77;
+
     // Allow client to customize other options
     Application(const char *title = "") : CLI::App(title) {
         add_option("-n,--frames", config.frames, "Draw the given number of frames then exit");
         add_option("-g,--geometry", config.window_size, "Specify the size of window like -g NNNxMMM (default 800x600)")
                 ->delimiter('x');
+        add_option("--capture", config.capture_dir, "Write the frames drawn as images into the given directory");
+        add_option("--every", config.capture_every, "Capture one frame in N (default 1)");
+        add_option("--capture-format", config.capture_format, "png, qoi, bmp or ppm (default png)")
+                ->transform(CLI::CheckedTransformer(std::map<std::string, ImageFormat>{
+                    {"png", ImageFormat::PNG},
+                    {"qoi", ImageFormat::QOI},
+                    {"bmp", ImageFormat::BMP},
+                    {"ppm", ImageFormat::PPM}}));
+        add_option("--capture-level", config.capture_level, "PNG compression level from 1, fastest, to 9 (default 1)");
+        add_option("--stream", config.stream, "Write every frame to the given pipe or file, - for the standard output");
+        add_option("--stream-format", config.stream_format, "y4m or rgba (default y4m)")
+                ->transform(CLI::CheckedTransformer(std::map<std::string, FrameStream::Format>{
+                    {"y4m", FrameStream::Format::Y4M},
+                    {"rgba", FrameStream::Format::RGBA}}));
+        add_option("--shm", config.shm, "Publish every frame to the shared memory object of the given name");
+        add_option("--shm-slots", config.shm_slots, "Frames the shared memory object holds (default 4)");
+        add_option("--screenshot", config.screenshot, "Write the last of the --frames as a PNG, or QOI, BMP or PPM after the extension");
+        add_flag("--headless", config.headless, "Render into a hidden window, exit with 77 if there is none");
+        add_option("--fixed-step", config.fixed_step, "Advance the animation time by the given seconds per frame "
+                                                       "instead of following the clock");
+        add_option("--samples", config.samples, "Multisample the window with the given samples per pixel");
+        add_option("--bench-json", config.bench_json, "Time every frame without vsync and write the times to the given JSON file");
+        add_option("--warmup", config.warmup, "Frames left out of the times (default 10)");
 
         config.title = title;
     }
 
     ~Application() {
+        // their buffers belong to the context
+        capture.reset();
+        stream.reset();
+        shm.reset();
+        timer.reset();
         glfwTerminate();
     }
 
@@ -56,27 +117,44 @@ public:
             std::exit(1);
         }
 
+        // before anything is printed, which would otherwise go to a stream on the standard output
+        if (!config.stream.empty())
+            stream.reset(new FrameStream(config.stream, config.stream_format,
+                                         config.fixed_step > 0.0 ? 1.0 / config.fixed_step : 60.0));
+
         std::cout << "Window size: " << config.window_size.first << "x"
                                      << config.window_size.second << std::endl;
         if (!glfwInit()) {
             std::cerr << "Failed to initialize GLFW" << std::endl;
-            std::exit(2);
+            std::exit(config.headless ? EXIT_SKIP : 2);
         }
 
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
         glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        if (config.headless)
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        if (config.samples > 0)
+            glfwWindowHint(GLFW_SAMPLES, config.samples);
 
         window = glfwCreateWindow(config.window_size.first, config.window_size.second,
                                   config.title.c_str(), NULL, NULL);
         if (!window) {
             std::cerr << "Failed to create GLFW window" << std::endl;
             glfwTerminate();
-            std::exit(2);
+            std::exit(config.headless ? EXIT_SKIP : 2);
         }
 
         glfwMakeContextCurrent(window);
-        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, [](GLFWwindow *w, int width, int height) {
+            framebuffer_size_callback(w, width, height);
+
+            auto *app = static_cast<Application *>(glfwGetWindowUserPointer(w));
+            app->config.window_size = {width, height};
+            for (auto& cb : app->resize_callbacks)
+                cb.second(width, height);
+        });
 
         glfwMakeContextCurrent(window);
         glewExperimental = GL_TRUE;
@@ -84,6 +162,20 @@ public:
             std::cerr << "Failed to initialize GLEW" << std::endl;
             std::exit(2);
         }
+
+        if (!config.capture_dir.empty())
+            capture.reset(new FrameCapture(config.capture_dir, config.capture_every, config.capture_format,
+                                           config.capture_level));
+        if (!config.shm.empty())
+            shm.reset(new SharedFrameSink(config.shm, config.shm_slots));
+
+        if (!config.bench_json.empty()) {
+            // frames must not wait for the display
+            glfwSwapInterval(0);
+            timer.reset(new FrameTimer(config.warmup));
+            for (int i = 0; i < argc; i++)
+                command_line += (i ? " " : "") + std::string(argv[i]);
+        }
     }
 
     void main_loop(std::function<void(void)> render) {
@@ -93,11 +185,19 @@ public:
                 (config.frames < 0 || config.frames--)) {
             processInput(window);
 
+            if (timer)
+                timer->begin_frame();
             render();
+            if (timer)
+                timer->end_frame();
 
+            capture_frame();
             glfwSwapBuffers(window);
             glfwPollEvents();
+            frame_count++;
         }
+
+        finish_capture();
     }
 
     // No SwapBuffers version in case that an application may render to non-default fbo
@@ -110,11 +210,41 @@ public:
                 (config.frames < 0 || config.frames--)) {
             processInput(window);
 
+            // the frame is swapped within render(), its end is timed after
+            if (timer)
+                timer->begin_frame();
             // Just make compiler happy
             render(true);
+            if (timer)
+                timer->end_frame();
 
             glfwPollEvents();
+            frame_count++;
         }
+
+        finish_capture();
+    }
+
+    // Reads back the frame just drawn if --capture, --stream, --shm or --screenshot is given. main_loop()
+    // calls it before swapping buffers, applications swapping them themselves must do so.
+    void capture_frame() {
+        if (capture)
+            capture->capture(config.window_size.first, config.window_size.second);
+        if (stream)
+            stream->capture(config.window_size.first, config.window_size.second);
+        if (shm)
+            shm->capture(config.window_size.first, config.window_size.second);
+
+        // --frames has been counted down to 0 for the last one
+        if (!config.screenshot.empty() && config.frames == 0 &&
+            !FrameCapture::save(config.screenshot, config.window_size.first, config.window_size.second))
+            std::cerr << "Failed to write " << config.screenshot << std::endl;
+    }
+
+    // Seconds animations should follow, which advance by --fixed-step per frame if given
+    // so that a frame looks the same whatever the frame rate
+    double time() const {
+        return config.fixed_step > 0.0 ? frame_count * config.fixed_step : glfwGetTime();
     }
 
     int getWindowWidth() const {
@@ -129,10 +259,80 @@ public:
         return window;
     }
 
+    // Options parsed by init(), their defaults may be changed before calling it
+    Config& get_config() {
+        return config;
+    }
+
+    const Config& get_config() const {
+        return config;
+    }
+
+    // Called with the new framebuffer size whenever the window is resized, e.g. to
+    // reallocate render targets which follow the window size. Returns the id which
+    // removes it, e.g. when what it refers to is destroyed before the application.
+    int add_resize_callback(std::function<void(int, int)> cb) {
+        resize_callbacks.push_back({next_resize_callback, std::move(cb)});
+        return next_resize_callback++;
+    }
+
+    void remove_resize_callback(int id) {
+        resize_callbacks.erase(std::remove_if(resize_callbacks.begin(), resize_callbacks.end(),
+                                              [id](const std::pair<int, std::function<void(int, int)>>& cb) {
+                                                  return cb.first == id;
+                                              }),
+                               resize_callbacks.end());
+    }
+
 private:
+    void finish_capture() {
+        if (capture) {
+            capture->finish();
+            capture->print_stats();
+        }
+        if (stream) {
+            stream->finish();
+            stream->print_stats();
+        }
+        if (shm) {
+            shm->finish();
+            shm->print_stats();
+        }
+        if (timer) {
+            timer->finish();
+            timer->print_stats();
+            write_bench_json();
+        }
+    }
+
+    void write_bench_json() {
+        std::ofstream os(config.bench_json);
+        JsonWriter json(os);
+        json.begin_object()
+            .key("name").value(config.title)
+            .key("command").value(command_line)
+            .key("width").value(config.window_size.first)
+            .key("height").value(config.window_size.second)
+            .key("samples").value(config.samples);
+        FrameTimer::write_environment(json);
+        timer->write_json(json);
+        json.end_object();
+
+        if (!os)
+            std::cerr << "Failed to write " << config.bench_json << std::endl;
+    }
+
     // Parsed from default options. Application is resposible for providing variables to bind to
     // and to use on their own.
     Config config;
     GLFWwindow* window;
+    uint64_t frame_count{0};
+    std::vector<std::pair<int, std::function<void(int, int)>>> resize_callbacks;
+    int next_resize_callback{0};
+    std::unique_ptr<FrameCapture> capture;
+    std::unique_ptr<FrameStream> stream;
+    std::unique_ptr<SharedFrameSink> shm;
+    std::unique_ptr<FrameTimer> timer;
+    std::string command_line;
 };
 }
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include <stb_image.h>
+#endif
+
+namespace trif
+{
+
+/// Where one image landed, padding excluded
+struct AtlasRegion {
+    float u0, v0, u1, v1;
+    float layer;
+    int x, y;
+    int width, height;
+};
+
+/// Packs many small RGBA images into a single texture so they can be drawn with one
+/// bind, either as a 2D atlas (skyline bottom-left packing) or as a GL_TEXTURE_2D_ARRAY
+/// with one image per layer.
+///
+/// Every image is surrounded by `padding` texels repeating its edges, so filtering never
+/// picks up a neighbour. Atlases stop their mip chain at the level where the padding
+/// shrinks to a single texel, arrays get a full chain.
+class AtlasBuilder {
+public:
+    enum class Mode { Atlas, Array };
+
+    explicit AtlasBuilder(Mode mode = Mode::Atlas, int padding = 4, bool mipmaps = true)
+        : _mode(mode), _padding(std::max(0, padding)), _mipmaps(mipmaps) {}
+
+    ~AtlasBuilder() {
+        if (_texture)
+            glDeleteTextures(1, &_texture);
+    }
+
+    /// not allowed
+    AtlasBuilder(const AtlasBuilder&) = delete;
+    AtlasBuilder& operator=(const AtlasBuilder&) = delete;
+
+    /// Loads an image through stb_image, returns its region index or -1
+    int add(const std::string& path) {
+        int width, height, channels;
+        unsigned char *data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+        if (!data) {
+            std::cerr << path << ": " << stbi_failure_reason() << std::endl;
+            return -1;
+        }
+
+        int index = add(data, width, height);
+        stbi_image_free(data);
+        return index;
+    }
+
+    /// Copies an 8-bit RGBA image, returns its region index
+    int add(const unsigned char *rgba, int width, int height) {
+        _images.push_back({width, height, std::vector<unsigned char>(rgba, rgba + static_cast<size_t>(width) * height * 4)});
+        return static_cast<int>(_images.size()) - 1;
+    }
+
+    /// Packs the added images and uploads the texture, replacing a previous one.
+    /// Fails if they don't fit into max_size x max_size (0: GL_MAX_TEXTURE_SIZE).
+    bool build(int max_size = 0) {
+        auto start = std::chrono::steady_clock::now();
+
+        if (_images.empty())
+            return false;
+
+        GLint gl_max;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &gl_max);
+        max_size = max_size > 0 ? std::min(max_size, static_cast<int>(gl_max)) : gl_max;
+
+        if (_texture) {
+            glDeleteTextures(1, &_texture);
+            _texture = 0;
+        }
+
+        bool ok = _mode == Mode::Atlas ? build_atlas(max_size) : build_array(max_size);
+
+        _build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return ok;
+    }
+
+    GLuint texture() const { return _texture; }
+    GLenum target() const { return _mode == Mode::Atlas ? GL_TEXTURE_2D : GL_TEXTURE_2D_ARRAY; }
+    int width() const { return _width; }
+    int height() const { return _height; }
+    int layers() const { return _layers; }
+    int levels() const { return _levels; }
+    const std::vector<AtlasRegion>& regions() const { return _regions; }
+
+    /// The UV/layer table, two vec4 per region: (u0, v0, u1, v1) and (layer, 0, 0, 0).
+    /// It fits a std140 uniform block or an RGBA32F buffer texture as is.
+    std::vector<float> table() const {
+        std::vector<float> table;
+        table.reserve(_regions.size() * 8);
+        for (const auto& r : _regions) {
+            float entry[8] = {r.u0, r.v0, r.u1, r.v1, r.layer, 0.0f, 0.0f, 0.0f};
+            table.insert(table.end(), entry, entry + 8);
+        }
+        return table;
+    }
+
+    /// Share of the texture covered by images, padding counts as waste
+    double occupancy() const {
+        double used = 0.0;
+        for (const auto& image : _images)
+            used += static_cast<double>(image.width) * image.height;
+        return used / (static_cast<double>(_width) * _height * _layers);
+    }
+
+    void print_stats(std::ostream& os = std::cout) const {
+        os << "Atlas: " << _images.size() << " images into "
+           << _width << "x" << _height << "x" << _layers
+           << (_mode == Mode::Atlas ? " atlas" : " array") << ", " << _levels << " levels, "
+           << std::fixed << std::setprecision(1) << occupancy() * 100.0 << "% occupied, "
+           << std::setprecision(2) << _build_ms << " ms" << std::defaultfloat << std::endl;
+    }
+
+private:
+    struct Image {
+        int width;
+        int height;
+        std::vector<unsigned char> pixels;
+    };
+
+    struct SkylineNode {
+        int x, y, width;
+    };
+
+    /// Finds the lowest spot for a w x h rectangle on the skyline, leftmost on ties.
+    /// Returns the node index or -1.
+    static int skyline_fit(const std::vector<SkylineNode>& skyline, int w, int h, int width, int height,
+                           int *out_x, int *out_y) {
+        int best = -1, best_top = INT_MAX;
+
+        for (size_t i = 0; i < skyline.size(); i++) {
+            int x = skyline[i].x;
+            if (x + w > width)
+                break;
+
+            // the rectangle rests on the highest node it spans
+            int y = 0, spanned = 0;
+            for (size_t j = i; spanned < w; j++) {
+                y = std::max(y, skyline[j].y);
+                spanned += skyline[j].width;
+            }
+
+            if (y + h <= height && y + h < best_top) {
+                best_top = y + h;
+                best = static_cast<int>(i);
+                *out_x = x;
+                *out_y = y;
+            }
+        }
+
+        return best;
+    }
+
+    static void skyline_insert(std::vector<SkylineNode>& skyline, int index, int x, int y, int w) {
+        skyline.insert(skyline.begin() + index, {x, y, w});
+
+        // trim the nodes now under the new one
+        for (size_t i = index + 1; i < skyline.size();) {
+            int overlap = x + w - skyline[i].x;
+            if (overlap <= 0)
+                break;
+            if (overlap < skyline[i].width) {
+                skyline[i].x += overlap;
+                skyline[i].width -= overlap;
+                break;
+            }
+            skyline.erase(skyline.begin() + i);
+        }
+
+        // merge neighbours of the same height
+        for (size_t i = 0; i + 1 < skyline.size();) {
+            if (skyline[i].y == skyline[i + 1].y) {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + i + 1);
+            } else {
+                i++;
+            }
+        }
+    }
+
+    /// Packs into width x height, tallest images first, writing the padded positions
+    bool pack(int width, int height, const std::vector<size_t>& order, std::vector<std::pair<int, int>>& positions) {
+        std::vector<SkylineNode> skyline = {{0, 0, width}};
+
+        for (size_t i : order) {
+            int w = _images[i].width + 2 * _padding;
+            int h = _images[i].height + 2 * _padding;
+            int x, y;
+            int node = skyline_fit(skyline, w, h, width, height, &x, &y);
+            if (node < 0)
+                return false;
+
+            skyline_insert(skyline, node, x, y + h, w);
+            positions[i] = {x, y};
+        }
+
+        return true;
+    }
+
+    /// Copies the image to (x, y) of the canvas and repeats its edges over the rest of
+    /// the pad_w x pad_h rectangle
+    static void blit_padded(const Image& image, unsigned char *canvas, int canvas_width,
+                            int x, int y, int pad_w, int pad_h, int padding) {
+        for (int row = 0; row < pad_h; row++) {
+            int sy = std::min(std::max(row - padding, 0), image.height - 1);
+            const unsigned char *src = image.pixels.data() + static_cast<size_t>(sy) * image.width * 4;
+            unsigned char *dst = canvas + (static_cast<size_t>(y + row) * canvas_width + x) * 4;
+
+            for (int col = 0; col < padding; col++)
+                memcpy(dst + col * 4, src, 4);
+            memcpy(dst + padding * 4, src, static_cast<size_t>(image.width) * 4);
+            for (int col = padding + image.width; col < pad_w; col++)
+                memcpy(dst + col * 4, src + (image.width - 1) * 4, 4);
+        }
+    }
+
+    bool build_atlas(int max_size) {
+        std::vector<size_t> order(_images.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return _images[a].height > _images[b].height;
+        });
+
+        // start from the smallest power of two square holding the padded area,
+        // and grow the shorter side until everything fits
+        double area = 0.0;
+        int widest = 0;
+        for (const auto& image : _images) {
+            area += static_cast<double>(image.width + 2 * _padding) * (image.height + 2 * _padding);
+            widest = std::max(widest, image.width + 2 * _padding);
+        }
+
+        int width = 1;
+        while (static_cast<double>(width) * width < area || width < widest)
+            width *= 2;
+        int height = width;
+
+        // the first square may already be too large, e.g. for an image wider than max_size
+        std::vector<std::pair<int, int>> positions(_images.size());
+        for (;;) {
+            if (width > max_size || height > max_size) {
+                std::cerr << "Atlas: images don't fit into " << max_size << "x" << max_size << std::endl;
+                return false;
+            }
+            if (pack(width, height, order, positions))
+                break;
+
+            if (width <= height)
+                width *= 2;
+            else
+                height *= 2;
+        }
+
+        std::vector<unsigned char> canvas(static_cast<size_t>(width) * height * 4, 0);
+        _regions.clear();
+
+        for (size_t i = 0; i < _images.size(); i++) {
+            const Image& image = _images[i];
+            int x = positions[i].first, y = positions[i].second;
+
+            blit_padded(image, canvas.data(), width, x, y,
+                        image.width + 2 * _padding, image.height + 2 * _padding, _padding);
+
+            int ix = x + _padding, iy = y + _padding;
+            _regions.push_back({static_cast<float>(ix) / width, static_cast<float>(iy) / height,
+                                static_cast<float>(ix + image.width) / width,
+                                static_cast<float>(iy + image.height) / height,
+                                0.0f, ix, iy, image.width, image.height});
+        }
+
+        // past level log2(padding) the footprint of a texel reaches the neighbours
+        int levels = 1;
+        if (_mipmaps) {
+            while ((1 << levels) <= _padding)
+                levels++;
+        }
+
+        _width = width;
+        _height = height;
+        _layers = 1;
+        _levels = levels;
+
+        glGenTextures(1, &_texture);
+        glBindTexture(GL_TEXTURE_2D, _texture);
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGBA8, width, height);
+        GLint alignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, canvas.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+        set_filtering(GL_TEXTURE_2D, levels);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        return true;
+    }
+
+    bool build_array(int max_size) {
+        int width = 0, height = 0;
+        for (const auto& image : _images) {
+            width = std::max(width, image.width + 2 * _padding);
+            height = std::max(height, image.height + 2 * _padding);
+        }
+
+        GLint max_layers;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+        if (width > max_size || height > max_size || static_cast<GLint>(_images.size()) > max_layers) {
+            std::cerr << "Atlas: " << _images.size() << " layers of " << width << "x" << height
+                      << " exceed the limits" << std::endl;
+            return false;
+        }
+
+        int levels = 1;
+        if (_mipmaps) {
+            while ((std::max(width, height) >> levels) > 0)
+                levels++;
+        }
+
+        _width = width;
+        _height = height;
+        _layers = static_cast<int>(_images.size());
+        _levels = levels;
+        _regions.clear();
+
+        glGenTextures(1, &_texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, _texture);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, width, height, _layers);
+        GLint alignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        // every layer is the image at (padding, padding) with its edges repeated up to
+        // the layer size, so smaller images don't sample undefined texels
+        std::vector<unsigned char> layer(static_cast<size_t>(width) * height * 4);
+        for (size_t i = 0; i < _images.size(); i++) {
+            const Image& image = _images[i];
+            blit_padded(image, layer.data(), width, 0, 0, width, height, _padding);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(i), width, height, 1,
+                            GL_RGBA, GL_UNSIGNED_BYTE, layer.data());
+
+            _regions.push_back({static_cast<float>(_padding) / width, static_cast<float>(_padding) / height,
+                                static_cast<float>(_padding + image.width) / width,
+                                static_cast<float>(_padding + image.height) / height,
+                                static_cast<float>(i), _padding, _padding, image.width, image.height});
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+        set_filtering(GL_TEXTURE_2D_ARRAY, levels);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        return true;
+    }
+
+    static void set_filtering(GLenum target, int levels) {
+        if (levels > 1)
+            glGenerateMipmap(target);
+
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+private:
+    Mode _mode;
+    int _padding;
+    bool _mipmaps;
+
+    std::vector<Image> _images;
+    std::vector<AtlasRegion> _regions;
+
+    GLuint _texture{0};
+    int _width{0};
+    int _height{0};
+    int _layers{0};
+    int _levels{0};
+    double _build_ms{0.0};
+};
+
+}
@@ -0,0 +1,549 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "compressed_texture.hpp"
+#include "mipmap.hpp"
+#include "thread_pool.hpp"
+
+namespace trif
+{
+
+/// Offline block encoders. They aim at reasonable quality at interactive speed
+/// (one principal axis fit per block, no exhaustive partition search), which is what
+/// the asset pipeline needs, not at the quality of the reference encoders.
+///
+/// BC7 only uses mode 6 (single subset, RGBA 7.7.7.7 endpoints with p-bits, 4-bit
+/// indices) and ETC2 only the ETC1 compatible individual/differential modes.
+namespace detail
+{
+
+/// Gathers the 4x4 block at (bx, by) as RGBA, row-major, clamping at the image edges
+inline void fetch_block(const unsigned char *pixels, int width, int height, int channels,
+                        int bx, int by, uint8_t block[16][4])
+{
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            int sx = std::min(bx * 4 + x, width - 1);
+            int sy = std::min(by * 4 + y, height - 1);
+            const unsigned char *p = pixels + (static_cast<size_t>(sy) * width + sx) * channels;
+            uint8_t *t = block[y * 4 + x];
+
+            if (channels >= 3) {
+                t[0] = p[0]; t[1] = p[1]; t[2] = p[2];
+                t[3] = channels == 4 ? p[3] : 255;
+            } else {
+                t[0] = t[1] = t[2] = p[0];
+                t[3] = channels == 2 ? p[1] : 255;
+            }
+        }
+    }
+}
+
+/// Fits a line through the first N channels of the block by power iteration on the
+/// covariance matrix, and returns its two ends clamped to [0, 255]
+template<int N>
+inline void fit_endpoints(const uint8_t block[16][4], float e0[N], float e1[N])
+{
+    float mean[N] = {};
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < N; c++)
+            mean[c] += block[i][c];
+    for (int c = 0; c < N; c++)
+        mean[c] /= 16.0f;
+
+    float cov[N][N] = {};
+    for (int i = 0; i < 16; i++) {
+        float d[N];
+        for (int c = 0; c < N; c++)
+            d[c] = block[i][c] - mean[c];
+        for (int r = 0; r < N; r++)
+            for (int c = 0; c < N; c++)
+                cov[r][c] += d[r] * d[c];
+    }
+
+    float axis[N];
+    for (int c = 0; c < N; c++)
+        axis[c] = 1.0f;
+
+    for (int iter = 0; iter < 8; iter++) {
+        float next[N] = {};
+        for (int r = 0; r < N; r++)
+            for (int c = 0; c < N; c++)
+                next[r] += cov[r][c] * axis[c];
+
+        float norm = 0.0f;
+        for (int c = 0; c < N; c++)
+            norm = std::max(norm, std::fabs(next[c]));
+        if (norm < 1e-6f)
+            break;
+        for (int c = 0; c < N; c++)
+            axis[c] = next[c] / norm;
+    }
+
+    float len2 = 0.0f;
+    for (int c = 0; c < N; c++)
+        len2 += axis[c] * axis[c];
+
+    float tmin = 0.0f, tmax = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < N; c++)
+            t += (block[i][c] - mean[c]) * axis[c];
+        t /= len2;
+        tmin = std::min(tmin, t);
+        tmax = std::max(tmax, t);
+    }
+
+    for (int c = 0; c < N; c++) {
+        e0[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * tmin));
+        e1[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * tmax));
+    }
+}
+
+template<int N>
+inline int nearest(const uint8_t texel[4], const int palette[][4], int n)
+{
+    int best = 0, best_err = INT32_MAX;
+    for (int i = 0; i < n; i++) {
+        int err = 0;
+        for (int c = 0; c < N; c++) {
+            int d = texel[c] - palette[i][c];
+            err += d * d;
+        }
+        if (err < best_err) {
+            best_err = err;
+            best = i;
+        }
+    }
+    return best;
+}
+
+inline void store_be64(uint64_t v, uint8_t *out)
+{
+    for (int i = 0; i < 8; i++)
+        out[i] = static_cast<uint8_t>(v >> (56 - 8 * i));
+}
+
+inline void store_le64(uint64_t v, uint8_t *out)
+{
+    for (int i = 0; i < 8; i++)
+        out[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+/// BC1 color block in 4-color mode, also the color half of BC3
+inline void encode_bc1(const uint8_t block[16][4], uint8_t out[8])
+{
+    float e0[3], e1[3];
+    fit_endpoints<3>(block, e0, e1);
+
+    // inset the endpoints by 1/16 of the range, the extremes are rarely hit exactly
+    for (int c = 0; c < 3; c++) {
+        float inset = (e1[c] - e0[c]) / 16.0f;
+        e0[c] += inset;
+        e1[c] -= inset;
+    }
+
+    auto pack565 = [](const float e[3]) {
+        int r = static_cast<int>(e[0] * 31.0f / 255.0f + 0.5f);
+        int g = static_cast<int>(e[1] * 63.0f / 255.0f + 0.5f);
+        int b = static_cast<int>(e[2] * 31.0f / 255.0f + 0.5f);
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    };
+
+    uint16_t c0 = pack565(e1), c1 = pack565(e0);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    auto unpack565 = [](uint16_t c, int rgb[4]) {
+        int r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+        rgb[3] = 255;
+    };
+
+    int palette[4][4];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        for (int i = 0; i < 16; i++)
+            indices |= static_cast<uint32_t>(nearest<3>(block[i], palette, 4)) << (2 * i);
+    }
+
+    out[0] = c0 & 0xff; out[1] = c0 >> 8;
+    out[2] = c1 & 0xff; out[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = static_cast<uint8_t>(indices >> (8 * i));
+}
+
+/// BC3 alpha block in 8-value mode
+inline void encode_bc3_alpha(const uint8_t block[16][4], uint8_t out[8])
+{
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; i++) {
+        a0 = std::max(a0, static_cast<int>(block[i][3]));
+        a1 = std::min(a1, static_cast<int>(block[i][3]));
+    }
+
+    int palette[8][4] = {};
+    palette[0][0] = a0;
+    palette[1][0] = a1;
+    for (int k = 2; k < 8; k++)
+        palette[k][0] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+
+    uint64_t bits = static_cast<uint64_t>(a0) | static_cast<uint64_t>(a1) << 8;
+    if (a0 != a1) {
+        for (int i = 0; i < 16; i++) {
+            uint8_t alpha[4] = {block[i][3]};
+            bits |= static_cast<uint64_t>(nearest<1>(alpha, palette, 8)) << (16 + 3 * i);
+        }
+    }
+    store_le64(bits, out);
+}
+
+/// BC7 mode 6
+inline void encode_bc7(const uint8_t block[16][4], uint8_t out[16])
+{
+    static const int WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    float e[2][4];
+    fit_endpoints<4>(block, e[0], e[1]);
+
+    // 7-bit endpoints sharing one p-bit each, pick the p-bit with the lower error
+    int q[2][4], p[2];
+    for (int k = 0; k < 2; k++) {
+        float best_err = 1e30f;
+        for (int pbit = 0; pbit < 2; pbit++) {
+            int candidate[4];
+            float err = 0.0f;
+            for (int c = 0; c < 4; c++) {
+                candidate[c] = std::min(127, std::max(0, static_cast<int>((e[k][c] - pbit) / 2.0f + 0.5f)));
+                float d = (candidate[c] << 1 | pbit) - e[k][c];
+                err += d * d;
+            }
+            if (err < best_err) {
+                best_err = err;
+                p[k] = pbit;
+                std::copy(candidate, candidate + 4, q[k]);
+            }
+        }
+    }
+
+    int palette[16][4];
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 4; c++) {
+            int v0 = q[0][c] << 1 | p[0], v1 = q[1][c] << 1 | p[1];
+            palette[i][c] = ((64 - WEIGHTS[i]) * v0 + WEIGHTS[i] * v1 + 32) >> 6;
+        }
+    }
+
+    int indices[16];
+    for (int i = 0; i < 16; i++)
+        indices[i] = nearest<4>(block[i], palette, 16);
+
+    // the MSB of the first index is implicitly 0
+    if (indices[0] & 8) {
+        std::swap(q[0], q[1]);
+        std::swap(p[0], p[1]);
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    uint64_t lo = 0, hi = 0;
+    int pos = 0;
+    auto put = [&](uint64_t value, int n) {
+        for (int b = 0; b < n; b++, pos++) {
+            uint64_t bit = (value >> b) & 1;
+            if (pos < 64)
+                lo |= bit << pos;
+            else
+                hi |= bit << (pos - 64);
+        }
+    };
+
+    put(1 << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        put(q[0][c], 7);
+        put(q[1][c], 7);
+    }
+    put(p[0], 1);
+    put(p[1], 1);
+    put(indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        put(indices[i], 4);
+
+    store_le64(lo, out);
+    store_le64(hi, out + 8);
+}
+
+static const int ETC1_MODIFIERS[8][2] = {
+    {2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}
+};
+
+static const int EAC_MODIFIERS[16][8] = {
+    {-3, -6, -9, -15, 2, 5, 8, 14}, {-3, -7, -10, -13, 2, 6, 9, 12},
+    {-2, -5, -8, -13, 1, 4, 7, 12}, {-2, -4, -6, -13, 1, 3, 5, 12},
+    {-3, -6, -8, -12, 2, 5, 7, 11}, {-3, -7, -9, -11, 2, 6, 8, 10},
+    {-4, -7, -8, -11, 3, 6, 7, 10}, {-3, -5, -8, -11, 2, 4, 7, 10},
+    {-2, -6, -8, -10, 1, 5, 7, 9},  {-2, -5, -8, -10, 1, 4, 7, 9},
+    {-2, -4, -8, -10, 1, 3, 7, 9},  {-2, -5, -7, -10, 1, 4, 6, 9},
+    {-3, -4, -7, -10, 2, 3, 6, 9},  {-1, -2, -3, -10, 0, 1, 2, 9},
+    {-4, -6, -8, -9, 3, 5, 7, 8},   {-3, -5, -7, -9, 2, 4, 6, 8},
+};
+
+/// Picks the best modifier table for the texels of one ETC1 sub-block around base,
+/// writing the 2-bit selectors (msb: negative, lsb: large) and returning the error
+inline int etc1_fit_subblock(const uint8_t block[16][4], const int texels[8], const int base[3],
+                             int *table, int selectors[16])
+{
+    int best_err = INT32_MAX;
+    for (int t = 0; t < 8; t++) {
+        int err = 0;
+        int chosen[8];
+        for (int k = 0; k < 8; k++) {
+            const uint8_t *px = block[texels[k]];
+            int best_sel_err = INT32_MAX;
+            for (int sel = 0; sel < 4; sel++) {
+                int mod = ETC1_MODIFIERS[t][sel & 1] * (sel & 2 ? -1 : 1);
+                int sel_err = 0;
+                for (int c = 0; c < 3; c++) {
+                    int d = std::min(255, std::max(0, base[c] + mod)) - px[c];
+                    sel_err += d * d;
+                }
+                if (sel_err < best_sel_err) {
+                    best_sel_err = sel_err;
+                    chosen[k] = sel;
+                }
+            }
+            err += best_sel_err;
+        }
+
+        if (err < best_err) {
+            best_err = err;
+            *table = t;
+            for (int k = 0; k < 8; k++)
+                selectors[texels[k]] = chosen[k];
+        }
+    }
+    return best_err;
+}
+
+/// ETC2 RGB8 block restricted to the ETC1 individual and differential modes
+inline void encode_etc2_rgb(const uint8_t block[16][4], uint8_t out[8])
+{
+    uint64_t best_bits = 0;
+    int best_err = INT32_MAX;
+
+    for (int flip = 0; flip < 2; flip++) {
+        // sub-block membership of the row-major texels
+        int texels[2][8], n[2] = {0, 0};
+        for (int i = 0; i < 16; i++) {
+            int x = i % 4, y = i / 4;
+            int sub = flip ? y >= 2 : x >= 2;
+            texels[sub][n[sub]++] = i;
+        }
+
+        float avg[2][3] = {};
+        for (int s = 0; s < 2; s++) {
+            for (int k = 0; k < 8; k++)
+                for (int c = 0; c < 3; c++)
+                    avg[s][c] += block[texels[s][k]][c] / 8.0f;
+        }
+
+        int q[2][3];
+        bool differential = true;
+        for (int c = 0; c < 3; c++) {
+            q[0][c] = static_cast<int>(avg[0][c] * 31.0f / 255.0f + 0.5f);
+            q[1][c] = static_cast<int>(avg[1][c] * 31.0f / 255.0f + 0.5f);
+            int d = q[1][c] - q[0][c];
+            differential = differential && d >= -4 && d <= 3;
+        }
+
+        int base[2][3];
+        if (differential) {
+            for (int s = 0; s < 2; s++)
+                for (int c = 0; c < 3; c++)
+                    base[s][c] = (q[s][c] << 3) | (q[s][c] >> 2);
+        } else {
+            for (int s = 0; s < 2; s++) {
+                for (int c = 0; c < 3; c++) {
+                    q[s][c] = static_cast<int>(avg[s][c] * 15.0f / 255.0f + 0.5f);
+                    base[s][c] = q[s][c] * 17;
+                }
+            }
+        }
+
+        int table[2] = {0, 0}, selectors[16];
+        int err = etc1_fit_subblock(block, texels[0], base[0], &table[0], selectors)
+                + etc1_fit_subblock(block, texels[1], base[1], &table[1], selectors);
+        if (err >= best_err)
+            continue;
+        best_err = err;
+
+        uint64_t bits = 0;
+        for (int c = 0; c < 3; c++) {
+            int shift = 59 - 8 * c;
+            if (differential) {
+                bits |= static_cast<uint64_t>(q[0][c]) << shift;
+                bits |= static_cast<uint64_t>((q[1][c] - q[0][c]) & 7) << (shift - 3);
+            } else {
+                bits |= static_cast<uint64_t>(q[0][c]) << (shift + 1);
+                bits |= static_cast<uint64_t>(q[1][c]) << (shift - 3);
+            }
+        }
+        bits |= static_cast<uint64_t>(table[0]) << 37;
+        bits |= static_cast<uint64_t>(table[1]) << 34;
+        bits |= static_cast<uint64_t>(differential) << 33;
+        bits |= static_cast<uint64_t>(flip) << 32;
+
+        // selectors are stored column-major, msb plane above the lsb plane
+        for (int i = 0; i < 16; i++) {
+            int bit = (i % 4) * 4 + i / 4;
+            bits |= static_cast<uint64_t>(selectors[i] >> 1) << (16 + bit);
+            bits |= static_cast<uint64_t>(selectors[i] & 1) << bit;
+        }
+        best_bits = bits;
+    }
+
+    store_be64(best_bits, out);
+}
+
+/// EAC alpha block of ETC2 RGBA8
+inline void encode_eac_alpha(const uint8_t block[16][4], uint8_t out[8])
+{
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++) {
+        lo = std::min(lo, static_cast<int>(block[i][3]));
+        hi = std::max(hi, static_cast<int>(block[i][3]));
+    }
+
+    uint64_t best_bits = 0;
+    int best_err = INT32_MAX;
+
+    for (int t = 0; t < 16 && best_err > 0; t++) {
+        const int *mods = EAC_MODIFIERS[t];
+        int span = mods[7] - mods[3];
+        int m0 = std::max(1, (hi - lo + span / 2) / span);
+
+        for (int m = std::max(1, m0 - 1); m <= std::min(15, m0 + 1); m++) {
+            // center the table range on the alpha range
+            int base = std::min(255, std::max(0, (lo + hi - (mods[7] + mods[3]) * m + 1) / 2));
+
+            uint64_t bits = static_cast<uint64_t>(base) << 56 | static_cast<uint64_t>(m) << 52
+                          | static_cast<uint64_t>(t) << 48;
+            int err = 0;
+            for (int i = 0; i < 16; i++) {
+                int alpha = block[i][3];
+                int best_idx = 0, best_idx_err = INT32_MAX;
+                for (int idx = 0; idx < 8; idx++) {
+                    int d = std::min(255, std::max(0, base + mods[idx] * m)) - alpha;
+                    if (d * d < best_idx_err) {
+                        best_idx_err = d * d;
+                        best_idx = idx;
+                    }
+                }
+                err += best_idx_err;
+
+                int column_major = (i % 4) * 4 + i / 4;
+                bits |= static_cast<uint64_t>(best_idx) << (45 - 3 * column_major);
+            }
+
+            if (err < best_err) {
+                best_err = err;
+                best_bits = bits;
+            }
+        }
+    }
+
+    store_be64(best_bits, out);
+}
+
+inline void encode_block(CompressedFormat format, const uint8_t block[16][4], uint8_t *out)
+{
+    switch (format) {
+        case CompressedFormat::BC1:
+            encode_bc1(block, out);
+            break;
+        case CompressedFormat::BC3:
+            encode_bc3_alpha(block, out);
+            encode_bc1(block, out + 8);
+            break;
+        case CompressedFormat::BC7:
+            encode_bc7(block, out);
+            break;
+        case CompressedFormat::ETC2_RGB:
+            encode_etc2_rgb(block, out);
+            break;
+        case CompressedFormat::ETC2_RGBA:
+            encode_eac_alpha(block, out);
+            encode_etc2_rgb(block, out + 8);
+            break;
+    }
+}
+
+}
+
+
+/// Encodes one image into out, block rows spread over the pool when there is one
+inline void compress_image(const unsigned char *pixels, int width, int height, int channels,
+                           CompressedFormat format, unsigned char *out, ThreadPool *pool = nullptr)
+{
+    const int blocks_x = (width + 3) / 4;
+    const int blocks_y = (height + 3) / 4;
+    const size_t stride = block_bytes(format);
+
+    auto encode_row = [&](size_t by) {
+        uint8_t block[16][4];
+        for (int bx = 0; bx < blocks_x; bx++) {
+            detail::fetch_block(pixels, width, height, channels, bx, static_cast<int>(by), block);
+            detail::encode_block(format, block, out + (by * blocks_x + bx) * stride);
+        }
+    };
+
+    if (pool) {
+        pool->parallel_for(blocks_y, encode_row);
+    } else {
+        for (int by = 0; by < blocks_y; by++)
+            encode_row(by);
+    }
+}
+
+/// Encodes every level of a mip chain
+inline CompressedImage compress_chain(const MipChain& chain, CompressedFormat format, bool srgb,
+                                      ThreadPool *pool = nullptr)
+{
+    CompressedImage image;
+    image.format = format;
+    image.srgb = srgb;
+    image.width = chain.width;
+    image.height = chain.height;
+
+    size_t offset = 0;
+    for (int level = 0; level < chain.levels(); level++) {
+        int w = chain.level_width(level), h = chain.level_height(level);
+        size_t size = CompressedImage::level_size(format, w, h);
+        image.levels.push_back({w, h, offset, size});
+        offset += size;
+    }
+    image.data.resize(offset);
+
+    for (int level = 0; level < chain.levels(); level++) {
+        compress_image(chain.level_data(level), chain.level_width(level), chain.level_height(level),
+                       chain.channels, format, image.data.data() + image.levels[level].offset, pool);
+    }
+
+    return image;
+}
+
+}
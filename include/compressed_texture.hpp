@@ -0,0 +1,483 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "file.hpp"
+
+namespace trif
+{
+
+/// Block compressed formats, all of them with 4x4 texel blocks
+enum class CompressedFormat {
+    BC1,        /// RGB, 8 bytes per block
+    BC3,        /// RGBA, BC1 color plus interpolated alpha, 16 bytes per block
+    BC7,        /// RGBA, 16 bytes per block
+    ETC2_RGB,   /// RGB, 8 bytes per block
+    ETC2_RGBA,  /// RGBA, EAC alpha plus ETC2 color, 16 bytes per block
+};
+
+inline size_t block_bytes(CompressedFormat format)
+{
+    return format == CompressedFormat::BC1 || format == CompressedFormat::ETC2_RGB ? 8 : 16;
+}
+
+inline const char *format_name(CompressedFormat format)
+{
+    switch (format) {
+        case CompressedFormat::BC1:       return "BC1";
+        case CompressedFormat::BC3:       return "BC3";
+        case CompressedFormat::BC7:       return "BC7";
+        case CompressedFormat::ETC2_RGB:  return "ETC2 RGB8";
+        case CompressedFormat::ETC2_RGBA: return "ETC2 RGBA8";
+    }
+    return "";
+}
+
+inline GLenum gl_internal_format(CompressedFormat format, bool srgb)
+{
+    switch (format) {
+        case CompressedFormat::BC1:
+            return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case CompressedFormat::BC3:
+            return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case CompressedFormat::BC7:
+            return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+        case CompressedFormat::ETC2_RGB:
+            return srgb ? GL_COMPRESSED_SRGB8_ETC2 : GL_COMPRESSED_RGB8_ETC2;
+        case CompressedFormat::ETC2_RGBA:
+            return srgb ? GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC : GL_COMPRESSED_RGBA8_ETC2_EAC;
+    }
+    return GL_NONE;
+}
+
+/// Whether the context samples the format natively
+inline bool format_supported(CompressedFormat format)
+{
+    switch (format) {
+        case CompressedFormat::BC1:
+        case CompressedFormat::BC3:
+            return GLEW_EXT_texture_compression_s3tc;
+        case CompressedFormat::BC7:
+            return GLEW_ARB_texture_compression_bptc;
+        case CompressedFormat::ETC2_RGB:
+        case CompressedFormat::ETC2_RGBA:
+            return GLEW_ARB_ES3_compatibility;
+    }
+    return false;
+}
+
+/// A block compressed image with its mip levels, as stored in a KTX2 or DDS container
+struct CompressedImage {
+    struct Level {
+        int width;
+        int height;
+        size_t offset;
+        size_t size;
+    };
+
+    CompressedFormat format{CompressedFormat::BC1};
+    bool srgb{false};
+    int width{0};
+    int height{0};
+    std::vector<Level> levels;
+    std::vector<unsigned char> data;
+
+    /// GPU memory taken by all levels
+    size_t bytes() const {
+        size_t total = 0;
+        for (const auto& level : levels)
+            total += level.size;
+        return total;
+    }
+
+    static size_t level_size(CompressedFormat format, int width, int height) {
+        return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * block_bytes(format);
+    }
+};
+
+
+namespace detail
+{
+
+template<typename T>
+inline bool read_at(const std::vector<unsigned char>& bytes, size_t offset, T *out)
+{
+    if (offset + sizeof(T) > bytes.size())
+        return false;
+    memcpy(out, bytes.data() + offset, sizeof(T));
+    return true;
+}
+
+template<typename T>
+inline void append(std::vector<unsigned char>& bytes, T value)
+{
+    auto *p = reinterpret_cast<const unsigned char *>(&value);
+    bytes.insert(bytes.end(), p, p + sizeof(T));
+}
+
+static const unsigned char KTX2_IDENTIFIER[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+/// VkFormat values of the supported formats, unorm then srgb
+struct VkFormatPair {
+    CompressedFormat format;
+    uint32_t unorm;
+    uint32_t srgb;
+    /// Khronos data format color model
+    uint8_t color_model;
+    /// Channel of the color sample in that model, e.g. KHR_DF_CHANNEL_ETC2_COLOR
+    uint8_t color_channel;
+};
+
+static const VkFormatPair VK_FORMATS[] = {
+    {CompressedFormat::BC1,       131, 132, 128, 0},
+    {CompressedFormat::BC3,       137, 138, 130, 0},
+    {CompressedFormat::BC7,       145, 146, 133, 0},
+    {CompressedFormat::ETC2_RGB,  147, 148, 161, 2},
+    {CompressedFormat::ETC2_RGBA, 151, 152, 161, 2},
+};
+
+/// DXGI formats of the DX10 extended DDS header, unorm then srgb
+static const uint32_t DXGI_BC1[] = {71, 72};
+static const uint32_t DXGI_BC3[] = {77, 78};
+static const uint32_t DXGI_BC7[] = {98, 99};
+
+inline uint32_t fourcc(const char *s)
+{
+    return s[0] | (s[1] << 8) | (s[2] << 16) | (static_cast<uint32_t>(s[3]) << 24);
+}
+
+}
+
+
+/// Parses a KTX2 container with a supported block compressed vkFormat and no
+/// supercompression. Only 2D textures are read, the data format descriptor is ignored.
+inline bool parse_ktx2(const std::vector<unsigned char>& bytes, CompressedImage& image)
+{
+    using detail::read_at;
+
+    if (bytes.size() < 80 || memcmp(bytes.data(), detail::KTX2_IDENTIFIER, 12) != 0)
+        return false;
+
+    uint32_t header[9];
+    for (int i = 0; i < 9; i++)
+        read_at(bytes, 12 + 4 * i, &header[i]);
+
+    uint32_t vk_format = header[0];
+    uint32_t level_count = std::max(header[7], 1u);
+    uint32_t supercompression = header[8];
+
+    if (supercompression != 0 || header[4] > 1 || header[5] > 1 || header[6] != 1) {
+        std::cerr << "KTX2: only plain 2D textures are supported" << std::endl;
+        return false;
+    }
+
+    bool found = false;
+    for (const auto& f : detail::VK_FORMATS) {
+        if (vk_format == f.unorm || vk_format == f.srgb) {
+            image.format = f.format;
+            image.srgb = vk_format == f.srgb;
+            found = true;
+        }
+    }
+    if (!found) {
+        std::cerr << "KTX2: unsupported vkFormat " << vk_format << std::endl;
+        return false;
+    }
+
+    image.width = static_cast<int>(header[2]);
+    image.height = static_cast<int>(header[3]);
+    image.levels.clear();
+    image.data.clear();
+
+    for (uint32_t level = 0; level < level_count; level++) {
+        uint64_t offset, length;
+        if (!read_at(bytes, 80 + 24 * level, &offset) || !read_at(bytes, 80 + 24 * level + 8, &length))
+            return false;
+        // a corrupt index may hold offsets whose sum wraps around
+        if (offset > bytes.size() || length > bytes.size() - offset)
+            return false;
+
+        int w = std::max(1, image.width >> level);
+        int h = std::max(1, image.height >> level);
+        if (length != CompressedImage::level_size(image.format, w, h)) {
+            std::cerr << "KTX2: level " << level << " holds " << length << " bytes, "
+                      << CompressedImage::level_size(image.format, w, h) << " expected" << std::endl;
+            return false;
+        }
+        image.levels.push_back({w, h, image.data.size(), static_cast<size_t>(length)});
+        image.data.insert(image.data.end(), bytes.begin() + offset, bytes.begin() + offset + length);
+    }
+
+    return true;
+}
+
+/// Parses a DDS container holding DXT1/DXT5 (FourCC) or BC1/BC3/BC7 (DX10 header)
+inline bool parse_dds(const std::vector<unsigned char>& bytes, CompressedImage& image)
+{
+    using detail::read_at;
+    using detail::fourcc;
+
+    uint32_t magic;
+    if (!read_at(bytes, 0, &magic) || magic != fourcc("DDS "))
+        return false;
+
+    uint32_t height, width, mip_count, pf_flags, pf_fourcc;
+    read_at(bytes, 12, &height);
+    read_at(bytes, 16, &width);
+    read_at(bytes, 28, &mip_count);
+    read_at(bytes, 80, &pf_flags);
+    read_at(bytes, 84, &pf_fourcc);
+
+    size_t offset = 128;
+    image.srgb = false;
+
+    if (pf_fourcc == fourcc("DXT1")) {
+        image.format = CompressedFormat::BC1;
+    } else if (pf_fourcc == fourcc("DXT5")) {
+        image.format = CompressedFormat::BC3;
+    } else if (pf_fourcc == fourcc("DX10")) {
+        uint32_t dxgi, dimension;
+        if (!read_at(bytes, 128, &dxgi) || !read_at(bytes, 132, &dimension))
+            return false;
+        offset += 20;
+
+        if (dxgi == detail::DXGI_BC1[0] || dxgi == detail::DXGI_BC1[1])
+            image.format = CompressedFormat::BC1;
+        else if (dxgi == detail::DXGI_BC3[0] || dxgi == detail::DXGI_BC3[1])
+            image.format = CompressedFormat::BC3;
+        else if (dxgi == detail::DXGI_BC7[0] || dxgi == detail::DXGI_BC7[1])
+            image.format = CompressedFormat::BC7;
+        else {
+            std::cerr << "DDS: unsupported DXGI format " << dxgi << std::endl;
+            return false;
+        }
+        image.srgb = dxgi == detail::DXGI_BC1[1] || dxgi == detail::DXGI_BC3[1] || dxgi == detail::DXGI_BC7[1];
+    } else {
+        std::cerr << "DDS: only block compressed pixel formats are supported" << std::endl;
+        return false;
+    }
+
+    image.width = static_cast<int>(width);
+    image.height = static_cast<int>(height);
+    image.levels.clear();
+    image.data.assign(bytes.begin() + std::min(offset, bytes.size()), bytes.end());
+
+    size_t level_offset = 0;
+    for (uint32_t level = 0; level < std::max(mip_count, 1u); level++) {
+        int w = std::max(1, image.width >> level);
+        int h = std::max(1, image.height >> level);
+        size_t size = CompressedImage::level_size(image.format, w, h);
+        if (level_offset + size > image.data.size())
+            return false;
+
+        image.levels.push_back({w, h, level_offset, size});
+        level_offset += size;
+    }
+
+    return true;
+}
+
+/// Loads a .ktx2 or .dds file, telling them apart by their magic
+inline bool load_compressed(const std::string& path, CompressedImage& image)
+{
+    std::vector<unsigned char> bytes = read_file(path);
+    if (bytes.empty()) {
+        std::cerr << "Failed to read " << path << std::endl;
+        return false;
+    }
+
+    return parse_ktx2(bytes, image) || parse_dds(bytes, image);
+}
+
+/// Serializes the image as KTX2. Levels are stored smallest first as the specification
+/// requires, with a basic data format descriptor and no key/value data.
+inline std::vector<unsigned char> write_ktx2(const CompressedImage& image)
+{
+    using detail::append;
+
+    const detail::VkFormatPair *vk = nullptr;
+    for (const auto& f : detail::VK_FORMATS) {
+        if (f.format == image.format)
+            vk = &f;
+    }
+
+    const bool two_samples = image.format == CompressedFormat::BC3 || image.format == CompressedFormat::ETC2_RGBA;
+    const uint32_t n_levels = static_cast<uint32_t>(image.levels.size());
+    const uint32_t dfd_offset = 80 + 24 * n_levels;
+    const uint32_t dfd_block_size = 24 + 16 * (two_samples ? 2 : 1);
+    const uint32_t dfd_size = 4 + dfd_block_size;
+
+    std::vector<unsigned char> out(detail::KTX2_IDENTIFIER, detail::KTX2_IDENTIFIER + 12);
+    append<uint32_t>(out, image.srgb ? vk->srgb : vk->unorm);
+    append<uint32_t>(out, 1);               // typeSize
+    append<uint32_t>(out, image.width);
+    append<uint32_t>(out, image.height);
+    append<uint32_t>(out, 0);               // pixelDepth
+    append<uint32_t>(out, 0);               // layerCount
+    append<uint32_t>(out, 1);               // faceCount
+    append<uint32_t>(out, n_levels);
+    append<uint32_t>(out, 0);               // supercompressionScheme
+
+    append<uint32_t>(out, dfd_offset);
+    append<uint32_t>(out, dfd_size);
+    append<uint32_t>(out, 0);               // kvdByteOffset
+    append<uint32_t>(out, 0);               // kvdByteLength
+    append<uint64_t>(out, 0);               // sgdByteOffset
+    append<uint64_t>(out, 0);               // sgdByteLength
+
+    // Level data follows the data format descriptor, smallest level first, aligned to
+    // the block size
+    const size_t align = block_bytes(image.format);
+    std::vector<uint64_t> offsets(n_levels);
+    uint64_t offset = dfd_offset + dfd_size;
+    for (uint32_t i = n_levels; i-- > 0;) {
+        offset = (offset + align - 1) / align * align;
+        offsets[i] = offset;
+        offset += image.levels[i].size;
+    }
+
+    for (uint32_t i = 0; i < n_levels; i++) {
+        append<uint64_t>(out, offsets[i]);
+        append<uint64_t>(out, image.levels[i].size);
+        append<uint64_t>(out, 0);           // uncompressedByteLength
+    }
+
+    // Basic data format descriptor block
+    append<uint32_t>(out, dfd_size);
+    append<uint32_t>(out, 0);               // vendorId, descriptorType
+    append<uint16_t>(out, 2);               // versionNumber
+    append<uint16_t>(out, static_cast<uint16_t>(dfd_block_size));
+    append<uint8_t>(out, vk->color_model);
+    append<uint8_t>(out, 1);                // BT.709 primaries
+    append<uint8_t>(out, image.srgb ? 2 : 1);
+    append<uint8_t>(out, 0);                // straight alpha
+    append<uint32_t>(out, 0x00000303);      // 4x4x1x1 texel block
+    append<uint64_t>(out, block_bytes(image.format));
+
+    // Samples: alpha then color for the two-plane formats, color only otherwise
+    if (two_samples) {
+        append<uint16_t>(out, 0);
+        append<uint8_t>(out, 63);
+        append<uint8_t>(out, 15);           // alpha channel
+        append<uint32_t>(out, 0);
+        append<uint32_t>(out, 0);
+        append<uint32_t>(out, UINT32_MAX);
+    }
+    append<uint16_t>(out, two_samples ? 64 : 0);
+    append<uint8_t>(out, 63);
+    append<uint8_t>(out, vk->color_channel);
+    append<uint32_t>(out, 0);
+    append<uint32_t>(out, 0);
+    append<uint32_t>(out, UINT32_MAX);
+
+    for (uint32_t i = n_levels; i-- > 0;) {
+        out.resize(offsets[i], 0);
+        const auto& level = image.levels[i];
+        out.insert(out.end(), image.data.begin() + level.offset, image.data.begin() + level.offset + level.size);
+    }
+
+    return out;
+}
+
+/// Serializes a BCn image as DDS with a DX10 header
+inline std::vector<unsigned char> write_dds(const CompressedImage& image)
+{
+    using detail::append;
+
+    uint32_t dxgi = 0;
+    switch (image.format) {
+        case CompressedFormat::BC1: dxgi = detail::DXGI_BC1[image.srgb]; break;
+        case CompressedFormat::BC3: dxgi = detail::DXGI_BC3[image.srgb]; break;
+        case CompressedFormat::BC7: dxgi = detail::DXGI_BC7[image.srgb]; break;
+        default:
+            std::cerr << "DDS: " << format_name(image.format) << " can't be stored" << std::endl;
+            return {};
+    }
+
+    const uint32_t DDSD_CAPS_HEIGHT_WIDTH_PIXELFORMAT = 0x1007, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+    const uint32_t DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP_COMPLEX = 0x400008;
+    const uint32_t n_levels = static_cast<uint32_t>(image.levels.size());
+
+    std::vector<unsigned char> out;
+    append<uint32_t>(out, detail::fourcc("DDS "));
+    append<uint32_t>(out, 124);
+    append<uint32_t>(out, DDSD_CAPS_HEIGHT_WIDTH_PIXELFORMAT | DDSD_LINEARSIZE | (n_levels > 1 ? DDSD_MIPMAPCOUNT : 0));
+    append<uint32_t>(out, image.height);
+    append<uint32_t>(out, image.width);
+    append<uint32_t>(out, static_cast<uint32_t>(image.levels[0].size));
+    append<uint32_t>(out, 0);               // depth
+    append<uint32_t>(out, n_levels);
+    for (int i = 0; i < 11; i++)
+        append<uint32_t>(out, 0);
+
+    // DDS_PIXELFORMAT
+    append<uint32_t>(out, 32);
+    append<uint32_t>(out, 0x4);             // DDPF_FOURCC
+    append<uint32_t>(out, detail::fourcc("DX10"));
+    for (int i = 0; i < 5; i++)
+        append<uint32_t>(out, 0);
+
+    append<uint32_t>(out, DDSCAPS_TEXTURE | (n_levels > 1 ? DDSCAPS_MIPMAP_COMPLEX : 0));
+    for (int i = 0; i < 4; i++)
+        append<uint32_t>(out, 0);
+
+    // DDS_HEADER_DXT10
+    append<uint32_t>(out, dxgi);
+    append<uint32_t>(out, 3);               // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+    append<uint32_t>(out, 0);
+    append<uint32_t>(out, 1);               // arraySize
+    append<uint32_t>(out, 0);
+
+    out.insert(out.end(), image.data.begin(), image.data.end());
+    return out;
+}
+
+/// Creates a texture from all levels of the image with glCompressedTexImage2D.
+/// Returns 0 if the context can't sample the format or a level has the wrong size.
+inline GLuint upload_compressed(const CompressedImage& image)
+{
+    if (!format_supported(image.format)) {
+        std::cerr << format_name(image.format) << " textures are not supported by this context" << std::endl;
+        return 0;
+    }
+
+    for (const auto& l : image.levels) {
+        if (l.size != CompressedImage::level_size(image.format, l.width, l.height) ||
+            l.offset > image.data.size() || l.size > image.data.size() - l.offset) {
+            std::cerr << format_name(image.format) << " image with a level of the wrong size" << std::endl;
+            return 0;
+        }
+    }
+
+    GLenum internal_format = gl_internal_format(image.format, image.srgb);
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    for (size_t level = 0; level < image.levels.size(); level++) {
+        const auto& l = image.levels[level];
+        glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), internal_format, l.width, l.height, 0,
+                               static_cast<GLsizei>(l.size), image.data.data() + l.offset);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels.size()) - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    image.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texture;
+}
+
+}
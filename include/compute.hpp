@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include <GL/glew.h>
+
+namespace trif
+{
+
+/// Group counts of an indirect dispatch, as read from GL_DISPATCH_INDIRECT_BUFFER
+struct DispatchIndirectCommand {
+    GLuint num_groups_x;
+    GLuint num_groups_y;
+    GLuint num_groups_z;
+};
+
+/// Work groups of `group_size` invocations covering `count` of them
+inline GLuint groups_for(size_t count, GLuint group_size)
+{
+    return static_cast<GLuint>((count + group_size - 1) / group_size);
+}
+
+/// A buffer of `count` T for a shader storage block whose last member is a T array.
+/// T must be laid out as std430 lays out the GLSL type, e.g. with glm::vec4 members
+/// rather than glm::vec3 ones, which std430 pads to 16 bytes.
+///
+/// The same buffer may be bound as vertex attributes, indices or indirect commands
+/// by its id().
+template<typename T>
+class StorageBuffer {
+    static_assert(std::is_trivially_copyable<T>::value, "StorageBuffer elements are copied as bytes");
+
+public:
+    explicit StorageBuffer(size_t count, const T *data = NULL, GLenum usage = GL_DYNAMIC_DRAW)
+        : _count(count) {
+        glGenBuffers(1, &_id);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _id);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bytes(), data, usage);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    explicit StorageBuffer(const std::vector<T>& data, GLenum usage = GL_DYNAMIC_DRAW)
+        : StorageBuffer(data.size(), data.data(), usage) {}
+
+    ~StorageBuffer() { glDeleteBuffers(1, &_id); }
+
+    /// not allowed
+    StorageBuffer(const StorageBuffer&) = delete;
+    StorageBuffer& operator=(const StorageBuffer&) = delete;
+
+    GLuint id() const { return _id; }
+    size_t size() const { return _count; }
+    size_t bytes() const { return _count * sizeof(T); }
+
+    /// Binds the whole buffer to the storage block of the given binding
+    void bind(GLuint binding) const {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, _id);
+    }
+
+    /// Binds `count` elements from `first` only, `first * sizeof(T)` must be a multiple
+    /// of GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+    void bind_range(GLuint binding, size_t first, size_t count) const {
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, _id, first * sizeof(T), count * sizeof(T));
+    }
+
+    /// Writes `count` elements from `first`
+    void upload(const T *data, size_t count, size_t first = 0) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _id);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(T), count * sizeof(T), data);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    /// Reads every element back, waiting for the GPU. Shaders writing them must be
+    /// followed by memory_barrier(Barrier::BufferUpdate).
+    std::vector<T> download() const {
+        std::vector<T> data(_count);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _id);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes(), data.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return data;
+    }
+
+private:
+    GLuint _id{0};
+    size_t _count;
+};
+
+/// How the shaders access an image unit, as its GLSL image is qualified
+enum class ImageAccess : GLenum {
+    /// readonly
+    Read = GL_READ_ONLY,
+    /// writeonly
+    Write = GL_WRITE_ONLY,
+    /// neither
+    ReadWrite = GL_READ_WRITE,
+};
+
+/// Binds `level` of a texture to an image unit. `format` is the one of its GLSL image
+/// declaration, e.g. GL_RGBA8 for rgba8, and must be size compatible with the texture.
+/// A negative `layer` binds all layers of an array, cube or 3D texture.
+inline void bind_image(GLuint unit, GLuint texture, GLenum format, ImageAccess access = ImageAccess::ReadWrite,
+                       GLint level = 0, GLint layer = -1)
+{
+    glBindImageTexture(unit, texture, level, layer < 0 ? GL_TRUE : GL_FALSE, layer < 0 ? 0 : layer,
+                       static_cast<GLenum>(access), format);
+}
+
+/// What reads the buffers and images written by shaders next, see memory_barrier()
+enum class Barrier : GLbitfield {
+    VertexAttribs = GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT,
+    Indices = GL_ELEMENT_ARRAY_BARRIER_BIT,
+    Uniforms = GL_UNIFORM_BARRIER_BIT,
+    /// texelFetch() and texture() of a texture written as an image
+    TextureFetch = GL_TEXTURE_FETCH_BARRIER_BIT,
+    /// image loads, stores and atomics
+    Images = GL_SHADER_IMAGE_ACCESS_BARRIER_BIT,
+    /// indirect draws and dispatches
+    Commands = GL_COMMAND_BARRIER_BIT,
+    /// glReadPixels into and glTexSubImage from pixel buffers
+    PixelBuffers = GL_PIXEL_BUFFER_BARRIER_BIT,
+    /// glTexSubImage and glGetTexImage of a texture written as an image
+    TextureUpdate = GL_TEXTURE_UPDATE_BARRIER_BIT,
+    /// glBufferSubData, glGetBufferSubData, copies and maps
+    BufferUpdate = GL_BUFFER_UPDATE_BARRIER_BIT,
+    Framebuffer = GL_FRAMEBUFFER_BARRIER_BIT,
+    /// shader storage loads, stores and atomics
+    Storage = GL_SHADER_STORAGE_BARRIER_BIT,
+    All = GL_ALL_BARRIER_BITS,
+};
+
+inline Barrier operator|(Barrier a, Barrier b)
+{
+    return static_cast<Barrier>(static_cast<GLbitfield>(a) | static_cast<GLbitfield>(b));
+}
+
+/// Makes what shaders wrote to buffers and images so far visible to the given readers
+/// of later commands, e.g. after a dispatch writing vertices
+///
+///   memory_barrier(Barrier::VertexAttribs | Barrier::Storage);
+///
+/// Writes by other means, e.g. glBufferSubData, and the order of draws and dispatches
+/// themselves need no barrier.
+inline void memory_barrier(Barrier readers)
+{
+    glMemoryBarrier(static_cast<GLbitfield>(readers));
+}
+
+}
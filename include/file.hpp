@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace trif
+{
+
+inline std::vector<unsigned char> read_file(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return {};
+
+    std::vector<unsigned char> bytes(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(bytes.data()), bytes.size());
+    return bytes;
+}
+
+/// 64-bit FNV-1a, used to key on-disk caches by content
+inline uint64_t fnv1a64(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+    auto *p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+inline std::string hash_hex(uint64_t hash)
+{
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(hash));
+    return buf;
+}
+
+}
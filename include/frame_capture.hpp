@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <GL/glew.h>
+
+#include "image_writer.hpp"
+#include "pixel.hpp"
+#include "readback_ring.hpp"
+#include "thread_pool.hpp"
+
+namespace trif
+{
+
+/// Records rendered frames to image files without stalling the render loop.
+///
+/// capture() reads the framebuffer being drawn to through a ReadbackRing, and the
+/// pixels of the frames it has read back are handed to worker threads which flip and
+/// encode them with an ImageWriter. A frame is dropped rather than waited for when the
+/// next buffer is still in flight or when too many frames are queued for encoding.
+class FrameCapture {
+public:
+    struct Stats {
+        uint64_t captured{0};
+        uint64_t written{0};
+        uint64_t failed{0};
+        /// Frames skipped because the next pack buffer was still being read back
+        uint64_t dropped_busy{0};
+        /// Frames skipped because the encode queue was full
+        uint64_t dropped_queue{0};
+        size_t max_queue{0};
+        double readback_ms{0.0};
+        double encode_ms{0.0};
+    };
+
+public:
+    /// Captures one frame in `every` into `dir`, which is created if missing. `level` is
+    /// the compression level of PNG, see ImageWriter.
+    explicit FrameCapture(const std::string& dir, int every = 1, ImageFormat format = ImageFormat::PNG,
+                          int level = 1, size_t ring_size = 3, size_t max_queue = 8,
+                          size_t n_workers = ThreadPool::default_workers())
+        : _dir(dir)
+        , _every(std::max(every, 1))
+        , _format(format)
+        , _writer(&_pool, level)
+        , _ring(ring_size)
+        , _max_queue(max_queue)
+        , _pool(n_workers) {
+        mkdir(_dir.c_str(), 0755);
+    }
+
+    ~FrameCapture() {
+        _pool.wait_idle();
+    }
+
+    /// not allowed
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    /// Call once per frame once it has been drawn, before swapping buffers
+    void capture(int width, int height) {
+        auto start = std::chrono::steady_clock::now();
+        const uint64_t frame = _frame++;
+
+        collect(false);
+
+        if (frame % _every == 0) {
+            if (_ring.busy()) {
+                _stats.dropped_busy++;
+            } else if (_queued >= _max_queue) {
+                _stats.dropped_queue++;
+            } else {
+                _ring.read(frame, width, height);
+                _stats.captured++;
+            }
+        }
+
+        _stats.readback_ms += elapsed_ms(start);
+    }
+
+    /// Writes every frame read back so far and waits for the files
+    void finish() {
+        collect(true);
+        _pool.wait_idle();
+    }
+
+    const Stats& stats() const { return _stats; }
+
+    /// Reads the framebuffer being drawn to and writes it in the format of the extension
+    /// of `path`, waiting for both
+    static bool save(const std::string& path, int width, int height) {
+        std::vector<unsigned char> pixels = ReadbackRing::read_now(width, height);
+        make_opaque(pixels, width, height);
+        return ImageWriter().write(path, ImageWriter::format_of(path), pixels.data(), width, height, 4);
+    }
+
+    void print_stats(std::ostream& os = std::cout) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        os << "FrameCapture: " << _stats.written << " frames written to " << _dir << ", "
+           << _stats.failed << " failed, dropped " << _stats.dropped_busy << " (readback busy) "
+           << _stats.dropped_queue << " (encode queue full), max queue " << _stats.max_queue << ", "
+           << std::fixed << std::setprecision(2)
+           << "render thread " << (_frame ? _stats.readback_ms / _frame : 0.0) << " ms/frame, "
+           << "encode " << (_stats.written ? _stats.encode_ms / _stats.written : 0.0) << " ms/frame (workers)"
+           << std::endl;
+    }
+
+private:
+    static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /// GL rows start at the bottom, and the window's alpha is meaningless
+    static void make_opaque(std::vector<unsigned char>& pixels, int width, int height) {
+        pixel::flip_vertical(pixels.data(), width, height, 4);
+        for (size_t i = 3; i < pixels.size(); i += 4)
+            pixels[i] = 255;
+    }
+
+    /// Hands the pixels of the frames read back to the workers, waiting for them if `wait`
+    void collect(bool wait) {
+        _ring.collect(wait, [this](uint64_t frame, int width, int height, const unsigned char *src) {
+            std::vector<unsigned char> pixels(src, src + static_cast<size_t>(width) * height * 4);
+
+            size_t queued = ++_queued;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stats.max_queue = std::max(_stats.max_queue, queued);
+            }
+
+            _pool.submit([this, frame, width, height, pixels = std::move(pixels)]() mutable {
+                encode(frame, width, height, pixels);
+            });
+        });
+    }
+
+    /// Runs on a worker thread
+    void encode(uint64_t frame, int width, int height, std::vector<unsigned char>& pixels) {
+        auto start = std::chrono::steady_clock::now();
+
+        make_opaque(pixels, width, height);
+
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%06llu.%s", static_cast<unsigned long long>(frame),
+                 ImageWriter::extension(_format));
+        const std::string path = _dir + name;
+
+        bool ok = _writer.write(path, _format, pixels.data(), width, height, 4);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (ok)
+            _stats.written++;
+        else
+            _stats.failed++;
+        _stats.encode_ms += elapsed_ms(start);
+        _queued--;
+    }
+
+private:
+    std::string _dir;
+    uint64_t _every;
+    ImageFormat _format;
+    /// Compresses PNG on the workers too
+    ImageWriter _writer;
+    ReadbackRing _ring;
+    size_t _max_queue;
+    std::atomic<size_t> _queued{0};
+    uint64_t _frame{0};
+    mutable std::mutex _mutex;
+    Stats _stats;
+    /// Declared last so that workers are joined before anything they touch is destroyed
+    ThreadPool _pool;
+};
+
+}
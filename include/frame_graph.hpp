@@ -0,0 +1,521 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "render_target.hpp"
+
+namespace trif
+{
+
+/// Declarative description of a multi-pass frame.
+///
+/// Every pass declares in its setup callback the render targets it creates, reads
+/// (samples) and writes (renders to), and optionally how they are cleared. compile()
+/// turns the declarations into a schedule which
+///
+/// - culls the passes whose outputs never reach the backbuffer or a side effect,
+/// - acquires every transient target from the RenderTargetPool right before its first
+///   use and releases it right after its last use, so that targets of passes which do
+///   not overlap alias each other,
+/// - invalidates (glInvalidateFramebuffer) attachments whose contents are no longer
+///   needed after their last use,
+/// - folds clear-only passes into the next pass rendering to the same target and
+///   issues every clear of a pass as a single glClear.
+///
+/// execute() runs the schedule and measures the GPU time of each pass with timer
+/// queries which are read back a few frames later so they never stall the pipeline.
+class FrameGraph {
+public:
+    /// Handle of a resource in the graph
+    using Resource = int;
+    static constexpr Resource None = -1;
+
+    struct Clear {
+        GLbitfield mask{0};
+        glm::vec4 color{0.0f, 0.0f, 0.0f, 1.0f};
+        float depth{1.0f};
+        int stencil{0};
+    };
+
+    class Builder {
+    public:
+        /// Declares a transient render target which lives only within this frame
+        Resource create(const std::string& name, const RenderTargetDesc& desc) {
+            _graph._resources.push_back({name, desc, false});
+            return static_cast<Resource>(_graph._resources.size() - 1);
+        }
+
+        /// The pass samples the color texture of the resource
+        void read(Resource r) {
+            _graph._passes[_pass].reads.push_back(r);
+        }
+
+        /// The pass renders to the resource. A pass renders to one target at most.
+        void write(Resource r) {
+            auto& pass = _graph._passes[_pass];
+            assert((pass.write == None || pass.write == r) && "A pass writes one resource at most");
+            pass.write = r;
+        }
+
+        /// Clears the resource at the beginning of the pass, implies write(r)
+        void clear(Resource r, const Clear& clear) {
+            write(r);
+            _graph._passes[_pass].clear = merge_clears(_graph._passes[_pass].clear, clear);
+        }
+
+        /// Never cull the pass even if nothing consumes its output
+        void side_effect() {
+            _graph._passes[_pass].side_effect = true;
+        }
+
+    private:
+        friend class FrameGraph;
+        Builder(FrameGraph& graph, size_t pass) : _graph(graph), _pass(pass) {}
+
+        FrameGraph& _graph;
+        size_t _pass;
+    };
+
+    class Context {
+    public:
+        /// Color texture of a resource read or written by the current pass
+        GLuint texture(Resource r) const {
+            const RenderTarget* rt = _graph._resources[r].target;
+            return rt ? rt->color_texture() : 0;
+        }
+
+        const RenderTarget* target(Resource r) const {
+            return _graph._resources[r].target;
+        }
+
+    private:
+        friend class FrameGraph;
+        explicit Context(const FrameGraph& graph) : _graph(graph) {}
+
+        const FrameGraph& _graph;
+    };
+
+public:
+    explicit FrameGraph(RenderTargetPool& pool) : _pool(pool) {}
+
+    ~FrameGraph() {
+        for (auto& pass : _passes) {
+            if (pass.queries[0])
+                glDeleteQueries(2 * QUERY_LATENCY, pass.queries.data());
+        }
+    }
+
+    /// not allowed
+    FrameGraph(const FrameGraph&) = delete;
+    FrameGraph& operator=(const FrameGraph&) = delete;
+
+    /// The default framebuffer. It is the final consumer of the frame so passes which
+    /// contribute to it are never culled.
+    Resource import_backbuffer(const std::string& name = "backbuffer") {
+        _resources.push_back({name, {}, true});
+        return static_cast<Resource>(_resources.size() - 1);
+    }
+
+    /// A pass without execute callback only clears, and is usually merged into the
+    /// next pass rendering to the same target
+    void add_pass(const std::string& name,
+                  std::function<void(Builder&)> setup,
+                  std::function<void(Context&)> execute = nullptr) {
+        _passes.emplace_back();
+        _passes.back().name = name;
+        _passes.back().execute = std::move(execute);
+
+        Builder builder(*this, _passes.size() - 1);
+        setup(builder);
+
+        _compiled = false;
+    }
+
+    void compile() {
+        for (auto& pass : _passes) {
+            pass.culled = false;
+            pass.merged = false;
+            pass.implicit_read = false;
+            pass.acquire.clear();
+            pass.release.clear();
+            pass.invalidate.clear();
+            pass.merged_clear = pass.clear;
+        }
+
+        add_implicit_reads();
+        cull();
+        merge_clears();
+        analyze_lifetimes();
+
+        _compiled = true;
+    }
+
+    void execute() {
+        if (!_compiled)
+            compile();
+
+        static const bool has_invalidate = GLEW_ARB_invalidate_subdata;
+        Context ctx(*this);
+
+        for (auto& pass : _passes) {
+            if (pass.culled || pass.merged)
+                continue;
+
+            for (auto r : pass.acquire)
+                _resources[r].target = _pool.acquire(_resources[r].desc);
+
+            if (pass.write != None) {
+                const auto& res = _resources[pass.write];
+                if (res.imported) {
+                    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                    glViewport(0, 0, _pool.window_width(), _pool.window_height());
+                } else {
+                    res.target->bind();
+                }
+            }
+
+            if (!pass.queries[0])
+                glGenQueries(2 * QUERY_LATENCY, pass.queries.data());
+            collect_timing(pass);
+            glQueryCounter(pass.queries[2 * (_frame % QUERY_LATENCY)], GL_TIMESTAMP);
+
+            const Clear& clear = pass.merged_clear;
+            if (clear.mask) {
+                glClearColor(clear.color.r, clear.color.g, clear.color.b, clear.color.a);
+                glClearDepth(clear.depth);
+                glClearStencil(clear.stencil);
+                glClear(clear.mask);
+            }
+
+            if (pass.execute)
+                pass.execute(ctx);
+
+            glQueryCounter(pass.queries[2 * (_frame % QUERY_LATENCY) + 1], GL_TIMESTAMP);
+            pass.issued[_frame % QUERY_LATENCY] = true;
+
+            if (has_invalidate) {
+                for (const auto& inv : pass.invalidate) {
+                    const auto& res = _resources[inv.first];
+                    glBindFramebuffer(GL_FRAMEBUFFER, res.imported ? 0 : res.target->fbo());
+                    glInvalidateFramebuffer(GL_FRAMEBUFFER, static_cast<GLsizei>(inv.second.size()),
+                                            inv.second.data());
+                }
+            }
+
+            for (auto r : pass.release) {
+                _pool.release(_resources[r].target);
+                _resources[r].target = nullptr;
+            }
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        _frame++;
+    }
+
+    /// Prints the compiled schedule, i.e. which passes are culled or merged and where
+    /// targets are acquired, released and invalidated
+    void print_schedule(std::ostream& os = std::cout) {
+        if (!_compiled)
+            compile();
+
+        os << "FrameGraph schedule:\n";
+        for (const auto& pass : _passes) {
+            os << "  " << pass.name;
+            if (pass.culled) {
+                os << " [culled]\n";
+                continue;
+            }
+            if (pass.merged) {
+                os << " [clear merged into next pass]\n";
+                continue;
+            }
+            os << '\n';
+            for (auto r : pass.acquire)
+                os << "    acquire " << _resources[r].name << '\n';
+            for (auto r : pass.reads)
+                os << "    read " << _resources[r].name << '\n';
+            if (pass.write != None)
+                os << "    write " << _resources[pass.write].name
+                   << (pass.implicit_read ? " (load)" : "") << '\n';
+            if (pass.merged_clear.mask)
+                os << "    clear" << clear_bits(pass.merged_clear.mask) << '\n';
+            for (const auto& inv : pass.invalidate)
+                os << "    invalidate " << _resources[inv.first].name << '\n';
+            for (auto r : pass.release)
+                os << "    release " << _resources[r].name << '\n';
+        }
+    }
+
+    /// Prints the average GPU time of every executed pass
+    void print_timings(std::ostream& os = std::cout) const {
+        os << "FrameGraph GPU time per pass:\n";
+        for (const auto& pass : _passes) {
+            if (pass.culled || pass.merged)
+                continue;
+            os << "  " << std::left << std::setw(24) << pass.name << std::right
+               << std::fixed << std::setprecision(3) << gpu_time_ms(pass) << " ms ("
+               << pass.samples << " samples)\n";
+        }
+    }
+
+private:
+    static constexpr size_t QUERY_LATENCY = 4;
+
+    struct ResourceNode {
+        std::string name;
+        RenderTargetDesc desc;
+        bool imported{false};
+        RenderTarget* target{nullptr};
+        int refcount{0};
+    };
+
+    struct Pass {
+        std::string name;
+        std::function<void(Context&)> execute;
+        std::vector<Resource> reads;
+        Resource write{None};
+        Clear clear;
+        bool side_effect{false};
+
+        /// Results of compile()
+        bool culled{false};
+        bool merged{false};
+        bool implicit_read{false};
+        int refcount{0};
+        Clear merged_clear;
+        std::vector<Resource> acquire;
+        std::vector<Resource> release;
+        std::vector<std::pair<Resource, std::vector<GLenum>>> invalidate;
+
+        /// GPU timing, a begin and end timestamp per frame in flight
+        std::array<GLuint, 2 * QUERY_LATENCY> queries{};
+        std::array<bool, QUERY_LATENCY> issued{};
+        uint64_t samples{0};
+        uint64_t total_ns{0};
+    };
+
+    static Clear merge_clears(const Clear& first, const Clear& second) {
+        Clear res = first;
+        if (second.mask & GL_COLOR_BUFFER_BIT)
+            res.color = second.color;
+        if (second.mask & GL_DEPTH_BUFFER_BIT)
+            res.depth = second.depth;
+        if (second.mask & GL_STENCIL_BUFFER_BIT)
+            res.stencil = second.stencil;
+        res.mask |= second.mask;
+        return res;
+    }
+
+    static std::string clear_bits(GLbitfield mask) {
+        std::string s;
+        if (mask & GL_COLOR_BUFFER_BIT)
+            s += " color";
+        if (mask & GL_DEPTH_BUFFER_BIT)
+            s += " depth";
+        if (mask & GL_STENCIL_BUFFER_BIT)
+            s += " stencil";
+        return s;
+    }
+
+    /// Rendering to a target an earlier pass rendered to without clearing it first
+    /// loads the earlier contents, which makes it a read as well
+    void add_implicit_reads() {
+        std::vector<bool> written(_resources.size(), false);
+
+        for (auto& pass : _passes) {
+            if (pass.write == None)
+                continue;
+
+            const GLbitfield full = GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT;
+            if (written[pass.write] && (pass.clear.mask & full) != full)
+                pass.implicit_read = true;
+
+            written[pass.write] = true;
+        }
+    }
+
+    /// Inputs which keep their resource alive. A pass loading its own target depends
+    /// on the earlier writers, which are culled or kept along with it since they all
+    /// write the same resource, but does not consume the target itself.
+    std::vector<Resource> consumed(const Pass& pass) const {
+        std::vector<Resource> res;
+        for (auto r : pass.reads) {
+            if (r != pass.write)
+                res.push_back(r);
+        }
+        return res;
+    }
+
+    void cull() {
+        for (auto& res : _resources)
+            res.refcount = res.imported ? 1 : 0;
+
+        for (auto& pass : _passes) {
+            pass.refcount = pass.write != None ? 1 : 0;
+            for (auto r : consumed(pass))
+                _resources[r].refcount++;
+        }
+
+        std::vector<Resource> unused;
+        for (size_t r = 0; r < _resources.size(); r++) {
+            if (_resources[r].refcount == 0)
+                unused.push_back(static_cast<Resource>(r));
+        }
+
+        while (!unused.empty()) {
+            Resource r = unused.back();
+            unused.pop_back();
+
+            for (auto& pass : _passes) {
+                if (pass.write != r || pass.side_effect || pass.culled)
+                    continue;
+
+                if (--pass.refcount > 0)
+                    continue;
+
+                pass.culled = true;
+                for (auto in : consumed(pass)) {
+                    if (--_resources[in].refcount == 0)
+                        unused.push_back(in);
+                }
+            }
+        }
+
+        for (auto& pass : _passes) {
+            if (pass.write == None && !pass.side_effect)
+                pass.culled = true;
+        }
+    }
+
+    void merge_clears() {
+        for (size_t i = 0; i < _passes.size(); i++) {
+            Pass& pass = _passes[i];
+            if (pass.culled || pass.execute || pass.write == None)
+                continue;
+
+            for (size_t j = i + 1; j < _passes.size(); j++) {
+                Pass& next = _passes[j];
+                if (next.culled)
+                    continue;
+
+                const auto& reads = next.reads;
+                if (std::find(reads.begin(), reads.end(), pass.write) != reads.end())
+                    break;
+
+                if (next.write == pass.write) {
+                    next.merged_clear = merge_clears(pass.merged_clear, next.merged_clear);
+                    next.implicit_read = pass.implicit_read;
+                    pass.merged = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    void analyze_lifetimes() {
+        const size_t n = _resources.size();
+        std::vector<int> first(n, -1), last(n, -1), last_write(n, -1);
+
+        for (size_t i = 0; i < _passes.size(); i++) {
+            const Pass& pass = _passes[i];
+            if (pass.culled || pass.merged)
+                continue;
+
+            auto touch = [&](Resource r) {
+                if (first[r] < 0)
+                    first[r] = static_cast<int>(i);
+                last[r] = static_cast<int>(i);
+            };
+
+            for (auto r : pass.reads)
+                touch(r);
+            if (pass.write != None) {
+                touch(pass.write);
+                last_write[pass.write] = static_cast<int>(i);
+            }
+        }
+
+        for (size_t r = 0; r < n; r++) {
+            const auto& res = _resources[r];
+            if (first[r] < 0)
+                continue;
+
+            if (res.imported) {
+                // Depth and stencil of the default framebuffer are never presented
+                if (last_write[r] >= 0)
+                    _passes[last_write[r]].invalidate.push_back({static_cast<Resource>(r), {GL_DEPTH, GL_STENCIL}});
+                continue;
+            }
+
+            _passes[first[r]].acquire.push_back(static_cast<Resource>(r));
+            _passes[last[r]].release.push_back(static_cast<Resource>(r));
+
+            // Depth/stencil attachments are renderbuffers which no pass can sample, so
+            // they are dead after the last pass rendering to them
+            std::vector<GLenum> depth;
+            if (res.desc.depth_format != GL_NONE) {
+                bool stencil = res.desc.depth_format == GL_DEPTH24_STENCIL8 ||
+                               res.desc.depth_format == GL_DEPTH32F_STENCIL8;
+                depth.push_back(stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT);
+            }
+
+            std::vector<GLenum> color;
+            if (res.desc.color_format != GL_NONE)
+                color.push_back(GL_COLOR_ATTACHMENT0);
+
+            if (last_write[r] >= 0 && last_write[r] != last[r]) {
+                if (!depth.empty())
+                    _passes[last_write[r]].invalidate.push_back({static_cast<Resource>(r), depth});
+                depth.clear();
+            }
+
+            color.insert(color.end(), depth.begin(), depth.end());
+            if (!color.empty())
+                _passes[last[r]].invalidate.push_back({static_cast<Resource>(r), color});
+        }
+    }
+
+    /// Accumulates the result of the query issued QUERY_LATENCY frames ago in the slot
+    /// about to be reused. A result not available by then is dropped.
+    void collect_timing(Pass& pass) {
+        size_t slot = _frame % QUERY_LATENCY;
+        if (!pass.issued[slot])
+            return;
+
+        pass.issued[slot] = false;
+
+        // the end timestamp landing implies the begin one did
+        GLuint available = 0;
+        glGetQueryObjectuiv(pass.queries[2 * slot + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(pass.queries[2 * slot], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(pass.queries[2 * slot + 1], GL_QUERY_RESULT, &end);
+        pass.total_ns += end - begin;
+        pass.samples++;
+    }
+
+    static double gpu_time_ms(const Pass& pass) {
+        return pass.samples ? pass.total_ns / 1.0e6 / pass.samples : 0.0;
+    }
+
+private:
+    RenderTargetPool& _pool;
+    std::vector<ResourceNode> _resources;
+    std::vector<Pass> _passes;
+    bool _compiled{false};
+    uint64_t _frame{0};
+};
+
+}
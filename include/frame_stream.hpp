@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pixel.hpp"
+#include "readback_ring.hpp"
+#include "thread_pool.hpp"
+
+namespace trif
+{
+
+/// Writes every rendered frame to a pipe, a FIFO or a file, e.g. for an encoder to
+/// consume without intermediate images
+///
+///   glxgears --stream - | ffmpeg -i - out.mp4
+///
+/// Frames are read back through a ReadbackRing. A writer thread converts them, to
+/// YUV 4:2:0 for Y4M or top row first for raw RGBA, and writes them in order. Unlike
+/// FrameCapture no frame is dropped: once max_queue frames wait for the writer the
+/// render thread waits too, and the time it spent so is reported.
+///
+/// Raw RGBA has no header, its consumer is told the size, e.g.
+/// ffmpeg -f rawvideo -pix_fmt rgba -s 800x600 -i - out.mp4
+class FrameStream {
+public:
+    enum class Format { Y4M, RGBA };
+
+    struct Stats {
+        uint64_t frames{0};
+        uint64_t bytes{0};
+        /// Frames of another size than the first one, which the stream cannot hold
+        uint64_t skipped{0};
+        double stall_ms{0.0};
+        double convert_ms{0.0};
+        double write_ms{0.0};
+    };
+
+public:
+    /// Opens `path`, "-" being the standard output. Anything the application prints
+    /// is then sent to the standard error instead. `fps` is recorded in the Y4M header.
+    explicit FrameStream(const std::string& path, Format format = Format::Y4M, double fps = 60.0,
+                         size_t ring_size = 3, size_t max_queue = 4)
+        : _path(path)
+        , _format(format)
+        , _fps(fps)
+        , _ring(ring_size)
+        , _max_queue(max_queue)
+        , _pool(1) {
+        if (path == "-") {
+            std::cout.flush();
+            _fd = dup(STDOUT_FILENO);
+            dup2(STDERR_FILENO, STDOUT_FILENO);
+        } else {
+            // blocks until a reader opens a FIFO
+            _fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+
+        if (_fd < 0)
+            std::cerr << "Failed to open " << path << " for streaming" << std::endl;
+
+        // a consumer quitting makes writes fail with EPIPE rather than kill us
+        std::signal(SIGPIPE, SIG_IGN);
+    }
+
+    ~FrameStream() {
+        _pool.wait_idle();
+        if (_fd >= 0)
+            close(_fd);
+    }
+
+    /// not allowed
+    FrameStream(const FrameStream&) = delete;
+    FrameStream& operator=(const FrameStream&) = delete;
+
+    bool is_open() const { return _fd >= 0 && !_failed; }
+
+    /// Call once per frame once it has been drawn, before swapping buffers
+    void capture(int width, int height) {
+        if (!is_open())
+            return;
+
+        auto start = std::chrono::steady_clock::now();
+        collect(false);
+
+        // both the ring and the writer are behind, the oldest frame has to come out
+        while (_ring.busy())
+            collect(true);
+
+        if (_width == 0) {
+            _width = width;
+            _height = height;
+            _start = start;
+        }
+
+        if (width != _width || height != _height)
+            _stats.skipped++;
+        else
+            _ring.read(_frame++, width, height);
+
+        _stats.stall_ms += elapsed_ms(start);
+    }
+
+    /// Writes every frame read back so far
+    void finish() {
+        if (_fd >= 0)
+            collect(true);
+        _pool.wait_idle();
+        _end = std::chrono::steady_clock::now();
+    }
+
+    const Stats& stats() const { return _stats; }
+
+    void print_stats(std::ostream& os = std::cout) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const double seconds = std::chrono::duration<double>(_end - _start).count();
+        os << "FrameStream: " << _stats.frames << " frames (" << _stats.skipped << " skipped) to "
+           << _path << (_failed ? " which failed" : "") << ", "
+           << std::fixed << std::setprecision(2)
+           << (seconds > 0.0 ? _stats.bytes / seconds / 1.0e6 : 0.0) << " MB/s, "
+           << (seconds > 0.0 ? _stats.frames / seconds : 0.0) << " frames/s, render thread "
+           << (_frame ? _stats.stall_ms / _frame : 0.0) << " ms/frame, writer "
+           << (_stats.frames ? _stats.convert_ms / _stats.frames : 0.0) << " ms/frame converting and "
+           << (_stats.frames ? _stats.write_ms / _stats.frames : 0.0) << " ms/frame writing" << std::endl;
+    }
+
+private:
+    static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /// Copies the frames read back for the writer, waiting for the ring if `wait`, then
+    /// for the writer if it is too far behind
+    void collect(bool wait) {
+        _ring.collect(wait, [this](uint64_t, int width, int height, const unsigned char *src) {
+            std::vector<unsigned char> pixels;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [this] { return _queue.size() < _max_queue; });
+                if (!_free.empty()) {
+                    pixels = std::move(_free.back());
+                    _free.pop_back();
+                }
+            }
+            pixels.assign(src, src + static_cast<size_t>(width) * height * 4);
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queue.push_back(std::move(pixels));
+            _pool.submit([this] { write_next(); });
+        });
+    }
+
+    /// Runs on the writer thread, in the order of the frames
+    void write_next() {
+        std::vector<unsigned char> pixels;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            pixels = std::move(_queue.front());
+            _queue.erase(_queue.begin());
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        const size_t row = static_cast<size_t>(_width) * 4;
+        // GL rows start at the bottom
+        const unsigned char *top = pixels.data() + (_height - 1) * row;
+
+        if (_format == Format::Y4M) {
+            const size_t luma = static_cast<size_t>(_width) * _height;
+            const size_t chroma = static_cast<size_t>((_width + 1) / 2) * ((_height + 1) / 2);
+            std::string header;
+            if (_written == 0) {
+                char line[96];
+                snprintf(line, sizeof(line), "YUV4MPEG2 W%d H%d F%ld:1000 Ip A1:1 C420jpeg\n",
+                         _width, _height, std::lround(_fps * 1000.0));
+                header = line;
+            }
+            header += "FRAME\n";
+
+            _frame_data.resize(header.size() + luma + 2 * chroma);
+            unsigned char *y = _frame_data.data() + header.size();
+            std::copy(header.begin(), header.end(), _frame_data.begin());
+            pixel::rgba_to_yuv420(top, _width, _height, -static_cast<ptrdiff_t>(row), y, y + luma, y + luma + chroma);
+        } else {
+            _frame_data.resize(row * _height);
+            for (int r = 0; r < _height; r++)
+                std::copy(top - r * row, top - r * row + row, _frame_data.begin() + r * row);
+        }
+
+        auto converted = std::chrono::steady_clock::now();
+        bool ok = !_failed && write_all(_frame_data.data(), _frame_data.size());
+        _written++;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (ok) {
+            _stats.frames++;
+            _stats.bytes += _frame_data.size();
+        } else if (!_failed) {
+            _failed = true;
+            std::cerr << "Streaming to " << _path << " failed: " << strerror(errno) << std::endl;
+        }
+        _stats.convert_ms += std::chrono::duration<double, std::milli>(converted - start).count();
+        _stats.write_ms += elapsed_ms(converted);
+        _free.push_back(std::move(pixels));
+        _cv.notify_one();
+    }
+
+    bool write_all(const unsigned char *data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::write(_fd, data, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+private:
+    std::string _path;
+    Format _format;
+    double _fps;
+    int _fd{-1};
+    std::atomic<bool> _failed{false};
+    ReadbackRing _ring;
+    size_t _max_queue;
+    uint64_t _frame{0};
+    int _width{0};
+    int _height{0};
+    std::chrono::steady_clock::time_point _start, _end;
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+    /// Frames waiting for the writer, and buffers it is done with
+    std::vector<std::vector<unsigned char>> _queue, _free;
+    /// Used by the writer only
+    std::vector<unsigned char> _frame_data;
+    uint64_t _written{0};
+    Stats _stats;
+    /// Declared last so that the writer is joined before anything it touches is destroyed
+    ThreadPool _pool;
+};
+
+}
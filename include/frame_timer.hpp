@@ -0,0 +1,219 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "json.hpp"
+
+namespace trif
+{
+
+/// Times every frame for benchmarks: the interval between frames, the CPU time spent
+/// submitting it and the GPU time it took, from a pair of timestamp queries read back
+/// QUERY_LATENCY frames later so that they never stall the pipeline.
+///
+/// The first `warmup` frames are left out, they pay for shader compilation, first use
+/// of the resources and the driver settling down.
+class FrameTimer {
+public:
+    struct Summary {
+        size_t count{0};
+        double mean{0.0};
+        double stddev{0.0};
+        double min{0.0};
+        double p50{0.0};
+        double p90{0.0};
+        double p95{0.0};
+        double p99{0.0};
+        double max{0.0};
+    };
+
+    static constexpr size_t QUERY_LATENCY = 4;
+
+public:
+    explicit FrameTimer(size_t warmup = 10) : _warmup(warmup) {}
+
+    ~FrameTimer() {
+        if (_queries[0])
+            glDeleteQueries(2 * QUERY_LATENCY, _queries.data());
+    }
+
+    /// not allowed
+    FrameTimer(const FrameTimer&) = delete;
+    FrameTimer& operator=(const FrameTimer&) = delete;
+
+    /// Call before drawing a frame
+    void begin_frame() {
+        auto now = std::chrono::steady_clock::now();
+        if (_frame > _warmup)
+            _frame_ms.push_back(std::chrono::duration<double, std::milli>(now - _last).count());
+        _last = now;
+
+        if (!_queries[0])
+            glGenQueries(2 * QUERY_LATENCY, _queries.data());
+        collect(_frame % QUERY_LATENCY);
+        glQueryCounter(_queries[2 * (_frame % QUERY_LATENCY)], GL_TIMESTAMP);
+    }
+
+    /// Call once the frame has been submitted, before swapping buffers
+    void end_frame() {
+        const size_t slot = _frame % QUERY_LATENCY;
+        glQueryCounter(_queries[2 * slot + 1], GL_TIMESTAMP);
+        _issued[slot] = _frame + 1;
+
+        if (_frame >= _warmup)
+            _cpu_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _last).count());
+        _frame++;
+    }
+
+    /// Reads back the queries still pending
+    void finish() {
+        for (size_t i = 0; i < QUERY_LATENCY; i++)
+            collect((_frame + i) % QUERY_LATENCY);
+    }
+
+    size_t frames() const { return _frame; }
+
+    /// Milliseconds between the beginnings of successive frames, swap included
+    const std::vector<double>& frame_ms() const { return _frame_ms; }
+    /// Milliseconds the CPU spent from the beginning of a frame to its end
+    const std::vector<double>& cpu_ms() const { return _cpu_ms; }
+    /// Milliseconds the GPU spent from the beginning of a frame to its end
+    const std::vector<double>& gpu_ms() const { return _gpu_ms; }
+
+    static Summary summarize(std::vector<double> v) {
+        Summary s;
+        if (v.empty())
+            return s;
+
+        std::sort(v.begin(), v.end());
+        s.count = v.size();
+        for (double x : v)
+            s.mean += x;
+        s.mean /= v.size();
+        for (double x : v)
+            s.stddev += (x - s.mean) * (x - s.mean);
+        s.stddev = v.size() > 1 ? std::sqrt(s.stddev / (v.size() - 1)) : 0.0;
+
+        auto percentile = [&v](double p) {
+            // linear interpolation between the closest ranks
+            double rank = p * (v.size() - 1);
+            size_t lo = static_cast<size_t>(rank);
+            size_t hi = std::min(lo + 1, v.size() - 1);
+            return v[lo] + (v[hi] - v[lo]) * (rank - lo);
+        };
+        s.min = v.front();
+        s.p50 = percentile(0.50);
+        s.p90 = percentile(0.90);
+        s.p95 = percentile(0.95);
+        s.p99 = percentile(0.99);
+        s.max = v.back();
+        return s;
+    }
+
+    /// Writes the summary and the samples of every series as members of the object
+    /// being written
+    void write_json(JsonWriter& json) const {
+        json.key("frames").value(static_cast<uint64_t>(_frame))
+            .key("warmup").value(static_cast<uint64_t>(_warmup));
+        write_series(json, "frame_ms", _frame_ms);
+        write_series(json, "cpu_ms", _cpu_ms);
+        write_series(json, "gpu_ms", _gpu_ms);
+    }
+
+    void print_stats(std::ostream& os = std::cout) const {
+        os << "FrameTimer: " << _frame << " frames, " << _warmup << " of warmup\n" << std::fixed << std::setprecision(3);
+        print_series(os, "frame", _frame_ms);
+        print_series(os, "cpu", _cpu_ms);
+        print_series(os, "gpu", _gpu_ms);
+        os << std::defaultfloat;
+    }
+
+    /// Describes the machine and the GL implementation, as members of the object being
+    /// written
+    static void write_environment(JsonWriter& json) {
+        auto gl_string = [](GLenum name) {
+            const GLubyte *s = glGetString(name);
+            return std::string(s ? reinterpret_cast<const char *>(s) : "");
+        };
+
+        json.key("renderer").value(gl_string(GL_RENDERER))
+            .key("vendor").value(gl_string(GL_VENDOR))
+            .key("gl_version").value(gl_string(GL_VERSION))
+            .key("cpu").value(cpu_model())
+            .key("threads").value(std::thread::hardware_concurrency());
+    }
+
+    /// Model name of the first CPU in /proc/cpuinfo
+    static std::string cpu_model() {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        while (std::getline(cpuinfo, line)) {
+            if (line.compare(0, 10, "model name") == 0) {
+                size_t colon = line.find(':');
+                if (colon != std::string::npos)
+                    return line.substr(line.find_first_not_of(' ', colon + 1));
+            }
+        }
+        return "unknown";
+    }
+
+private:
+    void collect(size_t slot) {
+        if (!_issued[slot])
+            return;
+
+        const size_t frame = _issued[slot] - 1;
+        _issued[slot] = 0;
+
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(_queries[2 * slot], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(_queries[2 * slot + 1], GL_QUERY_RESULT, &end);
+        if (frame >= _warmup && end >= begin)
+            _gpu_ms.push_back((end - begin) / 1.0e6);
+    }
+
+    static void write_series(JsonWriter& json, const std::string& name, const std::vector<double>& v) {
+        const Summary s = summarize(v);
+        json.key(name).begin_object()
+            .key("count").value(static_cast<uint64_t>(s.count))
+            .key("mean").value(s.mean)
+            .key("stddev").value(s.stddev)
+            .key("min").value(s.min)
+            .key("p50").value(s.p50)
+            .key("p90").value(s.p90)
+            .key("p95").value(s.p95)
+            .key("p99").value(s.p99)
+            .key("max").value(s.max)
+            .key("samples").value(v)
+            .end_object();
+    }
+
+    static void print_series(std::ostream& os, const std::string& name, const std::vector<double>& v) {
+        const Summary s = summarize(v);
+        os << "  " << std::left << std::setw(6) << name << std::right
+           << " mean " << std::setw(8) << s.mean << " p50 " << std::setw(8) << s.p50
+           << " p99 " << std::setw(8) << s.p99 << " max " << std::setw(8) << s.max << " ms\n";
+    }
+
+private:
+    size_t _warmup;
+    size_t _frame{0};
+    std::chrono::steady_clock::time_point _last;
+    std::array<GLuint, 2 * QUERY_LATENCY> _queries{};
+    /// Frame number + 1 of the queries in flight in every slot, 0 if none
+    std::array<size_t, QUERY_LATENCY> _issued{};
+    std::vector<double> _frame_ms, _cpu_ms, _gpu_ms;
+};
+
+}
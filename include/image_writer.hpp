@@ -0,0 +1,474 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <strings.h>
+#include <zlib.h>
+
+#include "thread_pool.hpp"
+
+namespace trif
+{
+
+enum class ImageFormat { PNG, QOI, BMP, PPM };
+
+/// Encodes 8-bit images, top row first, for captures and screenshots.
+///
+/// PNG is compressed like pigz does: the filtered rows are cut into chunks deflated in
+/// parallel, each primed with the 32 KiB before it and ended by a sync flush so that the
+/// raw streams concatenate. QOI trades size for a single fast pass, BMP (24-bit) and PPM
+/// are not compressed at all. BMP and PPM drop alpha.
+class ImageWriter {
+public:
+    /// Encodes on the calling thread and the workers of `pool`, if any. `level` is the
+    /// zlib compression level of PNG, 1 being fastest and 9 smallest.
+    explicit ImageWriter(ThreadPool *pool = nullptr, int level = 6)
+        : _pool(pool)
+        , _level(std::min(std::max(level, 0), 9)) {}
+
+    /// Format of a path from its extension, PNG if unknown
+    static ImageFormat format_of(const std::string& path) {
+        auto ends_with = [&](const char *ext) {
+            const size_t n = strlen(ext);
+            return path.size() >= n && strcasecmp(path.c_str() + path.size() - n, ext) == 0;
+        };
+        return ends_with(".qoi") ? ImageFormat::QOI
+             : ends_with(".bmp") ? ImageFormat::BMP
+             : ends_with(".ppm") ? ImageFormat::PPM
+             : ImageFormat::PNG;
+    }
+
+    static const char *extension(ImageFormat format) {
+        switch (format) {
+            case ImageFormat::QOI: return "qoi";
+            case ImageFormat::BMP: return "bmp";
+            case ImageFormat::PPM: return "ppm";
+            default:               return "png";
+        }
+    }
+
+    std::vector<unsigned char> encode(ImageFormat format, const unsigned char *pixels, int width, int height,
+                                      int channels) const {
+        switch (format) {
+            case ImageFormat::QOI: return encode_qoi(pixels, width, height, channels);
+            case ImageFormat::BMP: return encode_bmp(pixels, width, height, channels);
+            case ImageFormat::PPM: return encode_ppm(pixels, width, height, channels);
+            default:               return encode_png(pixels, width, height, channels);
+        }
+    }
+
+    bool write(const std::string& path, ImageFormat format, const unsigned char *pixels, int width, int height,
+               int channels) const {
+        std::vector<unsigned char> encoded = encode(format, pixels, width, height, channels);
+        if (encoded.empty())
+            return false;
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+        return file.good();
+    }
+
+    /// PNG of 1 to 4 channels, gray, gray and alpha, RGB or RGBA
+    std::vector<unsigned char> encode_png(const unsigned char *pixels, int width, int height, int channels) const {
+        if (channels < 1 || channels > 4 || width <= 0 || height <= 0)
+            return {};
+
+        // every row starts with its filter type
+        const size_t stride = static_cast<size_t>(width) * channels;
+        const size_t row_size = stride + 1;
+        std::vector<unsigned char> filtered(row_size * height);
+        const std::vector<unsigned char> zero_row(stride, 0);
+        for_each(height, [&](size_t y) {
+            filter_row(pixels + y * stride, y ? pixels + (y - 1) * stride : zero_row.data(), stride, channels,
+                       &filtered[y * row_size]);
+        });
+
+        // chunks of whole rows, at least CHUNK_SIZE bytes unless there are fewer
+        const size_t rows_per_chunk = std::max<size_t>(1, CHUNK_SIZE / row_size);
+        const size_t n_chunks = (height + rows_per_chunk - 1) / rows_per_chunk;
+        std::vector<Chunk> chunks(n_chunks);
+        for_each(n_chunks, [&](size_t i) {
+            const size_t begin = i * rows_per_chunk * row_size;
+            const size_t end = std::min(filtered.size(), begin + rows_per_chunk * row_size);
+            deflate_chunk(filtered.data(), begin, end, i + 1 == n_chunks, chunks[i]);
+        });
+
+        std::vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+        static const unsigned char color_types[] = {0, 4, 2, 6};
+        unsigned char ihdr[13];
+        put_be32(ihdr, width);
+        put_be32(ihdr + 4, height);
+        ihdr[8] = 8;
+        ihdr[9] = color_types[channels - 1];
+        ihdr[10] = ihdr[11] = ihdr[12] = 0;
+        put_chunk(png, "IHDR", ihdr, sizeof(ihdr));
+
+        // one IDAT, its CRC combined from those of the chunks
+        size_t idat_size = 2 + 4;
+        for (auto& chunk : chunks)
+            idat_size += chunk.data.size();
+
+        const unsigned char header[2] = {0x78, static_cast<unsigned char>(_level <= 1 ? 0x01 : _level <= 5 ? 0x5e
+                                                                         : _level == 6 ? 0x9c : 0xda)};
+        uLong adler = adler32(0L, Z_NULL, 0);
+        for (auto& chunk : chunks)
+            adler = adler32_combine(adler, chunk.adler, chunk.input);
+        unsigned char trailer[4];
+        put_be32(trailer, static_cast<uint32_t>(adler));
+
+        put_be32(png, static_cast<uint32_t>(idat_size));
+        const size_t type_offset = png.size();
+        png.insert(png.end(), {'I', 'D', 'A', 'T'});
+        png.insert(png.end(), header, header + 2);
+        uLong crc = crc32(0L, &png[type_offset], 4 + 2);
+        for (auto& chunk : chunks) {
+            png.insert(png.end(), chunk.data.begin(), chunk.data.end());
+            crc = crc32_combine(crc, chunk.crc, chunk.data.size());
+        }
+        png.insert(png.end(), trailer, trailer + 4);
+        put_be32(png, static_cast<uint32_t>(crc32(crc, trailer, 4)));
+
+        put_chunk(png, "IEND", nullptr, 0);
+        return png;
+    }
+
+    /// QOI of RGB or RGBA, see https://qoiformat.org/qoi-specification.pdf
+    static std::vector<unsigned char> encode_qoi(const unsigned char *pixels, int width, int height, int channels) {
+        if ((channels != 3 && channels != 4) || width <= 0 || height <= 0)
+            return {};
+
+        const size_t n = static_cast<size_t>(width) * height;
+        std::vector<unsigned char> qoi;
+        qoi.reserve(QOI_HEADER_SIZE + n * (channels + 1) + QOI_END_SIZE);
+        qoi.insert(qoi.end(), {'q', 'o', 'i', 'f'});
+        put_be32(qoi, width);
+        put_be32(qoi, height);
+        qoi.push_back(static_cast<unsigned char>(channels));
+        qoi.push_back(0);
+
+        Rgba index[64] = {};
+        Rgba prev = {0, 0, 0, 255};
+        int run = 0;
+
+        for (size_t i = 0; i < n; i++) {
+            const unsigned char *p = pixels + i * channels;
+            Rgba px = {p[0], p[1], p[2], channels == 4 ? p[3] : prev.a};
+
+            if (px == prev) {
+                if (++run == 62 || i + 1 == n) {
+                    qoi.push_back(static_cast<unsigned char>(QOI_OP_RUN | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run) {
+                qoi.push_back(static_cast<unsigned char>(QOI_OP_RUN | (run - 1)));
+                run = 0;
+            }
+
+            const int hash = px.hash();
+            if (index[hash] == px) {
+                qoi.push_back(static_cast<unsigned char>(QOI_OP_INDEX | hash));
+            } else {
+                index[hash] = px;
+                if (px.a == prev.a) {
+                    const int dr = static_cast<int8_t>(px.r - prev.r);
+                    const int dg = static_cast<int8_t>(px.g - prev.g);
+                    const int db = static_cast<int8_t>(px.b - prev.b);
+                    const int dr_dg = dr - dg, db_dg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        qoi.push_back(static_cast<unsigned char>(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                    } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                        qoi.push_back(static_cast<unsigned char>(QOI_OP_LUMA | (dg + 32)));
+                        qoi.push_back(static_cast<unsigned char>((dr_dg + 8) << 4 | (db_dg + 8)));
+                    } else {
+                        qoi.insert(qoi.end(), {QOI_OP_RGB, px.r, px.g, px.b});
+                    }
+                } else {
+                    qoi.insert(qoi.end(), {QOI_OP_RGBA, px.r, px.g, px.b, px.a});
+                }
+            }
+            prev = px;
+        }
+
+        qoi.insert(qoi.end(), qoi_end(), qoi_end() + QOI_END_SIZE);
+        return qoi;
+    }
+
+    /// Decodes a QOI image to its own number of channels, false if it is invalid
+    static bool decode_qoi(const unsigned char *data, size_t size, std::vector<unsigned char>& pixels,
+                           int& width, int& height, int& channels) {
+        if (size < QOI_HEADER_SIZE + QOI_END_SIZE || memcmp(data, "qoif", 4) != 0)
+            return false;
+
+        const uint32_t w = get_be32(data + 4), h = get_be32(data + 8);
+        channels = data[12];
+        if (w == 0 || h == 0 || (channels != 3 && channels != 4) || static_cast<uint64_t>(w) * h > QOI_MAX_PIXELS)
+            return false;
+        width = static_cast<int>(w);
+        height = static_cast<int>(h);
+
+        const size_t n = static_cast<size_t>(w) * h;
+        pixels.resize(n * channels);
+
+        Rgba index[64] = {};
+        Rgba px = {0, 0, 0, 255};
+        size_t pos = QOI_HEADER_SIZE;
+        const size_t end = size - QOI_END_SIZE;
+        int run = 0;
+
+        for (size_t i = 0; i < n; i++) {
+            if (run > 0) {
+                run--;
+            } else if (pos < end) {
+                const unsigned char op = data[pos++];
+                if (op == QOI_OP_RGB) {
+                    if (pos + 3 > end)
+                        return false;
+                    px.r = data[pos];
+                    px.g = data[pos + 1];
+                    px.b = data[pos + 2];
+                    pos += 3;
+                } else if (op == QOI_OP_RGBA) {
+                    if (pos + 4 > end)
+                        return false;
+                    px = {data[pos], data[pos + 1], data[pos + 2], data[pos + 3]};
+                    pos += 4;
+                } else if ((op & QOI_MASK) == QOI_OP_INDEX) {
+                    px = index[op];
+                } else if ((op & QOI_MASK) == QOI_OP_DIFF) {
+                    px.r += ((op >> 4) & 3) - 2;
+                    px.g += ((op >> 2) & 3) - 2;
+                    px.b += (op & 3) - 2;
+                } else if ((op & QOI_MASK) == QOI_OP_LUMA) {
+                    if (pos >= end)
+                        return false;
+                    const int dg = (op & 0x3f) - 32, next = data[pos++];
+                    px.r += dg - 8 + ((next >> 4) & 0x0f);
+                    px.g += dg;
+                    px.b += dg - 8 + (next & 0x0f);
+                } else {
+                    run = op & 0x3f;
+                }
+                index[px.hash()] = px;
+            } else {
+                return false;
+            }
+
+            unsigned char *p = &pixels[i * channels];
+            p[0] = px.r;
+            p[1] = px.g;
+            p[2] = px.b;
+            if (channels == 4)
+                p[3] = px.a;
+        }
+        return true;
+    }
+
+    /// 24-bit BMP of gray, RGB or RGBA
+    static std::vector<unsigned char> encode_bmp(const unsigned char *pixels, int width, int height, int channels) {
+        if (channels < 1 || channels > 4 || width <= 0 || height <= 0)
+            return {};
+
+        // rows are bottom up, BGR, padded to 4 bytes
+        const size_t row = (static_cast<size_t>(width) * 3 + 3) & ~static_cast<size_t>(3);
+        const size_t offset = 14 + 40;
+        std::vector<unsigned char> bmp(offset + row * height, 0);
+
+        unsigned char *h = bmp.data();
+        h[0] = 'B';
+        h[1] = 'M';
+        put_le32(h + 2, static_cast<uint32_t>(bmp.size()));
+        put_le32(h + 10, offset);
+        put_le32(h + 14, 40);
+        put_le32(h + 18, width);
+        put_le32(h + 22, height);
+        h[26] = 1;
+        h[28] = 24;
+        put_le32(h + 34, static_cast<uint32_t>(row * height));
+
+        for (int y = 0; y < height; y++) {
+            const unsigned char *src = pixels + static_cast<size_t>(height - 1 - y) * width * channels;
+            unsigned char *dst = &bmp[offset + y * row];
+            for (int x = 0; x < width; x++, src += channels, dst += 3) {
+                dst[0] = src[channels >= 3 ? 2 : 0];
+                dst[1] = src[channels >= 3 ? 1 : 0];
+                dst[2] = src[0];
+            }
+        }
+        return bmp;
+    }
+
+    /// Binary PPM (P6) of gray, RGB or RGBA
+    static std::vector<unsigned char> encode_ppm(const unsigned char *pixels, int width, int height, int channels) {
+        if (channels < 1 || channels > 4 || width <= 0 || height <= 0)
+            return {};
+
+        const std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+        const size_t n = static_cast<size_t>(width) * height;
+        std::vector<unsigned char> ppm(header.size() + n * 3);
+        std::copy(header.begin(), header.end(), ppm.begin());
+
+        unsigned char *dst = &ppm[header.size()];
+        if (channels == 3) {
+            memcpy(dst, pixels, n * 3);
+        } else {
+            for (size_t i = 0; i < n; i++, dst += 3) {
+                const unsigned char *src = pixels + i * channels;
+                dst[0] = src[0];
+                dst[1] = src[channels >= 3 ? 1 : 0];
+                dst[2] = src[channels >= 3 ? 2 : 0];
+            }
+        }
+        return ppm;
+    }
+
+private:
+    /// Bytes of filtered rows deflated by one job
+    static constexpr size_t CHUNK_SIZE = 256 * 1024;
+    /// Window of deflate, the dictionary of a chunk
+    static constexpr size_t WINDOW_SIZE = 32 * 1024;
+
+    static constexpr unsigned char QOI_OP_INDEX = 0x00;
+    static constexpr unsigned char QOI_OP_DIFF = 0x40;
+    static constexpr unsigned char QOI_OP_LUMA = 0x80;
+    static constexpr unsigned char QOI_OP_RUN = 0xc0;
+    static constexpr unsigned char QOI_OP_RGB = 0xfe;
+    static constexpr unsigned char QOI_OP_RGBA = 0xff;
+    static constexpr unsigned char QOI_MASK = 0xc0;
+    static constexpr size_t QOI_HEADER_SIZE = 14;
+    static constexpr uint64_t QOI_MAX_PIXELS = 400000000;
+    static constexpr size_t QOI_END_SIZE = 8;
+
+    /// Padding closing a QOI stream
+    static const unsigned char *qoi_end() {
+        static const unsigned char end[QOI_END_SIZE] = {0, 0, 0, 0, 0, 0, 0, 1};
+        return end;
+    }
+
+    struct Rgba {
+        unsigned char r, g, b, a;
+
+        bool operator==(const Rgba& o) const { return r == o.r && g == o.g && b == o.b && a == o.a; }
+        int hash() const { return (r * 3 + g * 5 + b * 7 + a * 11) % 64; }
+    };
+
+    /// Compressed chunk, with the checksums of its input and of itself
+    struct Chunk {
+        std::vector<unsigned char> data;
+        size_t input{0};
+        uLong adler{0};
+        uLong crc{0};
+    };
+
+    void for_each(size_t n, const std::function<void(size_t)>& job) const {
+        if (_pool)
+            _pool->parallel_for(n, job);
+        else
+            for (size_t i = 0; i < n; i++)
+                job(i);
+    }
+
+    void deflate_chunk(const unsigned char *filtered, size_t begin, size_t end, bool last, Chunk& chunk) const {
+        z_stream z = {};
+        deflateInit2(&z, _level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+        if (begin > 0) {
+            const size_t dict = begin < WINDOW_SIZE ? begin : WINDOW_SIZE;
+            deflateSetDictionary(&z, filtered + begin - dict, static_cast<uInt>(dict));
+        }
+
+        // the sync flush ends the chunk on a byte boundary with an empty stored block
+        chunk.data.resize(deflateBound(&z, end - begin) + 16);
+        z.next_in = const_cast<Bytef *>(filtered + begin);
+        z.avail_in = static_cast<uInt>(end - begin);
+        z.next_out = chunk.data.data();
+        z.avail_out = static_cast<uInt>(chunk.data.size());
+        deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+        chunk.data.resize(z.total_out);
+        deflateEnd(&z);
+
+        chunk.input = end - begin;
+        chunk.adler = adler32(adler32(0L, Z_NULL, 0), filtered + begin, static_cast<uInt>(end - begin));
+        chunk.crc = crc32(crc32(0L, Z_NULL, 0), chunk.data.data(), static_cast<uInt>(chunk.data.size()));
+    }
+
+    /// Writes the filter type and the filtered bytes of a row, choosing the filter whose
+    /// output has the smallest sum of absolute values like libpng does. The costs of
+    /// all filters are summed in one pass.
+    static void filter_row(const unsigned char *row, const unsigned char *prev, size_t size, int bpp,
+                           unsigned char *out) {
+        auto cost = [](int residual) { return static_cast<unsigned>(std::abs(static_cast<int8_t>(residual))); };
+
+        unsigned costs[5] = {};
+        for (size_t i = 0; i < size; i++) {
+            const bool first = i < static_cast<size_t>(bpp);
+            const int x = row[i], a = first ? 0 : row[i - bpp], b = prev[i], c = first ? 0 : prev[i - bpp];
+            costs[0] += cost(x);
+            costs[1] += cost(x - a);
+            costs[2] += cost(x - b);
+            costs[3] += cost(x - (a + b) / 2);
+            costs[4] += cost(x - paeth(a, b, c));
+        }
+        const int best = static_cast<int>(std::min_element(costs, costs + 5) - costs);
+
+        out[0] = static_cast<unsigned char>(best);
+        for (size_t i = 0; i < size; i++) {
+            const bool first = i < static_cast<size_t>(bpp);
+            const int a = first ? 0 : row[i - bpp], b = prev[i], c = first ? 0 : prev[i - bpp];
+            const int predicted = best == 1 ? a : best == 2 ? b : best == 3 ? (a + b) / 2 : best == 4 ? paeth(a, b, c) : 0;
+            out[1 + i] = static_cast<unsigned char>(row[i] - predicted);
+        }
+    }
+
+    static unsigned char paeth(int a, int b, int c) {
+        const int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        return static_cast<unsigned char>(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+    }
+
+    static void put_be32(unsigned char *p, uint32_t v) {
+        p[0] = static_cast<unsigned char>(v >> 24);
+        p[1] = static_cast<unsigned char>(v >> 16);
+        p[2] = static_cast<unsigned char>(v >> 8);
+        p[3] = static_cast<unsigned char>(v);
+    }
+
+    static void put_be32(std::vector<unsigned char>& out, uint32_t v) {
+        unsigned char bytes[4];
+        put_be32(bytes, v);
+        out.insert(out.end(), bytes, bytes + 4);
+    }
+
+    static void put_le32(unsigned char *p, uint32_t v) {
+        p[0] = static_cast<unsigned char>(v);
+        p[1] = static_cast<unsigned char>(v >> 8);
+        p[2] = static_cast<unsigned char>(v >> 16);
+        p[3] = static_cast<unsigned char>(v >> 24);
+    }
+
+    static uint32_t get_be32(const unsigned char *p) {
+        return static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+    }
+
+    static void put_chunk(std::vector<unsigned char>& png, const char *type, const unsigned char *data, size_t size) {
+        put_be32(png, static_cast<uint32_t>(size));
+        const size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        if (size)
+            png.insert(png.end(), data, data + size);
+        put_be32(png, static_cast<uint32_t>(crc32(0L, &png[start], static_cast<uInt>(size + 4))));
+    }
+
+private:
+    ThreadPool *_pool;
+    int _level;
+};
+
+}
@@ -0,0 +1,484 @@
+#pragma once
+
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace trif
+{
+
+/// Writes a JSON document as it goes, indenting objects and arrays but keeping arrays
+/// of numbers on one line, e.g.
+///
+///   JsonWriter json(os);
+///   json.begin_object().key("frames").value(300).key("samples").value(samples).end_object();
+class JsonWriter {
+public:
+    explicit JsonWriter(std::ostream& os, int indent = 2) : _os(os), _indent(indent) {}
+
+    /// not allowed
+    JsonWriter(const JsonWriter&) = delete;
+    JsonWriter& operator=(const JsonWriter&) = delete;
+
+    JsonWriter& begin_object() { return open('{'); }
+    JsonWriter& end_object() { return close('}'); }
+    JsonWriter& begin_array() { return open('['); }
+    JsonWriter& end_array() { return close(']'); }
+
+    /// Key of the next value, within an object
+    JsonWriter& key(const std::string& k) {
+        separate();
+        write_string(k);
+        _os << ": ";
+        _after_key = true;
+        return *this;
+    }
+
+    JsonWriter& value(const std::string& s) {
+        separate();
+        write_string(s);
+        return *this;
+    }
+
+    JsonWriter& value(const char *s) { return value(std::string(s ? s : "")); }
+
+    JsonWriter& value(bool b) {
+        separate();
+        _os << (b ? "true" : "false");
+        return *this;
+    }
+
+    JsonWriter& value(int v) { return value(static_cast<int64_t>(v)); }
+    JsonWriter& value(unsigned v) { return value(static_cast<uint64_t>(v)); }
+
+    JsonWriter& value(int64_t v) {
+        separate();
+        _os << v;
+        return *this;
+    }
+
+    JsonWriter& value(uint64_t v) {
+        separate();
+        _os << v;
+        return *this;
+    }
+
+    JsonWriter& value(double v) {
+        separate();
+        write_number(v);
+        return *this;
+    }
+
+    JsonWriter& value(const std::vector<double>& v) {
+        separate();
+        _os << '[';
+        for (size_t i = 0; i < v.size(); i++) {
+            if (i)
+                _os << ", ";
+            write_number(v[i]);
+        }
+        _os << ']';
+        return *this;
+    }
+
+    /// A value serialized already, e.g. a document written by another program, which
+    /// is indented further to fit in
+    JsonWriter& raw(const std::string& json) {
+        separate();
+        const std::string indent(_counts.size() * _indent, ' ');
+        for (char c : json) {
+            _os << c;
+            if (c == '\n')
+                _os << indent;
+        }
+        return *this;
+    }
+
+private:
+    JsonWriter& open(char c) {
+        separate();
+        _os << c;
+        _counts.push_back(0);
+        return *this;
+    }
+
+    JsonWriter& close(char c) {
+        const bool empty = _counts.back() == 0;
+        _counts.pop_back();
+        if (!empty)
+            newline();
+        _os << c;
+        if (_counts.empty())
+            _os << '\n';
+        return *this;
+    }
+
+    /// Puts the comma and the line break before a value or a key
+    void separate() {
+        if (_after_key) {
+            _after_key = false;
+            return;
+        }
+        if (_counts.empty())
+            return;
+        if (_counts.back()++)
+            _os << ',';
+        newline();
+    }
+
+    void newline() {
+        _os << '\n' << std::string(_counts.size() * _indent, ' ');
+    }
+
+    void write_number(double v) {
+        // JSON has no infinities nor NaN
+        if (!std::isfinite(v)) {
+            _os << "null";
+            return;
+        }
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.9g", v);
+        _os << buf;
+    }
+
+    void write_string(const std::string& s) {
+        _os << '"';
+        for (unsigned char c : s) {
+            switch (c) {
+            case '"': _os << "\\\""; break;
+            case '\\': _os << "\\\\"; break;
+            case '\n': _os << "\\n"; break;
+            case '\r': _os << "\\r"; break;
+            case '\t': _os << "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    _os << buf;
+                } else {
+                    _os << c;
+                }
+            }
+        }
+        _os << '"';
+    }
+
+private:
+    std::ostream& _os;
+    int _indent;
+    /// Values written so far in every object or array open
+    std::vector<size_t> _counts;
+    bool _after_key{false};
+};
+
+/// A parsed JSON document, e.g.
+///
+///   JsonValue doc;
+///   if (JsonValue::parse(text, doc))
+///       for (const auto& s : doc["scenarios"].items())
+///           std::cout << s["scenario"].as_string() << " " << s["result"]["gpu_ms"]["p50"].as_number();
+///
+/// Looking up what is not there gives null rather than failing, so that paths into
+/// documents of an older layout need no checks on the way.
+class JsonValue {
+public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    using Members = std::vector<std::pair<std::string, JsonValue>>;
+
+public:
+    JsonValue() = default;
+
+    /// Parses `text`, which must hold one value. On failure `error`, if given, says
+    /// what went wrong and where.
+    static bool parse(const std::string& text, JsonValue& out, std::string *error = nullptr) {
+        Parser parser{text, 0, ""};
+        out = JsonValue();
+        bool ok = parser.value(out, 0);
+        parser.skip_space();
+        if (ok && parser.pos != text.size())
+            ok = parser.fail("trailing characters");
+        if (!ok && error)
+            *error = parser.error + " at offset " + std::to_string(parser.pos);
+        return ok;
+    }
+
+    Type type() const { return _type; }
+    bool is_null() const { return _type == Type::Null; }
+    bool is_number() const { return _type == Type::Number; }
+    bool is_string() const { return _type == Type::String; }
+    bool is_array() const { return _type == Type::Array; }
+    bool is_object() const { return _type == Type::Object; }
+
+    bool as_bool(bool fallback = false) const { return _type == Type::Bool ? _bool : fallback; }
+    double as_number(double fallback = 0.0) const { return _type == Type::Number ? _number : fallback; }
+    const std::string& as_string() const { return _string; }
+
+    /// Elements of an array, empty for anything else
+    const std::vector<JsonValue>& items() const { return _items; }
+    /// Members of an object in the order of the document, empty for anything else
+    const Members& members() const { return _members; }
+
+    size_t size() const { return _type == Type::Object ? _members.size() : _items.size(); }
+
+    bool contains(const std::string& key) const { return find(key) != nullptr; }
+
+    /// Member `key` of an object, null if missing
+    const JsonValue& operator[](const std::string& key) const {
+        const JsonValue *v = find(key);
+        return v ? *v : null();
+    }
+
+    const JsonValue& operator[](const char *key) const { return (*this)[std::string(key)]; }
+
+    /// Element `i` of an array, null if out of range
+    const JsonValue& operator[](size_t i) const { return i < _items.size() ? _items[i] : null(); }
+
+    /// The elements of an array of numbers, anything else being skipped
+    std::vector<double> numbers() const {
+        std::vector<double> v;
+        for (const auto& item : _items)
+            if (item.is_number())
+                v.push_back(item._number);
+        return v;
+    }
+
+private:
+    struct Parser {
+        const std::string& text;
+        size_t pos;
+        std::string error;
+
+        /// Deep enough for any document we write, shallow enough for the stack
+        static constexpr int MAX_DEPTH = 256;
+
+        bool fail(const std::string& what) {
+            if (error.empty())
+                error = what;
+            return false;
+        }
+
+        void skip_space() {
+            while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+                pos++;
+        }
+
+        bool consume(const char *word) {
+            size_t n = strlen(word);
+            if (text.compare(pos, n, word) != 0)
+                return false;
+            pos += n;
+            return true;
+        }
+
+        bool value(JsonValue& v, int depth) {
+            if (depth > MAX_DEPTH)
+                return fail("too deep");
+
+            skip_space();
+            if (pos >= text.size())
+                return fail("unexpected end");
+
+            const char c = text[pos];
+            if (c == '{')
+                return object(v, depth);
+            if (c == '[')
+                return array(v, depth);
+            if (c == '"') {
+                v._type = Type::String;
+                return string(v._string);
+            }
+            if (consume("true")) {
+                v._type = Type::Bool;
+                v._bool = true;
+                return true;
+            }
+            if (consume("false")) {
+                v._type = Type::Bool;
+                return true;
+            }
+            if (consume("null"))
+                return true;
+            return number(v);
+        }
+
+        bool object(JsonValue& v, int depth) {
+            v._type = Type::Object;
+            pos++;
+            skip_space();
+            if (pos < text.size() && text[pos] == '}') {
+                pos++;
+                return true;
+            }
+
+            for (;;) {
+                skip_space();
+                std::string key;
+                if (pos >= text.size() || text[pos] != '"' || !string(key))
+                    return fail("expected a key");
+                skip_space();
+                if (pos >= text.size() || text[pos++] != ':')
+                    return fail("expected ':'");
+
+                v._members.emplace_back(std::move(key), JsonValue());
+                if (!value(v._members.back().second, depth + 1))
+                    return false;
+
+                skip_space();
+                if (pos < text.size() && text[pos] == ',') {
+                    pos++;
+                } else if (pos < text.size() && text[pos] == '}') {
+                    pos++;
+                    return true;
+                } else {
+                    return fail("expected ',' or '}'");
+                }
+            }
+        }
+
+        bool array(JsonValue& v, int depth) {
+            v._type = Type::Array;
+            pos++;
+            skip_space();
+            if (pos < text.size() && text[pos] == ']') {
+                pos++;
+                return true;
+            }
+
+            for (;;) {
+                v._items.emplace_back();
+                if (!value(v._items.back(), depth + 1))
+                    return false;
+
+                skip_space();
+                if (pos < text.size() && text[pos] == ',') {
+                    pos++;
+                } else if (pos < text.size() && text[pos] == ']') {
+                    pos++;
+                    return true;
+                } else {
+                    return fail("expected ',' or ']'");
+                }
+            }
+        }
+
+        bool number(JsonValue& v) {
+            const char *begin = text.c_str() + pos;
+            char *end = nullptr;
+            const double d = strtod(begin, &end);
+            if (end == begin)
+                return fail("unexpected character");
+            pos += end - begin;
+            v._type = Type::Number;
+            v._number = d;
+            return true;
+        }
+
+        /// Reads a string at the opening quote, decoding its escapes into UTF-8
+        bool string(std::string& out) {
+            pos++;
+            while (pos < text.size()) {
+                const char c = text[pos++];
+                if (c == '"')
+                    return true;
+                if (c != '\\') {
+                    out += c;
+                    continue;
+                }
+                if (pos >= text.size())
+                    break;
+                const char e = text[pos++];
+                switch (e) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned cp;
+                    if (!hex4(cp))
+                        return fail("bad \\u escape");
+                    // a surrogate pair makes one code point
+                    unsigned low;
+                    if (cp >= 0xd800 && cp < 0xdc00 && consume("\\u") && hex4(low) && low >= 0xdc00 && low < 0xe000)
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                    utf8(cp, out);
+                    break;
+                }
+                default:
+                    return fail("bad escape");
+                }
+            }
+            return fail("unterminated string");
+        }
+
+        bool hex4(unsigned& cp) {
+            if (pos + 4 > text.size())
+                return false;
+            cp = 0;
+            for (int i = 0; i < 4; i++) {
+                const char h = text[pos++];
+                cp <<= 4;
+                if (h >= '0' && h <= '9')
+                    cp |= h - '0';
+                else if (h >= 'a' && h <= 'f')
+                    cp |= h - 'a' + 10;
+                else if (h >= 'A' && h <= 'F')
+                    cp |= h - 'A' + 10;
+                else
+                    return false;
+            }
+            return true;
+        }
+
+        static void utf8(unsigned cp, std::string& out) {
+            if (cp < 0x80) {
+                out += static_cast<char>(cp);
+            } else if (cp < 0x800) {
+                out += static_cast<char>(0xc0 | (cp >> 6));
+                out += static_cast<char>(0x80 | (cp & 0x3f));
+            } else if (cp < 0x10000) {
+                out += static_cast<char>(0xe0 | (cp >> 12));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+                out += static_cast<char>(0x80 | (cp & 0x3f));
+            } else {
+                out += static_cast<char>(0xf0 | (cp >> 18));
+                out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+                out += static_cast<char>(0x80 | (cp & 0x3f));
+            }
+        }
+    };
+
+    const JsonValue *find(const std::string& key) const {
+        for (const auto& m : _members)
+            if (m.first == key)
+                return &m.second;
+        return nullptr;
+    }
+
+    static const JsonValue& null() {
+        static const JsonValue value;
+        return value;
+    }
+
+private:
+    Type _type{Type::Null};
+    bool _bool{false};
+    double _number{0.0};
+    std::string _string;
+    std::vector<JsonValue> _items;
+    Members _members;
+};
+
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "json.hpp"
+
+namespace trif
+{
+
+/// Makes the compiler believe `value` is read, so that computing it is not optimized away
+template<typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/// Makes the compiler believe `value` is read and written, so that it is neither
+/// computed once out of the loop nor assumed to be unchanged
+template<typename T>
+inline void do_not_optimize(T& value) {
+    asm volatile("" : "+m"(value) : : "memory");
+}
+
+/// Makes the compiler believe all memory is read and written, so that stores before
+/// it are not elided
+inline void clobber_memory() {
+    asm volatile("" : : : "memory");
+}
+
+/// Time stamp counter, 0 where there is none. It counts at a constant rate on recent
+/// CPUs, that of the nominal frequency rather than the actual core cycles.
+inline uint64_t cycle_counter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/// Runs functions of the host code many times over and reports the time one call takes.
+///
+/// A benchmark gets the number of iterations to run and loops itself, wrapping what it
+/// computes in do_not_optimize(), e.g.
+///
+///     bench.add("specialize", [&](size_t n) {
+///         for (size_t i = 0; i < n; i++)
+///             trif::do_not_optimize(tmpl.specialize(params));
+///     });
+///
+/// The iterations are calibrated so that one repetition lasts `min_time_ms`, then every
+/// repetition gives a sample of the nanoseconds and cycles per iteration.
+class MicroBench {
+public:
+    struct Result {
+        std::string name;
+        size_t iterations{0};
+        /// One sample per repetition
+        std::vector<double> ns_op;
+        std::vector<double> cycles_op;
+    };
+
+public:
+    explicit MicroBench(double min_time_ms = 50.0, int repetitions = 10)
+        : _min_time_ms(min_time_ms), _repetitions(std::max(1, repetitions)) {}
+    ~MicroBench() = default;
+
+    /// not allowed
+    MicroBench(const MicroBench&) = delete;
+    MicroBench& operator=(const MicroBench&) = delete;
+
+    void add(const std::string& name, std::function<void(size_t)> fn) {
+        _benchmarks.push_back({name, std::move(fn)});
+    }
+
+    /// Names of the benchmarks added
+    std::vector<std::string> names() const {
+        std::vector<std::string> v;
+        for (auto& b : _benchmarks)
+            v.push_back(b.name);
+        return v;
+    }
+
+    /// Runs the benchmarks whose name matches `filter`, all if empty, and prints a line
+    /// for each as it completes
+    void run(const std::string& filter = "", std::ostream& os = std::cout) {
+        const std::regex re(filter);
+
+        os << std::left << std::setw(32) << "benchmark" << std::right << std::setw(12) << "iterations"
+           << std::setw(12) << "ns/op" << std::setw(12) << "min" << std::setw(12) << "max"
+           << std::setw(12) << "cycles/op" << "\n";
+
+        for (auto& b : _benchmarks) {
+            if (!filter.empty() && !std::regex_search(b.name, re))
+                continue;
+
+            Result r = measure(b);
+            os << std::left << std::setw(32) << r.name << std::right << std::setw(12) << r.iterations
+               << std::fixed << std::setprecision(1)
+               << std::setw(12) << median(r.ns_op)
+               << std::setw(12) << *std::min_element(r.ns_op.begin(), r.ns_op.end())
+               << std::setw(12) << *std::max_element(r.ns_op.begin(), r.ns_op.end())
+               << std::setw(12) << median(r.cycles_op) << std::defaultfloat << std::endl;
+            _results.push_back(std::move(r));
+        }
+    }
+
+    const std::vector<Result>& results() const { return _results; }
+
+    /// Writes the results as scenarios of trif_bench, so that trif_bench_compare
+    /// compares them with --metric ns_op or cycles_op
+    void write_json(JsonWriter& json) const {
+        json.key("min_time_ms").value(_min_time_ms)
+            .key("repetitions").value(_repetitions)
+            .key("scenarios").begin_array();
+
+        for (auto& r : _results) {
+            json.begin_object()
+                .key("scenario").value(r.name)
+                .key("status").value("ok")
+                .key("result").begin_object()
+                    .key("iterations").value(static_cast<uint64_t>(r.iterations));
+            write_series(json, "ns_op", r.ns_op);
+            write_series(json, "cycles_op", r.cycles_op);
+            json.end_object().end_object();
+        }
+        json.end_array();
+    }
+
+private:
+    struct Benchmark {
+        std::string name;
+        std::function<void(size_t)> fn;
+    };
+
+    /// Nanoseconds `n` iterations take
+    static double time(const Benchmark& b, size_t n) {
+        auto start = std::chrono::steady_clock::now();
+        b.fn(n);
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    Result measure(const Benchmark& b) const {
+        Result r;
+        r.name = b.name;
+
+        // grow the iterations until a run lasts long enough to be timed, then aim for
+        // the minimum time with a margin, by at most 100x at a time
+        const double target_ns = _min_time_ms * 1.0e6;
+        size_t n = 1;
+        for (;;) {
+            const double ns = time(b, n);
+            if (ns >= target_ns || n >= (size_t(1) << 40))
+                break;
+            const double scale = ns > 0.0 ? 1.4 * target_ns / ns : 100.0;
+            n = std::max(n + 1, static_cast<size_t>(n * std::min(scale, 100.0)));
+        }
+        r.iterations = n;
+
+        for (int i = 0; i < _repetitions; i++) {
+            const uint64_t c0 = cycle_counter();
+            const double ns = time(b, n);
+            const uint64_t c1 = cycle_counter();
+
+            r.ns_op.push_back(ns / n);
+            if (c1 > c0)
+                r.cycles_op.push_back(static_cast<double>(c1 - c0) / n);
+        }
+        return r;
+    }
+
+    static double median(std::vector<double> v) {
+        if (v.empty())
+            return 0.0;
+        std::sort(v.begin(), v.end());
+        const size_t mid = v.size() / 2;
+        return v.size() % 2 ? v[mid] : (v[mid - 1] + v[mid]) / 2.0;
+    }
+
+    static void write_series(JsonWriter& json, const std::string& name, const std::vector<double>& v) {
+        json.key(name).begin_object()
+            .key("median").value(median(v))
+            .key("min").value(v.empty() ? 0.0 : *std::min_element(v.begin(), v.end()))
+            .key("max").value(v.empty() ? 0.0 : *std::max_element(v.begin(), v.end()))
+            .key("samples").value(v)
+            .end_object();
+    }
+
+private:
+    double _min_time_ms;
+    int _repetitions;
+    std::vector<Benchmark> _benchmarks;
+    std::vector<Result> _results;
+};
+
+}
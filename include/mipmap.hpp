@@ -0,0 +1,623 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <GL/glew.h>
+// stb_image_resize.h can't be included twice in the translation unit which defines
+// STB_IMAGE_RESIZE_IMPLEMENTATION
+#ifndef STBIR_INCLUDE_STB_IMAGE_RESIZE_H
+#include <stb_image_resize.h>
+#endif
+
+#include "compute.hpp"
+#include "shader.hpp"
+#include "thread_pool.hpp"
+
+namespace trif
+{
+
+/// Who builds the mip chain of a texture
+enum class MipBackend {
+    /// glGenerateMipmap, quality and speed up to the driver
+    Driver,
+    /// MipBuilder::build() on worker threads, then uploaded with the base level
+    CPU,
+    /// MipBuilder::generate_compute(), all levels in a single dispatch
+    Compute,
+};
+
+/// Downsampling filter of the CPU backend
+enum class MipFilter {
+    /// 2x2 average
+    Box,
+    /// 8-tap Kaiser-windowed sinc, sharper than box without visible ringing
+    Kaiser,
+    /// stb_image_resize's Mitchell-Netravali cubic
+    Mitchell,
+};
+
+/// Number of levels of a full mip chain
+inline int mip_levels(int width, int height)
+{
+    int levels = 1;
+    while ((width | height) >> levels)
+        levels++;
+    return levels;
+}
+
+/// All levels of an 8-bit image, tightly packed one after the other
+struct MipChain {
+    int width{0};
+    int height{0};
+    int channels{0};
+    std::vector<size_t> offsets;
+    std::vector<unsigned char> data;
+
+    int levels() const { return static_cast<int>(offsets.size()); }
+    int level_width(int level) const { return std::max(1, width >> level); }
+    int level_height(int level) const { return std::max(1, height >> level); }
+    size_t level_size(int level) const {
+        return static_cast<size_t>(level_width(level)) * level_height(level) * channels;
+    }
+    unsigned char *level_data(int level) { return data.data() + offsets[level]; }
+    const unsigned char *level_data(int level) const { return data.data() + offsets[level]; }
+
+    void allocate(int w, int h, int c) {
+        width = w;
+        height = h;
+        channels = c;
+        offsets.clear();
+
+        size_t size = 0;
+        for (int level = 0; level < mip_levels(w, h); level++) {
+            offsets.push_back(size);
+            size += level_size(level);
+        }
+        data.resize(size);
+    }
+};
+
+
+namespace detail
+{
+
+/// Writes rows [y0, y1) of the 2x box-downsampled src into dst
+inline void downsample_box(const unsigned char *src, int sw, int sh,
+                           unsigned char *dst, int dw, int channels, int y0, int y1)
+{
+    for (int y = y0; y < y1; y++) {
+        const unsigned char *r0 = src + static_cast<size_t>(std::min(2 * y, sh - 1)) * sw * channels;
+        const unsigned char *r1 = src + static_cast<size_t>(std::min(2 * y + 1, sh - 1)) * sw * channels;
+        unsigned char *out = dst + static_cast<size_t>(y) * dw * channels;
+        int x = 0;
+
+#if defined(__SSE2__)
+        if (channels == 4) {
+            // 8 source texels of both rows per 4 output texels, summed in 16 bits
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i two = _mm_set1_epi16(2);
+            for (; 2 * x + 8 <= sw && x + 4 <= dw; x += 4) {
+                __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r0 + 8 * x));
+                __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r0 + 8 * x + 16));
+                __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r1 + 8 * x));
+                __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r1 + 8 * x + 16));
+
+                // vertical sums of texels 0-1, 2-3, 4-5, 6-7
+                __m128i v01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+                __m128i v23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+                __m128i v45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+                __m128i v67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+                // horizontal sums of neighbouring texels
+                __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi64(v01, v23), _mm_unpackhi_epi64(v01, v23));
+                __m128i s1 = _mm_add_epi16(_mm_unpacklo_epi64(v45, v67), _mm_unpackhi_epi64(v45, v67));
+
+                s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+                s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4 * x), _mm_packus_epi16(s0, s1));
+            }
+        }
+#endif
+
+        for (; x < dw; x++) {
+            int x0 = std::min(2 * x, sw - 1) * channels;
+            int x1 = std::min(2 * x + 1, sw - 1) * channels;
+            for (int c = 0; c < channels; c++)
+                out[x * channels + c] = static_cast<unsigned char>(
+                        (r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) >> 2);
+        }
+    }
+}
+
+constexpr int KAISER_TAPS = 8;
+
+/// Weights of an 8-tap Kaiser-windowed sinc for 2x decimation. Tap k weighs the source
+/// texel 2x - 3 + k of output texel x.
+inline const std::array<float, KAISER_TAPS>& kaiser_weights()
+{
+    static const std::array<float, KAISER_TAPS> weights = [] {
+        // zeroth order modified Bessel function of the first kind
+        auto bessel_i0 = [](double x) {
+            double sum = 1.0, term = 1.0;
+            for (int k = 1; k < 20; k++) {
+                term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                sum += term;
+            }
+            return sum;
+        };
+
+        const double alpha = 4.0;
+        const double radius = KAISER_TAPS / 2.0;
+        std::array<float, KAISER_TAPS> w;
+        double total = 0.0;
+
+        for (int k = 0; k < KAISER_TAPS; k++) {
+            double d = k - 3.5;   // distance to the output texel center in source texels
+            double x = M_PI * d / 2.0;
+            double sinc = std::sin(x) / x;
+            double r = d / radius;
+            double window = bessel_i0(alpha * std::sqrt(std::max(0.0, 1.0 - r * r))) / bessel_i0(alpha);
+            w[k] = static_cast<float>(sinc * window);
+            total += w[k];
+        }
+
+        for (auto& v : w)
+            v = static_cast<float>(v / total);
+        return w;
+    }();
+
+    return weights;
+}
+
+/// Writes rows [y0, y1) of the 2x Kaiser-downsampled src into dst. Separable: source
+/// rows are filtered horizontally into floats, then columns vertically.
+inline void downsample_kaiser(const unsigned char *src, int sw, int sh,
+                              unsigned char *dst, int dw, int channels, int y0, int y1)
+{
+    const auto& w = kaiser_weights();
+    const int row_begin = std::max(0, 2 * y0 - 3);
+    const int row_end = std::min(sh, 2 * (y1 - 1) + 5);
+    const size_t row_floats = static_cast<size_t>(dw) * channels;
+
+    std::vector<float> rows(row_floats * (row_end - row_begin));
+
+    for (int r = row_begin; r < row_end; r++) {
+        const unsigned char *in = src + static_cast<size_t>(r) * sw * channels;
+        float *out = rows.data() + (r - row_begin) * row_floats;
+
+        for (int x = 0; x < dw; x++) {
+#if defined(__SSE2__)
+            if (channels == 4) {
+                __m128 acc = _mm_setzero_ps();
+                for (int k = 0; k < KAISER_TAPS; k++) {
+                    int sx = std::min(std::max(2 * x - 3 + k, 0), sw - 1);
+                    int texel;
+                    memcpy(&texel, in + 4 * sx, 4);
+                    __m128i v = _mm_cvtsi32_si128(texel);
+                    v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, _mm_setzero_si128()), _mm_setzero_si128());
+                    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(w[k])));
+                }
+                _mm_storeu_ps(out + 4 * x, acc);
+                continue;
+            }
+#endif
+            for (int c = 0; c < channels; c++) {
+                float acc = 0.0f;
+                for (int k = 0; k < KAISER_TAPS; k++) {
+                    int sx = std::min(std::max(2 * x - 3 + k, 0), sw - 1);
+                    acc += w[k] * in[sx * channels + c];
+                }
+                out[x * channels + c] = acc;
+            }
+        }
+    }
+
+    for (int y = y0; y < y1; y++) {
+        unsigned char *out = dst + static_cast<size_t>(y) * dw * channels;
+        const float *taps[KAISER_TAPS];
+        for (int k = 0; k < KAISER_TAPS; k++) {
+            int sy = std::min(std::max(2 * y - 3 + k, 0), sh - 1);
+            taps[k] = rows.data() + (sy - row_begin) * row_floats;
+        }
+
+        size_t i = 0;
+#if defined(__SSE2__)
+        for (; i + 4 <= row_floats; i += 4) {
+            __m128 acc = _mm_setzero_ps();
+            for (int k = 0; k < KAISER_TAPS; k++)
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(taps[k] + i), _mm_set1_ps(w[k])));
+
+            // round, then saturate to [0, 255] by the packs
+            __m128i v = _mm_cvtps_epi32(acc);
+            v = _mm_packs_epi32(v, v);
+            v = _mm_packus_epi16(v, v);
+            int packed = _mm_cvtsi128_si32(v);
+            memcpy(out + i, &packed, 4);
+        }
+#endif
+        for (; i < row_floats; i++) {
+            float acc = 0.0f;
+            for (int k = 0; k < KAISER_TAPS; k++)
+                acc += w[k] * taps[k][i];
+            out[i] = static_cast<unsigned char>(std::min(std::max(std::lround(acc), 0l), 255l));
+        }
+    }
+}
+
+/// Writes rows [y0, y1) of src resized by stb_image_resize into dst
+inline void downsample_stb(const unsigned char *src, int sw, int sh,
+                           unsigned char *dst, int dw, int dh, int channels, int y0, int y1)
+{
+    stbir_resize_region(src, sw, sh, 0,
+                        dst + static_cast<size_t>(y0) * dw * channels, dw, y1 - y0, 0,
+                        STBIR_TYPE_UINT8, channels, STBIR_ALPHA_CHANNEL_NONE, 0,
+                        STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP,
+                        STBIR_FILTER_MITCHELL, STBIR_FILTER_MITCHELL,
+                        STBIR_COLORSPACE_LINEAR, NULL,
+                        0.0f, static_cast<float>(y0) / dh, 1.0f, static_cast<float>(y1) / dh);
+}
+
+}
+
+
+/// Builds mip chains with a choice of backends.
+///
+/// The CPU backend builds each level from the previous one. A level is split into strips
+/// of TILE_ROWS rows which are filtered in parallel on the thread pool. Levels too small
+/// to split run on the calling thread. The box and Kaiser kernels are SSE2, the Mitchell
+/// filter goes through stb_image_resize.
+///
+/// The compute backend reduces the base level to all the others in a single dispatch.
+/// Every workgroup reduces a 64x64 block through shared memory, which produces 6 levels.
+/// The last workgroup to finish, found with an atomic counter, then reduces level 6 to
+/// the remaining levels. That is a single 64x64 block, so bases larger than 4096 get
+/// levels 1 to 6 from the dispatch and the rest from glGenerateMipmap.
+///
+/// CPU-built chains can be cached on disk, see TextureCache.
+class MipBuilder {
+public:
+    static constexpr int TILE_ROWS = 32;
+    /// Levels the compute backend generates at most, i.e. bases up to 4096x4096
+    static constexpr int MAX_COMPUTE_LEVELS = 12;
+    /// Largest base whose level 6 fits the 64x64 block of the last workgroup
+    static constexpr int MAX_COMPUTE_SIZE = 64 << 6;
+
+public:
+    /// Runs on the given pool, or on a pool of its own
+    explicit MipBuilder(ThreadPool *pool = nullptr)
+        : _pool(pool) {}
+
+    ~MipBuilder() {
+        if (_counter)
+            glDeleteBuffers(1, &_counter);
+    }
+
+    /// not allowed
+    MipBuilder(const MipBuilder&) = delete;
+    MipBuilder& operator=(const MipBuilder&) = delete;
+
+    MipChain build(const unsigned char *pixels, int width, int height, int channels, MipFilter filter) {
+        MipChain chain;
+        chain.allocate(width, height, channels);
+        memcpy(chain.level_data(0), pixels, chain.level_size(0));
+
+        ThreadPool& pool = this->pool();
+
+        for (int level = 1; level < chain.levels(); level++) {
+            const unsigned char *src = chain.level_data(level - 1);
+            unsigned char *dst = chain.level_data(level);
+            int sw = chain.level_width(level - 1), sh = chain.level_height(level - 1);
+            int dw = chain.level_width(level), dh = chain.level_height(level);
+
+            size_t n_tiles = (dh + TILE_ROWS - 1) / TILE_ROWS;
+            pool.parallel_for(n_tiles, [&](size_t tile) {
+                int y0 = static_cast<int>(tile) * TILE_ROWS;
+                int y1 = std::min(y0 + TILE_ROWS, dh);
+
+                switch (filter) {
+                    case MipFilter::Box:
+                        detail::downsample_box(src, sw, sh, dst, dw, channels, y0, y1);
+                        break;
+                    case MipFilter::Kaiser:
+                        detail::downsample_kaiser(src, sw, sh, dst, dw, channels, y0, y1);
+                        break;
+                    case MipFilter::Mitchell:
+                        detail::downsample_stb(src, sw, sh, dst, dw, dh, channels, y0, y1);
+                        break;
+                }
+            });
+        }
+
+        return chain;
+    }
+
+    /// Uploads every level of the chain into the bound GL_TEXTURE_2D, whose storage must
+    /// have been allocated already. With `from_unpack_buffer` the chain is sourced from
+    /// the bound pixel-unpack buffer, where it has been copied at offset 0.
+    static void upload(const MipChain& chain, bool from_unpack_buffer = false) {
+        upload(chain.width, chain.height, chain.channels, chain.offsets,
+               from_unpack_buffer ? nullptr : chain.data.data());
+    }
+
+    /// Same for levels laid out like in a MipChain at `offsets` of `data`, or of the
+    /// bound pixel-unpack buffer if `data` is null
+    static void upload(int width, int height, int channels, const std::vector<size_t>& offsets,
+                       const unsigned char *data) {
+        static const GLenum formats[] = {GL_RED, GL_RED, GL_RG, GL_RGB, GL_RGBA};
+
+        GLint alignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        for (size_t level = 0; level < offsets.size(); level++) {
+            const void *src = data ? static_cast<const void *>(data + offsets[level])
+                                   : reinterpret_cast<const void *>(offsets[level]);
+            glTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), 0, 0,
+                            std::max(1, width >> level), std::max(1, height >> level),
+                            formats[channels], GL_UNSIGNED_BYTE, src);
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    }
+
+    /// Generates all levels below the base of an RGBA8 texture with immutable storage.
+    /// Falls back to glGenerateMipmap if compute shaders or enough image units are
+    /// missing. Bases larger than MAX_COMPUTE_SIZE only get levels 1 to 6 from the
+    /// dispatch, glGenerateMipmap builds the rest from level 6.
+    void generate_compute(GLuint texture, int width, int height) {
+        const int total = mip_levels(width, height) - 1;
+        const int cap = std::max(width, height) > MAX_COMPUTE_SIZE ? 6 : MAX_COMPUTE_LEVELS;
+        const int levels = std::min(total, cap);
+        if (levels <= 0)
+            return;
+
+        GLint max_images = 0;
+        if (GLEW_ARB_compute_shader)
+            glGetIntegerv(GL_MAX_COMPUTE_IMAGE_UNIFORMS, &max_images);
+
+        if (max_images < levels) {
+            std::cerr << "MipBuilder: compute downsampler unsupported, using glGenerateMipmap" << std::endl;
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            return;
+        }
+
+        GLint current_program;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current_program);
+
+        auto& program = compute_program(levels);
+        program.bind();
+        glUniform2i(program.uniform("base_size"), width, height);
+        program.uniform("levels", levels);
+
+        if (!_counter) {
+            glGenBuffers(1, &_counter);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, _counter);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+        }
+        GLuint zero = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _counter);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _counter);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        for (int level = 1; level <= levels; level++)
+            bind_image(level - 1, texture, GL_RGBA8, ImageAccess::ReadWrite, level, 0);
+
+        program.dispatch(groups_for(width, 64), groups_for(height, 64));
+        // sampled, written as images by later dispatches, or read back and filtered by
+        // glGenerateMipmap below
+        memory_barrier(Barrier::TextureFetch | Barrier::Images | Barrier::TextureUpdate);
+        glUseProgram(current_program);
+
+        if (levels < total) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        }
+    }
+
+    /// Prints how long each backend takes to build the chain of an RGBA8 image,
+    /// glGenerateMipmap being the reference
+    void benchmark(const unsigned char *pixels, int width, int height, std::ostream& os = std::cout) {
+        const int levels = mip_levels(width, height);
+        const int repeat = 5;
+
+        // a timestamp pair rather than GL_TIME_ELAPSED, which some drivers only
+        // measure around draws
+        GLuint queries[2];
+        glGenQueries(2, queries);
+
+        auto gpu = [&](const char *name, std::function<void(GLuint)> generate) {
+            double best_cpu = 1e30, best_gpu = 1e30;
+            for (int i = 0; i <= repeat; i++) {
+                GLuint tex;
+                glGenTextures(1, &tex);
+                glBindTexture(GL_TEXTURE_2D, tex);
+                glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGBA8, width, height);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+                glFinish();
+
+                auto start = std::chrono::steady_clock::now();
+                glQueryCounter(queries[0], GL_TIMESTAMP);
+                generate(tex);
+                glQueryCounter(queries[1], GL_TIMESTAMP);
+                glFinish();
+                double cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                GLuint64 begin, end;
+                glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+                glDeleteTextures(1, &tex);
+
+                // the first run warms up shader compilation and driver paths
+                if (i > 0) {
+                    best_cpu = std::min(best_cpu, cpu_ms);
+                    best_gpu = std::min(best_gpu, (end - begin) / 1.0e6);
+                }
+            }
+            os << "  " << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(3)
+               << std::setw(10) << best_cpu << " ms wall" << std::setw(10) << best_gpu << " ms GPU\n";
+        };
+
+        auto cpu = [&](const char *name, MipFilter filter) {
+            double best = 1e30;
+            for (int i = 0; i < repeat; i++) {
+                auto start = std::chrono::steady_clock::now();
+                MipChain chain = build(pixels, width, height, 4, filter);
+                best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+            os << "  " << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(3)
+               << std::setw(10) << best << " ms wall (" << pool().size() + 1 << " threads)\n";
+        };
+
+        os << "Mipmap generation of " << width << "x" << height << " RGBA8, " << levels << " levels, best of " << repeat << ":\n";
+        gpu("glGenerateMipmap", [](GLuint) { glGenerateMipmap(GL_TEXTURE_2D); });
+        gpu("compute", [&](GLuint tex) { generate_compute(tex, width, height); });
+        cpu("cpu box", MipFilter::Box);
+        cpu("cpu kaiser", MipFilter::Kaiser);
+        cpu("cpu mitchell (stb)", MipFilter::Mitchell);
+
+        glDeleteQueries(2, queries);
+    }
+
+private:
+    ThreadPool& pool() {
+        if (!_pool) {
+            _own_pool.reset(new ThreadPool());
+            _pool = _own_pool.get();
+        }
+        return *_pool;
+    }
+
+    ComputeProgram& compute_program(int levels) {
+        auto it = _programs.find(levels);
+        if (it != _programs.end())
+            return *it->second;
+
+        ShaderSourceTemplate tmpl(compute_source());
+        std::string source = tmpl.specialize({{"LEVELS", std::to_string(levels)}});
+        auto *program = new ComputeProgram(source);
+        // linked once, generate_compute() only binds it
+        program->use();
+        _programs[levels].reset(program);
+        return *program;
+    }
+
+    static const char *compute_source() {
+        return R"(
+#version 430 core
+layout (local_size_x = 16, local_size_y = 16) in;
+
+layout (binding = 0) uniform sampler2D base;
+layout (rgba8, binding = 0) uniform coherent image2D dst[${LEVELS}];
+layout (std430, binding = 0) coherent buffer Counter { uint groups_done; };
+
+uniform ivec2 base_size;
+uniform int levels;
+
+shared vec4 tile[32][32];
+shared bool is_last;
+
+ivec2 level_size(int level)
+{
+    return max(base_size >> level, ivec2(1));
+}
+
+vec4 fetch(int level, ivec2 p)
+{
+    p = min(p, level_size(level) - 1);
+    if (level == 0)
+        return texelFetch(base, p, 0);
+    return imageLoad(dst[level - 1], p);
+}
+
+void store(int level, ivec2 p, vec4 v)
+{
+    if (level <= levels && all(lessThan(p, level_size(level))))
+        imageStore(dst[level - 1], p, v);
+}
+
+// Reduces the 64x64 block of src_level at `group` to the 6 levels below it
+void reduce(int src_level, ivec2 group)
+{
+    ivec2 t = ivec2(gl_LocalInvocationID.xy);
+
+    for (int j = 0; j < 2; j++) {
+        for (int i = 0; i < 2; i++) {
+            ivec2 p = group * 32 + t * 2 + ivec2(i, j);
+            ivec2 q = p * 2;
+            vec4 v = 0.25 * (fetch(src_level, q) + fetch(src_level, q + ivec2(1, 0)) +
+                             fetch(src_level, q + ivec2(0, 1)) + fetch(src_level, q + ivec2(1, 1)));
+            tile[t.y * 2 + j][t.x * 2 + i] = v;
+            store(src_level + 1, p, v);
+        }
+    }
+
+    for (int k = 2; k <= 6; k++) {
+        int n = 64 >> k;
+        bool inside = all(lessThan(t, ivec2(n)));
+        vec4 v = vec4(0.0);
+
+        memoryBarrierShared();
+        barrier();
+        if (inside)
+            v = 0.25 * (tile[t.y * 2][t.x * 2] + tile[t.y * 2][t.x * 2 + 1] +
+                        tile[t.y * 2 + 1][t.x * 2] + tile[t.y * 2 + 1][t.x * 2 + 1]);
+        memoryBarrierShared();
+        barrier();
+        if (inside) {
+            tile[t.y][t.x] = v;
+            store(src_level + k, group * n + t, v);
+        }
+    }
+}
+
+void main()
+{
+    reduce(0, ivec2(gl_WorkGroupID.xy));
+
+    if (levels <= 6)
+        return;
+
+    // Level 6 is complete once every workgroup has got here
+    memoryBarrierImage();
+    barrier();
+    if (gl_LocalInvocationIndex == 0u)
+        is_last = atomicAdd(groups_done, 1u) == gl_NumWorkGroups.x * gl_NumWorkGroups.y - 1u;
+    memoryBarrierShared();
+    barrier();
+
+    if (!is_last)
+        return;
+
+    memoryBarrierImage();
+    reduce(6, ivec2(0));
+}
+)";
+    }
+
+private:
+    ThreadPool *_pool;
+    std::unique_ptr<ThreadPool> _own_pool;
+    std::map<int, std::unique_ptr<ComputeProgram>> _programs;
+    GLuint _counter{0};
+};
+
+}
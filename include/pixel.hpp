@@ -0,0 +1,771 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define TRIF_PIXEL_X86 1
+#include <immintrin.h>
+/// Compiles a function for AVX2 whatever the target of the translation unit, it is
+/// only called once the CPU is known to support it
+#define TRIF_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace trif
+{
+
+/// Conversions of 8-bit images, vectorized with SSE2 and AVX2.
+///
+/// Every function dispatches at run time to the widest instruction set the CPU
+/// supports, see isa(). set_isa() restricts it, e.g. to compare the kernels.
+namespace pixel
+{
+
+enum class Isa { Scalar, SSE2, AVX2 };
+
+inline const char *isa_name(Isa isa)
+{
+    switch (isa) {
+        case Isa::SSE2: return "sse2";
+        case Isa::AVX2: return "avx2";
+        default:        return "scalar";
+    }
+}
+
+/// Widest instruction set of the CPU
+inline Isa detect_isa()
+{
+#if defined(TRIF_PIXEL_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return Isa::AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return Isa::SSE2;
+#endif
+    return Isa::Scalar;
+}
+
+/// Component-wise difference of two images, see compare()
+struct Difference {
+    size_t count{0};
+    uint64_t squared_error{0};
+    unsigned max_error{0};
+    /// Components differing by more than the tolerance
+    size_t over_tolerance{0};
+
+    double mse() const { return count ? static_cast<double>(squared_error) / count : 0.0; }
+
+    /// Peak signal-to-noise ratio in dB, infinite for identical images
+    double psnr() const { return squared_error ? 10.0 * std::log10(255.0 * 255.0 / mse()) : INFINITY; }
+
+    void add(const Difference& other) {
+        count += other.count;
+        squared_error += other.squared_error;
+        max_error = std::max(max_error, other.max_error);
+        over_tolerance += other.over_tolerance;
+    }
+};
+
+namespace detail
+{
+
+inline Isa& current_isa()
+{
+    static Isa isa = detect_isa();
+    return isa;
+}
+
+/// x / 255 rounded to nearest, exact for x in [0, 255 * 255]
+inline uint8_t div255(unsigned x)
+{
+    x += 128;
+    return static_cast<uint8_t>((x + (x >> 8)) >> 8);
+}
+
+inline float srgb_decode(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float srgb_encode(float l)
+{
+    return l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+}
+
+/// Linear value of every sRGB code
+inline const float *srgb_to_linear_table()
+{
+    static const struct Table {
+        float values[256];
+        Table() {
+            for (int i = 0; i < 256; i++)
+                values[i] = srgb_decode(i / 255.0f);
+        }
+    } table;
+    return table.values;
+}
+
+/// sRGB code of linear values quantized to 16 bits. The steepest slope of the curve is
+/// 12.92, so 16 bits keep the result within 0.05 of a code of the exact conversion.
+/// Padded so that 32-bit gathers of the last entries stay in bounds.
+constexpr int LINEAR_BITS = 16;
+
+inline const uint8_t *linear_to_srgb_table()
+{
+    static const struct Table {
+        uint8_t values[(1 << LINEAR_BITS) + 3];
+        Table() {
+            for (int i = 0; i < (1 << LINEAR_BITS); i++)
+                values[i] = static_cast<uint8_t>(srgb_encode(i / float((1 << LINEAR_BITS) - 1)) * 255.0f + 0.5f);
+            values[1 << LINEAR_BITS] = values[(1 << LINEAR_BITS) + 1] = values[(1 << LINEAR_BITS) + 2] = 0;
+        }
+    } table;
+    return table.values;
+}
+
+/// Whether component i of a texel is alpha, which stays linear
+inline bool is_alpha(int i, int channels)
+{
+    return (channels == 4 && i == 3) || (channels == 2 && i == 1);
+}
+
+// Scalar kernels, also finishing the tails of the vector ones
+
+inline void rgb_to_rgba_scalar(const uint8_t *src, uint8_t *dst, size_t n, uint8_t alpha)
+{
+    for (size_t i = 0; i < n; i++) {
+        dst[4 * i] = src[3 * i];
+        dst[4 * i + 1] = src[3 * i + 1];
+        dst[4 * i + 2] = src[3 * i + 2];
+        dst[4 * i + 3] = alpha;
+    }
+}
+
+inline void srgb_to_linear_scalar(const uint8_t *src, float *dst, size_t count, int channels, size_t first)
+{
+    const float *table = srgb_to_linear_table();
+    for (size_t i = first; i < count; i++)
+        dst[i] = is_alpha(static_cast<int>(i % channels), channels) ? src[i] * (1.0f / 255.0f) : table[src[i]];
+}
+
+inline void linear_to_srgb_scalar(const float *src, uint8_t *dst, size_t count, int channels, size_t first)
+{
+    const uint8_t *table = linear_to_srgb_table();
+    const float scale = float((1 << LINEAR_BITS) - 1);
+    for (size_t i = first; i < count; i++) {
+        float v = std::min(std::max(src[i], 0.0f), 1.0f);
+        dst[i] = is_alpha(static_cast<int>(i % channels), channels) ? static_cast<uint8_t>(v * 255.0f + 0.5f)
+                                                                      : table[static_cast<int>(v * scale + 0.5f)];
+    }
+}
+
+inline void premultiply_alpha_scalar(uint8_t *rgba, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        unsigned a = rgba[4 * i + 3];
+        rgba[4 * i] = div255(rgba[4 * i] * a);
+        rgba[4 * i + 1] = div255(rgba[4 * i + 1] * a);
+        rgba[4 * i + 2] = div255(rgba[4 * i + 2] * a);
+    }
+}
+
+inline void swap_rows_scalar(uint8_t *a, uint8_t *b, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        std::swap(a[i], b[i]);
+}
+
+inline void compare_scalar(const uint8_t *a, const uint8_t *b, size_t count, unsigned tolerance, Difference& diff)
+{
+    for (size_t i = 0; i < count; i++) {
+        unsigned d = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        diff.squared_error += d * d;
+        diff.max_error = std::max(diff.max_error, d);
+        diff.over_tolerance += d > tolerance;
+    }
+}
+
+/// Blocks of the vector kernels, after which their 32-bit sums of squares are
+/// flushed before they may overflow
+constexpr size_t COMPARE_BLOCK = 4096;
+
+/// BT.601 limited range in 8-bit fixed point, chroma weighing the sum of 2x2 texels
+inline uint8_t luma(unsigned r, unsigned g, unsigned b)
+{
+    return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+inline uint8_t chroma_u(int r, int g, int b)
+{
+    return static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+}
+
+inline uint8_t chroma_v(int r, int g, int b)
+{
+    return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+}
+
+inline void luma_row_scalar(const uint8_t *rgba, uint8_t *y, int width, int first)
+{
+    for (int i = first; i < width; i++)
+        y[i] = luma(rgba[4 * i], rgba[4 * i + 1], rgba[4 * i + 2]);
+}
+
+/// Chroma of the 2x2 blocks of two rows, from block `first` on. The last texel of an
+/// odd width counts twice.
+inline void chroma_row_scalar(const uint8_t *row0, const uint8_t *row1, uint8_t *u, uint8_t *v,
+                              int width, int first)
+{
+    for (int i = first; i < (width + 1) / 2; i++) {
+        const int x0 = 4 * (2 * i), x1 = 4 * std::min(2 * i + 1, width - 1);
+        int sum[3];
+        for (int c = 0; c < 3; c++)
+            sum[c] = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+        u[i] = chroma_u(sum[0], sum[1], sum[2]);
+        v[i] = chroma_v(sum[0], sum[1], sum[2]);
+    }
+}
+
+#if defined(__SSE2__)
+
+/// 4 texels per iteration, each gathered by shifting its 3 bytes to the bottom of a dword
+inline void rgb_to_rgba_sse2(const uint8_t *src, uint8_t *dst, size_t n, uint8_t alpha)
+{
+    const __m128i alpha_mask = _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(alpha) << 24));
+    const __m128i rgb_mask = _mm_set1_epi32(0x00ffffff);
+    size_t i = 0;
+
+    // the 16-byte load reads 4 bytes past the 4 texels
+    for (; i + 6 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 3 * i));
+        __m128i p01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+        __m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+        __m128i rgba = _mm_or_si128(_mm_and_si128(_mm_unpacklo_epi64(p01, p23), rgb_mask), alpha_mask);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i), rgba);
+    }
+
+    rgb_to_rgba_scalar(src + 3 * i, dst + 4 * i, n - i, alpha);
+}
+
+inline void linear_to_srgb_sse2(const float *src, uint8_t *dst, size_t count, int channels)
+{
+    const uint8_t *table = linear_to_srgb_table();
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    // alpha components of 4 consecutive components, a period of 4 or 2 texels
+    const __m128 is_alpha_lane = channels == 4 ? _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0))
+                               : channels == 2 ? _mm_castsi128_ps(_mm_set_epi32(-1, 0, -1, 0))
+                               : zero;
+    const __m128 scale = _mm_or_ps(_mm_and_ps(is_alpha_lane, _mm_set1_ps(255.0f)),
+                                   _mm_andnot_ps(is_alpha_lane, _mm_set1_ps(float((1 << LINEAR_BITS) - 1))));
+    size_t i = 0;
+
+    // every 4 components have their alpha in the same lanes, 3 channels having none
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one);
+        __m128i q = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+        alignas(16) int32_t idx[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(idx), q);
+        for (int k = 0; k < 4; k++)
+            dst[i + k] = is_alpha(static_cast<int>((i + k) % channels), channels) ? static_cast<uint8_t>(idx[k])
+                                                                                    : table[idx[k]];
+    }
+
+    linear_to_srgb_scalar(src, dst, count, channels, i);
+}
+
+inline void premultiply_alpha_sse2(uint8_t *rgba, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    // multiplies alpha by 255, which leaves it unchanged
+    const __m128i keep_alpha = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i color_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgba + 4 * i));
+        __m128i halves[2] = {_mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero)};
+
+        for (auto& h : halves) {
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(h, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm_or_si128(_mm_and_si128(a, color_mask), keep_alpha);
+            __m128i x = _mm_add_epi16(_mm_mullo_epi16(h, a), bias);
+            h = _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(rgba + 4 * i), _mm_packus_epi16(halves[0], halves[1]));
+    }
+
+    premultiply_alpha_scalar(rgba + 4 * i, n - i);
+}
+
+inline void swap_rows_sse2(uint8_t *a, uint8_t *b, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(a + i), vb);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(b + i), va);
+    }
+    swap_rows_scalar(a + i, b + i, size - i);
+}
+
+/// 16 components per iteration. The absolute difference is the sum of both saturated
+/// subtractions, and components within the tolerance saturate to zero once more.
+inline void compare_sse2(const uint8_t *a, const uint8_t *b, size_t count, unsigned tolerance, Difference& diff)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i tol = _mm_set1_epi8(static_cast<char>(std::min(tolerance, 255u)));
+    __m128i max = zero;
+    size_t i = 0;
+
+    while (i + 16 <= count) {
+        __m128i sum = zero;
+        for (size_t k = 0; k < COMPARE_BLOCK && i + 16 <= count; k++, i += 16) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+            __m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+            max = _mm_max_epu8(max, d);
+
+            __m128i within = _mm_cmpeq_epi8(_mm_subs_epu8(d, tol), zero);
+            diff.over_tolerance += 16 - __builtin_popcount(_mm_movemask_epi8(within));
+
+            __m128i lo = _mm_unpacklo_epi8(d, zero), hi = _mm_unpackhi_epi8(d, zero);
+            sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+        }
+
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes), sum);
+        for (uint32_t lane : lanes)
+            diff.squared_error += lane;
+    }
+
+    alignas(16) uint8_t maxima[16];
+    _mm_store_si128(reinterpret_cast<__m128i *>(maxima), max);
+    for (uint8_t m : maxima)
+        diff.max_error = std::max<unsigned>(diff.max_error, m);
+
+    compare_scalar(a + i, b + i, count - i, tolerance, diff);
+}
+
+/// Adds the two products _mm_madd_epi16 leaves for each texel of a and b, giving the
+/// weighted sums of their 4 texels in order
+inline __m128i sum_texels_sse2(__m128i a, __m128i b)
+{
+    __m128 x = _mm_castsi128_ps(a), y = _mm_castsi128_ps(b);
+    return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0))),
+                         _mm_castps_si128(_mm_shuffle_ps(x, y, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+/// Luma of 4 texels as 32-bit lanes
+inline __m128i luma4_sse2(__m128i texels)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i coefs = _mm_set_epi16(0, 25, 129, 66, 0, 25, 129, 66);
+    __m128i sum = sum_texels_sse2(_mm_madd_epi16(_mm_unpacklo_epi8(texels, zero), coefs),
+                                  _mm_madd_epi16(_mm_unpackhi_epi8(texels, zero), coefs));
+    return _mm_add_epi32(_mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8), _mm_set1_epi32(16));
+}
+
+/// 16 texels per iteration
+inline void luma_row_sse2(const uint8_t *rgba, uint8_t *y, int width)
+{
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        const __m128i *src = reinterpret_cast<const __m128i *>(rgba + 4 * i);
+        __m128i lo = _mm_packs_epi32(luma4_sse2(_mm_loadu_si128(src)), luma4_sse2(_mm_loadu_si128(src + 1)));
+        __m128i hi = _mm_packs_epi32(luma4_sse2(_mm_loadu_si128(src + 2)), luma4_sse2(_mm_loadu_si128(src + 3)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(y + i), _mm_packus_epi16(lo, hi));
+    }
+    luma_row_scalar(rgba, y, width, i);
+}
+
+/// Sums of the two 2x2 blocks of 4 texels of two rows, as 16-bit RGBA of either block
+inline __m128i block_sums_sse2(__m128i a, __m128i b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+    __m128i right = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+    return _mm_unpacklo_epi64(_mm_add_epi16(left, _mm_srli_si128(left, 8)),
+                              _mm_add_epi16(right, _mm_srli_si128(right, 8)));
+}
+
+/// 4 blocks, 8 texels of both rows, per iteration
+inline void chroma_row_sse2(const uint8_t *row0, const uint8_t *row1, uint8_t *u, uint8_t *v, int width)
+{
+    const __m128i u_coefs = _mm_set_epi16(0, 112, -74, -38, 0, 112, -74, -38);
+    const __m128i v_coefs = _mm_set_epi16(0, -18, -94, 112, 0, -18, -94, 112);
+    const __m128i round = _mm_set1_epi32(512), offset = _mm_set1_epi32(128);
+    int i = 0;
+
+    for (; 2 * i + 8 <= width; i += 4) {
+        const __m128i *a = reinterpret_cast<const __m128i *>(row0 + 8 * i);
+        const __m128i *b = reinterpret_cast<const __m128i *>(row1 + 8 * i);
+        __m128i blocks01 = block_sums_sse2(_mm_loadu_si128(a), _mm_loadu_si128(b));
+        __m128i blocks23 = block_sums_sse2(_mm_loadu_si128(a + 1), _mm_loadu_si128(b + 1));
+
+        __m128i us = sum_texels_sse2(_mm_madd_epi16(blocks01, u_coefs), _mm_madd_epi16(blocks23, u_coefs));
+        __m128i vs = sum_texels_sse2(_mm_madd_epi16(blocks01, v_coefs), _mm_madd_epi16(blocks23, v_coefs));
+        us = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(us, round), 10), offset);
+        vs = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(vs, round), 10), offset);
+
+        __m128i uv = _mm_packus_epi16(_mm_packs_epi32(us, vs), _mm_setzero_si128());
+        uint32_t u4 = static_cast<uint32_t>(_mm_cvtsi128_si32(uv));
+        uint32_t v4 = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(uv, 4)));
+        memcpy(u + i, &u4, 4);
+        memcpy(v + i, &v4, 4);
+    }
+    chroma_row_scalar(row0, row1, u, v, width, i);
+}
+
+#endif
+
+#if defined(TRIF_PIXEL_X86)
+
+/// 8 texels per iteration. Dwords 0-3 and 3-6 of the 32-byte load go to either lane,
+/// so both lanes start with 4 texels which a byte shuffle spreads out.
+TRIF_TARGET_AVX2 inline void rgb_to_rgba_avx2(const uint8_t *src, uint8_t *dst, size_t n, uint8_t alpha)
+{
+    const __m256i dwords = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i alpha_mask = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(alpha) << 24));
+    size_t i = 0;
+
+    // the 32-byte load reads 8 bytes past the 8 texels
+    for (; i + 11 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 3 * i));
+        v = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, dwords), spread);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 4 * i), _mm256_or_si256(v, alpha_mask));
+    }
+
+    rgb_to_rgba_sse2(src + 3 * i, dst + 4 * i, n - i, alpha);
+}
+
+/// Alpha lanes of 8 consecutive components
+TRIF_TARGET_AVX2 inline __m256 alpha_lanes_avx2(int channels)
+{
+    return channels == 4 ? _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1))
+         : channels == 2 ? _mm256_castsi256_ps(_mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1))
+         : _mm256_setzero_ps();
+}
+
+TRIF_TARGET_AVX2 inline void srgb_to_linear_avx2(const uint8_t *src, float *dst, size_t count, int channels)
+{
+    const float *table = srgb_to_linear_table();
+    const __m256 alpha = alpha_lanes_avx2(channels);
+    const __m256 inv255 = _mm256_set1_ps(1.0f / 255.0f);
+    size_t i = 0;
+
+    // 8 components keep the same alpha lanes every iteration for 1, 2 and 4 channels
+    if (channels != 3) {
+        for (; i + 8 <= count; i += 8) {
+            __m256i codes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)));
+            __m256 color = _mm256_i32gather_ps(table, codes, 4);
+            __m256 linear = _mm256_mul_ps(_mm256_cvtepi32_ps(codes), inv255);
+            _mm256_storeu_ps(dst + i, _mm256_blendv_ps(color, linear, alpha));
+        }
+    } else {
+        for (; i + 8 <= count; i += 8) {
+            __m256i codes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)));
+            _mm256_storeu_ps(dst + i, _mm256_i32gather_ps(table, codes, 4));
+        }
+    }
+
+    srgb_to_linear_scalar(src, dst, count, channels, i);
+}
+
+TRIF_TARGET_AVX2 inline void linear_to_srgb_avx2(const float *src, uint8_t *dst, size_t count, int channels)
+{
+    const uint8_t *table = linear_to_srgb_table();
+    const __m256 alpha = alpha_lanes_avx2(channels);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+    const __m256 scale = _mm256_blendv_ps(_mm256_set1_ps(float((1 << LINEAR_BITS) - 1)), _mm256_set1_ps(255.0f), alpha);
+    const __m256i low_byte = _mm256_set1_epi32(0xff);
+    size_t i = 0;
+
+    if (channels != 3) {
+        for (; i + 8 <= count; i += 8) {
+            __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), zero), one);
+            __m256i q = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, scale), half));
+            // 32-bit gathers at byte offsets of the table, keeping their first byte
+            __m256i color = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int *>(table), q, 1), low_byte);
+            __m256i codes = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(color), _mm256_castsi256_ps(q), alpha));
+
+            __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(codes), _mm256_extracti128_si256(codes, 1));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(words, words));
+        }
+    } else {
+        for (; i + 8 <= count; i += 8) {
+            __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), zero), one);
+            __m256i q = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, scale), half));
+            __m256i codes = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int *>(table), q, 1), low_byte);
+
+            __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(codes), _mm256_extracti128_si256(codes, 1));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(words, words));
+        }
+    }
+
+    linear_to_srgb_scalar(src, dst, count, channels, i);
+}
+
+TRIF_TARGET_AVX2 inline void premultiply_alpha_avx2(uint8_t *rgba, size_t n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i bias = _mm256_set1_epi16(128);
+    // the alpha word of every texel, and 255 in its own place so that alpha is kept
+    const __m256i broadcast = _mm256_setr_epi8(6, -1, 6, -1, 6, -1, -1, -1, 14, -1, 14, -1, 14, -1, -1, -1,
+                                               6, -1, 6, -1, 6, -1, -1, -1, 14, -1, 14, -1, 14, -1, -1, -1);
+    const __m256i keep_alpha = _mm256_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rgba + 4 * i));
+        // unpacking and packing both work within lanes, so texels end up in place
+        __m256i halves[2] = {_mm256_unpacklo_epi8(v, zero), _mm256_unpackhi_epi8(v, zero)};
+
+        for (auto& h : halves) {
+            __m256i a = _mm256_or_si256(_mm256_shuffle_epi8(h, broadcast), keep_alpha);
+            __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(h, a), bias);
+            h = _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(rgba + 4 * i), _mm256_packus_epi16(halves[0], halves[1]));
+    }
+
+    premultiply_alpha_sse2(rgba + 4 * i, n - i);
+}
+
+TRIF_TARGET_AVX2 inline void swap_rows_avx2(uint8_t *a, uint8_t *b, size_t size)
+{
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(a + i), vb);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(b + i), va);
+    }
+    swap_rows_sse2(a + i, b + i, size - i);
+}
+
+TRIF_TARGET_AVX2 inline void compare_avx2(const uint8_t *a, const uint8_t *b, size_t count, unsigned tolerance,
+                                          Difference& diff)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i tol = _mm256_set1_epi8(static_cast<char>(std::min(tolerance, 255u)));
+    __m256i max = zero;
+    size_t i = 0;
+
+    while (i + 32 <= count) {
+        __m256i sum = zero;
+        for (size_t k = 0; k < COMPARE_BLOCK && i + 32 <= count; k++, i += 32) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+            __m256i d = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+            max = _mm256_max_epu8(max, d);
+
+            __m256i within = _mm256_cmpeq_epi8(_mm256_subs_epu8(d, tol), zero);
+            diff.over_tolerance += 32 - __builtin_popcount(static_cast<uint32_t>(_mm256_movemask_epi8(within)));
+
+            __m256i lo = _mm256_unpacklo_epi8(d, zero), hi = _mm256_unpackhi_epi8(d, zero);
+            sum = _mm256_add_epi32(sum, _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+        }
+
+        alignas(32) uint32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), sum);
+        for (uint32_t lane : lanes)
+            diff.squared_error += lane;
+    }
+
+    alignas(32) uint8_t maxima[32];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(maxima), max);
+    for (uint8_t m : maxima)
+        diff.max_error = std::max<unsigned>(diff.max_error, m);
+
+    compare_sse2(a + i, b + i, count - i, tolerance, diff);
+}
+
+/// Luma of 8 texels as 32-bit lanes, in order
+TRIF_TARGET_AVX2 inline __m256i luma8_avx2(__m256i texels)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i coefs = _mm256_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0, 66, 129, 25, 0, 66, 129, 25, 0);
+    __m256 x = _mm256_castsi256_ps(_mm256_madd_epi16(_mm256_unpacklo_epi8(texels, zero), coefs));
+    __m256 y = _mm256_castsi256_ps(_mm256_madd_epi16(_mm256_unpackhi_epi8(texels, zero), coefs));
+    __m256i sum = _mm256_add_epi32(_mm256_castps_si256(_mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0))),
+                                   _mm256_castps_si256(_mm256_shuffle_ps(x, y, _MM_SHUFFLE(3, 1, 3, 1))));
+    return _mm256_add_epi32(_mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8),
+                            _mm256_set1_epi32(16));
+}
+
+/// 32 texels per iteration. The packs interleave the lanes, groups of 4 texels end up
+/// in the order 0 2 4 6 1 3 5 7 which a permutation undoes.
+TRIF_TARGET_AVX2 inline void luma_row_avx2(const uint8_t *rgba, uint8_t *y, int width)
+{
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int i = 0;
+    for (; i + 32 <= width; i += 32) {
+        const __m256i *src = reinterpret_cast<const __m256i *>(rgba + 4 * i);
+        __m256i lo = _mm256_packs_epi32(luma8_avx2(_mm256_loadu_si256(src)), luma8_avx2(_mm256_loadu_si256(src + 1)));
+        __m256i hi = _mm256_packs_epi32(luma8_avx2(_mm256_loadu_si256(src + 2)), luma8_avx2(_mm256_loadu_si256(src + 3)));
+        __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi), order);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(y + i), packed);
+    }
+    luma_row_sse2(rgba + 4 * i, y + i, width - i);
+}
+
+#endif
+
+}
+
+/// Instruction set the conversions use
+inline Isa isa()
+{
+    return detail::current_isa();
+}
+
+/// Restricts the conversions to an instruction set, or to the widest one the CPU
+/// supports if it lacks this one
+inline void set_isa(Isa isa)
+{
+    detail::current_isa() = static_cast<int>(isa) <= static_cast<int>(detect_isa()) ? isa : detect_isa();
+}
+
+/// Expands n RGB texels to RGBA with a constant alpha
+inline void rgb_to_rgba(const uint8_t *src, uint8_t *dst, size_t n, uint8_t alpha = 255)
+{
+    switch (isa()) {
+#if defined(TRIF_PIXEL_X86)
+        case Isa::AVX2: detail::rgb_to_rgba_avx2(src, dst, n, alpha); break;
+#endif
+#if defined(__SSE2__)
+        case Isa::SSE2: detail::rgb_to_rgba_sse2(src, dst, n, alpha); break;
+#endif
+        default:        detail::rgb_to_rgba_scalar(src, dst, n, alpha); break;
+    }
+}
+
+/// Decodes n texels of sRGB-encoded components to linear floats. Alpha, the last of
+/// 2 or 4 channels, is scaled to [0, 1] only. The SSE2 path is the scalar lookup,
+/// only AVX2 has gathers.
+inline void srgb_to_linear(const uint8_t *src, float *dst, size_t n, int channels)
+{
+    const size_t count = n * channels;
+    switch (isa()) {
+#if defined(TRIF_PIXEL_X86)
+        case Isa::AVX2: detail::srgb_to_linear_avx2(src, dst, count, channels); break;
+#endif
+        default:        detail::srgb_to_linear_scalar(src, dst, count, channels, 0); break;
+    }
+}
+
+/// Encodes n texels of linear floats, clamped to [0, 1], to sRGB. Alpha, the last of
+/// 2 or 4 channels, is quantized linearly.
+inline void linear_to_srgb(const float *src, uint8_t *dst, size_t n, int channels)
+{
+    const size_t count = n * channels;
+    switch (isa()) {
+#if defined(TRIF_PIXEL_X86)
+        case Isa::AVX2: detail::linear_to_srgb_avx2(src, dst, count, channels); break;
+#endif
+#if defined(__SSE2__)
+        case Isa::SSE2: detail::linear_to_srgb_sse2(src, dst, count, channels); break;
+#endif
+        default:        detail::linear_to_srgb_scalar(src, dst, count, channels, 0); break;
+    }
+}
+
+/// Multiplies the color of n RGBA texels by their alpha, rounding to nearest
+inline void premultiply_alpha(uint8_t *rgba, size_t n)
+{
+    switch (isa()) {
+#if defined(TRIF_PIXEL_X86)
+        case Isa::AVX2: detail::premultiply_alpha_avx2(rgba, n); break;
+#endif
+#if defined(__SSE2__)
+        case Isa::SSE2: detail::premultiply_alpha_sse2(rgba, n); break;
+#endif
+        default:        detail::premultiply_alpha_scalar(rgba, n); break;
+    }
+}
+
+/// Flips an image upside down in place
+inline void flip_vertical(uint8_t *pixels, int width, int height, size_t texel_size)
+{
+    const size_t row = static_cast<size_t>(width) * texel_size;
+    for (int y = 0; y < height / 2; y++) {
+        uint8_t *a = pixels + y * row, *b = pixels + (height - 1 - y) * row;
+        switch (isa()) {
+#if defined(TRIF_PIXEL_X86)
+            case Isa::AVX2: detail::swap_rows_avx2(a, b, row); break;
+#endif
+#if defined(__SSE2__)
+            case Isa::SSE2: detail::swap_rows_sse2(a, b, row); break;
+#endif
+            default:        detail::swap_rows_scalar(a, b, row); break;
+        }
+    }
+}
+
+/// Converts RGBA texels to planar YUV 4:2:0 with BT.601 limited range, e.g. for Y4M.
+/// Row r of the image starts at rgba + r * stride, so a negative stride from the last
+/// row flips it. The chroma planes have (width + 1) / 2 by (height + 1) / 2 samples.
+/// Only luma has an AVX2 path, chroma is a quarter of the work.
+inline void rgba_to_yuv420(const uint8_t *rgba, int width, int height, ptrdiff_t stride,
+                           uint8_t *y, uint8_t *u, uint8_t *v)
+{
+    const int chroma_width = (width + 1) / 2;
+    for (int r = 0; r < height; r++) {
+        const uint8_t *row = rgba + r * stride;
+        switch (isa()) {
+#if defined(TRIF_PIXEL_X86)
+            case Isa::AVX2: detail::luma_row_avx2(row, y + static_cast<size_t>(r) * width, width); break;
+#endif
+#if defined(__SSE2__)
+            case Isa::SSE2: detail::luma_row_sse2(row, y + static_cast<size_t>(r) * width, width); break;
+#endif
+            default:        detail::luma_row_scalar(row, y + static_cast<size_t>(r) * width, width, 0); break;
+        }
+    }
+
+    for (int r = 0; r < height; r += 2) {
+        const uint8_t *row0 = rgba + r * stride;
+        const uint8_t *row1 = r + 1 < height ? row0 + stride : row0;
+        uint8_t *u_row = u + static_cast<size_t>(r / 2) * chroma_width;
+        uint8_t *v_row = v + static_cast<size_t>(r / 2) * chroma_width;
+        switch (isa()) {
+#if defined(__SSE2__)
+            case Isa::AVX2:
+            case Isa::SSE2: detail::chroma_row_sse2(row0, row1, u_row, v_row, width); break;
+#endif
+            default:        detail::chroma_row_scalar(row0, row1, u_row, v_row, width, 0); break;
+        }
+    }
+}
+
+/// Compares n texels of two images of the given texel size component by component,
+/// counting the components which differ by more than `tolerance`
+inline Difference compare(const uint8_t *a, const uint8_t *b, size_t n, size_t texel_size, unsigned tolerance = 0)
+{
+    Difference diff;
+    diff.count = n * texel_size;
+    switch (isa()) {
+#if defined(TRIF_PIXEL_X86)
+        case Isa::AVX2: detail::compare_avx2(a, b, diff.count, tolerance, diff); break;
+#endif
+#if defined(__SSE2__)
+        case Isa::SSE2: detail::compare_sse2(a, b, diff.count, tolerance, diff); break;
+#endif
+        default:        detail::compare_scalar(a, b, diff.count, tolerance, diff); break;
+    }
+    return diff;
+}
+
+}
+
+}
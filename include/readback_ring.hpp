@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <GL/glew.h>
+
+namespace trif
+{
+
+/// Reads frames back without waiting for them: read() copies the framebuffer being
+/// drawn to into the next of a ring of pixel-pack buffers and fences it, collect()
+/// maps the buffers whose fence has signalled, usually a few frames later. Pixels are
+/// RGBA, bottom row first.
+///
+/// The buffers are created on first use, so the ring may be built before the context.
+class ReadbackRing {
+public:
+    /// Frame number, size and pixels of a frame read back, valid during the call only
+    using Callback = std::function<void(uint64_t, int, int, const unsigned char *)>;
+
+    explicit ReadbackRing(size_t size = 3) : _slots(size) {}
+
+    ~ReadbackRing() {
+        for (auto& slot : _slots) {
+            if (slot.fence)
+                glDeleteSync(slot.fence);
+            if (slot.pbo)
+                glDeleteBuffers(1, &slot.pbo);
+        }
+    }
+
+    /// not allowed
+    ReadbackRing(const ReadbackRing&) = delete;
+    ReadbackRing& operator=(const ReadbackRing&) = delete;
+
+    /// Whether the next buffer is still being read into, read() would then have to wait
+    bool busy() const { return _slots[_next].fence != 0; }
+
+    /// Starts reading a frame into the next buffer, which must not be busy
+    void read(uint64_t frame, int width, int height) {
+        Slot& slot = _slots[_next];
+        const size_t size = static_cast<size_t>(width) * height * 4;
+
+        if (!slot.pbo)
+            glGenBuffers(1, &slot.pbo);
+
+        {
+            ReadState state;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+            if (size > slot.size) {
+                glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+                slot.size = size;
+            }
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.frame = frame;
+        slot.width = width;
+        slot.height = height;
+        _next = (_next + 1) % _slots.size();
+    }
+
+    /// Calls `fn` with the pixels of every frame read back, oldest first, waiting for
+    /// them if `wait`. Returns how many there were.
+    size_t collect(bool wait, const Callback& fn) {
+        size_t count = 0;
+        for (size_t i = 0; i < _slots.size(); i++) {
+            Slot& slot = _slots[(_next + i) % _slots.size()];
+            if (!slot.fence)
+                continue;
+
+            GLenum res = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                          wait ? UINT64_MAX : 0);
+            if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+                continue;
+
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+
+            const size_t size = static_cast<size_t>(slot.width) * slot.height * 4;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+            const void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+            if (pixels) {
+                fn(slot.frame, slot.width, slot.height, static_cast<const unsigned char *>(pixels));
+                count++;
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        return count;
+    }
+
+    /// Reads the framebuffer being drawn to into client memory, waiting for it
+    static std::vector<unsigned char> read_now(int width, int height) {
+        std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 4);
+        ReadState state;
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        return pixels;
+    }
+
+private:
+    struct Slot {
+        GLuint pbo{0};
+        size_t size{0};
+        GLsync fence{0};
+        uint64_t frame{0};
+        int width{0};
+        int height{0};
+    };
+
+    /// Selects the framebuffer just drawn to for reading, the back buffer of the window
+    /// by default, and restores the previous state when destroyed
+    struct ReadState {
+        GLint draw_fbo, read_fbo, read_buffer, alignment;
+
+        ReadState() {
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+            glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, draw_fbo);
+            glGetIntegerv(GL_READ_BUFFER, &read_buffer);
+            glReadBuffer(draw_fbo ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+            glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        }
+
+        ~ReadState() {
+            glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+            glReadBuffer(read_buffer);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+        }
+    };
+
+    std::vector<Slot> _slots;
+    size_t _next{0};
+};
+
+}
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "application.hpp"
+
+namespace trif
+{
+
+/// Bytes per pixel of the sized internal formats a render target may use.
+/// Used for memory accounting only, so compressed or unknown formats count as 4.
+inline size_t bytes_per_pixel(GLenum internal_format)
+{
+    switch (internal_format) {
+        case GL_NONE:
+            return 0;
+        case GL_R8:
+            return 1;
+        case GL_RG8:
+        case GL_R16F:
+        case GL_RGB565:
+        case GL_DEPTH_COMPONENT16:
+            return 2;
+        case GL_RGB8:
+        case GL_SRGB8:
+        case GL_DEPTH_COMPONENT24:
+            return 3;
+        case GL_RGBA16F:
+        case GL_RGBA16:
+        case GL_RGBA16UI:
+        case GL_RG32F:
+            return 8;
+        case GL_RGBA32F:
+            return 16;
+        case GL_DEPTH32F_STENCIL8:
+            return 5;
+        default:
+            return 4;
+    }
+}
+
+/// Client format and type compatible with a sized color internal format, required by
+/// glTexImage2D even though no pixels are transferred
+inline std::pair<GLenum, GLenum> transfer_format(GLenum internal_format)
+{
+    switch (internal_format) {
+        case GL_R8:             return {GL_RED, GL_UNSIGNED_BYTE};
+        case GL_RG8:            return {GL_RG, GL_UNSIGNED_BYTE};
+        case GL_R16F:           return {GL_RED, GL_FLOAT};
+        case GL_RGB8:
+        case GL_SRGB8:          return {GL_RGB, GL_UNSIGNED_BYTE};
+        case GL_RGB565:         return {GL_RGB, GL_UNSIGNED_SHORT_5_6_5};
+        case GL_R11F_G11F_B10F: return {GL_RGB, GL_FLOAT};
+        case GL_RGBA16F:
+        case GL_RGBA32F:        return {GL_RGBA, GL_FLOAT};
+        case GL_RGBA16UI:       return {GL_RGBA_INTEGER, GL_UNSIGNED_SHORT};
+        default:                return {GL_RGBA, GL_UNSIGNED_BYTE};
+    }
+}
+
+/// Describes a render target by size, formats and sample count.
+///
+/// A zero width or height makes the target follow the window size, scaled by `scale`,
+/// e.g. {0, 0, 0.5f} is a half resolution target which is reallocated on window resize.
+struct RenderTargetDesc {
+    int width{0};
+    int height{0};
+    float scale{1.0f};
+    /// GL_NONE for a depth-only target
+    GLenum color_format{GL_RGBA8};
+    /// GL_NONE for a color-only target
+    GLenum depth_format{GL_DEPTH24_STENCIL8};
+    int samples{1};
+
+    bool follows_window() const { return width == 0 || height == 0; }
+};
+
+/// An FBO with its attachments.
+///
+/// Single-sampled color is a texture so that a later pass may sample it, multisampled
+/// color and all depth/stencil attachments are renderbuffers.
+class RenderTarget {
+public:
+    RenderTarget(const RenderTargetDesc& desc, int width, int height)
+        : _desc(desc) {
+        glGenFramebuffers(1, &_fbo);
+        if (desc.color_format != GL_NONE) {
+            if (desc.samples > 1)
+                glGenRenderbuffers(1, &_color_rbo);
+            else
+                glGenTextures(1, &_color_tex);
+        }
+        if (desc.depth_format != GL_NONE)
+            glGenRenderbuffers(1, &_depth_rbo);
+
+        allocate(width, height);
+    }
+
+    ~RenderTarget() {
+        glDeleteFramebuffers(1, &_fbo);
+        if (_color_tex)
+            glDeleteTextures(1, &_color_tex);
+        if (_color_rbo)
+            glDeleteRenderbuffers(1, &_color_rbo);
+        if (_depth_rbo)
+            glDeleteRenderbuffers(1, &_depth_rbo);
+    }
+
+    /// not allowed
+    RenderTarget(const RenderTarget&) = delete;
+    RenderTarget& operator=(const RenderTarget&) = delete;
+
+    /// (Re)specifies the storage of every attachment. The FBO and attachment names
+    /// are kept so that references held by the client stay valid across resizes.
+    /// The framebuffer, texture and renderbuffer bindings are left as they were, so a
+    /// target bound for drawing stays bound.
+    void allocate(int width, int height) {
+        _width = width;
+        _height = height;
+
+        GLint draw_fbo, read_fbo, texture, renderbuffer;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+        glGetIntegerv(GL_RENDERBUFFER_BINDING, &renderbuffer);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+
+        if (_color_tex) {
+            auto fmt = transfer_format(_desc.color_format);
+            glBindTexture(GL_TEXTURE_2D, _color_tex);
+            glTexImage2D(GL_TEXTURE_2D, 0, _desc.color_format, width, height, 0,
+                         fmt.first, fmt.second, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _color_tex, 0);
+        }
+
+        if (_color_rbo) {
+            glBindRenderbuffer(GL_RENDERBUFFER, _color_rbo);
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, _desc.samples, _desc.color_format, width, height);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _color_rbo);
+        }
+
+        if (_desc.color_format == GL_NONE) {
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+
+        if (_depth_rbo) {
+            glBindRenderbuffer(GL_RENDERBUFFER, _depth_rbo);
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, _desc.samples > 1 ? _desc.samples : 0,
+                                             _desc.depth_format, width, height);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, depth_attachment(), GL_RENDERBUFFER, _depth_rbo);
+        }
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+    }
+
+    /// Binds the FBO for drawing and sets the viewport to cover it
+    void bind() const {
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+        glViewport(0, 0, _width, _height);
+    }
+
+    GLenum depth_attachment() const {
+        switch (_desc.depth_format) {
+            case GL_DEPTH24_STENCIL8:
+            case GL_DEPTH32F_STENCIL8:
+                return GL_DEPTH_STENCIL_ATTACHMENT;
+            default:
+                return GL_DEPTH_ATTACHMENT;
+        }
+    }
+
+    /// GPU memory taken by all attachments, estimated from the sized formats
+    size_t bytes() const {
+        size_t bpp = bytes_per_pixel(_desc.color_format) + bytes_per_pixel(_desc.depth_format);
+        return bpp * static_cast<size_t>(_width) * _height * std::max(_desc.samples, 1);
+    }
+
+    GLuint fbo() const { return _fbo; }
+    GLuint color_texture() const { return _color_tex; }
+    int width() const { return _width; }
+    int height() const { return _height; }
+    const RenderTargetDesc& desc() const { return _desc; }
+
+private:
+    RenderTargetDesc _desc;
+    int _width{0};
+    int _height{0};
+    GLuint _fbo{0};
+    GLuint _color_tex{0};
+    GLuint _color_rbo{0};
+    GLuint _depth_rbo{0};
+};
+
+
+/// Hands out render targets by descriptor and reuses them across passes and frames.
+///
+/// Persistent targets are owned by the caller until released. Transient targets are
+/// only valid until released or until the end of the frame, whichever comes first.
+/// Once released, a transient target is immediately available to any later acquire
+/// of a compatible descriptor in the same frame, so passes whose targets do not
+/// live at the same time alias the same FBO and memory.
+///
+/// Targets whose descriptor follows the window are reallocated in place on resize.
+/// Idle targets are destroyed after `max_idle_frames` frames.
+class RenderTargetPool {
+public:
+    struct Stats {
+        uint64_t acquires{0};
+        uint64_t reuses{0};
+        uint64_t allocations{0};
+        size_t   bytes{0};
+        size_t   peak_bytes{0};
+        size_t   targets{0};
+
+        double reuse_rate() const {
+            return acquires ? static_cast<double>(reuses) / acquires : 0.0;
+        }
+    };
+
+public:
+    RenderTargetPool(int window_width, int window_height)
+        : _window_width(window_width)
+        , _window_height(window_height) {}
+
+    /// Follows the window size of the given application automatically, which must
+    /// outlive the pool
+    explicit RenderTargetPool(Application& app)
+        : RenderTargetPool(app.getWindowWidth(), app.getWindowHeight()) {
+        _app = &app;
+        _resize_callback = app.add_resize_callback([this](int width, int height) { resize(width, height); });
+    }
+
+    ~RenderTargetPool() {
+        if (_app)
+            _app->remove_resize_callback(_resize_callback);
+    }
+
+    /// not allowed
+    RenderTargetPool(const RenderTargetPool&) = delete;
+    RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+    RenderTarget* acquire(const RenderTargetDesc& desc, bool transient = true) {
+        int width, height;
+        std::tie(width, height) = resolve(desc);
+
+        _stats.acquires++;
+
+        for (auto& entry : _entries) {
+            if (entry.in_use || !compatible(*entry.target, desc, width, height))
+                continue;
+
+            entry.in_use = true;
+            entry.transient = transient;
+            entry.last_used = _frame;
+            _stats.reuses++;
+            return entry.target.get();
+        }
+
+        Entry entry;
+        entry.target.reset(new RenderTarget(desc, width, height));
+        entry.in_use = true;
+        entry.transient = transient;
+        entry.last_used = _frame;
+        _entries.push_back(std::move(entry));
+
+        _stats.allocations++;
+        update_memory();
+
+        return _entries.back().target.get();
+    }
+
+    /// Returns the target to the pool. Its contents are undefined for the next user.
+    void release(const RenderTarget* target) {
+        for (auto& entry : _entries) {
+            if (entry.target.get() == target) {
+                entry.in_use = false;
+                return;
+            }
+        }
+    }
+
+    /// Recycles transient targets still held and frees targets idle for too long
+    void end_frame() {
+        for (auto& entry : _entries) {
+            if (entry.in_use && entry.transient)
+                entry.in_use = false;
+        }
+
+        auto idle = [this](const Entry& entry) {
+            return !entry.in_use && _frame - entry.last_used > _max_idle_frames;
+        };
+        auto n = _entries.size();
+        _entries.erase(std::remove_if(_entries.begin(), _entries.end(), idle), _entries.end());
+        if (n != _entries.size())
+            update_memory();
+
+        _frame++;
+    }
+
+    void resize(int window_width, int window_height) {
+        if (window_width == _window_width && window_height == _window_height)
+            return;
+
+        _window_width = window_width;
+        _window_height = window_height;
+
+        for (auto& entry : _entries) {
+            if (entry.target->desc().follows_window()) {
+                auto size = resolve(entry.target->desc());
+                entry.target->allocate(size.first, size.second);
+            }
+        }
+
+        update_memory();
+    }
+
+    void set_max_idle_frames(uint64_t frames) { _max_idle_frames = frames; }
+
+    int window_width() const { return _window_width; }
+    int window_height() const { return _window_height; }
+
+    const Stats& stats() const { return _stats; }
+
+    void print_stats(std::ostream& os = std::cout) const {
+        os << "RenderTargetPool: " << _stats.targets << " targets, "
+           << std::fixed << std::setprecision(2)
+           << _stats.bytes / (1024.0 * 1024.0) << " MiB (peak "
+           << _stats.peak_bytes / (1024.0 * 1024.0) << " MiB), "
+           << _stats.acquires << " acquires, " << _stats.allocations << " allocations, "
+           << "reuse rate " << _stats.reuse_rate() * 100.0 << "%" << std::endl;
+    }
+
+private:
+    struct Entry {
+        std::unique_ptr<RenderTarget> target;
+        bool in_use{false};
+        bool transient{true};
+        uint64_t last_used{0};
+    };
+
+    std::pair<int, int> resolve(const RenderTargetDesc& desc) const {
+        if (!desc.follows_window())
+            return {desc.width, desc.height};
+
+        return {std::max(1, static_cast<int>(_window_width * desc.scale)),
+                std::max(1, static_cast<int>(_window_height * desc.scale))};
+    }
+
+    static bool compatible(const RenderTarget& rt, const RenderTargetDesc& desc, int width, int height) {
+        const auto& d = rt.desc();
+        return rt.width() == width && rt.height() == height &&
+               d.follows_window() == desc.follows_window() &&
+               d.color_format == desc.color_format &&
+               d.depth_format == desc.depth_format &&
+               d.samples == desc.samples;
+    }
+
+    void update_memory() {
+        _stats.bytes = 0;
+        for (const auto& entry : _entries)
+            _stats.bytes += entry.target->bytes();
+        _stats.targets = _entries.size();
+        _stats.peak_bytes = std::max(_stats.peak_bytes, _stats.bytes);
+    }
+
+private:
+    std::vector<Entry> _entries;
+    Stats _stats;
+    int _window_width;
+    int _window_height;
+    /// Whose resize callback follows the window, removed with the pool
+    Application *_app{nullptr};
+    int _resize_callback{-1};
+    uint64_t _frame{0};
+    uint64_t _max_idle_frames{3};
+};
+
+}
@@ -3,6 +3,7 @@
 #include <algorithm> // for std::transform
 #include <array>
 #include <fstream>
+#include <type_traits>
 #include <vector>
 
 #include <GL/gl.h>
@@ -133,6 +134,13 @@ private:
     GLuint _id;
 };
 
+/// Whether a stage is the compute one, only compute programs dispatch
+template<typename S>
+struct is_compute_stage : std::false_type {};
+
+template<>
+struct is_compute_stage<Shaders<GL_COMPUTE_SHADER>> : std::true_type {};
+
 //
 // never instantiated
 //
@@ -200,6 +208,12 @@ public:
         glUseProgram(this->id());
     }
 
+    /// Activates the program without linking it again, once use() has linked it, e.g.
+    /// every frame
+    void bind() {
+        glUseProgram(this->id());
+    }
+
     unsigned int uniform(const std::string& name) {
         return glGetUniformLocation(this->id(), name.c_str());
     }
@@ -224,6 +238,20 @@ public:
         glUniformMatrix4fv(uniform(name), 1, GL_FALSE, &value[0][0]);
     }
 
+    /// Runs the work groups of a compute program in use. What they write is only
+    /// visible to later commands after a memory_barrier() for them, see compute.hpp
+    void dispatch(GLuint x, GLuint y = 1, GLuint z = 1) {
+        static_assert(is_compute_stage<First>::value, "only compute programs dispatch");
+        glDispatchCompute(x, y, z);
+    }
+
+    /// Runs as many work groups as the DispatchIndirectCommand at `offset` of the buffer
+    /// bound to GL_DISPATCH_INDIRECT_BUFFER says, e.g. counted by an earlier dispatch
+    void dispatch_indirect(GLintptr offset = 0) {
+        static_assert(is_compute_stage<First>::value, "only compute programs dispatch");
+        glDispatchComputeIndirect(offset);
+    }
+
 protected:
     First _first;
 };
@@ -234,4 +262,7 @@ template<int... T>
 class Program<Shaders<T>...> {
 };
 
+/// The program of a compute shader alone
+using ComputeProgram = Program<Shaders<GL_COMPUTE_SHADER>>;
+
 }
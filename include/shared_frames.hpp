@@ -0,0 +1,407 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "readback_ring.hpp"
+
+namespace trif
+{
+
+/// Layout of the POSIX shared memory object through which SharedFrameSink hands frames
+/// to SharedFrameSource in another process: a header page, then `slot_count` slots of
+/// `slot_size` bytes, each a SharedFrameSlot padded to a page and the pixels.
+///
+/// Every slot is a seqlock, its sequence odd while the producer writes it. `published`
+/// counts the frames published so far, the last one being in slot (published - 1) %
+/// slot_count, and consumers sleep on it as a futex.
+struct SharedFrameHeader {
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t page_size;
+    uint64_t slot_size;
+    std::atomic<uint32_t> published;
+    /// Set once the producer is gone
+    std::atomic<uint32_t> closed;
+
+    static constexpr uint32_t MAGIC = 0x4d465254; // "TRFM"
+    static constexpr uint32_t VERSION = 1;
+};
+
+struct SharedFrameSlot {
+    std::atomic<uint32_t> sequence;
+    /// GL format and type of the pixels, GL_RGBA and GL_UNSIGNED_BYTE
+    uint32_t format;
+    uint32_t type;
+    uint32_t width;
+    uint32_t height;
+    /// Bytes per row, rows are bottom first like GL's
+    uint32_t stride;
+    uint64_t frame;
+    /// CLOCK_MONOTONIC when the frame was read back and when it was published
+    uint64_t capture_ns;
+    uint64_t publish_ns;
+};
+
+namespace shm
+{
+
+inline uint64_t monotonic_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+/// Name of the shared memory object, which must start with a slash
+inline std::string object_name(const std::string& name)
+{
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+inline void futex_wake(std::atomic<uint32_t>& word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+/// Sleeps while `word` holds `expected`, at most `timeout_ms`
+inline void futex_wait(std::atomic<uint32_t>& word, uint32_t expected, int timeout_ms)
+{
+    timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+}
+
+
+/// Publishes the rendered frames into a ring of slots in shared memory, for
+/// SharedFrameSource to read in place from another process, e.g.
+///
+///   glxgears --shm trif & shm_consumer --name trif
+///
+/// Frames are read back through a ReadbackRing, whose mapped buffers are copied into the
+/// slots, the only copy a frame goes through. Slots are sized after the first frame.
+/// The newest frame overwrites the oldest slot, so a slow consumer misses frames rather
+/// than slowing down rendering, and the seqlock tells it when a slot it was reading got
+/// overwritten.
+class SharedFrameSink {
+public:
+    struct Stats {
+        uint64_t published{0};
+        /// Frames of another size than the slots
+        uint64_t skipped{0};
+        /// Frames the readback ring had no room for
+        uint64_t dropped{0};
+        double copy_ms{0.0};
+    };
+
+public:
+    explicit SharedFrameSink(const std::string& name, uint32_t slot_count = 4, size_t ring_size = 3)
+        : _name(shm::object_name(name))
+        , _slot_count(std::max(slot_count, 2u))
+        , _ring(ring_size)
+        , _capture_ns(ring_size) {}
+
+    ~SharedFrameSink() {
+        if (_header) {
+            _header->closed.store(1, std::memory_order_release);
+            _header->published.fetch_add(1, std::memory_order_release);
+            shm::futex_wake(_header->published);
+            munmap(_base, _length);
+            shm_unlink(_name.c_str());
+        }
+    }
+
+    /// not allowed
+    SharedFrameSink(const SharedFrameSink&) = delete;
+    SharedFrameSink& operator=(const SharedFrameSink&) = delete;
+
+    const std::string& name() const { return _name; }
+
+    /// Call once per frame once it has been drawn, before swapping buffers. The frame is
+    /// dropped when the ring is still busy with earlier ones.
+    void capture(int width, int height) {
+        collect(false);
+        if (_ring.busy()) {
+            _stats.dropped++;
+            return;
+        }
+        _capture_ns[_frame % _capture_ns.size()] = shm::monotonic_ns();
+        _ring.read(_frame++, width, height);
+    }
+
+    /// Publishes every frame read back so far
+    void finish() { collect(true); }
+
+    /// Copies and publishes a frame of RGBA pixels, bottom row first. The first frame
+    /// creates the shared memory object.
+    bool publish(uint64_t frame, int width, int height, const unsigned char *pixels, uint64_t capture_ns) {
+        if (!_header && !_failed && !create(width, height))
+            _failed = true;
+        if (!_header)
+            return false;
+
+        if (static_cast<uint32_t>(width) != _width || static_cast<uint32_t>(height) != _height) {
+            _stats.skipped++;
+            return false;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        SharedFrameSlot *s = slot(_header->published.load(std::memory_order_relaxed) % _slot_count);
+        const uint32_t seq = s->sequence.load(std::memory_order_relaxed);
+
+        // odd: readers which see it, or see it change, drop what they read
+        s->sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        s->format = 0x1908;  // GL_RGBA
+        s->type = 0x1401;    // GL_UNSIGNED_BYTE
+        s->width = _width;
+        s->height = _height;
+        s->stride = _width * 4;
+        s->frame = frame;
+        s->capture_ns = capture_ns;
+        memcpy(reinterpret_cast<unsigned char *>(s) + _page_size, pixels, static_cast<size_t>(_width) * _height * 4);
+        s->publish_ns = shm::monotonic_ns();
+
+        s->sequence.store(seq + 2, std::memory_order_release);
+        _header->published.fetch_add(1, std::memory_order_release);
+        shm::futex_wake(_header->published);
+
+        _stats.published++;
+        _stats.copy_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    const Stats& stats() const { return _stats; }
+
+    void print_stats(std::ostream& os = std::cout) const {
+        os << "SharedFrameSink: " << _stats.published << " frames published to " << _name
+           << (_failed ? " which failed" : "") << ", " << _stats.skipped << " skipped, "
+           << _stats.dropped << " dropped, "
+           << std::fixed << std::setprecision(3)
+           << "copy " << (_stats.published ? _stats.copy_ms / _stats.published : 0.0) << " ms/frame" << std::endl;
+    }
+
+private:
+    void collect(bool wait) {
+        _ring.collect(wait, [this](uint64_t frame, int width, int height, const unsigned char *pixels) {
+            publish(frame, width, height, pixels, _capture_ns[frame % _capture_ns.size()]);
+        });
+    }
+
+    bool create(int width, int height) {
+        _width = static_cast<uint32_t>(width);
+        _height = static_cast<uint32_t>(height);
+        _page_size = static_cast<uint32_t>(sysconf(_SC_PAGESIZE));
+
+        const size_t pixels = static_cast<size_t>(_width) * _height * 4;
+        _slot_size = (_page_size + pixels + _page_size - 1) / _page_size * _page_size;
+        _length = _page_size + _slot_size * _slot_count;
+
+        // a stale object of a crashed run would keep its old size
+        shm_unlink(_name.c_str());
+        int fd = shm_open(_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) {
+            std::cerr << "Failed to create " << _name << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        void *base = MAP_FAILED;
+        if (ftruncate(fd, _length) == 0)
+            base = mmap(nullptr, _length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            std::cerr << "Failed to map " << _name << ": " << strerror(errno) << std::endl;
+            shm_unlink(_name.c_str());
+            return false;
+        }
+
+        _base = base;
+        _header = static_cast<SharedFrameHeader *>(base);
+        _header->version = SharedFrameHeader::VERSION;
+        _header->slot_count = _slot_count;
+        _header->page_size = _page_size;
+        _header->slot_size = _slot_size;
+        _header->published.store(0, std::memory_order_relaxed);
+        _header->closed.store(0, std::memory_order_relaxed);
+        // the pages are zeroed, every slot starts at sequence 0
+        _header->magic.store(SharedFrameHeader::MAGIC, std::memory_order_release);
+        return true;
+    }
+
+    SharedFrameSlot *slot(uint32_t i) {
+        return reinterpret_cast<SharedFrameSlot *>(static_cast<unsigned char *>(_base) + _page_size + i * _slot_size);
+    }
+
+private:
+    std::string _name;
+    uint32_t _slot_count;
+    uint32_t _page_size{0};
+    uint32_t _width{0};
+    uint32_t _height{0};
+    size_t _slot_size{0};
+    size_t _length{0};
+    void *_base{nullptr};
+    SharedFrameHeader *_header{nullptr};
+    bool _failed{false};
+    ReadbackRing _ring;
+    /// When the frames in the ring were read back
+    std::vector<uint64_t> _capture_ns;
+    uint64_t _frame{0};
+    Stats _stats;
+};
+
+
+/// Reads the frames of a SharedFrameSink in place
+class SharedFrameSource {
+public:
+    /// A frame in its slot, which stays valid until the producer writes the slot again
+    struct Frame {
+        const SharedFrameSlot *slot{nullptr};
+        uint32_t sequence{0};
+        const unsigned char *pixels{nullptr};
+        uint32_t width{0};
+        uint32_t height{0};
+        uint32_t stride{0};
+        uint64_t frame{0};
+        uint64_t capture_ns{0};
+        uint64_t publish_ns{0};
+    };
+
+public:
+    explicit SharedFrameSource(const std::string& name) : _name(shm::object_name(name)) {}
+
+    ~SharedFrameSource() {
+        if (_base)
+            munmap(_base, _length);
+    }
+
+    /// not allowed
+    SharedFrameSource(const SharedFrameSource&) = delete;
+    SharedFrameSource& operator=(const SharedFrameSource&) = delete;
+
+    /// Maps the object once its producer has created it, false until then
+    bool open() {
+        if (_header)
+            return true;
+
+        int fd = shm_open(_name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        void *base = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(SharedFrameHeader))
+            base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+            return false;
+
+        auto *header = static_cast<SharedFrameHeader *>(base);
+        if (header->magic.load(std::memory_order_acquire) != SharedFrameHeader::MAGIC ||
+            header->version != SharedFrameHeader::VERSION ||
+            header->page_size + header->slot_size * header->slot_count > static_cast<uint64_t>(st.st_size)) {
+            munmap(base, st.st_size);
+            return false;
+        }
+
+        _base = base;
+        _length = st.st_size;
+        _header = header;
+        _next = header->published.load(std::memory_order_acquire);
+        return true;
+    }
+
+    /// Whether the producer has exited
+    bool closed() const { return _header && _header->closed.load(std::memory_order_acquire); }
+
+    /// Frames published and not returned by wait() because newer ones were
+    uint64_t missed() const { return _missed; }
+
+    /// Waits up to `timeout_ms` for a frame newer than the last one returned, and returns
+    /// the newest one
+    bool wait(Frame& frame, int timeout_ms) {
+        if (!open())
+            return false;
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        for (;;) {
+            const uint32_t published = _header->published.load(std::memory_order_acquire);
+            if (closed())
+                return false;
+
+            if (published != _next) {
+                _missed += published - _next - 1;
+                _next = published;
+                if (read(published - 1, frame))
+                    return true;
+                // overwritten already, wait for the next one
+                continue;
+            }
+
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0)
+                return false;
+            shm::futex_wait(_header->published, published, static_cast<int>(left.count()));
+        }
+    }
+
+    /// Whether the pixels of `frame` were not overwritten while they were used, to be
+    /// checked once done with them
+    bool valid(const Frame& frame) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return frame.slot->sequence.load(std::memory_order_relaxed) == frame.sequence;
+    }
+
+private:
+    bool read(uint32_t index, Frame& frame) {
+        const auto *s = reinterpret_cast<const SharedFrameSlot *>(
+            static_cast<const unsigned char *>(_base) + _header->page_size + (index % _header->slot_count) * _header->slot_size);
+
+        const uint32_t seq = s->sequence.load(std::memory_order_acquire);
+        if (seq & 1)
+            return false;
+
+        frame.slot = s;
+        frame.sequence = seq;
+        frame.pixels = reinterpret_cast<const unsigned char *>(s) + _header->page_size;
+        frame.width = s->width;
+        frame.height = s->height;
+        frame.stride = s->stride;
+        frame.frame = s->frame;
+        frame.capture_ns = s->capture_ns;
+        frame.publish_ns = s->publish_ns;
+
+        return static_cast<uint64_t>(frame.stride) * frame.height <= _header->slot_size - _header->page_size &&
+               valid(frame);
+    }
+
+private:
+    std::string _name;
+    void *_base{nullptr};
+    size_t _length{0};
+    SharedFrameHeader *_header{nullptr};
+    uint32_t _next{0};
+    uint64_t _missed{0};
+};
+
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file.hpp"
+#include "mipmap.hpp"
+
+namespace trif
+{
+
+/// A decoded image, or all levels of its mip chain, mapped read-only from a file
+/// written by TextureCache. Levels are tightly packed like in MipChain. The pixels
+/// stay in the page cache, so reading them costs no decode nor heap copy.
+class MappedImage {
+public:
+    ~MappedImage() {
+        if (_base)
+            munmap(_base, _length);
+    }
+
+    /// not allowed
+    MappedImage(const MappedImage&) = delete;
+    MappedImage& operator=(const MappedImage&) = delete;
+
+    int width() const { return _width; }
+    int height() const { return _height; }
+    int channels() const { return _channels; }
+    int levels() const { return static_cast<int>(_offsets.size()); }
+    int level_width(int level) const { return std::max(1, _width >> level); }
+    int level_height(int level) const { return std::max(1, _height >> level); }
+    const std::vector<size_t>& offsets() const { return _offsets; }
+
+    /// Pixels of all levels, page-aligned in the mapping
+    const unsigned char *data() const { return static_cast<const unsigned char *>(_base) + DATA_OFFSET; }
+    size_t size() const { return _size; }
+    const unsigned char *level_data(int level) const { return data() + _offsets[level]; }
+
+    /// How long producing the pixels took when the entry was stored
+    double produce_ms() const { return _produce_ms; }
+
+    static constexpr size_t DATA_OFFSET = 4096;
+
+private:
+    friend class TextureCache;
+
+    MappedImage() = default;
+
+    void *_base{nullptr};
+    size_t _length{0};
+    int _width{0};
+    int _height{0};
+    int _channels{0};
+    std::vector<size_t> _offsets;
+    size_t _size{0};
+    double _produce_ms{0.0};
+};
+
+
+/// Caches decoded pixels on disk, keyed by the contents of the encoded file and the
+/// parameters they were decoded with.
+///
+/// An entry is a raw file: a header padded to a page, then the pixels of every level
+/// back to back. open() maps it, so a hit costs a hash of the encoded bytes and page
+/// faults instead of a decode, and the pixels can be copied straight from the mapping
+/// into an upload buffer. Entries are written to a temporary file renamed into place,
+/// so concurrent writers and readers never see a partial entry.
+///
+/// The entry records how long producing its pixels took, which gives the time a hit
+/// saves, see MappedImage::produce_ms().
+class TextureCache {
+public:
+    /// Uses the directory, created if missing
+    explicit TextureCache(const std::string& dir) : _dir(dir) {
+        mkdir(_dir.c_str(), 0755);
+    }
+
+    const std::string& dir() const { return _dir; }
+
+    /// Entry of an encoded image decoded to `channels` channels (0 keeping those of the
+    /// file), with or without the mip chain built by the CPU backend with `filter`.
+    /// `variant` tells apart any other processing of the pixels.
+    std::string path(const std::vector<unsigned char>& encoded, int channels, bool mip_chain,
+                     MipFilter filter = MipFilter::Box, int variant = 0) const {
+        uint64_t hash = fnv1a64(encoded.data(), encoded.size());
+        int params[] = {VERSION, channels, mip_chain ? static_cast<int>(filter) : -1, variant};
+        hash = fnv1a64(params, sizeof(params), hash);
+        return _dir + "/" + hash_hex(hash) + ".tex";
+    }
+
+    /// Maps an entry, nullptr if it is missing or invalid
+    static std::unique_ptr<MappedImage> open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return nullptr;
+
+        struct stat st;
+        void *base = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= MappedImage::DATA_OFFSET)
+            base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED)
+            return nullptr;
+
+        std::unique_ptr<MappedImage> image(new MappedImage());
+        image->_base = base;
+        image->_length = st.st_size;
+
+        Header header;
+        memcpy(&header, base, sizeof(header));
+        if (header.magic != MAGIC || header.version != VERSION || header.levels < 1 ||
+            header.levels > MAX_LEVELS || header.channels < 1 || header.channels > 4)
+            return nullptr;
+
+        image->_width = header.width;
+        image->_height = header.height;
+        image->_channels = header.channels;
+
+        // the offsets follow from the size, so only the size of the file is checked
+        size_t size = 0;
+        for (uint32_t level = 0; level < header.levels; level++) {
+            image->_offsets.push_back(size);
+            size += static_cast<size_t>(image->level_width(level)) * image->level_height(level) * header.channels;
+        }
+        if (size != header.size || MappedImage::DATA_OFFSET + size > image->_length)
+            return nullptr;
+
+        image->_size = size;
+        image->_produce_ms = header.produce_ms;
+
+        // the whole entry is about to be read once, front to back
+        madvise(base, image->_length, MADV_SEQUENTIAL);
+        madvise(base, image->_length, MADV_WILLNEED);
+        return image;
+    }
+
+    /// Stores a single level
+    static bool store(const std::string& path, const unsigned char *pixels, int width, int height,
+                      int channels, double produce_ms) {
+        size_t size = static_cast<size_t>(width) * height * channels;
+        return write(path, pixels, size, width, height, channels, 1, produce_ms);
+    }
+
+    /// Stores all levels of a chain
+    static bool store(const std::string& path, const MipChain& chain, double produce_ms) {
+        return write(path, chain.data.data(), chain.data.size(), chain.width, chain.height,
+                     chain.channels, chain.levels(), produce_ms);
+    }
+
+private:
+    static constexpr uint32_t MAGIC = 0x31584554; // "TEX1"
+    static constexpr int VERSION = 1;
+    static constexpr uint32_t MAX_LEVELS = 32;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;
+        uint32_t levels;
+        uint64_t size;
+        double produce_ms;
+    };
+
+    static bool write(const std::string& path, const unsigned char *pixels, size_t size,
+                      int width, int height, int channels, int levels, double produce_ms) {
+        // thread ids repeat across processes, which may fill the same cache at once
+        std::ostringstream tmp;
+        tmp << path << ".tmp" << getpid() << "_" << std::this_thread::get_id();
+
+        {
+            std::ofstream file(tmp.str(), std::ios::binary);
+            if (!file.is_open())
+                return false;
+
+            std::vector<char> page(MappedImage::DATA_OFFSET, 0);
+            const Header header = {MAGIC, static_cast<uint32_t>(VERSION), static_cast<uint32_t>(width),
+                                   static_cast<uint32_t>(height), static_cast<uint32_t>(channels),
+                                   static_cast<uint32_t>(levels), size, produce_ms};
+            memcpy(page.data(), &header, sizeof(header));
+            file.write(page.data(), page.size());
+            file.write(reinterpret_cast<const char *>(pixels), size);
+            if (!file.good()) {
+                file.close();
+                std::remove(tmp.str().c_str());
+                return false;
+            }
+        }
+
+        if (std::rename(tmp.str().c_str(), path.c_str()) != 0) {
+            std::remove(tmp.str().c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    std::string _dir;
+};
+
+}
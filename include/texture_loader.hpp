@@ -0,0 +1,567 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+// stb_image.h can't be included twice in the translation unit which defines
+// STB_IMAGE_IMPLEMENTATION
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include <stb_image.h>
+#endif
+
+#include "file.hpp"
+#include "mipmap.hpp"
+#include "pixel.hpp"
+#include "texture_cache.hpp"
+#include "thread_pool.hpp"
+#include "upload_scheduler.hpp"
+
+namespace trif
+{
+
+/// Sized internal format, client format for a number of 8-bit channels
+inline std::pair<GLenum, GLenum> texture_formats(int channels)
+{
+    switch (channels) {
+        case 1:  return {GL_R8, GL_RED};
+        case 2:  return {GL_RG8, GL_RG};
+        case 3:  return {GL_RGB8, GL_RGB};
+        default: return {GL_RGBA8, GL_RGBA};
+    }
+}
+
+/// Refers to a texture loaded asynchronously by TextureLoader.
+///
+/// The texture becomes ready once the GPU has consumed its upload, at the earliest
+/// the frame after its pixels have been decoded. Until then id() is 0, which samples
+/// as black, so it is always safe to bind. The size and channels are 0 until the pixels
+/// have been decoded, the levels until the texture is ready.
+class TextureHandle {
+public:
+    enum class Status { Decoding, Uploading, Ready, Failed };
+
+    TextureHandle() = default;
+
+    bool ready() const { return _state && _state->status == Status::Ready; }
+    bool failed() const { return !_state || _state->status == Status::Failed; }
+
+    GLuint id() const { return ready() ? _state->id : 0; }
+    int width() const { return decoded() ? _state->width : 0; }
+    int height() const { return decoded() ? _state->height : 0; }
+    int channels() const { return decoded() ? _state->channels : 0; }
+    int levels() const { return ready() ? _state->levels : 0; }
+    const std::string& path() const { return _state->path; }
+
+private:
+    friend class TextureLoader;
+
+    /// Whether the worker is done with the size, which it writes before the status
+    bool decoded() const { return _state && _state->status != Status::Decoding; }
+
+    struct State {
+        std::string path;
+        std::atomic<Status> status{Status::Decoding};
+        GLuint id{0};
+        int width{0};
+        int height{0};
+        int channels{0};
+        int levels{1};
+        bool mipmaps{false};
+        MipBackend mip_backend{MipBackend::Driver};
+        std::chrono::steady_clock::time_point requested;
+    };
+
+    explicit TextureHandle(std::shared_ptr<State> state) : _state(std::move(state)) {}
+
+    std::shared_ptr<State> _state;
+};
+
+
+/// Loads image files into textures without blocking the render thread.
+///
+/// Files are read and decoded with stbi_load_from_memory on worker threads, which also
+/// expand RGB to RGBA, flip and premultiply with the trif::pixel kernels. update(),
+/// called once per frame on the GL thread, copies decoded pixels into a ring of
+/// pixel-unpack buffers and uploads them with glTexStorage2D/glTexSubImage2D, so the
+/// transfer itself is asynchronous too. Each upload is fenced. A ring slot is reused
+/// and the handle becomes ready once its fence has signalled.
+///
+/// Mip chains are built by the driver, by the compute downsampler right after the
+/// upload, or on the workers right after decoding, see MipBuilder.
+///
+/// With a cache directory, decoded pixels, along with the chains built on the workers,
+/// are kept in a TextureCache. Later runs map them instead of decoding and filtering,
+/// and update() copies them straight from the mapping into the unpack buffer.
+///
+/// An UploadScheduler may take over the transfers, spreading every image over frames
+/// within its byte budget instead of uploading it whole in the frame it is decoded.
+///
+/// The including translation unit must provide the stb_image implementation. All
+/// textures are owned by the loader and deleted with it.
+class TextureLoader {
+public:
+    struct Options {
+        /// Number of channels of the texture, 0 keeps the channels of the file
+        int channels{4};
+        bool mipmaps{false};
+        MipBackend mip_backend{MipBackend::Driver};
+        /// Filter of the CPU backend
+        MipFilter mip_filter{MipFilter::Box};
+        /// Whether the bottom row comes first, as glTexImage2D expects
+        bool flip_vertically{false};
+        /// Whether to multiply the color of 4-channel images by their alpha
+        bool premultiply_alpha{false};
+        /// Directory caching decoded pixels and the chains built by the CPU backend,
+        /// none if empty
+        std::string cache_dir;
+    };
+
+    struct Stats {
+        uint64_t loaded{0};
+        uint64_t failed{0};
+        uint64_t cache_hits{0};
+        uint64_t cache_misses{0};
+        uint64_t bytes{0};
+        double decode_ms{0.0};
+        double upload_ms{0.0};
+        double latency_ms{0.0};
+        /// Decode and filter time the cache hits would have cost, minus their own
+        double cache_saved_ms{0.0};
+    };
+
+public:
+    explicit TextureLoader(size_t ring_size = 3, size_t n_workers = ThreadPool::default_workers())
+        : _slots(ring_size)
+        , _mip_builder(&_pool)
+        , _pool(n_workers) {
+        for (auto& slot : _slots)
+            glGenBuffers(1, &slot.pbo);
+    }
+
+    ~TextureLoader() {
+        _pool.wait_idle();
+
+        // its callbacks refer to the loader
+        if (_scheduler)
+            _scheduler->finish();
+
+        for (auto& decoded : _decoded)
+            stbi_image_free(decoded.pixels);
+
+        for (auto& slot : _slots) {
+            if (slot.fence)
+                glDeleteSync(slot.fence);
+            glDeleteBuffers(1, &slot.pbo);
+        }
+
+        for (auto id : _textures)
+            glDeleteTextures(1, &id);
+    }
+
+    /// not allowed
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    /// Uploads through the scheduler from now on. Its update() is left to the caller,
+    /// as other uploads may share it, and it must outlive the loader.
+    void use_scheduler(UploadScheduler *scheduler) {
+        _scheduler = scheduler;
+    }
+
+    TextureHandle load(const std::string& path) {
+        return load(path, Options());
+    }
+
+    TextureHandle load(const std::string& path, const Options& options) {
+        auto state = std::make_shared<TextureHandle::State>();
+        state->path = path;
+        state->mipmaps = options.mipmaps;
+        state->mip_backend = options.mip_backend;
+        state->requested = std::chrono::steady_clock::now();
+
+        _pool.submit([this, state, options] { decode(state, options); });
+
+        return TextureHandle(state);
+    }
+
+    /// Retires finished uploads and starts new ones. Call once per frame on the GL thread.
+    void update() {
+        auto start = std::chrono::steady_clock::now();
+
+        retire();
+
+        for (;;) {
+            Slot& slot = _slots[_next_slot];
+            if (!_scheduler && slot.fence)
+                break;
+
+            Decoded decoded;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_decoded.empty())
+                    break;
+                decoded = std::move(_decoded.front());
+                _decoded.pop_front();
+            }
+
+            if (_scheduler) {
+                schedule(decoded);
+                continue;
+            }
+
+            upload(slot, decoded);
+            _next_slot = (_next_slot + 1) % _slots.size();
+        }
+
+        _stats.upload_ms += elapsed_ms(start);
+    }
+
+    /// Blocks until every requested texture is ready or failed
+    void finish() {
+        for (;;) {
+            _pool.wait_idle();
+            update();
+            if (_scheduler)
+                _scheduler->finish();
+
+            bool busy = false;
+            for (auto& slot : _slots) {
+                if (slot.fence) {
+                    glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+                    busy = true;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!busy && _decoded.empty())
+                break;
+        }
+    }
+
+    /// A copy, the workers update the decode times
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _stats;
+    }
+
+    void print_stats(std::ostream& os = std::cout) const {
+        const Stats stats = this->stats();
+        os << "TextureLoader: " << stats.loaded << " loaded, " << stats.failed << " failed, "
+           << std::fixed << std::setprecision(2)
+           << stats.bytes / (1024.0 * 1024.0) << " MiB uploaded, "
+           << "decode " << stats.decode_ms << " ms (workers), "
+           << "render thread " << stats.upload_ms << " ms, "
+           << "average latency " << (stats.loaded ? stats.latency_ms / stats.loaded : 0.0) << " ms"
+           << std::endl;
+
+        if (stats.cache_hits || stats.cache_misses)
+            os << "TextureCache: " << stats.cache_hits << " hits, " << stats.cache_misses << " misses, "
+               << "saved " << stats.cache_saved_ms << " ms of decoding" << std::endl;
+    }
+
+private:
+    struct Decoded {
+        std::shared_ptr<TextureHandle::State> state;
+        unsigned char *pixels{nullptr};
+        /// Levels built by the CPU backend, which replace pixels
+        MipChain chain;
+        /// Pixels, or levels, mapped from the cache, which replace both
+        std::unique_ptr<MappedImage> mapped;
+    };
+
+    struct Slot {
+        GLuint pbo{0};
+        size_t size{0};
+        GLsync fence{0};
+        std::shared_ptr<TextureHandle::State> state;
+    };
+
+    static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /// Runs on a worker thread
+    void decode(std::shared_ptr<TextureHandle::State> state, const Options& options) {
+        auto start = std::chrono::steady_clock::now();
+
+        Decoded decoded;
+        decoded.state = state;
+
+        bool cpu_mips = options.mipmaps && options.mip_backend == MipBackend::CPU;
+        std::string cache_path;
+
+        std::vector<unsigned char> bytes = read_file(state->path);
+        if (!bytes.empty() && !options.cache_dir.empty()) {
+            int variant = (options.flip_vertically ? 1 : 0) | (options.premultiply_alpha ? 2 : 0);
+            cache_path = TextureCache(options.cache_dir).path(bytes, options.channels, cpu_mips, options.mip_filter, variant);
+            decoded.mapped = TextureCache::open(cache_path);
+        }
+
+        if (decoded.mapped) {
+            state->width = decoded.mapped->width();
+            state->height = decoded.mapped->height();
+            state->channels = decoded.mapped->channels();
+        } else if (!bytes.empty()) {
+            decoded.pixels = decode_pixels(bytes, options, *state);
+        }
+
+        if (decoded.pixels && cpu_mips) {
+            decoded.chain = _mip_builder.build(decoded.pixels, state->width, state->height,
+                                               state->channels, options.mip_filter);
+            stbi_image_free(decoded.pixels);
+            decoded.pixels = nullptr;
+        }
+
+        if (!cache_path.empty() && !decoded.mapped) {
+            if (decoded.chain.levels())
+                TextureCache::store(cache_path, decoded.chain, elapsed_ms(start));
+            else if (decoded.pixels)
+                TextureCache::store(cache_path, decoded.pixels, state->width, state->height,
+                                    state->channels, elapsed_ms(start));
+        }
+
+        bool ok = decoded.pixels || decoded.chain.levels() > 0 || decoded.mapped;
+        if (!ok) {
+            std::cerr << "Failed to load texture " << state->path << std::endl;
+            state->status = TextureHandle::Status::Failed;
+        } else {
+            state->status = TextureHandle::Status::Uploading;
+        }
+
+        double ms = elapsed_ms(start);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stats.decode_ms += ms;
+        if (decoded.mapped) {
+            _stats.cache_hits++;
+            _stats.cache_saved_ms += decoded.mapped->produce_ms() - ms;
+        } else if (!cache_path.empty()) {
+            _stats.cache_misses++;
+        }
+        if (ok)
+            _decoded.push_back(std::move(decoded));
+        else
+            _stats.failed++;
+    }
+
+    /// Decodes to the requested channels, leaving RGB to RGBA to the pixel kernels rather
+    /// than to stb's scalar converter
+    static unsigned char *decode_pixels(const std::vector<unsigned char>& bytes, const Options& options,
+                                        TextureHandle::State& state) {
+        int channels_in_file = 0;
+        stbi_info_from_memory(bytes.data(), static_cast<int>(bytes.size()), nullptr, nullptr, &channels_in_file);
+        const bool expand = channels_in_file == 3 && options.channels == 4;
+
+        unsigned char *pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()),
+                                                      &state.width, &state.height, &channels_in_file,
+                                                      expand ? 3 : options.channels);
+        state.channels = options.channels ? options.channels : channels_in_file;
+        if (!pixels)
+            return nullptr;
+
+        const size_t n = static_cast<size_t>(state.width) * state.height;
+        if (expand) {
+            // allocated like stb's own buffers, so that stbi_image_free() releases it
+            auto *rgba = static_cast<unsigned char *>(malloc(n * 4));
+            if (rgba)
+                pixel::rgb_to_rgba(pixels, rgba, n);
+            stbi_image_free(pixels);
+            // the load fails like one stb could not decode
+            if (!rgba)
+                return nullptr;
+            pixels = rgba;
+        }
+
+        if (options.flip_vertically)
+            pixel::flip_vertical(pixels, state.width, state.height, state.channels);
+        if (options.premultiply_alpha && state.channels == 4)
+            pixel::premultiply_alpha(pixels, n);
+
+        return pixels;
+    }
+
+    void upload(Slot& slot, Decoded& decoded) {
+        auto& state = *decoded.state;
+        const MipChain& chain = decoded.chain;
+        const MappedImage *mapped = decoded.mapped.get();
+        size_t size = mapped ? mapped->size()
+                    : chain.levels() ? chain.data.size()
+                    : static_cast<size_t>(state.width) * state.height * state.channels;
+        const unsigned char *src = mapped ? mapped->data()
+                                 : chain.levels() ? chain.data.data()
+                                 : decoded.pixels;
+        auto formats = texture_formats(state.channels);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+        if (size > slot.size) {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+            slot.size = size;
+        }
+
+        // The slot's previous upload has been consumed (its fence signalled), so the
+        // buffer can be overwritten without synchronization
+        void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!dst) {
+            std::cerr << "Failed to map the upload buffer of " << state.path << std::endl;
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (decoded.pixels)
+                stbi_image_free(decoded.pixels);
+            state.status = TextureHandle::Status::Failed;
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stats.failed++;
+            return;
+        }
+        memcpy(dst, src, size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        if (decoded.pixels)
+            stbi_image_free(decoded.pixels);
+        // levels besides the base mean the chain was built by the CPU backend
+        bool has_chain = chain.levels() || (mapped && mapped->levels() > 1);
+
+        allocate(state);
+
+        if (chain.levels()) {
+            MipBuilder::upload(chain, true);
+        } else if (has_chain) {
+            MipBuilder::upload(state.width, state.height, state.channels, mapped->offsets(), nullptr);
+        } else {
+            GLint alignment;
+            glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, state.width, state.height,
+                            formats.second, GL_UNSIGNED_BYTE, (void *)0);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        decoded.mapped.reset();
+
+        finalize(state, has_chain);
+
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.state = decoded.state;
+
+        _stats.bytes += size;
+    }
+
+    /// Queues every level to the scheduler, the handle becoming ready with the last one
+    void schedule(Decoded& decoded) {
+        auto state = decoded.state;
+        auto formats = texture_formats(state->channels);
+        allocate(*state);
+
+        // keeps the pixels, or the mapping, alive until the scheduler has staged them
+        std::shared_ptr<Decoded> owner(new Decoded(std::move(decoded)), [](Decoded *d) {
+            if (d->pixels)
+                stbi_image_free(d->pixels);
+            delete d;
+        });
+
+        const MappedImage *mapped = owner->mapped.get();
+        const int levels = mapped ? mapped->levels() : std::max(owner->chain.levels(), 1);
+        const bool has_chain = levels > 1;
+
+        for (int level = 0; level < levels; level++) {
+            const unsigned char *src = mapped ? mapped->level_data(level)
+                                     : owner->chain.levels() ? owner->chain.level_data(level)
+                                     : owner->pixels;
+            const int width = std::max(1, state->width >> level), height = std::max(1, state->height >> level);
+
+            UploadScheduler::Callback done;
+            if (level == levels - 1) {
+                done = [this, state, has_chain] {
+                    finalize(*state, has_chain);
+                    state->status = TextureHandle::Status::Ready;
+                    _stats.loaded++;
+                    _stats.latency_ms += elapsed_ms(state->requested);
+                };
+            }
+
+            _scheduler->upload_texture(state->id, level, width, height, formats.second, GL_UNSIGNED_BYTE,
+                                       src, owner, std::move(done));
+            _stats.bytes += static_cast<size_t>(width) * height * state->channels;
+        }
+    }
+
+    /// Creates the texture of the handle with room for all its levels
+    void allocate(TextureHandle::State& state) {
+        auto formats = texture_formats(state.channels);
+        state.levels = state.mipmaps ? mip_levels(state.width, state.height) : 1;
+
+        glGenTextures(1, &state.id);
+        glBindTexture(GL_TEXTURE_2D, state.id);
+        if (GLEW_ARB_texture_storage) {
+            glTexStorage2D(GL_TEXTURE_2D, state.levels, formats.first, state.width, state.height);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, formats.first, state.width, state.height, 0,
+                         formats.second, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, state.levels - 1);
+        }
+
+        _textures.push_back(state.id);
+    }
+
+    /// Generates the levels not uploaded and sets the filters, once the base is in place
+    void finalize(TextureHandle::State& state, bool has_chain) {
+        if (state.mipmaps && !has_chain) {
+            // The compute downsampler writes RGBA8 images only
+            if (state.mip_backend == MipBackend::Compute && state.channels == 4 && GLEW_ARB_texture_storage) {
+                _mip_builder.generate_compute(state.id, state.width, state.height);
+            } else {
+                glBindTexture(GL_TEXTURE_2D, state.id);
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
+        }
+
+        glBindTexture(GL_TEXTURE_2D, state.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, state.mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    /// Publishes the textures whose upload the GPU has completed
+    void retire() {
+        for (auto& slot : _slots) {
+            if (!slot.fence)
+                continue;
+
+            GLenum res = glClientWaitSync(slot.fence, 0, 0);
+            if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+                continue;
+
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+
+            slot.state->status = TextureHandle::Status::Ready;
+            _stats.loaded++;
+            _stats.latency_ms += elapsed_ms(slot.state->requested);
+            slot.state.reset();
+        }
+    }
+
+private:
+    std::vector<Slot> _slots;
+    size_t _next_slot{0};
+    std::vector<GLuint> _textures;
+    std::deque<Decoded> _decoded;
+    mutable std::mutex _mutex;
+    Stats _stats;
+    MipBuilder _mip_builder;
+    UploadScheduler *_scheduler{nullptr};
+    /// Declared last so that workers are joined before anything they touch is destroyed
+    ThreadPool _pool;
+};
+
+}
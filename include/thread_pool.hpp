@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace trif
+{
+
+/// Fixed-size pool of worker threads running jobs in FIFO order.
+///
+/// Jobs must not touch GL, there is no context current on the workers.
+class ThreadPool {
+public:
+    /// Default to one worker per hardware thread but the one rendering
+    explicit ThreadPool(size_t n_workers = default_workers()) {
+        for (size_t i = 0; i < n_workers; i++)
+            _workers.emplace_back([this] { run(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _cv.notify_all();
+
+        for (auto& worker : _workers)
+            worker.join();
+    }
+
+    /// not allowed
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _jobs.push_back(std::move(job));
+        }
+        _cv.notify_one();
+    }
+
+    /// Runs job(i) for i in [0, n) on the workers and the calling thread, and returns
+    /// once all of them are done. The caller runs queued jobs while it waits, so it is
+    /// safe to call from a job running on the pool itself.
+    void parallel_for(size_t n, const std::function<void(size_t)>& job) {
+        std::atomic<size_t> remaining{n};
+
+        for (size_t i = 1; i < n; i++) {
+            submit([&, i] {
+                job(i);
+                remaining--;
+            });
+        }
+
+        if (n > 0) {
+            job(0);
+            remaining--;
+        }
+
+        while (remaining > 0) {
+            if (!run_one())
+                std::this_thread::yield();
+        }
+    }
+
+    /// Blocks until the queue is drained and no job is running
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _idle.wait(lock, [this] { return _jobs.empty() && _busy == 0; });
+    }
+
+    size_t size() const { return _workers.size(); }
+
+    static size_t default_workers() {
+        return std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+
+private:
+    void run() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [this] { return _stopping || !_jobs.empty(); });
+                if (_jobs.empty())
+                    return;
+
+                job = std::move(_jobs.front());
+                _jobs.pop_front();
+                _busy++;
+            }
+
+            execute(job);
+        }
+    }
+
+    /// Runs a queued job on the calling thread if there is any
+    bool run_one() {
+        std::function<void()> job;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_jobs.empty())
+                return false;
+
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+            _busy++;
+        }
+
+        execute(job);
+        return true;
+    }
+
+    void execute(std::function<void()>& job) {
+        job();
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _busy--;
+        }
+        _idle.notify_all();
+    }
+
+private:
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()>> _jobs;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::condition_variable _idle;
+    size_t _busy{0};
+    bool _stopping{false};
+};
+
+}
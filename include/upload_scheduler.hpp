@@ -0,0 +1,420 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+namespace trif
+{
+
+/// Spreads buffer and texture uploads over frames so that none of them stalls the
+/// frame it is issued in.
+///
+/// Uploads are queued and update(), called once per frame on the GL thread, drains at
+/// most the per-frame byte budget of them. Buffers are cut into chunks and textures
+/// into bands of rows, or into spans of a row when a single row exceeds the budget.
+/// Chunks are copied into one segment of a staging buffer ring and copied from there
+/// with glCopyBufferSubData or glTexSubImage2D. Each segment is fenced. A segment the
+/// GPU has not consumed yet is never waited for, the frame simply uploads nothing.
+///
+/// The time between update() calls is tracked too, a frame taking SPIKE_FACTOR times
+/// the running average being counted as a spike, so it shows whether uploading still
+/// causes hitches.
+class UploadScheduler {
+public:
+    /// Called on the GL thread once the GPU has consumed the whole upload, right away
+    /// for an empty one
+    using Callback = std::function<void()>;
+
+    static constexpr double SPIKE_FACTOR = 2.0;
+
+    struct Stats {
+        uint64_t frames{0};
+        /// Frames which uploaded something
+        uint64_t upload_frames{0};
+        /// Frames with uploads pending whose staging segment was still in use
+        uint64_t busy_frames{0};
+        uint64_t uploads{0};
+        uint64_t chunks{0};
+        uint64_t bytes{0};
+        uint64_t max_frame_bytes{0};
+        uint64_t spikes{0};
+        /// Spikes of frames which uploaded something
+        uint64_t upload_spikes{0};
+        double max_update_ms{0.0};
+    };
+
+public:
+    /// The budget must hold the largest texel, 16 bytes
+    explicit UploadScheduler(size_t budget = 4 << 20, size_t ring_size = 3)
+        : _budget(budget)
+        , _segments(ring_size) {
+        if (_budget < CHUNK_ALIGNMENT)
+            throw std::invalid_argument("UploadScheduler: budget of " + std::to_string(_budget) +
+                                        " bytes, smaller than a texel");
+        glGenBuffers(1, &_staging);
+        glBindBuffer(GL_COPY_READ_BUFFER, _staging);
+        glBufferData(GL_COPY_READ_BUFFER, _budget * _segments.size(), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+    ~UploadScheduler() {
+        for (auto& segment : _segments) {
+            if (segment.fence)
+                glDeleteSync(segment.fence);
+        }
+        glDeleteBuffers(1, &_staging);
+    }
+
+    /// not allowed
+    UploadScheduler(const UploadScheduler&) = delete;
+    UploadScheduler& operator=(const UploadScheduler&) = delete;
+
+    size_t budget() const { return _budget; }
+
+    /// Queues `size` bytes to be written at `offset` of `buffer`. `data` must stay valid
+    /// until it has been staged, which `owner` may ensure.
+    void upload_buffer(GLuint buffer, GLintptr offset, const void *data, size_t size,
+                       std::shared_ptr<const void> owner = nullptr, Callback done = nullptr) {
+        Job job;
+        job.kind = Kind::Buffer;
+        job.name = buffer;
+        job.offset = offset;
+        job.data = static_cast<const unsigned char *>(data);
+        job.size = size;
+        job.owner = std::move(owner);
+        job.done = std::move(done);
+        push(std::move(job));
+    }
+
+    /// Same, owning the bytes
+    void upload_buffer(GLuint buffer, GLintptr offset, std::vector<unsigned char> bytes, Callback done = nullptr) {
+        auto owner = std::make_shared<std::vector<unsigned char>>(std::move(bytes));
+        upload_buffer(buffer, offset, owner->data(), owner->size(), owner, std::move(done));
+    }
+
+    /// Queues a level of a GL_TEXTURE_2D whose storage is allocated already. Rows of
+    /// `pixels` are tightly packed. `pixels` must stay valid until it has been staged,
+    /// which `owner` may ensure.
+    void upload_texture(GLuint texture, int level, int width, int height, GLenum format, GLenum type,
+                        const void *pixels, std::shared_ptr<const void> owner = nullptr,
+                        Callback done = nullptr) {
+        Job job;
+        job.kind = Kind::Texture;
+        job.name = texture;
+        job.level = level;
+        job.width = width;
+        job.height = height;
+        job.format = format;
+        job.type = type;
+        job.texel_size = texel_size(format, type);
+        job.data = static_cast<const unsigned char *>(pixels);
+        job.size = static_cast<size_t>(width) * height * job.texel_size;
+        job.owner = std::move(owner);
+        job.done = std::move(done);
+        push(std::move(job));
+    }
+
+    /// Same, owning the pixels
+    void upload_texture(GLuint texture, int level, int width, int height, GLenum format, GLenum type,
+                        std::vector<unsigned char> pixels, Callback done = nullptr) {
+        auto owner = std::make_shared<std::vector<unsigned char>>(std::move(pixels));
+        upload_texture(texture, level, width, height, format, type, owner->data(), owner, std::move(done));
+    }
+
+    /// Bytes queued but not staged yet
+    size_t pending() const { return _pending; }
+
+    /// Whether every upload has been consumed by the GPU
+    bool idle() const {
+        if (!_jobs.empty())
+            return false;
+        for (auto& segment : _segments) {
+            if (segment.fence)
+                return false;
+        }
+        return true;
+    }
+
+    /// Retires consumed segments and stages up to the budget. Call once per frame on
+    /// the GL thread.
+    void update() {
+        auto start = std::chrono::steady_clock::now();
+        bool uploaded = false;
+
+        retire();
+
+        Segment& segment = _segments[_next_segment];
+        if (!_jobs.empty() && segment.fence) {
+            _stats.busy_frames++;
+        } else if (!_jobs.empty()) {
+            stage(segment);
+            _next_segment = (_next_segment + 1) % _segments.size();
+            uploaded = true;
+        }
+
+        _stats.frames++;
+        if (uploaded) {
+            _stats.upload_frames++;
+            _stats.max_frame_bytes = std::max<uint64_t>(_stats.max_frame_bytes, segment.size);
+        }
+
+        // The interval since the previous update() is the previous frame, so the spike is
+        // put down to whether that one uploaded
+        if (_frames_timed++ > 0) {
+            double interval = std::chrono::duration<double, std::milli>(start - _last_update).count();
+            if (_frames_timed > WARMUP_FRAMES && interval > SPIKE_FACTOR * _average_interval) {
+                _stats.spikes++;
+                if (_last_uploaded)
+                    _stats.upload_spikes++;
+            }
+            _average_interval = _frames_timed == 2 ? interval : 0.9 * _average_interval + 0.1 * interval;
+        }
+        _last_update = start;
+        _last_uploaded = uploaded;
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        _stats.max_update_ms = std::max(_stats.max_update_ms, ms);
+    }
+
+    /// Blocks until every queued upload has been consumed by the GPU
+    void finish() {
+        while (!idle()) {
+            for (auto& segment : _segments) {
+                if (segment.fence)
+                    glClientWaitSync(segment.fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+            }
+            retire();
+
+            if (!_jobs.empty()) {
+                stage(_segments[_next_segment]);
+                _next_segment = (_next_segment + 1) % _segments.size();
+            }
+        }
+    }
+
+    const Stats& stats() const { return _stats; }
+
+    void print_stats(std::ostream& os = std::cout) const {
+        os << "UploadScheduler: " << _stats.uploads << " uploads, " << _stats.chunks << " chunks, "
+           << std::fixed << std::setprecision(2)
+           << _stats.bytes / (1024.0 * 1024.0) << " MiB in " << _stats.upload_frames << "/" << _stats.frames
+           << " frames (budget " << _budget / 1024.0 << " KiB, max " << _stats.max_frame_bytes / 1024.0 << " KiB), "
+           << _stats.busy_frames << " frames waiting for staging, "
+           << _stats.spikes << " frame time spikes (" << _stats.upload_spikes << " uploading), "
+           << "max update " << _stats.max_update_ms << " ms" << std::endl;
+    }
+
+    /// Bytes per texel of a client format and type
+    static size_t texel_size(GLenum format, GLenum type) {
+        size_t components;
+        switch (format) {
+            case GL_RED: case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: components = 1; break;
+            case GL_RG: case GL_RG_INTEGER: components = 2; break;
+            case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: components = 3; break;
+            default: components = 4; break;
+        }
+
+        switch (type) {
+            case GL_UNSIGNED_BYTE: case GL_BYTE: return components;
+            case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: return components * 2;
+            case GL_UNSIGNED_INT_8_8_8_8: case GL_UNSIGNED_INT_8_8_8_8_REV:
+            case GL_UNSIGNED_INT_2_10_10_10_REV: case GL_UNSIGNED_INT_24_8: return 4;
+            default: return components * 4;
+        }
+    }
+
+private:
+    static constexpr uint64_t WARMUP_FRAMES = 8;
+    /// Chunks start at multiples of this in the staging buffer
+    static constexpr size_t CHUNK_ALIGNMENT = 16;
+
+    enum class Kind { Buffer, Texture };
+
+    struct Job {
+        Kind kind{Kind::Buffer};
+        GLuint name{0};
+        GLintptr offset{0};
+        int level{0};
+        int width{0};
+        int height{0};
+        GLenum format{GL_RGBA};
+        GLenum type{GL_UNSIGNED_BYTE};
+        size_t texel_size{1};
+        const unsigned char *data{nullptr};
+        size_t size{0};
+        /// Bytes staged so far
+        size_t staged{0};
+        std::shared_ptr<const void> owner;
+        Callback done;
+    };
+
+    /// A copy out of the staging buffer, issued once the segment is unmapped
+    struct Copy {
+        Kind kind;
+        GLuint name;
+        size_t src;
+        GLintptr dst;
+        int level, x, y, width, height;
+        GLenum format, type;
+        size_t size;
+    };
+
+    struct Segment {
+        GLsync fence{0};
+        size_t size{0};
+        /// Completed by the copies of this segment
+        std::vector<Callback> done;
+    };
+
+    void push(Job job) {
+        // nothing for the GPU to consume, and a texture without rows can't be staged
+        if (job.size == 0) {
+            if (job.done)
+                job.done();
+            return;
+        }
+
+        _pending += job.size;
+        _stats.uploads++;
+        _jobs.push_back(std::move(job));
+    }
+
+    static size_t align(size_t n) {
+        return (n + CHUNK_ALIGNMENT - 1) / CHUNK_ALIGNMENT * CHUNK_ALIGNMENT;
+    }
+
+    /// Copies chunks of the queued jobs into the segment until it is full
+    void stage(Segment& segment) {
+        const size_t base = (&segment - _segments.data()) * _budget;
+        std::vector<Copy> copies;
+
+        glBindBuffer(GL_COPY_READ_BUFFER, _staging);
+        // The segment's previous copies have been consumed (its fence signalled), so it
+        // can be overwritten without synchronization
+        auto *dst = static_cast<unsigned char *>(glMapBufferRange(GL_COPY_READ_BUFFER, base, _budget,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+
+        size_t used = 0;
+        while (!_jobs.empty()) {
+            Job& job = _jobs.front();
+            size_t space = _budget - used;
+            Copy copy{job.kind, job.name, base + used, 0, job.level, 0, 0, 0, 0, job.format, job.type, 0};
+
+            if (job.kind == Kind::Buffer) {
+                copy.size = std::min(space, job.size - job.staged);
+                copy.dst = job.offset + job.staged;
+                memcpy(dst + used, job.data + job.staged, copy.size);
+            } else {
+                const size_t row_size = job.width * job.texel_size;
+                const size_t y = job.staged / row_size, x = job.staged % row_size / job.texel_size;
+                copy.x = static_cast<int>(x);
+                copy.y = static_cast<int>(y);
+
+                if (x == 0 && row_size <= space) {
+                    // a band of whole rows
+                    copy.width = job.width;
+                    copy.height = static_cast<int>(std::min(space / row_size, job.height - y));
+                } else {
+                    // a span of the current row
+                    copy.width = static_cast<int>(std::min(space / job.texel_size, job.width - x));
+                    copy.height = 1;
+                }
+                copy.size = static_cast<size_t>(copy.width) * copy.height * job.texel_size;
+                memcpy(dst + used, job.data + job.staged, copy.size);
+            }
+            // no room left for the job to advance, it goes on next frame
+            if (copy.size == 0 && job.staged < job.size)
+                break;
+
+            copies.push_back(copy);
+            job.staged += copy.size;
+            _pending -= copy.size;
+            used = align(used + copy.size);
+
+            if (job.staged == job.size) {
+                if (job.done)
+                    segment.done.push_back(std::move(job.done));
+                _jobs.pop_front();
+            }
+            if (used >= _budget)
+                break;
+        }
+
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+        GLint alignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _staging);
+
+        for (const Copy& copy : copies) {
+            if (copy.kind == Kind::Buffer) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, copy.name);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, copy.src, copy.dst, copy.size);
+            } else {
+                glBindTexture(GL_TEXTURE_2D, copy.name);
+                glTexSubImage2D(GL_TEXTURE_2D, copy.level, copy.x, copy.y, copy.width, copy.height,
+                                copy.format, copy.type, reinterpret_cast<const void *>(copy.src));
+            }
+            segment.size += copy.size;
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+        segment.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        _stats.chunks += copies.size();
+        _stats.bytes += segment.size;
+    }
+
+    /// Completes the uploads whose last chunk the GPU has consumed
+    void retire() {
+        for (auto& segment : _segments) {
+            if (!segment.fence)
+                continue;
+
+            GLenum res = glClientWaitSync(segment.fence, 0, 0);
+            if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+                continue;
+
+            glDeleteSync(segment.fence);
+            segment.fence = 0;
+            segment.size = 0;
+
+            std::vector<Callback> done;
+            done.swap(segment.done);
+            for (auto& callback : done)
+                callback();
+        }
+    }
+
+private:
+    size_t _budget;
+    GLuint _staging{0};
+    std::vector<Segment> _segments;
+    size_t _next_segment{0};
+    std::deque<Job> _jobs;
+    size_t _pending{0};
+    Stats _stats;
+
+    std::chrono::steady_clock::time_point _last_update;
+    uint64_t _frames_timed{0};
+    double _average_interval{0.0};
+    bool _last_uploaded{false};
+};
+
+}
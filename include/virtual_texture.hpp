@@ -0,0 +1,718 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <GL/glew.h>
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include <stb_image.h>
+#endif
+
+#include "mipmap.hpp"
+#include "render_target.hpp"
+#include "thread_pool.hpp"
+
+namespace trif
+{
+
+/// Provides the texels of a virtual texture. read() runs on worker threads.
+class TileSource {
+public:
+    virtual ~TileSource() = default;
+
+    /// Size of level 0 in texels
+    virtual int width() const = 0;
+    virtual int height() const = 0;
+
+    /// Writes the size x size RGBA8 texels of the given level whose top-left corner is
+    /// (x, y), clamping coordinates outside of the level to its edges
+    virtual bool read(int level, int x, int y, int size, unsigned char *rgba) = 0;
+};
+
+/// A whole image decoded through stb_image, with a CPU built mip chain
+class ImageTileSource : public TileSource {
+public:
+    explicit ImageTileSource(const std::string& path, MipFilter filter = MipFilter::Box) {
+        int width, height, channels;
+        unsigned char *data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+        if (!data) {
+            std::cerr << path << ": " << stbi_failure_reason() << std::endl;
+            return;
+        }
+
+        _chain = MipBuilder().build(data, width, height, 4, filter);
+        stbi_image_free(data);
+    }
+
+    bool valid() const { return _chain.levels() > 0; }
+
+    int width() const override { return _chain.width; }
+    int height() const override { return _chain.height; }
+
+    bool read(int level, int x, int y, int size, unsigned char *rgba) override {
+        if (!valid())
+            return false;
+
+        level = std::min(level, _chain.levels() - 1);
+        const int w = _chain.level_width(level), h = _chain.level_height(level);
+        const unsigned char *src = _chain.level_data(level);
+
+        for (int row = 0; row < size; row++) {
+            int sy = std::min(std::max(y + row, 0), h - 1);
+            for (int col = 0; col < size; col++) {
+                int sx = std::min(std::max(x + col, 0), w - 1);
+                memcpy(rgba + (static_cast<size_t>(row) * size + col) * 4,
+                       src + (static_cast<size_t>(sy) * w + sx) * 4, 4);
+            }
+        }
+        return true;
+    }
+
+private:
+    MipChain _chain;
+};
+
+/// A generated image of any size, e.g. 65536x65536 for a 4 gigapixel texture.
+/// Each level is evaluated directly, so patterns finer than a texel of the level fade
+/// to their average instead of aliasing.
+class ProceduralTileSource : public TileSource {
+public:
+    ProceduralTileSource(int width, int height) : _width(width), _height(height) {}
+
+    int width() const override { return _width; }
+    int height() const override { return _height; }
+
+    bool read(int level, int x, int y, int size, unsigned char *rgba) override {
+        const int scale = 1 << level;
+        const int w = std::max(1, _width >> level), h = std::max(1, _height >> level);
+
+        for (int row = 0; row < size; row++) {
+            int ly = std::min(std::max(y + row, 0), h - 1);
+            for (int col = 0; col < size; col++) {
+                int lx = std::min(std::max(x + col, 0), w - 1);
+
+                // level 0 coordinates of the texel center
+                double X = (lx + 0.5) * scale, Y = (ly + 0.5) * scale;
+                float r = static_cast<float>(X / _width), g = static_cast<float>(Y / _height), b = 0.5f;
+                float shade = 1.0f;
+
+                // 256 and 16 texel checkers, averaged out once a level texel covers a period
+                if (scale < 128)
+                    shade *= ((static_cast<int64_t>(X) / 256 + static_cast<int64_t>(Y) / 256) & 1) ? 0.7f : 1.0f;
+                else
+                    shade *= 0.85f;
+                if (scale < 8)
+                    shade *= ((static_cast<int64_t>(X) / 16 + static_cast<int64_t>(Y) / 16) & 1) ? 0.85f : 1.0f;
+                else
+                    shade *= 0.925f;
+
+                // a line every 4096 texels, one level texel wide at least
+                double line = std::max(4.0, static_cast<double>(scale));
+                bool on_grid = std::fmod(X, 4096.0) < line || std::fmod(Y, 4096.0) < line;
+
+                unsigned char *p = rgba + (static_cast<size_t>(row) * size + col) * 4;
+                if (on_grid) {
+                    p[0] = p[1] = p[2] = 255;
+                } else {
+                    p[0] = static_cast<unsigned char>(255.0f * r * shade);
+                    p[1] = static_cast<unsigned char>(255.0f * g * shade);
+                    p[2] = static_cast<unsigned char>(255.0f * b * shade);
+                }
+                p[3] = 255;
+            }
+        }
+        return true;
+    }
+
+private:
+    int _width;
+    int _height;
+};
+
+/// Pages stored as one image file per page, decoded by stb_image when requested.
+///
+/// The directory holds an `info` file with "width height page_size border" and
+/// `<level>/<y>_<x>.png` files of (page_size + 2 * border)^2 texels, as written by
+/// VirtualTexture::write_tiles(). Only whole page reads are served.
+class TileDirectorySource : public TileSource {
+public:
+    explicit TileDirectorySource(const std::string& dir) : _dir(dir) {
+        std::ifstream info(dir + "/info");
+        if (!(info >> _width >> _height >> _page_size >> _border))
+            std::cerr << dir << ": missing or malformed info file" << std::endl;
+    }
+
+    bool valid() const { return _page_size > 0; }
+    int page_size() const { return _page_size; }
+    int border() const { return _border; }
+
+    int width() const override { return _width; }
+    int height() const override { return _height; }
+
+    bool read(int level, int x, int y, int size, unsigned char *rgba) override {
+        if (size != _page_size + 2 * _border || (x + _border) % _page_size || (y + _border) % _page_size)
+            return false;
+
+        std::string path = _dir + "/" + std::to_string(level) + "/" + std::to_string((y + _border) / _page_size)
+                         + "_" + std::to_string((x + _border) / _page_size) + ".png";
+
+        int w, h, channels;
+        unsigned char *data = stbi_load(path.c_str(), &w, &h, &channels, 4);
+        if (!data)
+            return false;
+
+        bool ok = w == size && h == size;
+        if (ok)
+            memcpy(rgba, data, static_cast<size_t>(size) * size * 4);
+        stbi_image_free(data);
+        return ok;
+    }
+
+private:
+    std::string _dir;
+    int _width{0};
+    int _height{0};
+    int _page_size{0};
+    int _border{0};
+};
+
+
+/// Software virtual texturing.
+///
+/// The virtual texture is split into square pages at every level. A fixed number of
+/// them live in a physical cache texture, and a page table texture (one texel per page
+/// and level) maps each page to its slot in the cache, or to the slot of the closest
+/// coarser page when it is not resident. The coarsest level is a single page and stays
+/// resident, so every lookup resolves.
+///
+/// Every frame the scene is also drawn into a small feedback target recording which page
+/// each pixel wants. update() reads it back a few frames later, decodes missing pages on
+/// the worker threads and uploads them, evicting the least recently requested ones. GPU
+/// memory stays constant whatever the size of the source.
+///
+/// Shaders include glsl() and call vt_sample(uv) to sample, or write vt_feedback(uv) to
+/// a uvec4 output in the feedback pass.
+class VirtualTexture {
+public:
+    static constexpr int BORDER = 1;
+
+    struct Stats {
+        size_t frames{0};
+        size_t requests{0};
+        size_t hits{0};
+        size_t misses{0};
+        size_t uploads{0};
+        size_t evictions{0};
+        size_t failures{0};
+        size_t decodes{0};
+        double decode_ms{0.0};
+    };
+
+    /// cache_pages x cache_pages slots of page_size texels each, plus borders. The cache
+    /// needs 2 x 2 slots at least, one of them pinned to the coarsest page.
+    VirtualTexture(std::shared_ptr<TileSource> source, int cache_pages = 16, int page_size = 128,
+                   int feedback_scale = 8, size_t n_workers = ThreadPool::default_workers())
+        : _source(std::move(source)), _page_size(page_size), _cache_pages(std::min(cache_pages, 256)),
+          _feedback_scale(feedback_scale), _pool(n_workers) {
+        if (cache_pages < 2)
+            throw std::invalid_argument("VirtualTexture: cache of " + std::to_string(cache_pages) +
+                                        " x " + std::to_string(cache_pages) + " pages, 2 x 2 at least");
+        _levels = level_count(_source->width(), _source->height(), _page_size);
+        _pages = 1 << (_levels - 1);
+
+        _page_table.resize(_levels);
+        _resident.resize(_levels);
+        for (int level = 0; level < _levels; level++) {
+            size_t n = static_cast<size_t>(pages_at(level)) * pages_at(level);
+            _page_table[level].assign(n, 0);
+            _resident[level].assign(n, -1);
+        }
+
+        const int slot = _page_size + 2 * BORDER;
+        glGenTextures(1, &_cache);
+        glBindTexture(GL_TEXTURE_2D, _cache);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, _cache_pages * slot, _cache_pages * slot);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenTextures(1, &_table_texture);
+        glBindTexture(GL_TEXTURE_2D, _table_texture);
+        glTexStorage2D(GL_TEXTURE_2D, _levels, GL_RGBA8, _pages, _pages);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // slot 0 holds the coarsest page for good, every other slot is up for eviction
+        for (int i = 1; i < _cache_pages * _cache_pages; i++)
+            _free_slots.push_back(i);
+        _slot_keys.assign(_cache_pages * _cache_pages, 0);
+        _slot_lru.resize(_cache_pages * _cache_pages);
+
+        std::vector<unsigned char> top(static_cast<size_t>(slot) * slot * 4);
+        _source->read(_levels - 1, -BORDER, -BORDER, slot, top.data());
+        upload(0, top.data());
+        _resident[_levels - 1][0] = 0;
+        _slot_keys[0] = key(_levels - 1, 0, 0);
+        _dirty = true;
+        update_page_table();
+
+        glGenBuffers(FEEDBACK_LATENCY, _feedback_pbos);
+    }
+
+    ~VirtualTexture() {
+        _pool.wait_idle();
+
+        glDeleteTextures(1, &_cache);
+        glDeleteTextures(1, &_table_texture);
+        glDeleteBuffers(FEEDBACK_LATENCY, _feedback_pbos);
+        for (auto& fence : _feedback_fences) {
+            if (fence)
+                glDeleteSync(fence);
+        }
+    }
+
+    /// not allowed
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    /// Declarations and functions to prepend to the shaders sampling the texture
+    static const char *glsl() {
+        return R"(
+            uniform sampler2D vt_cache;
+            uniform sampler2D vt_page_table;
+            uniform vec2 vt_scale;          // source extent over the virtual extent
+            uniform float vt_size;          // virtual texels per side at level 0
+            uniform float vt_page;          // texels per page, borders excluded
+            uniform float vt_slot;          // texels per cache slot, borders included
+            uniform float vt_cache_size;    // cache texels per side
+            uniform float vt_max_level;
+            uniform float vt_lod_bias;
+
+            int vt_level(vec2 uv)
+            {
+                vec2 t = uv * vt_size;
+                vec2 dx = dFdx(t), dy = dFdy(t);
+                float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vt_lod_bias;
+                return int(clamp(lod, 0.0, vt_max_level));
+            }
+
+            ivec2 vt_page_at(vec2 uv, int level)
+            {
+                int pages = max(1, int(vt_size / vt_page) >> level);
+                return clamp(ivec2(uv * vt_size / vt_page) >> level, ivec2(0), ivec2(pages - 1));
+            }
+
+            vec4 vt_sample(vec2 image_uv)
+            {
+                vec2 uv = clamp(image_uv, 0.0, 1.0) * vt_scale;
+                int level = vt_level(uv);
+                vec4 entry = texelFetch(vt_page_table, vt_page_at(uv, level), level);
+
+                // the entry may point at a coarser page than requested
+                float resident = floor(entry.z * 255.0 + 0.5);
+                vec2 texel = uv * vt_size / exp2(resident);
+                vec2 in_page = clamp(texel - floor(texel / vt_page) * vt_page, 0.0, vt_page);
+                vec2 slot = floor(entry.xy * 255.0 + 0.5);
+
+                float border = (vt_slot - vt_page) * 0.5;
+                return textureLod(vt_cache, (slot * vt_slot + border + in_page) / vt_cache_size, 0.0);
+            }
+
+            uvec4 vt_feedback(vec2 image_uv)
+            {
+                vec2 uv = clamp(image_uv, 0.0, 1.0) * vt_scale;
+                int level = vt_level(uv);
+                return uvec4(uvec2(vt_page_at(uv, level)), uint(level), 1u);
+            }
+        )";
+    }
+
+    /// Binds the cache and page table to texture units unit and unit + 1 and sets the
+    /// uniforms of glsl(). Pass feedback for the program of the feedback pass, which
+    /// renders at lower resolution and has to bias its level selection.
+    template<typename P>
+    void bind(P& program, int unit = 0, bool feedback = false) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, _cache);
+        glActiveTexture(GL_TEXTURE0 + unit + 1);
+        glBindTexture(GL_TEXTURE_2D, _table_texture);
+        glActiveTexture(GL_TEXTURE0);
+
+        const float virtual_size = static_cast<float>(_pages * _page_size);
+        program.uniform("vt_cache", unit);
+        program.uniform("vt_page_table", unit + 1);
+        program.uniform("vt_scale", glm::vec2(_source->width() / virtual_size, _source->height() / virtual_size));
+        program.uniform("vt_size", virtual_size);
+        program.uniform("vt_page", static_cast<float>(_page_size));
+        program.uniform("vt_slot", static_cast<float>(_page_size + 2 * BORDER));
+        program.uniform("vt_cache_size", static_cast<float>(_cache_pages * (_page_size + 2 * BORDER)));
+        program.uniform("vt_max_level", static_cast<float>(_levels - 1));
+        program.uniform("vt_lod_bias", feedback ? -std::log2(static_cast<float>(_feedback_scale)) : 0.0f);
+    }
+
+    /// Binds and clears the feedback target for a window of the given size
+    void begin_feedback(int width, int height) {
+        _window_width = width;
+        _window_height = height;
+
+        int w = std::max(1, width / _feedback_scale), h = std::max(1, height / _feedback_scale);
+        if (!_feedback || _feedback->width() != w || _feedback->height() != h)
+            _feedback.reset(new RenderTarget({w, h, 1.0f, GL_RGBA16UI, GL_DEPTH_COMPONENT24}, w, h));
+
+        _feedback->bind();
+        const GLuint none[4] = {0, 0, 0, 0};
+        glClearBufferuiv(GL_COLOR, 0, none);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    /// Starts the asynchronous readback of the feedback and rebinds the window
+    void end_feedback() {
+        size_t slot = _feedback_frame % FEEDBACK_LATENCY;
+
+        // a readback that was never consumed is dropped
+        if (_feedback_fences[slot]) {
+            glDeleteSync(_feedback_fences[slot]);
+            _feedback_fences[slot] = nullptr;
+        }
+
+        const int w = _feedback->width(), h = _feedback->height();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, _feedback_pbos[slot]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(w) * h * 8, nullptr, GL_STREAM_READ);
+        glReadPixels(0, 0, w, h, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        _feedback_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        _feedback_sizes[slot] = {w, h};
+        _feedback_frame++;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, _window_width, _window_height);
+    }
+
+    /// Consumes finished feedback, queues the missing pages for decoding and uploads up
+    /// to max_uploads decoded pages. Call once per frame.
+    void update(int max_uploads = 16) {
+        for (size_t i = 0; i < FEEDBACK_LATENCY; i++) {
+            size_t slot = (_feedback_frame + i) % FEEDBACK_LATENCY;
+            GLsync& fence = _feedback_fences[slot];
+            if (fence && glClientWaitSync(fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+                glDeleteSync(fence);
+                fence = nullptr;
+                consume_feedback(slot);
+            }
+        }
+
+        std::vector<Decoded> decoded;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            while (!_decoded.empty() && static_cast<int>(decoded.size()) < max_uploads) {
+                decoded.push_back(std::move(_decoded.front()));
+                _decoded.pop_front();
+            }
+        }
+
+        for (auto& page : decoded) {
+            _in_flight.erase(page.key);
+            if (page.texels.empty()) {
+                _stats.failures++;
+                continue;
+            }
+            install(page.key, page.texels.data());
+        }
+
+        update_page_table();
+        _stats.frames++;
+    }
+
+    /// Levels of a virtual texture. Its page grid is the smallest power of two covering
+    /// the source, so that every level halves it exactly down to a single page.
+    static int level_count(int width, int height, int page_size) {
+        if (page_size <= 0)
+            throw std::invalid_argument("VirtualTexture: page size of " + std::to_string(page_size) + " texels");
+        int levels = 1;
+        for (int pages = 1; pages * page_size < std::max(width, height); pages *= 2)
+            levels++;
+        return levels;
+    }
+
+    int levels() const { return _levels; }
+    int resident_pages() const { return _cache_pages * _cache_pages - static_cast<int>(_free_slots.size()); }
+
+    /// GPU memory of the cache and page table, independent of the source size
+    size_t gpu_bytes() const {
+        size_t slot = _page_size + 2 * BORDER;
+        size_t bytes = slot * slot * _cache_pages * _cache_pages * 4;
+        for (int level = 0; level < _levels; level++)
+            bytes += _page_table[level].size() * 4;
+        return bytes;
+    }
+
+    const Stats& stats() const { return _stats; }
+
+    void print_stats(std::ostream& os = std::cout) const {
+        os << "VirtualTexture: " << _source->width() << "x" << _source->height() << " in "
+           << _levels << " levels of " << _page_size << "^2 pages, "
+           << resident_pages() << "/" << _cache_pages * _cache_pages << " slots resident, "
+           << gpu_bytes() / 1024 << " KiB GPU memory" << std::endl;
+        os << "  page requests " << _stats.requests << ", hits " << _stats.hits
+           << ", misses " << _stats.misses << std::fixed << std::setprecision(1)
+           << " (hit rate " << (_stats.requests ? 100.0 * _stats.hits / _stats.requests : 0.0) << "%)"
+           << ", uploads " << _stats.uploads << ", evictions " << _stats.evictions
+           << ", failures " << _stats.failures << ", decode "
+           << std::setprecision(3) << (_stats.decodes ? _stats.decode_ms / _stats.decodes : 0.0)
+           << " ms/page" << std::defaultfloat << std::endl;
+    }
+
+    /// Writes the pages of source in the layout read by TileDirectorySource. The caller
+    /// provides the PNG encoder, and must have created dir and its per-level directories.
+    static bool write_tiles(TileSource& source, const std::string& dir, int page_size,
+                            const std::function<bool(const std::string&, int, const unsigned char *)>& write_png) {
+        std::ofstream info(dir + "/info");
+        info << source.width() << " " << source.height() << " " << page_size << " " << BORDER << std::endl;
+        if (!info)
+            return false;
+
+        const int levels = level_count(source.width(), source.height(), page_size);
+        const int slot = page_size + 2 * BORDER;
+        std::vector<unsigned char> texels(static_cast<size_t>(slot) * slot * 4);
+
+        for (int level = 0; level < levels; level++) {
+            // skip the pages past the source extent, they are never requested
+            int pages_x = std::max(1, ((source.width() >> level) + page_size - 1) / page_size);
+            int pages_y = std::max(1, ((source.height() >> level) + page_size - 1) / page_size);
+
+            for (int y = 0; y < pages_y; y++) {
+                for (int x = 0; x < pages_x; x++) {
+                    source.read(level, x * page_size - BORDER, y * page_size - BORDER, slot, texels.data());
+                    std::string path = dir + "/" + std::to_string(level) + "/"
+                                     + std::to_string(y) + "_" + std::to_string(x) + ".png";
+                    if (!write_png(path, slot, texels.data()))
+                        return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+private:
+    struct Decoded {
+        uint64_t key;
+        std::vector<unsigned char> texels;
+    };
+
+    static uint64_t key(int level, int x, int y) {
+        return static_cast<uint64_t>(level) << 48 | static_cast<uint64_t>(y) << 24 | static_cast<uint64_t>(x);
+    }
+    static int key_level(uint64_t k) { return static_cast<int>(k >> 48); }
+    static int key_y(uint64_t k) { return static_cast<int>((k >> 24) & 0xffffff); }
+    static int key_x(uint64_t k) { return static_cast<int>(k & 0xffffff); }
+
+    int pages_at(int level) const { return std::max(1, _pages >> level); }
+
+    int& resident(uint64_t k) {
+        return _resident[key_level(k)][static_cast<size_t>(key_y(k)) * pages_at(key_level(k)) + key_x(k)];
+    }
+
+    void consume_feedback(size_t slot) {
+        const int w = _feedback_sizes[slot].first, h = _feedback_sizes[slot].second;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, _feedback_pbos[slot]);
+        auto *texels = static_cast<const uint16_t *>(
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(w) * h * 8, GL_MAP_READ_BIT));
+
+        // requested pages and their ancestors, so that zooming in refines step by step
+        std::unordered_set<uint64_t> requested;
+        if (texels) {
+            uint64_t last = UINT64_MAX;
+            for (size_t i = 0; i < static_cast<size_t>(w) * h; i++) {
+                const uint16_t *t = texels + i * 4;
+                if (!t[3] || t[2] >= _levels)
+                    continue;
+
+                uint64_t k = key(t[2], t[0], t[1]);
+                if (k == last)
+                    continue;
+                last = k;
+
+                for (int level = t[2], x = t[0], y = t[1]; level < _levels; level++, x /= 2, y /= 2) {
+                    if (x >= pages_at(level) || y >= pages_at(level) || !requested.insert(key(level, x, y)).second)
+                        break;
+                }
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // coarse pages first, they unblock the most pixels
+        std::vector<uint64_t> order(requested.begin(), requested.end());
+        std::sort(order.begin(), order.end(), [](uint64_t a, uint64_t b) { return a > b; });
+
+        for (uint64_t k : order) {
+            _stats.requests++;
+
+            int slot_index = resident(k);
+            if (slot_index >= 0) {
+                _stats.hits++;
+                if (slot_index > 0)
+                    _lru.splice(_lru.begin(), _lru, _slot_lru[slot_index]);
+                continue;
+            }
+
+            _stats.misses++;
+            if (_in_flight.count(k) || _in_flight.size() >= MAX_IN_FLIGHT)
+                continue;
+
+            _in_flight.insert(k);
+            _pool.submit([this, k] { decode(k); });
+        }
+    }
+
+    /// Runs on a worker
+    void decode(uint64_t k) {
+        auto start = std::chrono::steady_clock::now();
+
+        const int slot = _page_size + 2 * BORDER;
+        Decoded page{k, std::vector<unsigned char>(static_cast<size_t>(slot) * slot * 4)};
+        if (!_source->read(key_level(k), key_x(k) * _page_size - BORDER, key_y(k) * _page_size - BORDER,
+                           slot, page.texels.data()))
+            page.texels.clear();
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stats.decodes++;
+        _stats.decode_ms += ms;
+        _decoded.push_back(std::move(page));
+    }
+
+    void install(uint64_t k, const unsigned char *texels) {
+        if (resident(k) >= 0)
+            return;
+
+        int slot_index;
+        if (!_free_slots.empty()) {
+            slot_index = _free_slots.back();
+            _free_slots.pop_back();
+        } else {
+            slot_index = _lru.back();
+            _lru.pop_back();
+            resident(_slot_keys[slot_index]) = -1;
+            _stats.evictions++;
+        }
+
+        upload(slot_index, texels);
+        _slot_keys[slot_index] = k;
+        resident(k) = slot_index;
+        _lru.push_front(slot_index);
+        _slot_lru[slot_index] = _lru.begin();
+
+        _stats.uploads++;
+        _dirty = true;
+    }
+
+    void upload(int slot_index, const unsigned char *texels) {
+        const int slot = _page_size + 2 * BORDER;
+        glBindTexture(GL_TEXTURE_2D, _cache);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (slot_index % _cache_pages) * slot, (slot_index / _cache_pages) * slot,
+                        slot, slot, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    /// Rebuilds the page table from the coarsest level down, pages that are not
+    /// resident inherit the entry of their parent
+    void update_page_table() {
+        if (!_dirty)
+            return;
+
+        glBindTexture(GL_TEXTURE_2D, _table_texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        for (int level = _levels - 1; level >= 0; level--) {
+            const int n = pages_at(level);
+            for (int y = 0; y < n; y++) {
+                for (int x = 0; x < n; x++) {
+                    size_t i = static_cast<size_t>(y) * n + x;
+                    int slot_index = _resident[level][i];
+
+                    if (slot_index >= 0) {
+                        _page_table[level][i] = static_cast<uint32_t>(slot_index % _cache_pages)
+                                              | static_cast<uint32_t>(slot_index / _cache_pages) << 8
+                                              | static_cast<uint32_t>(level) << 16 | 0xff000000u;
+                    } else {
+                        const int parent_n = pages_at(level + 1);
+                        _page_table[level][i] = _page_table[level + 1][static_cast<size_t>(y / 2) * parent_n + x / 2];
+                    }
+                }
+            }
+
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, n, n, GL_RGBA, GL_UNSIGNED_BYTE, _page_table[level].data());
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        _dirty = false;
+    }
+
+private:
+    static constexpr size_t FEEDBACK_LATENCY = 3;
+    static constexpr size_t MAX_IN_FLIGHT = 64;
+
+    std::shared_ptr<TileSource> _source;
+    int _page_size;
+    int _cache_pages;
+    int _feedback_scale;
+    /// pages per side at level 0, a power of two
+    int _pages{1};
+    int _levels{1};
+
+    GLuint _cache{0};
+    GLuint _table_texture{0};
+    /// RGBA8 entries per level: slot x, slot y, resident level, 255
+    std::vector<std::vector<uint32_t>> _page_table;
+    /// slot of each page per level, -1 when not resident
+    std::vector<std::vector<int>> _resident;
+    bool _dirty{false};
+
+    std::vector<int> _free_slots;
+    std::vector<uint64_t> _slot_keys;
+    /// evictable slots, most recently requested first
+    std::list<int> _lru;
+    std::vector<std::list<int>::iterator> _slot_lru;
+
+    std::unique_ptr<RenderTarget> _feedback;
+    GLuint _feedback_pbos[FEEDBACK_LATENCY]{};
+    GLsync _feedback_fences[FEEDBACK_LATENCY]{};
+    std::pair<int, int> _feedback_sizes[FEEDBACK_LATENCY]{};
+    size_t _feedback_frame{0};
+    int _window_width{0};
+    int _window_height{0};
+
+    std::unordered_set<uint64_t> _in_flight;
+    std::mutex _mutex;
+    std::deque<Decoded> _decoded;
+    Stats _stats;
+
+    /// last member, so that workers are joined before the rest is torn down
+    ThreadPool _pool;
+};
+
+}
@@ -0,0 +1,74 @@
+// Checks which passes FrameGraph::compile() culls, from the printed schedule. Needs no
+// context, compile() makes no GL calls.
+//
+//   frame_graph_cull
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "frame_graph.hpp"
+
+using trif::FrameGraph;
+
+static const FrameGraph::Clear clear_all{GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT};
+
+static bool culled(const std::string& schedule, const std::string& pass)
+{
+    return schedule.find("  " + pass + " [culled]\n") != std::string::npos;
+}
+
+static int expect(const std::string& graph, const std::string& schedule, const std::string& pass, bool is_culled)
+{
+    if (culled(schedule, pass) == is_culled)
+        return 0;
+    std::cerr << graph << ": " << pass << (is_culled ? " should be culled" : " should not be culled")
+              << "\n" << schedule;
+    return 1;
+}
+
+/// Pass A clears X, pass B renders into X without clearing it first, which loads what A
+/// left. `consume` makes the present pass sample X.
+static std::string schedule(bool consume)
+{
+    trif::RenderTargetPool pool(320, 240);
+    FrameGraph graph(pool);
+    FrameGraph::Resource x = FrameGraph::None;
+    const FrameGraph::Resource backbuffer = graph.import_backbuffer();
+
+    graph.add_pass("A", [&](FrameGraph::Builder& builder) {
+        x = builder.create("X", trif::RenderTargetDesc());
+        builder.clear(x, clear_all);
+    });
+    graph.add_pass("B", [&](FrameGraph::Builder& builder) {
+        builder.write(x);
+    }, [](FrameGraph::Context&) {});
+    graph.add_pass("present", [&](FrameGraph::Builder& builder) {
+        if (consume)
+            builder.read(x);
+        builder.clear(backbuffer, clear_all);
+    }, [](FrameGraph::Context&) {});
+
+    std::ostringstream os;
+    graph.print_schedule(os);
+    return os.str();
+}
+
+int main()
+{
+    int failures = 0;
+
+    // nothing reads X, B's load of its own target must not keep it alive
+    const std::string dead = schedule(false);
+    failures += expect("unread X", dead, "A", true);
+    failures += expect("unread X", dead, "B", true);
+    failures += expect("unread X", dead, "present", false);
+
+    const std::string live = schedule(true);
+    failures += expect("sampled X", live, "A", false);
+    failures += expect("sampled X", live, "B", false);
+    failures += expect("sampled X", live, "present", false);
+
+    if (!failures)
+        std::cout << "Culled as expected" << std::endl;
+    return failures ? 1 : 0;
+}
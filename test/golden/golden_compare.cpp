@@ -0,0 +1,131 @@
+// Runs an example and compares the frame it wrote with a reference image, e.g.
+//
+//   golden_compare --reference glxgears.png --output out.png --
+//       glxgears --headless --fixed-step 0.02 -n 10 --screenshot out.png
+//
+// Exits with the code of the example if it fails, so that 77 (no display) makes CTest
+// skip the test. With --update the output replaces the reference instead. A failed
+// comparison writes the amplified difference next to the output.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "CLI11.hpp"
+#include "pixel.hpp"
+
+/// Exit code of the command, or 1 if it could not run or was killed
+static int run(const std::vector<std::string>& command)
+{
+    std::vector<char *> argv;
+    for (auto& arg : command)
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        execvp(argv[0], argv.data());
+        perror(argv[0]);
+        _exit(127);
+    }
+
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0)
+        return 1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+static bool copy_file(const std::string& from, const std::string& to)
+{
+    std::ifstream src(from, std::ios::binary);
+    std::ofstream dst(to, std::ios::binary);
+    dst << src.rdbuf();
+    return src.good() && dst.good();
+}
+
+int main(int argc, const char **argv)
+{
+    CLI::App app("golden_compare");
+
+    std::string reference, output;
+    std::vector<std::string> command;
+    unsigned tolerance = 2;
+    double max_outliers = 0.001;
+    double min_psnr = 40.0;
+    bool update = false;
+
+    app.add_option("--reference", reference, "Expected image")->required();
+    app.add_option("--output", output, "Image the command writes")->required();
+    app.add_option("--tolerance", tolerance, "Components may differ by this much (default 2)");
+    app.add_option("--max-outliers", max_outliers, "Fraction of the components allowed beyond the tolerance (default 0.001)");
+    app.add_option("--min-psnr", min_psnr, "Lowest PSNR accepted in dB (default 40)");
+    app.add_flag("--update", update, "Replace the reference by the output instead of comparing them");
+    app.add_option("command", command, "Command writing the output, after --")->required();
+
+    CLI11_PARSE(app, argc, argv);
+
+    std::remove(output.c_str());
+    int status = run(command);
+    if (status != 0) {
+        std::cerr << command[0] << " exited with " << status << std::endl;
+        return status;
+    }
+
+    if (update) {
+        if (!copy_file(output, reference)) {
+            std::cerr << "Failed to update " << reference << std::endl;
+            return 1;
+        }
+        std::cout << "Updated " << reference << std::endl;
+        return 0;
+    }
+
+    int width, height, ref_width, ref_height, channels;
+    stbi_uc *actual = stbi_load(output.c_str(), &width, &height, &channels, 4);
+    stbi_uc *expected = stbi_load(reference.c_str(), &ref_width, &ref_height, &channels, 4);
+    if (!actual || !expected) {
+        std::cerr << "Failed to load " << (actual ? reference : output)
+                  << (actual ? ", run with --update to create it" : "") << std::endl;
+        return 1;
+    }
+    if (width != ref_width || height != ref_height) {
+        std::cerr << output << " is " << width << "x" << height << ", " << reference << " is "
+                  << ref_width << "x" << ref_height << std::endl;
+        return 1;
+    }
+
+    const size_t n = static_cast<size_t>(width) * height;
+    trif::pixel::Difference diff = trif::pixel::compare(actual, expected, n, 4, tolerance);
+    const double outliers = static_cast<double>(diff.over_tolerance) / diff.count;
+    const bool pass = outliers <= max_outliers && diff.psnr() >= min_psnr;
+
+    std::cout << std::fixed << std::setprecision(2) << (pass ? "PASS " : "FAIL ") << output
+              << ": PSNR " << diff.psnr() << " dB, max error " << diff.max_error << ", "
+              << 100.0 * outliers << "% beyond " << tolerance << std::endl;
+
+    if (!pass) {
+        // differences scaled up to be visible
+        std::vector<unsigned char> image(n * 4);
+        for (size_t i = 0; i < n * 4; i++)
+            image[i] = (i % 4 == 3) ? 255 : static_cast<unsigned char>(std::min(255, 8 * std::abs(actual[i] - expected[i])));
+        const std::string path = output + ".diff.png";
+        stbi_write_png(path.c_str(), width, height, 4, image.data(), width * 4);
+        std::cout << "Difference written to " << path << std::endl;
+    }
+
+    stbi_image_free(actual);
+    stbi_image_free(expected);
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+// Checks MipBuilder::generate_compute() against the box filter of the CPU backend, e.g.
+//
+//   mip_compute 8192x512
+//
+// The base holds gradients, which show texels reduced from the wrong place of a large
+// level, and checkers, which show them in the small ones. Every texel of every level
+// has to match the CPU chain within a rounding tolerance. Bases larger than 4096 are
+// only reduced to level 6 by the dispatch and by glGenerateMipmap from there, so the
+// sizes are powers of two, which every driver's filter reduces the same way. Exits with
+// 77 if there is no display.
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "mipmap.hpp"
+
+/// The compute backend averages in float, the CPU one rounds every level
+static const int TOLERANCE = 2;
+
+static std::vector<unsigned char> make_base(int width, int height)
+{
+    std::vector<unsigned char> base(static_cast<size_t>(width) * height * 4);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            unsigned char *p = &base[(static_cast<size_t>(y) * width + x) * 4];
+            p[0] = static_cast<unsigned char>(static_cast<long>(x) * 255 / std::max(width - 1, 1));
+            p[1] = static_cast<unsigned char>(static_cast<long>(y) * 255 / std::max(height - 1, 1));
+            p[2] = ((x >> 6) ^ (y >> 6)) & 1 ? 255 : 0;
+            p[3] = ((x >> 2) ^ (y >> 2)) & 1 ? 255 : 32;
+        }
+    }
+    return base;
+}
+
+/// Number of texels of the bound texture's level which differ from `expected`
+static size_t check_level(int level, int width, int height, const unsigned char *expected)
+{
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+    size_t wrong = 0;
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        for (int c = 0; c < 4; c++) {
+            if (std::abs(pixels[i + c] - expected[i + c]) > TOLERANCE) {
+                wrong++;
+                break;
+            }
+        }
+    }
+    return wrong;
+}
+
+int main(int argc, const char **argv)
+{
+    int width = 8192, height = 512;
+    if (argc > 1 && sscanf(argv[1], "%dx%d", &width, &height) != 2) {
+        std::cerr << "usage: mip_compute [WIDTHxHEIGHT]" << std::endl;
+        return 1;
+    }
+
+    GLFWwindow *window = nullptr;
+    if (glfwInit()) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = glfwCreateWindow(64, 64, "mip_compute", NULL, NULL);
+    }
+    if (!window) {
+        std::cerr << "No display or no OpenGL 4.3, skipping" << std::endl;
+        glfwTerminate();
+        return 77;
+    }
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    glewInit();
+
+    const std::vector<unsigned char> base = make_base(width, height);
+
+    trif::MipBuilder builder;
+    const trif::MipChain chain = builder.build(base.data(), width, height, 4, trif::MipFilter::Box);
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, chain.levels(), GL_RGBA8, width, height);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, base.data());
+
+    builder.generate_compute(texture, width, height);
+
+    int status = 0;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    for (int level = 1; level < chain.levels(); level++) {
+        const int w = chain.level_width(level), h = chain.level_height(level);
+        size_t wrong = check_level(level, w, h, chain.level_data(level));
+        if (wrong) {
+            std::cerr << "Level " << level << " (" << w << "x" << h << "): " << wrong
+                      << " texels differ from the box filter" << std::endl;
+            status = 1;
+        }
+    }
+    if (!status)
+        std::cout << "All " << chain.levels() - 1 << " levels of " << width << "x" << height
+                  << " match the box filter" << std::endl;
+
+    glDeleteTextures(1, &texture);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return status;
+}